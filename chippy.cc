@@ -17,18 +17,50 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <string>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <cassert>
+#include <climits>
+#include <new>
 #include <math.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <stdint.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #define USEMCL2
 #ifdef USEMCL2
+// Define CHIPPY_LOCAL_MCL to use the in-process stand-in (see Local MCL)
+#ifndef CHIPPY_LOCAL_MCL
 #include "mcl_multiagent_api.h"
+#endif
 //#include "APICodes.h"
 #endif
 
+#ifdef _WIN32
+// Large file offsets, as the results files can be bigger than a long
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#define off_t  __int64
+#endif
+
 using namespace std;
 
 // --------------------------------------------------------------------
@@ -91,15 +123,67 @@ static int *CLOCKWISE[DIR_NUM] = {LOC_LL, LOC_UL, LOC_UR, LOC_LR};
 #define DRAW_LOGV   2
 #define DRAW_REWARD 3
 
+// --------------------------------------------------------------------
+//                                                   monitoring cadence
+// How often the MCL walkers tell MCL what they know: every step, every
+// K steps (K > 1), or only on events (rewards and new expectations)
+// with a heartbeat when there has been no event for MONITOR_HEARTBEAT
+// steps.  A step that is not monitored still decays epsilon, as a
+// monitor with no anomalies would, but the agent's settling and quiet
+// counts only move on monitored steps.
+// --------------------------------------------------------------------
+#define MONITOR_EVENTS    0
+#define MONITOR_EVERY     1
+#define MONITOR_HEARTBEAT 50
+
 // --------------------------------------------------------------------
 //                                                         command line
 // chippy2008 -h            display help
 //            -u            perform all unittests
 //            -t <name>     perform specified unittest
 //            -e            perform all experiments
+//               -r <num>   repeats per experiment
+//               -j <num>   threads (0 = one per core)
+//               -k <num>   lanes per QLearner batch (0 = no batches)
+//               --format <text|bin|bin32|both>  results files written
+//               --record   per-step trajectories to <basename>j<n>.traj
+//               --monitor <every|K|events>  MCL monitoring cadence
+//               --ci <width>  stop repeating a walker on a grid (up to -r)
+//                          when the 95% interval of its total reward is
+//                          narrower than width times the mean
+//               --ci-after <width>  the same for the mean reward after
+//                          the perturbation
+//               --min-repeats <num>  fewest repeats with --ci (default 5)
+//               --stats <ci|quantiles|all>  add the deviation and 95%
+//                          interval, and/or the 10th, 50th and 90th
+//                          percentiles, to the l.csv and t.csv files
+//               --shard <i/N>  run only the i'th (from 0) of N shards,
+//                          writing their sums to <basename>p<i>of<N>.bin
+//            --soak <steps> -g <name> -w <name>  run one walker for a
+//                          long time, recording to <basename>k.csv the
+//                          last, mean, smallest and largest average reward
+//                          of each bucket of steps, in constant memory
+//               --stride <num>   steps per bucket (default 1000)
+//               --perturb <num>  steps between perturbations (default 10000)
+//               --monitor  as for -e
+//            -m <file>...  merge shard files into the results files
+//               --format, --stats  as for -e
+//            --sweep -g <name> -w <name>  perform a parameter sweep
+//               --alpha, --gamma, --epsilon, --threshold, --size
+//                 <a,b,c|from:to:step>  values of each parameter
+//                 (thresholds and sizes whole, sizes at least 3)
+//               --rewards <r1/r2,...>  reward pairs (default: the grid's)
+//               -r, -j, -k, --ci and --seed as for -e
+//            --seed <num>  seed for the random numbers
 //            -g <name> -w <name>  perform specified experiment
-//               -v         verbose
+//               -v         verbose (traced to <basename>.trace)
 //               -p         output policy
+//            -b <name>     perform specified benchmark (or all)
+//            -c <file>     convert binary results (or trajectory) file to text
+//            -d <file>     print a trace file (written by -v) as text
+// Compiled with CHIPPY_BENCH defined this is chippy_bench instead, which
+// runs the microbenchmarks and writes them to chippy_bench.json (or the
+// file named on its command line).
 // --------------------------------------------------------------------
 #define CMD_NONE 0
 #define CMD_HELP 1
@@ -107,6 +191,12 @@ static int *CLOCKWISE[DIR_NUM] = {LOC_LL, LOC_UL, LOC_UR, LOC_LR};
 #define CMD_1_UNITTEST 3
 #define CMD_EXPERIMENTS 4
 #define CMD_1_EXPERIMENT 5
+#define CMD_BENCHMARKS 6
+#define CMD_CONVERT 7
+#define CMD_DECODE 8
+#define CMD_SWEEP 9
+#define CMD_MERGE 10
+#define CMD_SOAK 11
 
 // --------------------------------------------------------------------
 //                                                              walkers
@@ -141,26 +231,93 @@ const char *grid_initials[] = {
     "??", "CH", "CL", "CO", "RO", "PC", "PL", "PO", "PR"
 };
 
+// ====================================================================
+//                                                               Random
+// Counter-based random number generator.  The n-th number of a stream
+// is the SplitMix64 finalizer of key + n * golden ratio, so a stream is
+// just two integers: cheap to own, copy, save and restore.  Each walker
+// and grid has its own, so no lock is taken and runs can be repeated.
+// ====================================================================
+#define RANDOM_GOLDEN 0x9e3779b97f4a7c15ULL
+
+class Random
+{
+    unsigned long long key;
+    unsigned long long counter;
+    
+public:
+    Random(unsigned long long seed = 1, unsigned long long stream = 0)
+    {
+        set_seed(seed, stream);
+    }
+    
+    static unsigned long long mix(unsigned long long z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    
+    // Streams with the same seed but different numbers are independent
+    void set_seed(unsigned long long seed, unsigned long long stream = 0)
+    {
+        key = mix(mix(seed) + stream * RANDOM_GOLDEN);
+        counter = 0;
+    }
+    
+    unsigned long long get_key()     const { return key; }
+    unsigned long long get_counter() const { return counter; }
+    void set_state(unsigned long long k, unsigned long long c) {
+        key = k;
+        counter = c;
+    }
+    
+    unsigned long long next(void)
+    {
+        return mix(key + (++counter) * RANDOM_GOLDEN);
+    }
+    
+    // Uniform integer in [0, range) from the high 32 bits, no modulo
+    int below(int range)
+    {
+        return int(((next() >> 32) * (unsigned long long)range) >> 32);
+    }
+    
+    int randint(int low, int high)
+    {
+        return low + below(high - low + 1);
+    }
+};
+
+// ====================================================================
+//                                                       default_random
+// Generator for anything not given one of its own.  main() seeds it and
+// new walkers and grids take their seeds from it.
+// ====================================================================
+Random& default_random(void)
+{
+    static thread_local Random generator;
+    return generator;
+}
+
 // ====================================================================
 //                                                              randint
 // Return a random integer
 // ====================================================================
 int randint(int low, int high)
 {
-    int result = low + rand() % (high - low + 1);
-    //int result = low + random() % (high - low + 1);
-    //cout << "randint(" << low << "," << high << ")=" << result << endl;
-    return result;
+    return default_random().randint(low, high);
 }
 
 // ====================================================================
 //                                                         orient_value
 // Decode a location value based on size of grid
 // ====================================================================
-int orient_value(int value, int n)
+int orient_value(int value, int n, Random *r=NULL)
 {
     switch(value) {
         case LOC_RAN:
+            if (r) return r->randint(1, n-2);
             return randint(1, n-2);
         case LOC_MIN:
             return 0;
@@ -172,35 +329,797 @@ int orient_value(int value, int n)
     return value;
 }
 
+// ====================================================================
+//                                                        aligned_calloc
+// Zeroed memory starting on a cache line
+// ====================================================================
+#define CACHE_LINE 64
+
+void *aligned_calloc(size_t count, size_t size)
+{
+    void *p = NULL;
+    size_t bytes = count * size;
+    if (bytes == 0) bytes = CACHE_LINE;
+#ifdef _WIN32
+    p = _aligned_malloc(bytes, CACHE_LINE);
+#else
+    if (0 != posix_memalign(&p, CACHE_LINE, bytes)) p = NULL;
+#endif
+    if (p) memset(p, 0, bytes);
+    return p;
+}
+
+void aligned_free(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// ====================================================================
+//                                                          huge_calloc
+// Zeroed memory for big tables, on huge pages where the system has
+// them so that a large grid needs few TLB entries.  Small tables just
+// get a cache line aligned block.  Free with huge_free(), giving the
+// same size.
+// ====================================================================
+#define HUGE_PAGE (2*1024*1024)
+
+void *huge_calloc(size_t bytes)
+{
+#if defined(__linux__)
+    if (bytes >= HUGE_PAGE) {
+        size_t rounded = ((bytes + HUGE_PAGE - 1) / HUGE_PAGE) * HUGE_PAGE;
+        void *p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, 
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != p) return p;
+        p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == p) return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+        return p;
+    }
+#endif
+    return aligned_calloc(bytes, 1);
+}
+
+void huge_free(void *p, size_t bytes)
+{
+    if (NULL == p) return;
+#if defined(__linux__)
+    if (bytes >= HUGE_PAGE) {
+        munmap(p, ((bytes + HUGE_PAGE - 1) / HUGE_PAGE) * HUGE_PAGE);
+        return;
+    }
+#endif
+    aligned_free(p);
+}
+
+// ====================================================================
+//                                                             Snapshot
+// Binary checkpoint of walkers and grids.  The file starts with the
+// magic "CHIPPYS1" and a version, then each object writes a tag (its
+// class name) and its fields, base class first.  Loading checks every
+// tag, so a snapshot only goes back into the same kinds of objects.
+// The file is written under a temporary name and renamed when it is
+// complete, so a preempted save leaves the last checkpoint whole.
+// Created without a file name, the snapshot is kept in memory and can
+// be read back (as many times as wanted) after reread().
+// ====================================================================
+#define SNAPSHOT_MAGIC   "CHIPPYS1"
+#define SNAPSHOT_VERSION 2
+
+class Snapshot
+{
+    FILE *file;
+    bool  writing;
+    bool  good;
+    char  filename[256];
+    char  tempname[260];
+    char  *memory;
+    size_t used;
+    size_t room;
+    size_t at;
+    
+    Snapshot(const Snapshot&);
+    Snapshot& operator=(const Snapshot&);
+    
+public:
+    Snapshot() 
+    { 
+        file = NULL; 
+        writing = false; 
+        good = false; 
+        filename[0] = '\0';
+        tempname[0] = '\0';
+        memory = NULL;
+        used = 0;
+        room = 0;
+        at = 0;
+    }
+    
+    ~Snapshot() 
+    { 
+        close(); 
+        free(memory);
+    }
+    
+    bool create(const char *name=NULL)
+    {
+        // 1. Open the temporary file (or start over in memory)
+        close();
+        writing = true;
+        used = 0;
+        if (NULL == name) {
+            good = true;
+        } else {
+            snprintf(filename, sizeof(filename), "%s", name);
+            snprintf(tempname, sizeof(tempname), "%s.tmp", filename);
+            file = fopen(tempname, "wb");
+            good = (NULL != file);
+        }
+        
+        // 2. Write the header
+        put(SNAPSHOT_MAGIC, 8);
+        put_int(SNAPSHOT_VERSION);
+        return good;
+    }
+    
+    bool open(const char *name)
+    {
+        char magic[8];
+        
+        // 1. Open the file
+        close();
+        file = fopen(name, "rb");
+        writing = false;
+        good = (NULL != file);
+        
+        // 2. Check the header
+        get(magic, 8);
+        if (good && (0 != memcmp(magic, SNAPSHOT_MAGIC, 8))) good = false;
+        if (good && (SNAPSHOT_VERSION != get_int())) good = false;
+        return good;
+    }
+    
+    // Read back a snapshot made in memory from the beginning
+    bool reread(void)
+    {
+        char magic[8];
+        
+        // 1. Start at the beginning
+        if (NULL != file) return false;
+        writing = false;
+        at = 0;
+        good = (used > 0);
+        
+        // 2. Check the header
+        get(magic, 8);
+        if (good && (0 != memcmp(magic, SNAPSHOT_MAGIC, 8))) good = false;
+        if (good && (SNAPSHOT_VERSION != get_int())) good = false;
+        return good;
+    }
+    
+    // Returns true if everything was written (or read) 
+    bool close(void)
+    {
+        bool ok = good;
+        good = false;
+        if (NULL == file) return ok;
+        if (writing) {
+            if (0 != fclose(file)) ok = false;
+            if (ok) {
+#ifdef _WIN32
+                remove(filename);
+#endif
+                if (0 != rename(tempname, filename)) ok = false;
+            }
+            if (!ok) remove(tempname);
+        } else {
+            fclose(file);
+        }
+        file = NULL;
+        good = false;
+        return ok;
+    }
+    
+    bool ok(void) const { return good; }
+    
+    void put(const void *p, size_t size) 
+    { 
+        // 1. Write to the file
+        if (!good || (0 == size)) return;
+        if (NULL != file) {
+            if (1 != fwrite(p, size, 1, file)) good = false;
+            return;
+        }
+        
+        // 2. Or add to the memory, making more room when needed
+        if (used + size > room) {
+            size_t more = 2*room + size + 256;
+            char *bigger = (char *)realloc(memory, more);
+            if (NULL == bigger) { good = false; return; }
+            memory = bigger;
+            room = more;
+        }
+        memcpy(memory + used, p, size);
+        used += size;
+    }
+    void get(void *p, size_t size) 
+    { 
+        if (0 == size) return;
+        if (good && (NULL != file)) {
+            if (1 != fread(p, size, 1, file)) good = false;
+        } else if (good) {
+            if (at + size > used) good = false;
+            else memcpy(p, memory + at, size);
+            at += size;
+        }
+        if (!good) memset(p, 0, size);
+    }
+    
+    size_t get_size(void) const { return used; }
+    
+    void put_int(int value) { int32_t v = value; put(&v, sizeof(v)); }
+    int get_int(void) { int32_t v; get(&v, sizeof(v)); return v; }
+    void put_int64(int64_t value) { put(&value, sizeof(value)); }
+    int64_t get_int64(void) { int64_t v; get(&v, sizeof(v)); return v; }
+    void put_double(double value) { put(&value, sizeof(value)); }
+    double get_double(void) { double v; get(&v, sizeof(v)); return v; }
+    
+    void put_random(const Random &r)
+    {
+        uint64_t state[2] = {r.get_key(), r.get_counter()};
+        put(state, sizeof(state));
+    }
+    void get_random(Random &r)
+    {
+        uint64_t state[2];
+        get(state, sizeof(state));
+        if (good) r.set_state(state[0], state[1]);
+    }
+    
+    // Every object starts with its class name, which must match to load
+    void put_tag(const char *tag)
+    {
+        int length = strlen(tag);
+        put_int(length);
+        put(tag, length);
+    }
+    bool get_tag(const char *tag)
+    {
+        char found[64];
+        int length = get_int();
+        if (good && ((length != (int)strlen(tag)) || 
+                     (length >= (int)sizeof(found)))) good = false;
+        if (good) get(found, length);
+        if (good && (0 != memcmp(found, tag, length))) good = false;
+        return good;
+    }
+};
+
+// ====================================================================
+//                                                               Tracer
+// Structured event trace that replaces the verbose cout chains of the
+// MCL walkers.  TRACE(on, type, step, fields...) records a fixed size
+// event (step, type, thread and up to TRACE_FIELDS numbers) in a ring
+// buffer owned by the calling thread; a flusher thread drains the
+// rings to the trace file.  Nothing is formatted while the walker
+// runs: trace_decode() turns the file back into the text the verbose
+// walkers used to print.  Compiled with CHIPPY_NO_TRACE the TRACE
+// calls (and the evaluation of their arguments) disappear entirely.
+// ====================================================================
+#define TRACE_MAGIC    "CHIPPYT1"
+#define TRACE_VERSION  1
+#define TRACE_FIELDS   5
+#define TRACE_RING     4096   // events per thread, a power of two
+#define TRACE_THREADS  256
+#define TRACE_FLUSH_MS 10
+
+// Event types, indexes into trace_formats[]
+#define TRACE_DROPPED              0
+#define TRACE_REWARD               1
+#define TRACE_REWARD_LINE          2
+#define TRACE_NO_EXPECTATION       3
+#define TRACE_EXPECTATION          4
+#define TRACE_EXPECT_ADD           5
+#define TRACE_EXPECT_NAMED         6
+#define TRACE_EXPECTED             7
+#define TRACE_VIOLATION            8
+#define TRACE_THRESHOLD            9
+#define TRACE_RESET_SIMPLE        10
+#define TRACE_RESET_SENSITIVE     11
+#define TRACE_RESET_SOPHISTICATED 12
+#define TRACE_RESET_BAYES1        13
+#define TRACE_RESET_BAYES2        14
+#define TRACE_POLICY              15
+#define TRACE_PERTURB_TTR         16
+#define TRACE_PERTURB_PRF         17
+#define TRACE_PERTURB_EXP         18
+#define TRACE_COMPARE             19
+#define TRACE_ASSESS              20
+#define TRACE_ASSESS_VIOLATION    21
+#define TRACE_NOTE                22
+#define TRACE_ASSESS_NEG          23
+#define TRACE_DEGREE_NEG          24
+#define TRACE_EXCITATION          25
+#define TRACE_DEGREE_POS          26
+#define TRACE_DEGREE              27
+#define TRACE_MCL_RESPONSE        28
+#define TRACE_MCL_UNKNOWN         29
+#define TRACE_MCL_ERROR           30
+#define TRACE_MCL_OK              31
+#define TRACE_MCL_NOOP            32
+#define TRACE_MCL_CORRECTIVE      33
+#define TRACE_SUGGEST_IGNORE      34
+#define TRACE_SUGGEST_NOOP        35
+#define TRACE_SUGGEST_TRY_AGAIN   36
+#define TRACE_SUGGEST_REBUILD     37
+#define TRACE_SUGGEST_LEARNING    38
+#define TRACE_SUGGEST_REVISE      39
+#define TRACE_BAYES2_EXPECT       40
+#define TRACE_BAYES2_PERF         41
+#define TRACE_TYPES               42
+
+// The text of each event: %s is the step, %i and %g the next field as
+// an integer or as cout would print a double, %m the next field as an
+// MCL response class and %a as its Action/Abort flags
+static const char *trace_formats[TRACE_TYPES] = {
+    "[%i trace events dropped]\n",
+    "step %s: reward = %i at (%i,%i) ",
+    "step %s: reward = %i at (%i,%i) \n",
+    "step %s: No expectation\n",
+    "step %s: Expectation of %i\n",
+    "step %s: Adding expectation of reward %i at (%i,%i)\n",
+    "step %s: Added expectation of reward %i at (%i,%i)"
+        " named expect%i number %i\n",
+    "step %s: Got expected reward of %i at (%i,%i) Resetting violations\n",
+    "step %s: Got reward of %i at (%i,%i) instead of %i\n"
+        "Incremented violations to %i\n",
+    "Resetting, violations (%i) >= threshold of %i\n",
+    "step %s: MCLSimple::reset()\n",
+    "MCLSensitive::Reset()\n",
+    "MCLSophisticated::Reset()\n",
+    "step %s: MCLBayes1::reset()\n",
+    "step %s: MCLBayes2::reset()\n",
+    "step %s: increment_policy() to policy %i\n",
+    "Perturbation 1: actionNumber = %i, lastRewardTurn = %i,"
+        " rewardDistance = %g\n",
+    "Perturbation 2: actionNumber = %i, performance = %g,"
+        " highPerformance = %g\n",
+    "Perturbation 3: actionNumber = %i, expectedState = %i, inState = %i,"
+        " expectedReward = %i, inReward = %i\n",
+    "Compare(%i, %i, %i) = %i\n",
+    "Assess(%i, %i)\n  averageReward = %g, expectedReward = %i\n",
+    "Assess: violation (%i) > threshold of %i, increment_policy and reset\n",
+    "Note: lastPerturbation = %i, degreePerturbation = %g,"
+        " mvarMCL_excitation = %i\n",
+    "Assess(%i, %i)\n  neg/avg/exp/Reward = %i/%g/%i\n",
+    "Assess: negReward - degreePerturbation > 7, increment_policy and reset\n",
+    "excitation (%i) > threshold (%i), reset\n",
+    "Assess: !negReward - degreePerturbation > 7, increment_policy and reset\n",
+    "Assess: degreePerturbation = %g, MCL_excitation = %i\n",
+    "step %s: %m%a\nstep %s: ",
+    "Unknown MCL monitor response\n",
+    "mclInternalErrorResponse\n",
+    "mclMonitorOKResponse\n",
+    "mclMonitorNOOPResponse\n",
+    "mclMonitorCorrectiveResponse\n",
+    "Suggestion: Ignore\n",
+    "Suggestion: No Op\n",
+    "Suggestion: Try Again\n",
+    "Suggestion: Rebuild Models\n",
+    "Suggestion: Activate Learning\n",
+    "Suggestion: Revise Expectations\n",
+    "Step %s setting expectations  valperf > %g kntperf < %g"
+        " lastrwd < %g\n",
+    "step %s: val_perf = %g, knt_perf = %g, last_reward = %i\n",
+};
+
+// MCL response classes (the last is anything else)
+#define TRACE_MCL_CLASSES 5
+static const char *trace_mcl_classes[TRACE_MCL_CLASSES] = {
+    "internalError", "noAnomalies", "noOperation", "suggestion", "unknown"
+};
+#define TRACE_ACTION 1
+#define TRACE_ABORT  2
+
+struct TraceEvent
+{
+    uint32_t step;
+    uint16_t type;
+    uint16_t thread;
+    double   field[TRACE_FIELDS];
+};
+
+// Single producer (the owning thread), single consumer (the flusher)
+struct TraceRing
+{
+    TraceEvent events[TRACE_RING];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+    int thread;
+};
+
+class Tracer
+{
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread flusher;
+    TraceRing *rings[TRACE_THREADS];
+    std::atomic<int> knt_rings;
+    std::atomic<int> generation;
+    std::atomic<bool> on;
+    bool lossless;
+    bool stopping;
+    FILE *file;
+    long written;
+    
+    // Write whatever the rings hold (called with the lock held)
+    void drain(void)
+    {
+        for (int r = 0; r < knt_rings; ++r) {
+            TraceRing *ring = rings[r];
+            uint32_t t = ring->tail.load(std::memory_order_relaxed);
+            uint32_t h = ring->head.load(std::memory_order_acquire);
+            while (t != h) {
+                uint32_t at = t & (TRACE_RING-1);
+                uint32_t n = h - t;
+                if (n > TRACE_RING - at) n = TRACE_RING - at;
+                fwrite(&ring->events[at], sizeof(TraceEvent), n, file);
+                written += n;
+                t += n;
+            }
+            ring->tail.store(t, std::memory_order_release);
+        }
+    }
+    
+    void flush(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stopping) {
+            wake.wait_for(guard, std::chrono::milliseconds(TRACE_FLUSH_MS));
+            drain();
+        }
+    }
+    
+    // The calling thread's ring, registered on its first event
+    TraceRing* ring(void)
+    {
+        static thread_local TraceRing *mine = NULL;
+        static thread_local int mine_generation = -1;
+        if (mine_generation != generation) {
+            std::lock_guard<std::mutex> guard(lock);
+            mine = NULL;
+            mine_generation = generation;
+            if (knt_rings < TRACE_THREADS) {
+                mine = new TraceRing;
+                mine->head = 0;
+                mine->tail = 0;
+                mine->dropped = 0;
+                mine->thread = knt_rings;
+                rings[knt_rings] = mine;
+                ++knt_rings;
+            }
+        }
+        return mine;
+    }
+
+public:
+    Tracer() 
+    {
+        knt_rings = 0;
+        generation = 0;
+        on = false;
+        lossless = false;
+        stopping = false;
+        file = NULL;
+        written = 0;
+    }
+    ~Tracer() { close(); }
+    
+    bool is_on(void) const { return on; }
+    
+    // Start tracing to a file.  Lossless tracing makes a thread wait
+    // for the flusher when its ring is full instead of dropping events.
+    bool open(const char *filename, bool no_drops=false)
+    {
+        TraceEvent header;
+        close();
+        file = fopen(filename, "wb");
+        if (NULL == file) return false;
+        memset(&header, 0, sizeof(header));
+        memcpy(&header, TRACE_MAGIC, 8);
+        header.field[0] = TRACE_VERSION;
+        header.field[1] = TRACE_FIELDS;
+        fwrite(&header, sizeof(header), 1, file);
+        lossless = no_drops;
+        stopping = false;
+        written = 0;
+        ++generation;
+        flusher = std::thread(&Tracer::flush, this);
+        on = true;
+        return true;
+    }
+    
+    // Stop tracing, write what is left and close the file.  The threads
+    // that traced must be finished with their events.  Returns the
+    // number of events written.
+    long close(void)
+    {
+        uint32_t dropped = 0;
+        if (NULL == file) return 0;
+        on = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+        drain();
+        for (int r = 0; r < knt_rings; ++r) {
+            dropped += rings[r]->dropped;
+            delete rings[r];
+        }
+        knt_rings = 0;
+        ++generation;
+        if (dropped > 0) {
+            TraceEvent event;
+            memset(&event, 0, sizeof(event));
+            event.type = TRACE_DROPPED;
+            event.field[0] = dropped;
+            fwrite(&event, sizeof(event), 1, file);
+        }
+        fclose(file);
+        file = NULL;
+        return written;
+    }
+    
+    void record(int type, long step, const double *field)
+    {
+        if (!on) return;
+        TraceRing *r = ring();
+        if (NULL == r) return;
+        uint32_t h = r->head.load(std::memory_order_relaxed);
+        while ((h - r->tail.load(std::memory_order_acquire)) >= TRACE_RING) {
+            if (!lossless) {
+                ++r->dropped;
+                return;
+            }
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+        TraceEvent &e = r->events[h & (TRACE_RING-1)];
+        e.step = (uint32_t) step;
+        e.type = (uint16_t) type;
+        e.thread = (uint16_t) r->thread;
+        memcpy(e.field, field, sizeof(e.field));
+        r->head.store(h+1, std::memory_order_release);
+    }
+};
+
+static Tracer& tracer(void)
+{
+    static Tracer the_tracer;
+    return the_tracer;
+}
+
+template<typename... F>
+inline void trace_event(int type, long step, F... fields)
+{
+    static_assert(sizeof...(F) <= TRACE_FIELDS, "too many trace fields");
+    double field[TRACE_FIELDS] = {double(fields)...};
+    tracer().record(type, step, field);
+}
+
+#ifdef CHIPPY_NO_TRACE
+#define TRACE(on, ...) do { } while (0)
+#else
+#define TRACE(on, ...) \
+    do { if (on) trace_event(__VA_ARGS__); } while (0)
+
+// The trace_mcl_classes index of an MCL response's class
+static int trace_mcl_class(const string &rclass)
+{
+    int c = 0;
+    while ((c < TRACE_MCL_CLASSES-1) && (rclass != trace_mcl_classes[c])) ++c;
+    return c;
+}
+#endif
+
+// --------------------------------------------------------------------
+//                                                         trace_decode
+// Print the events of a trace file as text, returning the number of
+// events (or -1 if the file is not a trace)
+// --------------------------------------------------------------------
+void trace_text(const TraceEvent &event, ostream &out)
+{
+    int f = 0;
+    if (event.type >= TRACE_TYPES) {
+        out << "[unknown trace event " << event.type << "]" << endl;
+        return;
+    }
+    for (const char *c = trace_formats[event.type]; *c; ++c) {
+        if (('%' != *c) || ('\0' == c[1])) {
+            out << *c;
+            continue;
+        }
+        double v = (f < TRACE_FIELDS) ? event.field[f] : 0.0;
+        switch (*++c) {
+            case 's': out << event.step; break;
+            case 'i': out << (long long) v; ++f; break;
+            case 'g': out << v; ++f; break;
+            case 'm': 
+                out << trace_mcl_classes[((int) v) % TRACE_MCL_CLASSES];
+                ++f;
+                break;
+            case 'a':
+                if (((int) v) & TRACE_ACTION) out << " Action";
+                if (((int) v) & TRACE_ABORT) out << " Abort";
+                ++f;
+                break;
+            default: out << '%' << *c;
+        }
+    }
+}
+
+long trace_decode(const char *filename, ostream &out)
+{
+    TraceEvent event;
+    long knt = 0;
+    FILE *file = fopen(filename, "rb");
+    if (NULL == file) return -1;
+    if ((1 != fread(&event, sizeof(event), 1, file)) ||
+        (0 != memcmp(&event, TRACE_MAGIC, 8)) ||
+        (TRACE_FIELDS != event.field[1])) {
+        fclose(file);
+        return -1;
+    }
+    while (1 == fread(&event, sizeof(event), 1, file)) {
+        trace_text(event, out);
+        ++knt;
+    }
+    out.flush();
+    fclose(file);
+    return knt;
+}
+
+// ====================================================================
+//                                                          argmax_mask
+// The largest of the DIR_NUM Q values of a square and a bit mask of
+// the directions that have it.  With four directions this is one
+// (AVX) or two (SSE2) vector compares and a movemask.
+// ====================================================================
+#if defined(__GNUC__)
+#define POPCOUNT(m) __builtin_popcount(m)
+#define LOWBIT(m)   __builtin_ctz(m)
+#else
+static inline int POPCOUNT(unsigned m) {int k=0; for (; m; m &= m-1) ++k; return k;}
+static inline int LOWBIT(unsigned m) {int k=0; for (; !(m&1); m >>= 1) ++k; return k;}
+#endif
+
+static inline unsigned argmax_mask_scalar(const double *q, double *best)
+{
+    double value = q[0];
+    unsigned mask = 1;
+    for (int dir = 1; dir < DIR_NUM; ++dir)
+    {
+        if (q[dir] > value) { value = q[dir]; mask = 0; }
+        if (q[dir] == value) mask |= 1u << dir;
+    }
+    *best = value;
+    return mask;
+}
+
+static inline unsigned argmax_mask(const double *q, double *best)
+{
+#if (DIR_NUM == 4) && defined(__AVX__)
+    __m256d v = _mm256_loadu_pd(q);
+    __m256d m = _mm256_max_pd(v, _mm256_permute2f128_pd(v, v, 1));
+    m = _mm256_max_pd(m, _mm256_permute_pd(m, 5));
+    *best = _mm256_cvtsd_f64(m);
+    return _mm256_movemask_pd(_mm256_cmp_pd(v, m, _CMP_EQ_OQ));
+#elif (DIR_NUM == 4) && (defined(__SSE2__) || defined(_M_X64))
+    __m128d a = _mm_loadu_pd(q);
+    __m128d b = _mm_loadu_pd(q + 2);
+    __m128d m = _mm_max_pd(a, b);
+    m = _mm_max_pd(m, _mm_shuffle_pd(m, m, 1));
+    *best = _mm_cvtsd_f64(m);
+    return _mm_movemask_pd(_mm_cmpeq_pd(a, m)) 
+         | (_mm_movemask_pd(_mm_cmpeq_pd(b, m)) << 2);
+#else
+    return argmax_mask_scalar(q, best);
+#endif
+}
+
+// --------------------------------------------------------------------
+//                                                          pick_of_mask
+// One of the directions in the mask, each equally likely.  The random
+// number generator is only used when there is a tie.
+// --------------------------------------------------------------------
+static inline int pick_of_mask(unsigned mask, Random *r)
+{
+    int num = POPCOUNT(mask);
+    if (num > 1) 
+        for (int k = r->below(num); k > 0; --k) mask &= mask - 1;
+    return LOWBIT(mask);
+}
+
+// ====================================================================
+//                                                          SquareStore
+// Where the values of one or more squares are kept.  The Q values are
+// DIR_NUM doubles per square, everything else is only for pictures.
+// ====================================================================
+struct SquareStore
+{
+    double *q;
+    char   *letter;
+    double *value;
+    int    *visits;
+    bool   *underline;
+    double *reward;
+};
+
 // ====================================================================
 //                                                               Square
-// A single square of a grid world.
+// A single square of a grid world.  A square normally keeps its own
+// values, but it can also be a view of one slot of a grid's store.
 // ====================================================================
 class Square
 {
     int    x;
     int    y;
-    double q[DIR_NUM];
+    double *q;
+    int    index;
+    SquareStore *store;
+    
+    // Values of a square that is not part of a contiguous grid
+    SquareStore own;
+    double  own_q[DIR_NUM];
+    char    own_letter;
+    double  own_value;
+    int     own_visits;
+    bool    own_underline;
+    double  own_reward;
     
-    char    letter;
-    double  value;
-    int     visits;
-    bool    underline;
-    double  reward;
+    // The store points into the square itself, so no copies
+    Square(const Square&);
+    Square& operator=(const Square&);
     
 public:    
-    Square(int xx = 0, int yy = 0)
+    Square(int xx = 0, int yy = 0, SquareStore *s = NULL, int i = 0)
     {
             x    = xx;
             y    = yy;
 
-            letter = '\0';
-            visits = 0;
-            value  = 0.0;
-            underline = false;
-            reward = 0.0;
+            // 1. Set up our own values
+            own.q         = own_q;
+            own.letter    = &own_letter;
+            own.value     = &own_value;
+            own.visits    = &own_visits;
+            own.underline = &own_underline;
+            own.reward    = &own_reward;
+            own_letter = '\0';
+            own_visits = 0;
+            own_value  = 0.0;
+            own_underline = false;
+            own_reward = 0.0;
             
-            reset();
+            // 2. But use the grid's store if one was given
+            if (NULL == s) {
+                store = &own;
+                index = 0;
+            } else {
+                store = s;
+                index = i;
+            }
+            q = store->q ? store->q + index*DIR_NUM : own_q;
+            if (own_q == q) reset();
     }    
     
     int    get_x()      const { return x; }
@@ -208,85 +1127,52 @@ public:
 
     double get_q(int index) const { return q[index]; }
     void set_q(int index, double value) {q[index] = value; }
-
-    void set_letter(char l='\0') { letter = l; }
-    void set_value(double v=0.0) { value = v; }
-    void set_underline(bool u=true) { underline = u; }
-    void set_visits(int v=0) {visits = v; }
-    void set_reward(double r=0.0) {reward = r; }
-    void visit() {++visits; }
+    double *get_qs()    const { return q; }
+
+    void set_letter(char l='\0') { store->letter[index] = l; }
+    void set_value(double v=0.0) { store->value[index] = v; }
+    void set_underline(bool u=true) { store->underline[index] = u; }
+    void set_visits(int v=0) { store->visits[index] = v; }
+    void set_reward(double r=0.0) { store->reward[index] = r; }
+    void visit() { ++store->visits[index]; }
+    int  get_visits() const { return store->visits[index]; }
+    char get_letter() const { return store->letter[index]; }
     
     void reset() {for (int i = 0; i < DIR_NUM; ++i) q[i] = 0.0; }
     
-    int suggest()
+    int suggest(Random *r=NULL)
+    {
+        return best_of(q, r);
+    }
+    
+    double max()
+    {   
+        return max_of(q);
+    }    
+
+    double min()
+    {   
+        return min_of(q);
+    }    
+    
+    static int best_of(const double *q, Random *r=NULL)
     {
         // "Suggest the highest ranked move"
-        int picked[DIR_NUM] = {0};
-        int dir, d; 
-        
-        //  1. Start by picking a random direction
-        int pick = randint(0, DIR_NUM-1);
-        picked[pick] = 1;
-        double value  = q[pick];
-        
-        // 2. Loop for the other directions
-        for (dir = 0; dir < DIR_NUM; ++dir)
-        {
-            if (dir == pick) continue;
-            
-            // 3. If this direction is better, save it
-            if (q[dir] > value)
-			{
-				for (d = 0; d < DIR_NUM; ++d) picked[d] = 0;
-                value = q[dir];
-                picked[dir] = 1;
-				pick = dir;
-			}
-            
-            // 4. If the same, keep both (or more)    
-            else if (q[dir] == value)
-            {
-                picked[dir] = 1;
-				pick = dir;
-			}
-        }
-        
-        // 5. Count the number of "best" directions
-		int num = 0;
-		for (dir = 0; dir < DIR_NUM; ++dir)
-			if (picked[dir] == 1) ++num;
-        
-        // 6. Pick just one if there are multiple
-        if (num > 1) 
-        {
-		    num = rand() % num;
-		    for (dir = 0; dir < DIR_NUM; ++dir)
-            { 
-			    if (picked[dir] == 1)
-				{
-					--num;
-					if (num < 0) 
-                    {
-                        pick = dir;
-                        break;
-                    }
-				}
-            }
-        } 
+        double value;
+        if (NULL == r) r = &default_random();
         
-		// 7. Return one of the "best" directions
-        return pick;
+        // 1. Find the "best" directions, 2. and pick one of them
+        return pick_of_mask(argmax_mask(q, &value), r);
     }
     
-    double max()
+    static double max_of(const double *q)
     {   
-        double value  = q[0];
-        for (int dir = 1; dir < DIR_NUM; ++dir)
-            if (q[dir] > value) value = q[dir];
+        double value;
+        argmax_mask(q, &value);
         return value;
     }    
 
-    double min()
+    static double min_of(const double *q)
     {   
         double value  = q[0];
         for (int dir = 1; dir < DIR_NUM; ++dir)
@@ -299,6 +1185,11 @@ public:
             // 1. Get values and direction for squeare
             double smax = max();
             double smin = min();
+            char   letter    = store->letter[index];
+            double value     = store->value[index];
+            int    visits    = store->visits[index];
+            bool   underline = store->underline[index];
+            double reward    = store->reward[index];
             int    dir;
             
             // 2. Output as a comment all four values
@@ -403,14 +1294,14 @@ public:
     int    get_ox()     const { return o_x; }
     int    get_oy()     const { return o_y; }
     
-    void orient(int nn=0) {
+    void orient(int nn=0, Random *r=NULL) {
         n = nn;
-        o_x = orient_value(x, n);
-        o_y = orient_value(y, n);
+        o_x = orient_value(x, n, r);
+        o_y = orient_value(y, n, r);
     }
         
-    int    get_jumpx() const { return orient_value(nx, n); }
-    int    get_jumpy() const { return orient_value(ny, n); }
+    int    get_jumpx(Random *r=NULL) const { return orient_value(nx, n, r); }
+    int    get_jumpy(Random *r=NULL) const { return orient_value(ny, n, r); }
 
     void   set_x(int xx)  { x = xx; }
     void   set_y(int yy)  { y = yy; }
@@ -419,27 +1310,125 @@ public:
 // ====================================================================
 //                                                                 Grid
 // Multiple squares arranged in an n by n matrix with two rewards
+//
+// STORE_SQUARES keeps every square in its own allocation.
+// STORE_CONTIGUOUS keeps all the Q values in one aligned array, square
+// after square, with the picture values in separate arrays.  Squares
+// are then only views, made when someone asks for one.
+//
+// STORE_FLOAT and STORE_INT16 are for large grids.  They keep the Q
+// values as float32, or as int16 fixed point with a scale for the grid,
+// in one block on huge pages.  The squares and the picture values are
+// only made if someone asks for a square (to draw the policy), and the
+// squares then hold copies of the Q values as they were when asked for.
+// q_in() gives the Q values as doubles in one of two buffers that take
+// turns, so they are only good until the next but one call, and they
+// are changed with set_q_in().
+//
+// Each square also has a goal slot: 0 when there is no goal there, or
+// one more than the goal's place in the goal list.  set_goals() fills
+// the slots, so anything that moves the goals must call it again.
 // ====================================================================
+#define STORE_SQUARES    0
+#define STORE_CONTIGUOUS 1
+#define STORE_FLOAT      2
+#define STORE_INT16      3
+
+// The int16 values cover Q16_HEADROOM times the largest reward
+#define Q16_HEADROOM 16.0
+#define Q16_MAX      32767
+
 class Grid
 {
     int      n;
+    int      store;
     Square **squares;
+    SquareStore values;
+    double  *qtable;
+    float   *qfloat;
+    int16_t *qshort;
+    double   qscale;
+    mutable double qdecode[2][DIR_NUM];
+    mutable int    qflip;
     Goal   **goals;
+    int     *goal_slot;
+    Random   random;
     
-public:
-    Grid(int nn=8, Goal **g=NULL)
+    size_t compact_bytes() const
+    {
+        size_t size = (STORE_FLOAT == store) ? sizeof(float) : sizeof(int16_t);
+        return (size_t)n*n*DIR_NUM*size;
+    }
+    
+    // A compact store too big to have fails as new does, without leaking
+    // what the constructor has already allocated
+    void no_store()
+    {
+        free(goal_slot);
+        throw std::bad_alloc();
+    }
+    
+    // Compact grids only make their squares and picture values when a
+    // square is asked for
+    void make_pictures()
+    {
+        squares = (Square **)calloc(n*n, sizeof(Square *));
+        values.letter    = (char *)calloc(n*n, sizeof(char));
+        values.value     = (double *)calloc(n*n, sizeof(double));
+        values.visits    = (int *)calloc(n*n, sizeof(int));
+        values.underline = (bool *)calloc(n*n, sizeof(bool));
+        values.reward    = (double *)calloc(n*n, sizeof(double));
+    }
+    
+public:
+    Grid(int nn=8, Goal **g=NULL, int st=STORE_CONTIGUOUS)
     {
         // 1. Create the grid of squares
         n = nn;
-        squares = (Square **)malloc(sizeof(Square *)*n*n);
+        store = st;
+        random.set_seed(default_random().next());
+        squares = NULL;
+        memset(&values, 0, sizeof(values));
+        qtable = NULL;
+        qfloat = NULL;
+        qshort = NULL;
+        qscale = 1.0;
+        qflip = 0;
+        goal_slot = (int *)calloc(n*n, sizeof(int));
+        if ((STORE_FLOAT != store) && (STORE_INT16 != store))
+            squares = (Square **)calloc(n*n, sizeof(Square *));
             
-        // 2. Create all the individual squares
-        for (int x = 0; x < n; ++x)
+        // 2. Create all the individual squares or the shared store
+        if (STORE_FLOAT == store)
+        {
+            qfloat = (float *)huge_calloc(compact_bytes());
+            if (NULL == qfloat) no_store();
+        }
+        else if (STORE_INT16 == store)
+        {
+            qshort = (int16_t *)huge_calloc(compact_bytes());
+            if (NULL == qshort) no_store();
+        }
+        else if (STORE_CONTIGUOUS == store)
+        {
+            values.q         = (double *)aligned_calloc(n*n*DIR_NUM, 
+                                                        sizeof(double));
+            values.letter    = (char *)calloc(n*n, sizeof(char));
+            values.value     = (double *)calloc(n*n, sizeof(double));
+            values.visits    = (int *)calloc(n*n, sizeof(int));
+            values.underline = (bool *)calloc(n*n, sizeof(bool));
+            values.reward    = (double *)calloc(n*n, sizeof(double));
+            qtable = values.q;
+        }
+        else
         {
-            for (int y = 0; y < n; ++y)
-            {  
-                Square *s = new Square(x, y);
-                squares[x*n+y] = s;
+            for (int x = 0; x < n; ++x)
+            {
+                for (int y = 0; y < n; ++y)
+                {  
+                    Square *s = new Square(x, y);
+                    squares[x*n+y] = s;
+                }
             }
         }
         
@@ -448,22 +1437,33 @@ public:
     }
 
     virtual ~Grid(){
-        // 1. Loop for all of the squares in the grid
-        for (int x = 0; x < n; ++x)
+        // 1. Loop for all of the squares (or views) in the grid
+        for (int i = 0; squares && (i < n*n); ++i)
         {
-            for (int y = 0; y < n; ++y)
-            {  
-                // 2. And delete them
-                delete squares[x*n+y];
-            }
+            // 2. And delete them
+            delete squares[i];
         }
         
-        // 3. Delete the square pointers
+        // 3. Delete the square pointers, goal slots and the store
+        if (qfloat) huge_free(qfloat, compact_bytes());
+        if (qshort) huge_free(qshort, compact_bytes());
         free(squares);
+        free(goal_slot);
+        aligned_free(values.q);
+        free(values.letter);
+        free(values.value);
+        free(values.visits);
+        free(values.underline);
+        free(values.reward);
     }
     
     int    get_n()     const { return n; }
+    int    get_store() const { return store; }
     Goal **get_goals() const { return goals; }
+    Random *get_random()     { return &random; }
+    void set_seed(unsigned long long seed, unsigned long long stream=0) {
+        random.set_seed(seed, stream);
+    }
 
     void set_goals(Goal **g=NULL)
     {
@@ -473,17 +1473,110 @@ public:
         // 2. Orient each of the Goals  
         if (goals) {
             for (Goal **g = goals; *g != NULL; ++g) {
-                (*g)->orient(n);
+                (*g)->orient(n, &random);
+            }
+        }
+        
+        // 3. Index the squares that have goals (first goal wins)
+        memset(goal_slot, 0, sizeof(int)*n*n);
+        if (goals) {
+            for (int i = 0; goals[i] != NULL; ++i) {
+                int x = goals[i]->get_ox();
+                int y = goals[i]->get_oy();
+                if (x < 0 || x >= n || y < 0 || y >= n) continue;
+                if (0 == goal_slot[x*n + y]) goal_slot[x*n + y] = i + 1;
             }
         }
+        
+        // 4. Fixed point Q values cover a multiple of the largest reward
+        if (qshort && goals) {
+            int largest = 1;
+            for (Goal **g = goals; *g != NULL; ++g)
+                if (abs((*g)->get_reward()) > largest) 
+                    largest = abs((*g)->get_reward());
+            set_q_range(Q16_HEADROOM * largest);
+        }
     }
     
+    // The largest Q value an int16 grid can hold (rescaling any held)
+    void set_q_range(double range)
+    {
+        double scale = range / Q16_MAX;
+        if ((NULL == qshort) || (scale == qscale)) return;
+        double old = qscale;
+        qscale = scale;
+        for (size_t i = 0; i < (size_t)n*n*DIR_NUM; ++i)
+            qshort[i] = q_encode(qshort[i] * old);
+    }
+    double get_q_scale() const { return qscale; }
+    
     Square *square(int x, int y)
     {    
-        return squares[x*n + y];
+        if (NULL == squares) make_pictures();
+        Square *s = squares[x*n + y];
+        if (NULL == s) {
+            s = new Square(x, y, &values, x*n + y);
+            squares[x*n + y] = s;
+        }
+        if (qfloat || qshort) 
+            memcpy(s->get_qs(), q_at(x, y), sizeof(double)*DIR_NUM);
+        return s;
     }
     
-    Goal *goal_at(int x, int y)
+    // The DIR_NUM Q values of a square.  The _in versions take the grid
+    // size as a template argument, when it is known (or 0 when not).
+    template <int N> double *q_in(int x, int y) const
+    {
+        const int nn = (N > 0) ? N : n;
+        if (qtable) return qtable + (x*nn + y)*DIR_NUM;
+        if (qfloat || qshort) return q_decode((size_t)(x*nn + y)*DIR_NUM);
+        return squares[x*nn + y]->get_qs();
+    }
+    template <int N> void set_q_in(int x, int y, int dir, double v)
+    {
+        const int nn = (N > 0) ? N : n;
+        size_t i = (size_t)(x*nn + y)*DIR_NUM + dir;
+        if (qtable) qtable[i] = v;
+        else if (qfloat) qfloat[i] = float(v);
+        else if (qshort) qshort[i] = q_encode(v);
+        else squares[x*nn + y]->get_qs()[dir] = v;
+    }
+    double *q_at(int x, int y) const { return q_in<0>(x, y); }
+    double get_q(int x, int y, int dir) const { return q_at(x, y)[dir]; }
+    void set_q(int x, int y, int dir, double v) { set_q_in<0>(x, y, dir, v); }
+    
+    // Compact Q values to and from doubles
+    double *q_decode(size_t i) const
+    {
+        double *q = qdecode[qflip ^= 1];
+        if (qfloat) 
+            for (int dir = 0; dir < DIR_NUM; ++dir) q[dir] = qfloat[i + dir];
+        else
+            for (int dir = 0; dir < DIR_NUM; ++dir) 
+                q[dir] = qshort[i + dir] * qscale;
+        return q;
+    }
+    int16_t q_encode(double v) const
+    {
+        double f = floor(v / qscale + 0.5);
+        if (f > Q16_MAX) f = Q16_MAX;
+        if (f < -Q16_MAX) f = -Q16_MAX;
+        return int16_t(f);
+    }
+    double max(int x, int y) const { return Square::max_of(q_at(x, y)); }
+    
+    Goal *goal_at(int x, int y) const
+    {
+        // 1. Off the grid there are no goals
+        if (x < 0 || x >= n || y < 0 || y >= n) return NULL;
+        
+        // 2. Otherwise the slot says which goal (if any)
+        int slot = goal_slot[x*n + y];
+        return slot ? goals[slot-1] : NULL;
+    }
+    
+    // goal_at() without the index, by searching the list of goals
+    Goal *goal_scan(int x, int y) const
     {
         // 1. Loop for all the goals  
         if (goals) {
@@ -502,17 +1595,23 @@ public:
     }
     
     virtual Goal* move(int x, int y, int dir, int *n_x, int *n_y)
+    {
+        return move_in<0>(x, y, dir, n_x, n_y);
+    }
+    
+    template <int N> Goal* move_in(int x, int y, int dir, int *n_x, int *n_y)
     {
         //"From square 'at' move in direction 'dir'"
+        const int nn = (N > 0) ? N : n;
         Goal *g;
         
         // 1. Determine new square
         int new_x = x + DIR_DELTA_X[dir];
         if (new_x < 0)          new_x = 0;
-        if (new_x >= n)         new_x = n-1;
+        if (new_x >= nn)        new_x = nn-1;
         int new_y = y + DIR_DELTA_Y[dir];
         if (new_y < 0)          new_y = 0;
-        if (new_y >= n)         new_y = n-1;
+        if (new_y >= nn)        new_y = nn-1;
         *n_x = new_x;
         *n_y = new_y;
         
@@ -520,11 +1619,13 @@ public:
         if (x == new_x && y == new_y) return NULL;
         
         // 3. If no goal, no reward or jump
-        if (NULL == (g = goal_at(new_x, new_y))) return NULL;
+        int slot = goal_slot[new_x*nn + new_y];
+        if (0 == slot) return NULL;
+        g = goals[slot-1];
             
         // 4. Implement jumps at reward squares
-        *n_x = orient_value(g->get_newx(), n);
-        *n_y = orient_value(g->get_newy(), n);
+        *n_x = g->get_jumpx(&random);
+        *n_y = g->get_jumpy(&random);
         
         // 5. Return goal
         return g;
@@ -532,12 +1633,15 @@ public:
     
     void reset()
     {  
-        for (int i = 0; i < n*n; ++i) squares[i]->reset();
+        if (qtable) memset(qtable, 0, sizeof(double)*n*n*DIR_NUM);
+        else if (qfloat) memset(qfloat, 0, compact_bytes());
+        else if (qshort) memset(qshort, 0, compact_bytes());
+        else for (int i = 0; i < n*n; ++i) squares[i]->reset();
     }
     
-    int suggest(int x, int y)
+    int suggest(int x, int y, Random *r=NULL)
     { 
-        return square(x, y)->suggest();
+        return Square::best_of(q_at(x, y), r ? r : &random);
     }
     
     virtual int perturb(void) { return 0; }
@@ -545,11 +1649,98 @@ public:
     virtual const char* name(void)    const { return "Grid"; }
     virtual const char* initials(void) const { return "GR"; }
     
+    // Return a new, unperturbed grid of the same kind (shares the goals)
+    virtual Grid* clone(void) const { return new Grid(n, goals, store); }
+    
     virtual int reinit(void) {
         reset();
         restore();
         return 1;
     }
+    
+    // Snapshot the Q values, the goals' rewards and places, and the
+    // random stream (the picture values are not kept)
+    virtual int save(Snapshot &s)
+    {
+        // 1. The size and the Q values of every square
+        s.put_tag("Grid");
+        s.put_int(n);
+        for (int i = 0; i < n*n; ++i) 
+            s.put(q_at(i/n, i%n), sizeof(double)*DIR_NUM);
+        
+        // 2. The goals as they are now
+        int knt = 0;
+        if (goals) for (Goal **g = goals; *g != NULL; ++g) ++knt;
+        s.put_int(knt);
+        for (int i = 0; i < knt; ++i) {
+            s.put_int(goals[i]->get_reward());
+            s.put_int(goals[i]->get_x());
+            s.put_int(goals[i]->get_y());
+        }
+        
+        // 3. And the random number stream
+        s.put_random(random);
+        return s.ok();
+    }
+    
+    virtual int load(Snapshot &s)
+    {
+        // 1. The size must be the same, then read the Q values
+        if (!s.get_tag("Grid")) return 0;
+        if (n != s.get_int()) return 0;
+        for (int i = 0; i < n*n; ++i) {
+            double q[DIR_NUM];
+            s.get(q, sizeof(q));
+            for (int dir = 0; dir < DIR_NUM; ++dir) set_q(i/n, i%n, dir, q[dir]);
+        }
+        
+        // 2. The goals must be the same ones, wherever they are now
+        int knt = 0;
+        if (goals) for (Goal **g = goals; *g != NULL; ++g) ++knt;
+        if (knt != s.get_int()) return 0;
+        for (int i = 0; i < knt; ++i) {
+            goals[i]->set_reward(s.get_int());
+            goals[i]->set_x(s.get_int());
+            goals[i]->set_y(s.get_int());
+        }
+        set_goals(goals);
+        
+        // 3. And the random number stream
+        s.get_random(random);
+        return s.ok();
+    }
+    
+    // Would a walker move on this grid just as on the other one?  That
+    // is, are the goals the same and in the same places?
+    bool same_goals(const Grid *other) const
+    {
+        // 1. The same size and the same number of goals
+        if ((n != other->n) || (NULL == goals) || (NULL == other->goals)) 
+            return false;
+        int i;
+        for (i = 0; (goals[i] != NULL) && (other->goals[i] != NULL); ++i) {
+            
+            // 2. And each goal the same
+            Goal *a = goals[i];
+            Goal *b = other->goals[i];
+            if ((a->get_reward() != b->get_reward()) ||
+                (a->get_ox()     != b->get_ox())     ||
+                (a->get_oy()     != b->get_oy())     ||
+                (a->get_newx()   != b->get_newx())   ||
+                (a->get_newy()   != b->get_newy())) return false;
+        }
+        return (NULL == goals[i]) && (NULL == other->goals[i]);
+    }
+    
+    // Take the Q values and the random stream of a grid with same goals
+    void copy_state(const Grid *other)
+    {
+        for (int i = 0; i < n*n; ++i) {
+            double *q = other->q_at(i/n, i%n);
+            for (int dir = 0; dir < DIR_NUM; ++dir) set_q(i/n, i%n, dir, q[dir]);
+        }
+        random = other->random;
+    }
 
     void picture(ostream& out, bool arrow=true, int which=DRAW_QMAX)
     {
@@ -584,7 +1775,8 @@ class Chippy : public Grid
     Goal *g3[3];
     
 public:
-    Chippy(int n=8, int rr1=10, int rr2=-10) : Grid(n)
+    Chippy(int n=8, int rr1=10, int rr2=-10, int st=STORE_CONTIGUOUS) 
+    : Grid(n, NULL, st)
     {
         // 1. Save the reward values
         r1 = rr1;
@@ -605,12 +1797,30 @@ public:
         delete g3[1];
     }
 
-    int get_r1() { return r1; }
-    int get_r2() { return r2; }
+    int get_r1() const { return r1; }
+    int get_r2() const { return r2; }
     Goal *get_g1() { return get_goals()[0]; }
     Goal *get_g2() { return get_goals()[1]; }
     virtual const char* name(void)    const { return "ChippyFixed"; }
     virtual const char* initials(void) const { return "CH"; }
+    virtual int save(Snapshot &s)
+    {
+        Grid::save(s);
+        s.put_tag("Chippy");
+        s.put_int(r1);
+        s.put_int(r2);
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        if (!Grid::load(s) || !s.get_tag("Chippy")) return 0;
+        if (r1 != s.get_int()) return 0;
+        if (r2 != s.get_int()) return 0;
+        return s.ok();
+    }
+    virtual Grid* clone(void) const { 
+        return new Chippy(get_n(), r1, r2, get_store()); 
+    }
 };
 
 // ====================================================================
@@ -620,8 +1830,8 @@ public:
 class ChippyClassic : public Chippy
 {
 public:
-    ChippyClassic(int n=8, int r1=10, int r2=-10) 
-    : Chippy(n, r1, r2) {
+    ChippyClassic(int n=8, int r1=10, int r2=-10, int st=STORE_CONTIGUOUS) 
+    : Chippy(n, r1, r2, st) {
     }
      
     virtual int perturb() {
@@ -646,6 +1856,9 @@ public:
     }
     virtual const char* name(void)    const { return "ChippyClassic"; }
     virtual const char* initials(void) const { return "CL"; }
+    virtual Grid* clone(void) const { 
+        return new ChippyClassic(get_n(), get_r1(), get_r2(), get_store()); 
+    }
 };
 
 // ====================================================================
@@ -657,7 +1870,8 @@ class ChippyCorner : public ChippyClassic
     Goal *g3[3];
     
 public:
-    ChippyCorner(int n=8, int r1=10, int r2=-10) : ChippyClassic(n,r1,r2)
+    ChippyCorner(int n=8, int r1=10, int r2=-10, int st=STORE_CONTIGUOUS) 
+    : ChippyClassic(n, r1, r2, st)
     {
         // 1. Create the goals
         g3[0] = new Goal(r1, LOC_MIN, LOC_MIN, LOC_MAX, LOC_MAX);
@@ -676,6 +1890,9 @@ public:
 
     virtual const char* name(void)    const { return "ChippyCorner"; }
     virtual const char* initials(void) const { return "CO"; }
+    virtual Grid* clone(void) const { 
+        return new ChippyCorner(get_n(), get_r1(), get_r2(), get_store()); 
+    }
 };
 
 // ====================================================================
@@ -687,7 +1904,8 @@ class ChippyRotate : public Chippy
     int state;    
     
 public:
-    ChippyRotate(int n=8, int r1=10, int r2=-10) : Chippy(n,r1,r2) {
+    ChippyRotate(int n=8, int r1=10, int r2=-10, int st=STORE_CONTIGUOUS) 
+    : Chippy(n, r1, r2, st) {
         move_goals_to(0);
     };
 
@@ -723,8 +1941,325 @@ public:
     }
     virtual const char* name(void)    const { return "ChippyRotate"; }
     virtual const char* initials(void) const { return "CR"; }
+    virtual int save(Snapshot &s)
+    {
+        Chippy::save(s);
+        s.put_tag("ChippyRotate");
+        s.put_int(state);
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        // The goals have already been put back where the state says
+        if (!Chippy::load(s) || !s.get_tag("ChippyRotate")) return 0;
+        int st = s.get_int();
+        if ((st < 0) || (st > 3)) return 0;
+        state = st;
+        return s.ok();
+    }
+    virtual Grid* clone(void) const { 
+        return new ChippyRotate(get_n(), get_r1(), get_r2(), get_store()); 
+    }
+};
+
+
+// ====================================================================
+//                                                   TrajectoryRecorder
+// Per-step records of a QLearner with the columns that Results.py
+// reads (RUNNER, EXP, NUM, STEP, START_X/Y, DIRECTION, REWARD_X/Y,
+// EXPECTED, ACTUAL, FINAL_X/Y, WHY, Q_N..Q_W and SUGGESTION).  Rows
+// are filled into one of two buffers while a writer thread writes the
+// other to the file, packed as they are in memory after a header with
+// the magic "CHIPPYJ1".  The runner, experiment and repeat number are
+// not in every row: a run row (why is MOVE_TYPE_RUN) comes before the
+// first row of each run.  The last row stays writable until the next
+// one is added, so the MCL walkers can fill in what they expected and
+// what they did about it.  convert_trajectory() writes the CSV.
+// Recording is not cheap: every step streams a 40 byte row (with the
+// Q values as floats) through memory and out to the file, and a
+// QLearner step is only about 50ns.  -b Record measures what that
+// costs.
+// ====================================================================
+#define TRAJECTORY_MAGIC   "CHIPPYJ1"
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_ROWS    16384   // rows per buffer
+#define TRAJECTORY_HEADER  "RUNNER,EXP,NUM,STEP,START_X,START_Y,DIRECTION," \
+                           "REWARD_X,REWARD_Y,EXPECTED,ACTUAL,FINAL_X," \
+                           "FINAL_Y,WHY,Q_N,Q_S,Q_E,Q_W,SUGGESTION"
+
+// Why the move was made, and what MCL suggested (as in Constants.py)
+#define MOVE_TYPE_FORCED 'F'
+#define MOVE_TYPE_POLICY 'P'
+#define MOVE_TYPE_RANDOM 'R'
+#define MOVE_TYPE_RUN    0     // not a move: step is the repeat number,
+                               // start_x the runner, start_y the exp
+#define SUGGEST_NONE  0
+#define SUGGEST_RESET 1
+#define SUGGEST_LEARN 2
+
+struct TrajectoryRow
+{
+    float    q[DIR_NUM];
+    uint32_t step;
+    int16_t  start_x;
+    int16_t  start_y;
+    int16_t  reward_x;
+    int16_t  reward_y;
+    int16_t  final_x;
+    int16_t  final_y;
+    int16_t  expected;
+    int16_t  actual;
+    uint8_t  direction;
+    uint8_t  why;
+    uint8_t  suggestion;
+    uint8_t  unused;
+};
+
+struct TrajectoryFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t row_size;
+    char     unused[48];
+};
+
+class TrajectoryRecorder
+{
+    TrajectoryRow *buffers[2];
+    TrajectoryRow *last_row;
+    int   filling;
+    int   used;
+    int   runner;
+    int   exp;
+    int   num;
+    bool  new_run;
+    FILE *file;
+    long  rows;
+    
+    // Shared with the writer thread
+    std::mutex lock;
+    std::condition_variable ready;
+    std::thread writer;
+    TrajectoryRow *full;
+    int   full_used;
+    bool  stopping;
+    
+    TrajectoryRecorder(const TrajectoryRecorder&);
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&);
+    
+    void write(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            while ((NULL == full) && !stopping) ready.wait(guard);
+            if (NULL == full) break;
+            TrajectoryRow *rows_out = full;
+            int knt = full_used;
+            guard.unlock();
+            fwrite(rows_out, sizeof(TrajectoryRow), knt, file);
+            guard.lock();
+            full = NULL;
+            ready.notify_all();
+        }
+    }
+    
+    // Give the filled buffer to the writer (once it is done with the
+    // other one) and start filling the other
+    void hand_off(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (NULL != full) ready.wait(guard);
+        full = buffers[filling];
+        full_used = used;
+        ready.notify_all();
+        filling = 1 - filling;
+        used = 0;
+        last_row = NULL;
+    }
+    
+    TrajectoryRow *next_row(void)
+    {
+        if (TRAJECTORY_ROWS == used) hand_off();
+        return &buffers[filling][used++];
+    }
+    
+public:
+    TrajectoryRecorder()
+    {
+        buffers[0] = NULL;
+        buffers[1] = NULL;
+        last_row = NULL;
+        filling = 0;
+        used = 0;
+        runner = 0;
+        exp = 0;
+        num = 0;
+        new_run = true;
+        file = NULL;
+        rows = 0;
+        full = NULL;
+        full_used = 0;
+        stopping = false;
+    }
+    ~TrajectoryRecorder() { close(); }
+    
+    bool open(const char *filename)
+    {
+        TrajectoryFileHeader header;
+        
+        // 1. Open the file and write the header
+        close();
+        file = fopen(filename, "wb");
+        if (NULL == file) return false;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TRAJECTORY_MAGIC, 8);
+        header.version = TRAJECTORY_VERSION;
+        header.row_size = sizeof(TrajectoryRow);
+        fwrite(&header, sizeof(header), 1, file);
+        
+        // 2. Get the buffers and start the writer
+        buffers[0] = (TrajectoryRow *)malloc(2 * TRAJECTORY_ROWS * 
+                                             sizeof(TrajectoryRow));
+        buffers[1] = buffers[0] + TRAJECTORY_ROWS;
+        filling = 0;
+        used = 0;
+        rows = 0;
+        new_run = true;
+        stopping = false;
+        writer = std::thread(&TrajectoryRecorder::write, this);
+        return true;
+    }
+    
+    // Write the rest of the rows and close the file, returning the
+    // number of rows written
+    long close(void)
+    {
+        if (NULL == file) return 0;
+        if (used > 0) hand_off();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            ready.notify_all();
+        }
+        writer.join();
+        fclose(file);
+        file = NULL;
+        free(buffers[0]);
+        buffers[0] = NULL;
+        buffers[1] = NULL;
+        last_row = NULL;
+        return rows;
+    }
+    
+    // The runner, experiment and repeat number of the rows that follow
+    void set_run(int r, int e, int n)
+    {
+        runner = r;
+        exp = e;
+        num = n;
+        new_run = true;
+        last_row = NULL;
+    }
+    
+    TrajectoryRow *add(void)
+    {
+        // 1. The run, before its first row
+        if (new_run) {
+            TrajectoryRow *run = next_row();
+            memset(run, 0, sizeof(TrajectoryRow));
+            run->why = MOVE_TYPE_RUN;
+            run->step = num;
+            run->start_x = runner;
+            run->start_y = exp;
+            new_run = false;
+        }
+        
+        // 2. And the row of the step
+        last_row = next_row();
+        last_row->suggestion = SUGGEST_NONE;
+        last_row->unused = 0;
+        ++rows;
+        return last_row;
+    }
+    
+    TrajectoryRow *last(void) const { return last_row; }
+    long get_rows(void) const { return rows; }
 };
 
+// --------------------------------------------------------------------
+//                                                        is_trajectory
+// --------------------------------------------------------------------
+bool is_trajectory(const char *filename)
+{
+    char magic[8];
+    FILE *in = fopen(filename, "rb");
+    if (NULL == in) return false;
+    bool is = (1 == fread(magic, sizeof(magic), 1, in)) &&
+              (0 == memcmp(magic, TRAJECTORY_MAGIC, 8));
+    fclose(in);
+    return is;
+}
+
+// --------------------------------------------------------------------
+//                                                   convert_trajectory
+// Write a trajectory file as a CSV file for Results.py, returning the
+// number of rows (or -1 if it is not a trajectory file)
+// --------------------------------------------------------------------
+long convert_trajectory(const char *filename, const char *csvname)
+{
+    TrajectoryFileHeader header;
+    long knt = 0;
+    
+    // 1. Open the trajectory and check the header
+    FILE *in = fopen(filename, "rb");
+    if (NULL == in) return -1;
+    if ((1 != fread(&header, sizeof(header), 1, in)) ||
+        (0 != memcmp(header.magic, TRAJECTORY_MAGIC, 8)) ||
+        (sizeof(TrajectoryRow) != header.row_size)) {
+        fclose(in);
+        return -1;
+    }
+    
+    // 2. Write the CSV header
+    FILE *out = fopen(csvname, "w");
+    if (NULL == out) {
+        fclose(in);
+        return -1;
+    }
+    fprintf(out, "%s\n", TRAJECTORY_HEADER);
+    
+    // 3. Write the rows, a buffer at a time, each with its run
+    TrajectoryRow *rows = (TrajectoryRow *)malloc(TRAJECTORY_ROWS * 
+                                                  sizeof(TrajectoryRow));
+    int runner = 0, exp = 0, num = 0;
+    size_t got;
+    while (0 < (got = fread(rows, sizeof(TrajectoryRow), TRAJECTORY_ROWS, in))) {
+        for (size_t r = 0; r < got; ++r) {
+            const TrajectoryRow &t = rows[r];
+            if (MOVE_TYPE_RUN == t.why) {
+                runner = t.start_x;
+                exp = t.start_y;
+                num = (int)t.step;
+                continue;
+            }
+            fprintf(out, "%d,%d,%d,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%c,"
+                         "%f,%f,%f,%f,%d\n",
+                    runner, exp, num, t.step, 
+                    t.start_x, t.start_y, t.direction, 
+                    t.reward_x, t.reward_y, t.expected, t.actual,
+                    t.final_x, t.final_y, t.why, 
+                    t.q[DIR_N], t.q[DIR_S], t.q[DIR_E], t.q[DIR_W],
+                    t.suggestion);
+            ++knt;
+        }
+    }
+    
+    // 4. Close up and return the number of rows (of steps)
+    free(rows);
+    fclose(in);
+    fclose(out);
+    return knt;
+}
 
 // ====================================================================
 //                                                               Walker
@@ -734,7 +2269,7 @@ class Walker
 {
 protected:
     double score;
-    int    count;
+    int64_t count;     // a soak takes more steps than an int can count
     Grid  *grid;
     int    x;
     int    y;
@@ -743,12 +2278,17 @@ protected:
     int    last_x;
     int    last_y;
     int    verbose;
+    Random random;
+    TrajectoryRecorder *recorder;
 public:
     Walker(Grid *g = NULL, int sx = LOC_CTR, int sy = LOC_CTR)
     {    
             score   = 0;
             count   = 0;
             grid    = g;
+            verbose = 0;
+            recorder = NULL;
+            random.set_seed(default_random().next());
             start_at(sx, sy);
     }
     virtual ~Walker()
@@ -756,7 +2296,7 @@ public:
     }
 
     int     get_score()    const { return score; }
-    int     get_count()    const { return count; }
+    int64_t get_count()    const { return count; }
     Square* square(int x, int y) const { return grid->square(x,y); }
     int     get_x()        const { return x; }
     int     get_y()        const { return y; }
@@ -769,6 +2309,24 @@ public:
     void set_verbose(int v) {
         verbose = v;
     }
+    int get_verbose() const { return verbose; }
+    // Record every step (QLearners only) with recorder, or not if NULL
+    void set_recorder(TrajectoryRecorder *r) { recorder = r; }
+    TrajectoryRecorder* get_recorder() const { return recorder; }
+    TrajectoryRow* recorded() const {
+        return (NULL == recorder) ? NULL : recorder->last();
+    }
+    // What an MCL walker expected of, and did about, the recorded step
+    void record_expected(int r) {
+        if (NULL != recorded()) recorded()->expected = r;
+    }
+    void record_suggestion(int s) {
+        if (NULL != recorded()) recorded()->suggestion = s;
+    }
+    Random* get_random()          { return &random; }
+    void set_seed(unsigned long long seed, unsigned long long stream=0) {
+        random.set_seed(seed, stream);
+    }
     
     void start_at(int sx=LOC_CTR, int sy=LOC_CTR) 
     {
@@ -797,6 +2355,12 @@ public:
     }
         
     virtual Goal* move(int dir=-1)
+    {
+        return step<0>(dir);
+    }
+    
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir=-1)
     {
         // Move to the given, best, or random direction"
         int new_x;
@@ -806,11 +2370,11 @@ public:
         //  1. Pick a direction if none given
         if (-1 == dir)
         {    
-            dir = suggest();
+            dir = Square::best_of(grid->template q_in<N>(x, y), &random);
         }
         
         // 2. Move and get reward and new location
-        g = grid->move(x, y, dir, &new_x, &new_y);
+        g = grid->template move_in<N>(x, y, dir, &new_x, &new_y);
         
         // 3. Set new location
         last_x = x;
@@ -831,7 +2395,7 @@ public:
     
     int suggest()
     {
-        return grid->suggest(x, y);
+        return grid->suggest(x, y, &random);
     }
     
     virtual void reset()
@@ -842,6 +2406,13 @@ public:
     virtual const char* name(void)    const { return "Walker"; }
     virtual const char* initials(void) const { return "WA"; }
     
+    // Can several of these walkers run at once on different threads?
+    // (walker_reentrant() has to give the same answer for each kind)
+    virtual int reentrant(void) const { return 1; }
+    
+    // How often an MCL walker monitors (see monitoring cadence)
+    virtual void set_cadence(int) {}
+    
     virtual int reinit(void) {
         count = 0;
         score = 0;
@@ -850,6 +2421,36 @@ public:
             return grid->reinit();
         else return 1;
     }
+    
+    // Snapshot the walker (but not its grid, see save_snapshot())
+    virtual int save(Snapshot &s)
+    {
+        s.put_tag("Walker");
+        s.put_double(score);
+        s.put_int64(count);
+        s.put_int(x);
+        s.put_int(y);
+        s.put_int(startx);
+        s.put_int(starty);
+        s.put_int(last_x);
+        s.put_int(last_y);
+        s.put_random(random);
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        if (!s.get_tag("Walker")) return 0;
+        score  = s.get_double();
+        count  = s.get_int64();
+        x      = s.get_int();
+        y      = s.get_int();
+        startx = s.get_int();
+        starty = s.get_int();
+        last_x = s.get_int();
+        last_y = s.get_int();
+        s.get_random(random);
+        return s.ok();
+    }
 
     void picture(ostream& out, bool arrow=true, int which=DRAW_QMAX)
     {
@@ -899,9 +2500,16 @@ public:
     void set_gamma(double g)       { gamma = g; }
     
     virtual Goal* move(int dir=-1)
+    {
+        return step<0>(dir);
+    }
+    
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir=-1)
     {
         // Move in the direction with the best expected value or explore
         int reward = 0;
+        int why = MOVE_TYPE_FORCED;
         
         // 1. Remember the previous location
         int prev_x = get_x();
@@ -910,32 +2518,64 @@ public:
         // 2. Get suggested direction
         if (dir == -1)
         {
-            dir = suggest();
+            dir = Square::best_of(grid->template q_in<N>(prev_x, prev_y), 
+                                  &random);
+            why = MOVE_TYPE_POLICY;
             
             // 3. If exploring, get a random direction
-            if ((epsilon*10000) > (rand() % 10000))
+            if ((epsilon*10000) > random.below(10000))
             { 
-                dir = rand() % DIR_NUM;
+                dir = random.below(DIR_NUM);
+                why = MOVE_TYPE_RANDOM;
             }
         }
         
         // 4. Move in specified direction     
-        Goal* goal = Walker::move(dir);
+        Goal* goal = Walker::template step<N>(dir);
         if (goal != NULL) reward = goal->get_reward(); 
 
-        // 5. Adjust the action expected rewards
-        double newQsa = qreward(dir, prev_x, prev_y, reward, get_x(), get_y());
-        square(prev_x, prev_y)->set_q(dir, newQsa);
+        // 5. Record the step (with the Q values it started from)
+        if (NULL != recorder) record(prev_x, prev_y, dir, why, goal,
+                                     grid->template q_in<N>(prev_x, prev_y));
         
-        // 6. Return goal (if any)
+        // 6. Adjust the action expected rewards
+        double newQsa = qreward_in<N>(dir, prev_x, prev_y, reward, 
+                                      get_x(), get_y());
+        grid->template set_q_in<N>(prev_x, prev_y, dir, newQsa);
+        
+        // 7. Return goal (if any)
         return goal;
     }
     
+    void record(int prev_x, int prev_y, int dir, int why, Goal *goal,
+                const double *q)
+    {
+        TrajectoryRow *row = recorder->add();
+        row->step      = get_count() - 1;
+        row->start_x   = prev_x;
+        row->start_y   = prev_y;
+        row->direction = dir;
+        row->reward_x  = (NULL == goal) ? get_x() : goal->get_ox();
+        row->reward_y  = (NULL == goal) ? get_y() : goal->get_oy();
+        row->actual    = (NULL == goal) ? 0 : goal->get_reward();
+        row->expected  = row->actual;
+        row->final_x   = get_x();
+        row->final_y   = get_y();
+        row->why       = why;
+        for (int d = 0; d < DIR_NUM; ++d) row->q[d] = (float) q[d];
+    }
+    
     double qreward(int a, int s_x, int s_y, int r, int sp_x, int sp_y)
+    {
+        return qreward_in<0>(a, s_x, s_y, r, sp_x, sp_y);
+    }
+    
+    template <int N> 
+    double qreward_in(int a, int s_x, int s_y, int r, int sp_x, int sp_y)
     {
         //Spread out the reward over the past move
-        double oldQsa = square(s_x, s_y)->get_q(a);
-        double maxQspap = square(sp_x, sp_y)->max();
+        double oldQsa = grid->template q_in<N>(s_x, s_y)[a];
+        double maxQspap = Square::max_of(grid->template q_in<N>(sp_x, sp_y));
         double newQsa = oldQsa + alpha*(r + (gamma*maxQspap) - oldQsa);
         //printf("Q([%d,%d],%d) = %f = %f + %f(%f + %f*%f-%f)\n",
         //       s_x, s_y, a, newQsa, oldQsa, alpha, r, gamma, maxQspap, oldQsa);
@@ -943,6 +2583,31 @@ public:
     }
     virtual const char* name(void)    const { return "QLearner"; }
     virtual const char* initials(void) const { return "QL"; }
+    virtual int save(Snapshot &s)
+    {
+        Walker::save(s);
+        s.put_tag("QLearner");
+        s.put_double(alpha);
+        s.put_double(gamma);
+        s.put_double(epsilon);
+        s.put_double(start_alpha);
+        s.put_double(start_gamma);
+        s.put_double(start_epsilon);
+        s.put_int(policy_number);
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        if (!Walker::load(s) || !s.get_tag("QLearner")) return 0;
+        alpha         = s.get_double();
+        gamma         = s.get_double();
+        epsilon       = s.get_double();
+        start_alpha   = s.get_double();
+        start_gamma   = s.get_double();
+        start_epsilon = s.get_double();
+        policy_number = s.get_int();
+        return s.ok();
+    }
     virtual int reinit(void) {
         alpha   = start_alpha;
         gamma   = start_gamma;
@@ -951,6 +2616,7 @@ public:
         return Walker::reinit();
     }
     void increase_epsilon(double e){
+        if (e > 0) record_suggestion(SUGGEST_LEARN);
         epsilon += e;
         if (epsilon > MAX_EPSILON) epsilon = MAX_EPSILON;
         if (epsilon < MIN_EPSILON) epsilon = MIN_EPSILON;
@@ -961,6 +2627,7 @@ public:
     }
     void increment_policy()
     {
+        TRACE(verbose, TRACE_POLICY, get_count(), policy_number + 1);
         epsilon = start_epsilon;
         ++policy_number;
         Walker::reset();
@@ -968,69 +2635,37 @@ public:
 };        
 
 
-// ====================================================================
-//                                                          Expectation
-// Base class for hand coded MCL exceptions
-// ====================================================================
-class Expectation
-{
-    int number;
-public:
-    Expectation() {
-        number = 0;
-    }
-    virtual ~Expectation()
-    {
-    }
-
-    virtual int check() {
-        return 0;
-    }
-    virtual int check(Goal *g) {
-        return 0;
-    }
-    
-    virtual int get_x() const {
-        return -1;
-    }
-    virtual int get_y() const {
-        return -1;
-    }
-    
-    void set_number(int n) {
-        number = n;
-    }
-    int get_number(void) {
-        return number;
-    }
-};
-
 // ====================================================================
 //                                                  RewardAtExpectation
-// Expectation for receiving a reward at a square
+// Expectation for receiving a reward at a square.  These live in the
+// slots of Expectations, so they are plain values.
 // ====================================================================
-class RewardAtExpectation : public Expectation
+class RewardAtExpectation
 {
     int reward;
     int atx;
     int aty;
+    int number;
+    int generation;
+    
+    friend class Expectations;
 public:
-    RewardAtExpectation(int r, int x, int y) {
-        reward = r;
-        atx = x;
-        aty = y;
-    }
+    RewardAtExpectation() 
+    : reward(0), atx(-1), aty(-1), number(0), generation(0) {}
     
-    virtual int get_reward() const {
+    int get_reward() const {
         return reward;
     } 
-    virtual int get_x() const {
+    int get_x() const {
         return atx;
     }
-    virtual int get_y() const {
+    int get_y() const {
         return aty;
     }
-    virtual int check(Goal *g) {
+    int get_number(void) const {
+        return number;
+    }
+    int check(Goal *g) const {
         if (g == NULL) return 0;
         if (atx != g->get_ox()) return 0;
         if (aty != g->get_oy()) return 0;
@@ -1041,52 +2676,88 @@ public:
 
 // ====================================================================
 //                                                         Expectations
-// Bag of expecations
+// Bag of expecations, one slot per square (x + y*dim) so at() is an
+// index.  A slot holds an expectation only if its generation is the
+// current one, so clear() just starts a new generation.  The slots
+// grow (the only allocation) when a reward is first seen beyond them.
+// get(i) gives the expectations in the order they were added.
 // ====================================================================
 class Expectations
 {
-    Expectation **expect;
+    RewardAtExpectation *slots;
+    int dim;
+    int generation;
+    int order[MAX_EXPECTATIONS];
     int numexp;
     int maxexp;
+    
+    Expectations(const Expectations&);
+    Expectations& operator=(const Expectations&);
+    
+    void grow(int n)
+    {
+        // 1. Room for the larger grid, keeping what is expected now
+        RewardAtExpectation *old = slots;
+        dim = n;
+        slots = new RewardAtExpectation[dim * dim];
+        for (int i = 0; i < numexp; ++i) {
+            RewardAtExpectation &e = old[order[i]];
+            order[i] = e.atx + e.aty * dim;
+            slots[order[i]] = e;
+        }
+        delete [] old;
+    }
 public:
     Expectations(int maxnum = MAX_EXPECTATIONS) {
+        slots = NULL;
+        dim = 0;
+        generation = 1;
         numexp = 0;
-        maxexp = maxnum;
-        expect = (Expectation **)calloc(maxnum, sizeof(Expectation *));
+        maxexp = (maxnum < MAX_EXPECTATIONS) ? maxnum : MAX_EXPECTATIONS;
     }
     
-    virtual ~Expectations() {
-        clear();    
+    ~Expectations() {
+        delete [] slots;
     }
     
-    virtual void add(Expectation *exp) {
-        if (numexp < maxexp) {
-            expect[numexp] = exp;
-            ++numexp;
-            exp->set_number(numexp);
-        }
+    // Expect reward at (x, y), returning the expectation (numbered from
+    // one) or NULL if there are already as many as there can be
+    RewardAtExpectation* add(int reward, int x, int y) {
+        if ((numexp >= maxexp) || (x < 0) || (y < 0)) return NULL;
+        if ((x >= dim) || (y >= dim)) grow((x > y ? x : y) + 1);
+        int i = x + y * dim;
+        RewardAtExpectation &e = slots[i];
+        e.reward = reward;
+        e.atx = x;
+        e.aty = y;
+        e.generation = generation;
+        order[numexp] = i;
+        ++numexp;
+        e.number = numexp;
+        return &e;
     }
-    virtual int check(Goal *g) {
+    int check(Goal *g) const {
         for (int i = 0; i < numexp; ++i) {
-            if (expect[i]->check(g)) {
+            if (slots[order[i]].check(g)) {
                 return 1;
             }
         }
         return 0;
     }
-    virtual void clear() {
-        for (int i = 0; i < numexp; ++i)
-            delete expect[i];
+    void clear() {
+        ++generation;
         numexp = 0;
     }
-    virtual Expectation * at(int x, int y) {
-        for (int i = 0; i < numexp; ++i) {
-            if ((x == expect[i]->get_x()) &&
-                (y == expect[i]->get_y())) {
-                return expect[i];
-            }
-        }
-        return NULL;
+    int size(void) const {
+        return numexp;
+    }
+    const RewardAtExpectation *get(int i) const {
+        return &slots[order[i]];
+    }
+    RewardAtExpectation * at(int x, int y) {
+        if ((x < 0) || (y < 0) || (x >= dim) || (y >= dim)) return NULL;
+        RewardAtExpectation *e = &slots[x + y * dim];
+        return (generation == e->generation) ? e : NULL;
     }
 };
 
@@ -1123,6 +2794,9 @@ public:
     int get_violations(void) {
         return violations;
     }
+    void add_violation(void) {
+        ++violations;
+    }
     int get_resets(void) {
         return resets;
     }
@@ -1131,6 +2805,12 @@ public:
     }
     
     virtual Goal* move(int dir = -1)
+    {
+        return step<0>(dir);
+    }
+
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir = -1)
     {
         RewardAtExpectation* expectation;
         int reward;
@@ -1139,7 +2819,7 @@ public:
         int y;
         
         // 1. Move according to what we have learned
-        Goal* goal = QLearner::move(dir);
+        Goal* goal = QLearner::template step<N>(dir);
         
         // 2. If threshold is -1, we don't do MCL
         if (-1 == threshold) return goal;
@@ -1154,13 +2834,11 @@ public:
             x = goal->get_ox();
             y = goal->get_oy();
         }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() <<": reward = " << reward 
-                 << " at (" << x << "," << y << ") ";
-        }
+        TRACE(verbose && (reward != 0), TRACE_REWARD, get_count(), 
+              reward, x, y);
         
         // 4. Else get reward from goalWhich reward is this?
-        expectation = (RewardAtExpectation *) expectations->at(x, y);
+        expectation = expectations->at(x, y);
         if (expectation == NULL) {
             exp_reward = 0;
         } else {
@@ -1169,23 +2847,22 @@ public:
             } else {
                 exp_reward = expectation->get_reward();
             } 
+            record_expected(exp_reward);
         }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() << ": ";
-            if (expectation == NULL) cout << "No expectation" << endl;
-            else cout << "Expectation of " << expectation->get_reward() << endl;
+        if (reward != 0) {
+            if (expectation == NULL) {
+                TRACE(verbose, TRACE_NO_EXPECTATION, get_count());
+            } else {
+                TRACE(verbose, TRACE_EXPECTATION, get_count(), 
+                      expectation->get_reward());
+            }
         }
         
         // 5. Just store the reward if this is the first time
         if ((NULL == expectation) && (reward != 0))
         {
-            expectation = new RewardAtExpectation(reward, x, y);
-            expectations->add((Expectation*)expectation);
-            if (verbose) {
-                cout << "step " << get_count() << ": " 
-                << "Adding expectation of reward " << reward 
-                << " at (" << x << "," << y << ")" << endl;
-            }
+            expectations->add(reward, x, y);
+            TRACE(verbose, TRACE_EXPECT_ADD, get_count(), reward, x, y);
             return goal;
         }
         
@@ -1194,32 +2871,20 @@ public:
         {
             if (expectation) {
                 violations = 0;
-                if (verbose) {
-                    cout << "step " << get_count() << ": " 
-                    << "Got expected reward of " << reward << " at (" 
-                    << x << "," << y << ") Resetting violations" << endl;
-                }
+                TRACE(verbose, TRACE_EXPECTED, get_count(), reward, x, y);
             }
             return goal;
         }
         
         // 7. Assess: Increment the number of violations
         ++violations;
-        if (verbose) {
-            cout << "step " << get_count() << ": " 
-            << "Got reward of " << reward   
-            << " at (" << x << "," << y << ")" 
-            << " instead of " << exp_reward << endl;
-            cout << "Incremented violations to " << violations << endl;
-        }
+        TRACE(verbose, TRACE_VIOLATION, get_count(), 
+              reward, x, y, exp_reward, violations);
         
         // 8. Guide: If too many, reset the learner
         if (violations >= threshold)
         {
-            if (verbose) {
-                cout << "Resetting, violations (" << violations 
-                << ") >= threshold of " << threshold << endl;    
-            }
+            TRACE(verbose, TRACE_THRESHOLD, get_count(), violations, threshold);
             reset();
             increment_policy();
         }
@@ -1229,9 +2894,8 @@ public:
     }
     
     virtual void reset() {
-        if (verbose) {
-            cout << "step " << get_count() << ": MCLSimple::reset()" << endl;
-        }
+        TRACE(verbose, TRACE_RESET_SIMPLE, get_count());
+        record_suggestion(SUGGEST_RESET);
         violations = 0;
         ++resets;
         expectations->clear();
@@ -1239,6 +2903,47 @@ public:
     
     virtual const char* name(void)    const { return "MCLSimple"; }
     virtual const char* initials(void) const { return "SI"; }
+    virtual int save(Snapshot &s)
+    {
+        // 1. The counters
+        QLearner::save(s);
+        s.put_tag("QLMCLSimple");
+        s.put_int(violations);
+        s.put_int(threshold);
+        s.put_int(start_threshold);
+        s.put_int(resets);
+        
+        // 2. The rewards expected so far
+        s.put_int(expectations->size());
+        for (int i = 0; i < expectations->size(); ++i) {
+            const RewardAtExpectation *e = expectations->get(i);
+            s.put_int(e->get_reward());
+            s.put_int(e->get_x());
+            s.put_int(e->get_y());
+        }
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        // 1. The counters
+        if (!QLearner::load(s) || !s.get_tag("QLMCLSimple")) return 0;
+        violations      = s.get_int();
+        threshold       = s.get_int();
+        start_threshold = s.get_int();
+        resets          = s.get_int();
+        
+        // 2. The rewards expected so far
+        expectations->clear();
+        int knt = s.get_int();
+        if ((knt < 0) || (knt > MAX_EXPECTATIONS)) return 0;
+        for (int i = 0; i < knt; ++i) {
+            int r = s.get_int();
+            int x = s.get_int();
+            int y = s.get_int();
+            expectations->add(r, x, y);
+        }
+        return s.ok();
+    }
     virtual int reinit(void) {
         violations = 0;
         resets = 0;
@@ -1249,448 +2954,341 @@ public:
 };        
 
 // ====================================================================
-//                                                       QLMCLSensitive
-// A grid walker that learns with a modest amount of meta-congnition
+//                                                         MCL pipeline
+// The compare/note/assess/guide cycle of the Sensitive and
+// Sophisticated walkers, as a template over a bundle of policies chosen
+// at compile time, so a step makes no virtual calls after move():
+//   Detector  compares what happened with what was expected, calling
+//             note() on the walker for each anomaly, and returns the
+//             kind of the last one (or PERTURB_NONE)
+//   Assessor  notes the anomalies and decides what to do about them,
+//             and can learn from every reward
+//   Guide     what is done every step
+// The bundle also names the walker and its Reset trace event.  The
+// policies share the reward statistics in MCLCounters.
 // ====================================================================
-class QLMCLSensitive : public QLMCLSimple
+struct MCLCounters
 {
-    int expectedState;
-    int expectedReward;
-    int totalReward;
+    int    expectedState;
+    int    expectedReward;
+    int64_t totalReward;
     double performance;
     double highPerformance;
-    int lastRewardTurn;
+    int64_t lastRewardTurn;     // the step counts of a soak go past an int
     double rewardDistance;
-    int numRewards;
-    int actionNumber;
+    int64_t numRewards;
+    int64_t actionNumber;
     double averageReward;
-    
-public:
-    QLMCLSensitive(Grid *gr = NULL, int th = 3,
-                int sx = LOC_CTR, int sy = LOC_CTR, 
-                double a = 0.5, double g = 0.9, double e = 0.05) 
-    : QLMCLSimple(gr, th, sx, sy, a, g, e)    {
+
+    MCLCounters() : averageReward(0.0) { clear(); }
+
+    // Everything but the average reward starts over
+    void clear(void)
+    {
         expectedState = EXPECTED_STATE_UNKNOWN;
         expectedReward = EXPECTED_REWARD_UNKNOWN;
-        highPerformance = 0.0;
-        performance = 0.0;
         totalReward = 0;
+        performance = 0.0;
+        highPerformance = 0.0;
         lastRewardTurn = 0;
         rewardDistance = 0;
         numRewards = 0;
         actionNumber = 0;
     }
-
-    virtual int reinit(void) {
-        Reset();
-        return QLMCLSimple::reinit();
-    }
-    
-    virtual Goal* move(int dir = -1)
+    void reward(int inReward)
     {
-        RewardAtExpectation* expectation;
-        int reward;
-        int x;
-        int y;
-        
-        // 1. Move according to what we have learned
-        Goal* goal = QLearner::move(dir);
-        
-        // 2. If threshold is -1, we don't do MCL
-        if (-1 == threshold) return goal;
-        
-        // 3. Get reward value and location
-        if (NULL == goal) {
-            reward = 0;
-            x = get_x();
-            y = get_y();
-        } else {
-            reward = goal->get_reward();
-            x = goal->get_ox();
-            y = goal->get_oy();
-        }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() <<": reward = " << reward 
-            << " at (" << x << "," << y << ") ";
-        }
-        
-        // 4. Else get reward from goal?
-        expectation = (RewardAtExpectation *) expectations->at(x, y);
-        if (expectation == NULL) {
-            expectedReward = EXPECTED_REWARD_UNKNOWN;
-        } else {
-            if ((x == get_last_x()) && (y == get_last_y())) {
-                expectedReward = 0;
-            } else {
-                expectedReward = expectation->get_reward();
-            } 
-        }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() << ": ";
-            if (expectation == NULL) cout << "No expectation" << endl;
-            else cout << "Expectation of " << expectedReward << endl;
-        }
-        
-        // 5. Just store the reward if this is the first time
-        if ((NULL == expectation) && (reward != 0))
-        {
-            expectation = new RewardAtExpectation(reward, x, y);
-            expectations->add((Expectation*)expectation);
-            if (verbose) {
-                cout << "step " << get_count() << ": " 
-                << "Adding expectation of reward " << reward 
-                << " at (" << x << "," << y << ")" << endl;
-            }
-            return goal;
-        }
-        
-        // 6. Invoke MCL
-        expectedState = x*100+y;
-        Compare(x*100+y, reward, get_count());
-        
-        // 9. Return this reward, and hope for better days
-        return goal;
+        ++numRewards;
+        totalReward += inReward;
+        lastRewardTurn = actionNumber;
     }
-    
-    void Reset(void)
-    {    
-        if (verbose) {
-            cout << "MCLSensitive::Reset()" << endl;
+    void update(void)
+    {
+        if (numRewards > 0) {
+            rewardDistance = actionNumber / double(numRewards);
+            averageReward = totalReward / double(numRewards);
         }
-        expectations->clear();
-        reset();
-        resets += 1;
-        
-        performance = 0.0;
-        highPerformance = 0.0;
-        totalReward = 0;
-        lastRewardTurn = 0;
-        rewardDistance = 0;
-        numRewards = 0;
-        actionNumber = 0;
-        expectedState = EXPECTED_STATE_UNKNOWN;
-        expectedReward = EXPECTED_REWARD_UNKNOWN;
+        performance = totalReward / double(actionNumber);
     }
-    
-    virtual void Note(int inReward) 
+    void save(Snapshot &s)
     {
-        ++violations;
+        s.put_int(expectedState);
+        s.put_int(expectedReward);
+        s.put_int64(totalReward);
+        s.put_double(performance);
+        s.put_double(highPerformance);
+        s.put_int64(lastRewardTurn);
+        s.put_double(rewardDistance);
+        s.put_int64(numRewards);
+        s.put_int64(actionNumber);
+        s.put_double(averageReward);
     }
-    
-    virtual void Assess(int inType, int inReward)
-    {
-        if (verbose) {
-            cout << "Assess(" << inType << ", " << inReward << ")" << endl;
-            cout << "  averageReward = " << averageReward
-                << ", expectedReward = " << expectedReward << endl;
-        }
-        if (violations > threshold)
-            {
-                if (verbose) {
-                    cout << "Assess: violation (" << violations
-                    << ") > threshold of " << threshold
-                    << ", increment_policy and reset" << endl;
-                }
-                increment_policy();
-                Reset();
-            }
-        
-    } // end Assess
-    
-    virtual void Guide(void)
+    void load(Snapshot &s)
     {
-        decrease_epsilon(0.0003);
+        expectedState   = s.get_int();
+        expectedReward  = s.get_int();
+        totalReward     = s.get_int64();
+        performance     = s.get_double();
+        highPerformance = s.get_double();
+        lastRewardTurn  = s.get_int64();
+        rewardDistance  = s.get_double();
+        numRewards      = s.get_int64();
+        actionNumber    = s.get_int64();
+        averageReward   = s.get_double();
     }
-    
-    virtual void Compare(int inState, int inReward, int inTurn)
+};
+
+// --------------------------------------------------------------------
+//                                                    MCLRewardDetector
+// Three kinds of anomaly: a long time since the last reward, overall
+// performance below 80% of the best, and an unexpected state or reward
+// --------------------------------------------------------------------
+struct MCLRewardDetector
+{
+    template <class W> int detect(W &w, int inState, int inReward)
     {
-        int pType;
-        
-        // 1. Assume that nothing is wrong
-        pType = PERTURB_NONE;
+        MCLCounters &c = w.counters();
+        int pType = PERTURB_NONE;
 
-        // 2. Increase MCL action number and decrement counters
-        ++actionNumber;
-               
-        // 3. Check for Perturbation 1
+        // 1. Check for Perturbation 1
         //    It has been a long time since the last reward
         if (inReward != EXPECTED_REWARD_UNKNOWN)
         {
             if (inReward == 0)
             {
-                if (((actionNumber - lastRewardTurn) > (3 * rewardDistance))
-                    && (actionNumber > MIN_ACTION_NUMBER))
+                if (((c.actionNumber - c.lastRewardTurn) >
+                     (3 * c.rewardDistance))
+                    && (c.actionNumber > MIN_ACTION_NUMBER))
                 {
-                    if (verbose) {
-                        cout << "Perturbation 1: "
-                        << "actionNumber = " << actionNumber
-                        << ", lastRewardTurn = " << lastRewardTurn
-                        << ", rewardDistance = " << rewardDistance
-                        << endl;
-                    }
-                    Note(inReward);
+                    TRACE(w.get_verbose(), TRACE_PERTURB_TTR, w.get_count(),
+                          c.actionNumber, c.lastRewardTurn, c.rewardDistance);
+                    w.note(inReward);
                     pType = PERTURB_TTR;
                 }
             } else {
-                ++numRewards;
-                totalReward += inReward;
-                lastRewardTurn = actionNumber;
+                c.reward(inReward);
             }
         }
-        
-        if (numRewards > 0) {
-            rewardDistance = actionNumber / double(numRewards);
-            averageReward = totalReward / double(numRewards);
-        }
-        
-        performance = totalReward / double(actionNumber);
-        
-        // 4. Check for perturbation 2
+        c.update();
+
+        // 2. Check for perturbation 2
         //    Overall performance has dropped below 80% of high performance
-        if (actionNumber > MIN_ACTION_NUMBER) 
+        if (c.actionNumber > MIN_ACTION_NUMBER)
         {
-            if (performance > highPerformance) 
-                highPerformance = performance;
-            else if ((highPerformance != 0) &&
-                     (performance < (highPerformance * 0.8)))
+            if (c.performance > c.highPerformance)
+                c.highPerformance = c.performance;
+            else if ((c.highPerformance != 0) &&
+                     (c.performance < (c.highPerformance * 0.8)))
             {
-                if (verbose) {
-                    cout << "Perturbation 2: " 
-                    << "actionNumber = " << actionNumber
-                    << ", performance = " << performance
-                    << ", highPerformance = " << highPerformance
-                    << endl;
-                }
-                Note(inReward);
+                TRACE(w.get_verbose(), TRACE_PERTURB_PRF, w.get_count(),
+                      c.actionNumber, c.performance, c.highPerformance);
+                w.note(inReward);
                 pType = PERTURB_PRF;
             }
         }
-        
-        // 5. Perturbation 3 
-        //    Ending up in an unexpected state or with an unexpected rewar
-        if ( ( (expectedState != EXPECTED_STATE_UNKNOWN) &&
-               (expectedReward != EXPECTED_REWARD_UNKNOWN)) && 
-             ( (expectedState != inState) ||
-               (expectedReward != inReward))) {
-            if (actionNumber > MIN_ACTION_NUMBER) {
-                if (verbose) {
-                    cout << "Perturbation 3: " 
-                    << "actionNumber = " << actionNumber
-                    << ", expectedState = " << expectedState
-                    << ", inState = " << inState
-                    << ", expectedReward = " << expectedReward
-                    << ", inReward = " << inReward
-                    << endl;
-                }
-                Note(inReward);
-                pType = PERTURB_EXP;
-            } 
-        }
 
-        // 6. If there has been a perturbation, assess it
-        if (pType != PERTURB_NONE) 
-        {
-            if (verbose) {
-                cout << "Compare(" << inState 
-                << ", " << inReward
-                << ", " << inTurn 
-                << ") = " << pType << endl;
+        // 3. Perturbation 3
+        //    Ending up in an unexpected state or with an unexpected reward
+        if ( ( (c.expectedState != EXPECTED_STATE_UNKNOWN) &&
+               (c.expectedReward != EXPECTED_REWARD_UNKNOWN)) &&
+             ( (c.expectedState != inState) ||
+               (c.expectedReward != inReward))) {
+            if (c.actionNumber > MIN_ACTION_NUMBER) {
+                TRACE(w.get_verbose(), TRACE_PERTURB_EXP, w.get_count(),
+                      c.actionNumber, c.expectedState, inState,
+                      c.expectedReward, inReward);
+                w.note(inReward);
+                pType = PERTURB_EXP;
             }
-            Assess(pType, inReward);
         }
-        
-        // 7. Guide 
-        Guide();
-    }    
-    virtual const char* name(void)    const { return "MCLSensitive"; }
-    virtual const char* initials(void) const { return "SE"; }
-    
+        return pType;
+    }
+    void save(Snapshot &) {}
+    void load(Snapshot &) {}
 };
 
-// ====================================================================
-//                                                   QLMCLSophisticated
-// A grid walker that learns with a modest amount of meta-congnition
-// Based on Visual Basic version: mcl_module3.cls
-// ====================================================================
-class QLMCLSophisticated : public QLMCLSimple
+// --------------------------------------------------------------------
+//                                                    MCLDampedDetector
+// The same anomalies, but the first two are not noted again for 50
+// steps, and the assessor is calmed when the state and reward are the
+// expected ones (or nothing is expected)
+// --------------------------------------------------------------------
+struct MCLDampedDetector
 {
-    int mvarMCL_threshold;
-    int mvarMCL_excitation;
-    int expectedState;
-    int expectedReward;
-    int totalReward;
-    double performance;
-    double highPerformance;
-    int lastRewardTurn;
-    double rewardDistance;
-    int numRewards;
-    int actionNumber;
     int countdown1;
     int countdown2;
-    int lastPerturbation;
-    double degreePerturbation;
-    double averageReward;
-    int negReward;
-    int negRewardSet;
-public:
-    QLMCLSophisticated(Grid *gr = NULL, int th = 3,
-                   int sx = LOC_CTR, int sy = LOC_CTR, 
-                   double a = 0.5, double g = 0.9, double e = 0.05) 
-    : QLMCLSimple(gr, th, sx, sy, a, g, e)
-    {
-        expectedState = EXPECTED_STATE_UNKNOWN;
-        expectedReward = EXPECTED_REWARD_UNKNOWN;
-        mvarMCL_excitation = 0;
-        mvarMCL_threshold = 3;
-        highPerformance = 0.0;
-        performance = 0.0;
-        totalReward = 0;
-        lastRewardTurn = 0;
-        rewardDistance = 0;
-        numRewards = 0;
-        actionNumber = 0;
-        countdown1 = 0;
-        countdown2 = 0;
-        lastPerturbation = 0;
-        degreePerturbation = 0.0;
-        negReward = 0;
-        negRewardSet = 0;
-    }
-    virtual const char* name(void)    const { return "MCLSophisticated"; }
-    virtual const char* initials(void) const { return "SO"; }
-    virtual int reinit(void) {
-        Reset();
-        return QLMCLSimple::reinit();
-    }
 
-    virtual Goal* move(int dir = -1)
+    MCLDampedDetector() : countdown1(0), countdown2(0) {}
+
+    template <class W> int detect(W &w, int inState, int inReward)
     {
-        RewardAtExpectation* expectation;
-        int reward;
-        int x;
-        int y;
-        
-        // 1. Move according to what we have learned
-        Goal* goal = QLearner::move(dir);
-        
-        // 2. If threshold is -1, we don't do MCL
-        if (-1 == threshold) return goal;
-        
-        // 3. Get reward value and location
-        if (NULL == goal) {
-            reward = 0;
-            x = get_x();
-            y = get_y();
-        } else {
-            reward = goal->get_reward();
-            x = goal->get_ox();
-            y = goal->get_oy();
-        }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() <<": reward = " << reward 
-            << " at (" << x << "," << y << ") ";
-        }
-        
-        // 4. Else get reward from goal?
-        expectation = (RewardAtExpectation *) expectations->at(x, y);
-        if (expectation == NULL) {
-            expectedReward = EXPECTED_REWARD_UNKNOWN;
-        } else {
-            if ((x == get_last_x()) && (y == get_last_y())) {
-                expectedReward = 0;
+        MCLCounters &c = w.counters();
+        int pType = PERTURB_NONE;
+
+        // 1. Decrement counters
+        if (countdown1 > 0) --countdown1;
+        if (countdown2 > 0) --countdown2;
+
+        // 2. Check for Perturbation 1
+        //    It has been a long time since the last reward
+        //    (the assignment to countdown1 means that it never is, but
+        //    the results depend on it)
+        if (inReward != EXPECTED_REWARD_UNKNOWN)
+        {
+            if (inReward == 0)
+            {
+                if (((c.actionNumber - c.lastRewardTurn) >
+                     (3 * c.rewardDistance)) &&
+                    (countdown1 = 0) && (c.actionNumber > MIN_ACTION_NUMBER))
+                {
+                    TRACE(w.get_verbose(), TRACE_PERTURB_TTR, w.get_count(),
+                          c.actionNumber, c.lastRewardTurn, c.rewardDistance);
+                    w.note(inReward);
+                    pType = PERTURB_TTR;
+                    countdown1 = 50;
+                }
             } else {
-                expectedReward = expectation->get_reward();
-            } 
-        }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() << ": ";
-            if (expectation == NULL) cout << "No expectation" << endl;
-            else cout << "Expectation of " << expectedReward << endl;
+                c.reward(inReward);
+            }
         }
-        
-        // 5. Just store the reward if this is the first time
-        if ((NULL == expectation) && (reward != 0))
+        c.update();
+
+        // 3. Check for perturbation 2
+        //    Overall performance has dropped below 80% of high performance
+        if (c.actionNumber > MIN_ACTION_NUMBER)
         {
-            expectation = new RewardAtExpectation(reward, x, y);
-            expectations->add((Expectation*)expectation);
-            if (verbose) {
-                cout << "step " << get_count() << ": " 
-                << "Adding expectation of reward " << reward 
-                << " at (" << x << "," << y << ")" << endl;
+            if (c.performance > c.highPerformance)
+                c.highPerformance = c.performance;
+            else if ((c.highPerformance != 0) &&
+                     (c.performance < (c.highPerformance * 0.8)) &&
+                     (countdown2 == 0))
+            {
+                TRACE(w.get_verbose(), TRACE_PERTURB_PRF, w.get_count(),
+                      c.actionNumber, c.performance, c.highPerformance);
+                w.note(inReward);
+                pType = PERTURB_PRF;
+                countdown2 = 50;
             }
-            return goal;
         }
-        
-        // 6. Invoke MCL
-        expectedState = x*100+y;
-        Compare(x*100+y, reward, get_count());
-            
-        // 7. Return this reward, and hope for better days
-        return goal;
-    }
 
-    void Reset(void)
-    {    
-        if (verbose) {
-            cout << "MCLSophisticated::Reset()" << endl;
+        // 4. Perturbation 3
+        //    Ending up in an unexpected state or with an unexpected reward
+        if ((c.expectedState == EXPECTED_STATE_UNKNOWN) ||
+            (c.expectedReward == EXPECTED_REWARD_UNKNOWN)) {
+            w.calm();
+        } else if ((c.expectedState != inState) ||
+                   (c.expectedReward != inReward)) {
+            if (c.actionNumber > MIN_ACTION_NUMBER) {
+                TRACE(w.get_verbose(), TRACE_PERTURB_EXP, w.get_count(),
+                      c.actionNumber, c.expectedState, inState,
+                      c.expectedReward, inReward);
+                w.note(inReward);
+                pType = PERTURB_EXP;
+            }
+        } else {
+            w.calm();
         }
-        expectations->clear();
-        reset();
-        resets += 1;
-
-        mvarMCL_excitation = 0;
-        performance = 0.0;
-        highPerformance = 0.0;
-        totalReward = 0;
-        lastRewardTurn = 0;
-        rewardDistance = 0;
-        numRewards = 0;
-        actionNumber = 0;
-        expectedState = EXPECTED_STATE_UNKNOWN;
-        expectedReward = EXPECTED_REWARD_UNKNOWN;
-        lastPerturbation = 0;
-        degreePerturbation = 0.0;
-        negReward = 0;
-        negRewardSet = 0;
+        return pType;
     }
-    
-    virtual void Note(int inReward) 
+    void save(Snapshot &s)
     {
-        ++mvarMCL_excitation;
-        
-        if (((actionNumber - lastPerturbation) > 300) &&
-            (lastPerturbation != 0))
-        {
-                --mvarMCL_excitation;
-                degreePerturbation -= 0.02;
-                if (degreePerturbation < 0)
-                    degreePerturbation = 0;
-        }
-        
-        lastPerturbation = actionNumber;
-        if (verbose) {
-            cout << "Note: lastPerturbation = " << lastPerturbation
-            << ", degreePerturbation = " << degreePerturbation
-            << ", mvarMCL_excitation = " << mvarMCL_excitation
-            << endl;
-        }
+        s.put_int(countdown1);
+        s.put_int(countdown2);
     }
-
-    virtual void Assess(int inType, int inReward)
+    void load(Snapshot &s)
     {
-        if (verbose) {
-            cout << "Assess(" << inType << ", " << inReward << ")" << endl;
-            cout << "  neg/avg/exp/Reward = " << negReward 
-                 << "/" << averageReward
-                << "/" << expectedReward << endl;
+        countdown1 = s.get_int();
+        countdown2 = s.get_int();
+    }
+};
+
+// --------------------------------------------------------------------
+//                                                 MCLViolationAssessor
+// Count the anomalies as violations, and start over with a new policy
+// when there are more than the walker's threshold
+// --------------------------------------------------------------------
+struct MCLViolationAssessor
+{
+    template <class W> void note(W &w, int)
+    {
+        w.add_violation();
+    }
+
+    template <class W> void assess(W &w, int inType, int inReward)
+    {
+        // (Only traced, so unused under CHIPPY_NO_TRACE)
+        (void) inType;
+        (void) inReward;
+        TRACE(w.get_verbose(), TRACE_ASSESS, w.get_count(),
+              inType, inReward, w.counters().averageReward, 
+              w.counters().expectedReward);
+        if (w.get_violations() > w.get_threshold())
+        {
+            TRACE(w.get_verbose(), TRACE_ASSESS_VIOLATION, w.get_count(),
+                  w.get_violations(), w.get_threshold());
+            w.increment_policy();
+            w.Reset();
+        }
+    }
+
+    template <class W> void learn(W &, int) {}
+    void calm(void)  {}
+    void clear(void) {}
+    void save(Snapshot &) {}
+    void load(Snapshot &) {}
+};
+
+// --------------------------------------------------------------------
+//                                                    MCLDegreeAssessor
+// Weigh each anomaly by how far the reward is from what was expected
+// (more so once a negative reward has been seen), exploring more as
+// the degree of perturbation grows.  A new policy when the degree is
+// over 7, and a Reset when the excitation reaches the threshold.
+// Based on Visual Basic version: mcl_module3.cls
+// --------------------------------------------------------------------
+struct MCLDegreeAssessor
+{
+    int    mvarMCL_threshold;
+    int    mvarMCL_excitation;
+    int64_t lastPerturbation;
+    double degreePerturbation;
+    int    negReward;
+    int    negRewardSet;
+
+    MCLDegreeAssessor() : mvarMCL_threshold(3) { clear(); }
+
+    template <class W> void note(W &w, int)
+    {
+        MCLCounters &c = w.counters();
+        ++mvarMCL_excitation;
+
+        if (((c.actionNumber - lastPerturbation) > 300) &&
+            (lastPerturbation != 0))
+        {
+                --mvarMCL_excitation;
+                degreePerturbation -= 0.02;
+                if (degreePerturbation < 0)
+                    degreePerturbation = 0;
         }
+
+        lastPerturbation = c.actionNumber;
+        TRACE(w.get_verbose(), TRACE_NOTE, w.get_count(),
+              lastPerturbation, degreePerturbation, mvarMCL_excitation);
+    }
+
+    template <class W> void assess(W &w, int inType, int inReward)
+    {
+        MCLCounters &c = w.counters();
+        int    expectedReward = c.expectedReward;
+        double averageReward  = c.averageReward;
+        TRACE(w.get_verbose(), TRACE_ASSESS_NEG, w.get_count(), inType,
+              inReward, negReward, averageReward, expectedReward);
         if (negReward)
         {
             switch(inType)
             {
                 case PERTURB_TTR:
-                case PERTURB_PRF:    
-                    increase_epsilon(0.2);
+                case PERTURB_PRF:
+                    w.increase_epsilon(0.2);
                     degreePerturbation += 2;
                     break;
                 case PERTURB_EXP:
@@ -1698,61 +3296,55 @@ public:
                         (inReward > 0)) // valence change - to +
                     {
                         if (inReward > averageReward) {
-                            degreePerturbation += 8;       
+                            degreePerturbation += 8;
                         } else {
-                            increase_epsilon(0.3);
+                            w.increase_epsilon(0.3);
                             degreePerturbation += 3;
                         }
                     } else if ((expectedReward > 0) &&
                         (inReward < 0)) // valence change + to -
                     {
                         if (expectedReward > averageReward) {
-                            increase_epsilon(0.3);
+                            w.increase_epsilon(0.3);
                             degreePerturbation += 3;
                         } else {
-                            increase_epsilon(0.2);
+                            w.increase_epsilon(0.2);
                             degreePerturbation += 2;
                         }
                     } else { // both rewards positive
-                        if ((expectedReward > averageReward) && 
+                        if ((expectedReward > averageReward) &&
                             (expectedReward > inReward)) {
                             if ((double(inReward) / double(expectedReward)) < 0.75) {
-                                increase_epsilon(0.3);
+                                w.increase_epsilon(0.3);
                                 degreePerturbation += 3;
                             } else {
-                                increase_epsilon(0.1);
+                                w.increase_epsilon(0.1);
                                 degreePerturbation += 1;
-                            }  
+                            }
                         } else {
-                            increase_epsilon(0.1);
+                            w.increase_epsilon(0.1);
                             degreePerturbation += 1;
                         }
                     }
-                    break;    
+                    break;
             } // end switch
             if (degreePerturbation > 7)
             {
-                if (verbose) {
-                    cout << "Assess: negReward - degreePerturbation > 7"
-                    << ", increment_policy and reset" << endl;
-                }
-                increment_policy();
-                Reset();
+                TRACE(w.get_verbose(), TRACE_DEGREE_NEG, w.get_count());
+                w.increment_policy();
+                w.Reset();
             }
             if (mvarMCL_excitation >= mvarMCL_threshold)
             {
-                if (verbose) cout << "excitation ("
-                    << mvarMCL_excitation 
-                    << ") > threshold ("
-                    << mvarMCL_threshold
-                    << "), reset" << endl;
-                Reset();
+                TRACE(w.get_verbose(), TRACE_EXCITATION, w.get_count(),
+                      mvarMCL_excitation, mvarMCL_threshold);
+                w.Reset();
             }
         } else { // end if (negReward)
             switch(inType)
             {
                 case PERTURB_TTR:
-                case PERTURB_PRF:    
+                case PERTURB_PRF:
                     degreePerturbation += 2;
                     break;
                 case PERTURB_EXP:
@@ -1770,290 +3362,167 @@ public:
                             degreePerturbation += 2;
                         }
                     } else { // both rewards positive
-                        if ((expectedReward > averageReward) && 
-                            (expectedReward > inReward)) 
+                        if ((expectedReward > averageReward) &&
+                            (expectedReward > inReward))
                         {
                             if ((double(inReward) / double(expectedReward)) < 0.75) {
                                 degreePerturbation += 3;
                             } else {
                                 degreePerturbation += 1;
-                            }  
+                            }
                         } else {
                             degreePerturbation += 1;
                         }
                     }
-                    break;    
+                    break;
             } // end switch
             if (degreePerturbation > 7)
             {
-                if (verbose) {
-                    cout << "Assess: !negReward - degreePerturbation > 7"
-                    << ", increment_policy and reset" << endl;
-                }
-                increment_policy();
-                Reset();
+                TRACE(w.get_verbose(), TRACE_DEGREE_POS, w.get_count());
+                w.increment_policy();
+                w.Reset();
             }
             if (mvarMCL_excitation >= mvarMCL_threshold)
             {
-                increase_epsilon(double(degreePerturbation) / 10.0);
-                Reset();
+                w.increase_epsilon(double(degreePerturbation) / 10.0);
+                w.Reset();
             }
         } // end else (negReward)
-        if (verbose) {
-            cout << "Assess: degreePerturbation = " << degreePerturbation
-            << ", MCL_excitation = " << mvarMCL_excitation << endl;
-        }
-    } // end Assess
+        TRACE(w.get_verbose(), TRACE_DEGREE, w.get_count(),
+              degreePerturbation, mvarMCL_excitation);
+    } // end assess
 
-    virtual void Guide(void)
-    {
-        decrease_epsilon(0.0003);
-    }
-        
-    virtual void Compare(int inState, int inReward, int inTurn)
+    // Remember valiance of reward
+    template <class W> void learn(W &w, int inReward)
     {
-        int pType;
-        
-        // 1. Assume that nothing is wrong
-        pType = PERTURB_NONE;
-        
-        // 2. Increase MCL action number and decrement counters
-        ++actionNumber;
-        if (countdown1 > 0) --countdown1;
-        if (countdown2 > 0) --countdown2;
-                
-        // 3. Check for Perturbation 1
-        //    It has been a long time since the last reward
-        if (inReward != EXPECTED_REWARD_UNKNOWN)
-        {
-            if (inReward == 0)
-            {
-                if (((actionNumber - lastRewardTurn) > (3 * rewardDistance)) &&
-                    (countdown1 = 0) && (actionNumber > MIN_ACTION_NUMBER))
-                {
-                    if (verbose) {
-                        cout << "Perturbation 1: "
-                        << "actionNumber = " << actionNumber
-                        << ", lastRewardTurn = " << lastRewardTurn
-                        << ", rewardDistance = " << rewardDistance
-                        << endl;
-                    }
-                    Note(inReward);
-                        pType = PERTURB_TTR;
-                        countdown1 = 50;
-                }
-            } else {
-                ++numRewards;
-                totalReward += inReward;
-                lastRewardTurn = actionNumber;
-            }
-        }
-        
-        if (numRewards > 0) {
-            rewardDistance = actionNumber / double(numRewards);
-            averageReward = totalReward / double(numRewards);
-        }
-        
-        performance = totalReward / double(actionNumber);
-        
-        // 4. Check for perturbation 2
-        //    Overall performance has dropped below 80% of high performance
-        if (actionNumber > MIN_ACTION_NUMBER) 
-        {
-            if (performance > highPerformance) 
-                highPerformance = performance;
-            else if ((highPerformance != 0) &&
-                     (performance < (highPerformance * 0.8)) &&
-                     (countdown2 == 0))
-            {
-                if (verbose) {
-                    cout << "Perturbation 2: " 
-                    << "actionNumber = " << actionNumber
-                    << ", performance = " << performance
-                    << ", highPerformance = " << highPerformance
-                    << endl;
-                }
-                Note(inReward);
-                pType = PERTURB_PRF;
-                countdown2 = 50;
-            }
-        }
-        
-        // 5. Perturbation 3 
-        //    Ending up in an unexpected state or with an unexpected reward
-        if ((expectedState == EXPECTED_STATE_UNKNOWN) ||
-            (expectedReward == EXPECTED_REWARD_UNKNOWN)) {
-            if (mvarMCL_excitation < 0) mvarMCL_excitation = 0;
-        } else if ((expectedState != inState) ||
-                   (expectedReward != inReward)) {
-            if (actionNumber > MIN_ACTION_NUMBER) {
-                if (verbose) {
-                    cout << "Perturbation 3: "
-                    << "actionNumber = " << actionNumber
-                    << ", expectedState = " << expectedState
-                    << ", inState = " << inState
-                    << ", expectedReward = " << expectedReward
-                    << ", inReward = " << inReward
-                    << endl;
-                }
-                Note(inReward);
-                pType = PERTURB_EXP;
-            } 
-        } else {
-            if (mvarMCL_excitation < 0) mvarMCL_excitation = 0;
-        }
-        
-        // 6. If there has been a perturbation, assess it
-        if (pType != PERTURB_NONE) 
-        {
-            if (verbose) {
-                cout << "Compare(" << inState 
-                << ", " << inReward
-                << ", " << inTurn 
-                << ") = " << pType << endl;
-            }
-            Assess(pType, inReward);
-        }
-        
-        // 7. Guide 
-        Guide();
-        
-        // 8. Remember valiance of reward
         if (!negRewardSet)
         {
-            if ((inReward < 0) && 
+            if ((inReward < 0) &&
                 (inReward != EXPECTED_REWARD_UNKNOWN))
                 {
                     negReward = 1;
                     negRewardSet = 1;
                 }
-            if (actionNumber > MIN_ACTION_NUMBER)
+            if (w.counters().actionNumber > MIN_ACTION_NUMBER)
             {
                 negRewardSet = 1;
             }
         }
     }
+
+    void calm(void)
+    {
+        if (mvarMCL_excitation < 0) mvarMCL_excitation = 0;
+    }
+    void clear(void)
+    {
+        mvarMCL_excitation = 0;
+        lastPerturbation = 0;
+        degreePerturbation = 0.0;
+        negReward = 0;
+        negRewardSet = 0;
+    }
+    void save(Snapshot &s)
+    {
+        s.put_int(mvarMCL_threshold);
+        s.put_int(mvarMCL_excitation);
+        s.put_int64(lastPerturbation);
+        s.put_double(degreePerturbation);
+        s.put_int(negReward);
+        s.put_int(negRewardSet);
+    }
+    void load(Snapshot &s)
+    {
+        mvarMCL_threshold  = s.get_int();
+        mvarMCL_excitation = s.get_int();
+        lastPerturbation   = s.get_int64();
+        degreePerturbation = s.get_double();
+        negReward          = s.get_int();
+        negRewardSet       = s.get_int();
+    }
+};
+
+// --------------------------------------------------------------------
+//                                                        MCLDecayGuide
+// Explore a little less every step
+// --------------------------------------------------------------------
+struct MCLDecayGuide
+{
+    template <class W> void guide(W &w)
+    {
+        w.decrease_epsilon(0.0003);
+    }
 };
 
 // ====================================================================
-//                                                          QLMCLBayes1
-// A grid walker that learns with a modest amount of meta-congnition
+//                                                        QLMCLPipeline
+// A grid walker that learns with the meta-congnition of policy
+// bundle P (see MCL pipeline)
 // ====================================================================
-class QLMCLBayes1 : public QLMCLSimple
+template <class P>
+class QLMCLPipeline : public QLMCLSimple
 {
-    double sensors[10];
-    int    expected[5];
-#ifdef USEMCL2
-    mclMA::observables::update _update;
-    string mcl_key;
-#endif
+    MCLCounters           c;
+    typename P::Detector  detector;
+    typename P::Assessor  assessor;
+    typename P::Guide     guidance;
+
 public:
-    QLMCLBayes1(Grid *gr = NULL, int th = 3,
-                   int sx = LOC_CTR, int sy = LOC_CTR, 
-                   double a = 0.5, double g = 0.9, double e = 0.05) 
+    QLMCLPipeline(Grid *gr = NULL, int th = 3,
+                  int sx = LOC_CTR, int sy = LOC_CTR,
+                  double a = 0.5, double g = 0.9, double e = 0.05)
     : QLMCLSimple(gr, th, sx, sy, a, g, e)
     {
-
-#ifdef USEMCL2
-        // 1. Introduce ourselves to MCL
-        mcl_key = "QLMCLBayes1";
-        mclMA::setOutput("QLMCLBayes1.html");
-        mclMA::initializeMCL(mcl_key, 0); 
-        
-        // 2. Define properties
-        mclMA::setPropertyDefault(mcl_key, PCI_INTENTIONAL,         PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_EFFECTORS_CAN_FAIL,  PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_SENSORS_CAN_FAIL,    PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_PARAMETERIZED,       PC_YES);
-        mclMA::setPropertyDefault(mcl_key, PCI_DECLARATIVE,         PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_RETRAINABLE,         PC_YES);
-        mclMA::setPropertyDefault(mcl_key, PCI_HLC_CONTROLLING,     PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_HTN_IN_PLAY,         PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_PLAN_IN_PLAY,        PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_ACTION_IN_PLAY,      PC_NO);
-        
-        mclMA::setPropertyDefault(mcl_key, CRC_IGNORE,              PC_YES);
-        mclMA::setPropertyDefault(mcl_key, CRC_NOOP,                PC_YES);
-        mclMA::setPropertyDefault(mcl_key, CRC_TRY_AGAIN,           PC_YES);
-        mclMA::setPropertyDefault(mcl_key, CRC_SOLICIT_HELP,        PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_RELINQUISH_CONTROL,  PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_SENSOR_DIAG,         PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_EFFECTOR_DIAG,       PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_ACTIVATE_LEARNING,   PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_ADJ_PARAMS,          PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_REBUILD_MODELS,      PC_YES);
-        mclMA::setPropertyDefault(mcl_key, CRC_REVISIT_ASSUMPTIONS, PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_AMEND_CONTROLLER,    PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_REVISE_EXPECTATIONS, PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_ALG_SWAP,            PC_NO); 
-        mclMA::setPropertyDefault(mcl_key, CRC_CHANGE_HLC,          PC_NO);
-        
-        // 3. Define the sensors and property values
-        mclMA::observables::declare_observable_self(mcl_key, "step",    0.0);     // [0]
-        mclMA::observables::declare_observable_self(mcl_key, "reward",  0.0);   // [1]
-        mclMA::observables::declare_observable_self(mcl_key, "expect1", 0.0);  // [2]
-        mclMA::observables::declare_observable_self(mcl_key, "expect2", 0.0);  // [3]
-        mclMA::observables::declare_observable_self(mcl_key, "expect3", 0.0);  // [4]
-        mclMA::observables::declare_observable_self(mcl_key, "expect4", 0.0);  // [5]
-        
-        // 4. Define the property values for the sensors
-        mclMA::observables::set_obs_prop_self(mcl_key, "step",     
-                             PROP_DT, DT_INTEGER); // [0]
-        mclMA::observables::set_obs_prop_self(mcl_key, "reward",   
-                             PROP_DT, DT_INTEGER); // [1]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect1",  
-                             PROP_DT, DT_INTEGER); // [2]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect2",  
-                             PROP_DT, DT_INTEGER); // [3]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect3",  
-                             PROP_DT, DT_INTEGER); // [4]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect4",  
-                             PROP_DT, DT_INTEGER); // [5]
-        
-        mclMA::observables::set_obs_prop_self(mcl_key, "step",     
-                             PROP_SCLASS, SC_TEMPORAL); // [0]
-        mclMA::observables::set_obs_prop_self(mcl_key, "reward",  
-                             PROP_SCLASS, SC_REWARD);   // [1] 
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect1", 
-                             PROP_SCLASS, SC_REWARD);   // [2]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect2", 
-                             PROP_SCLASS, SC_REWARD);   // [3]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect3", 
-                             PROP_SCLASS, SC_REWARD);   // [4]
-        mclMA::observables::set_obs_prop_self(mcl_key, "expect4",  
-                             PROP_SCLASS, SC_REWARD);   // [5]
-        
-        // 5. Define the expectation group.  
-        //    We will add the expectations when we get the rewards.
-        mclMA::declareExpectationGroup(mcl_key, EGK);
-#endif
-        sensors[0] = 0;
     }
-    
-    virtual const char* name(void)    const { return "MCLBayes1"; }
-    virtual const char* initials(void) const { return "B1"; }
 
-#ifdef USEMCL2
-    ~QLMCLBayes1()
+    virtual const char* name(void)    const { return P::name(); }
+    virtual const char* initials(void) const { return P::initials(); }
+    virtual int save(Snapshot &s)
     {
-        mclMA::releaseMCL(mcl_key);
+        QLMCLSimple::save(s);
+        s.put_tag(P::tag());
+        c.save(s);
+        detector.save(s);
+        assessor.save(s);
+        return s.ok();
     }
-    
+    virtual int load(Snapshot &s)
+    {
+        if (!QLMCLSimple::load(s) || !s.get_tag(P::tag())) return 0;
+        c.load(s);
+        detector.load(s);
+        assessor.load(s);
+        return s.ok();
+    }
+    virtual int reinit(void) {
+        Reset();
+        return QLMCLSimple::reinit();
+    }
+
+    // For the policies
+    MCLCounters& counters(void) { return c; }
+    void note(int inReward)     { assessor.note(*this, inReward); }
+    void calm(void)             { assessor.calm(); }
+
     virtual Goal* move(int dir = -1)
     {
-        int reward;
-        int expectedReward;
-        int expectedNumber;
+        return step<0>(dir);
+    }
+
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir = -1)
+    {
         RewardAtExpectation* expectation;
+        int reward;
         int x;
         int y;
-        
+
         // 1. Move according to what we have learned
-        Goal* goal = QLearner::move(dir);
-        
+        Goal* goal = QLearner::template step<N>(dir);
+
         // 2. If threshold is -1, we don't do MCL
         if (-1 == threshold) return goal;
-        
+
         // 3. Get reward value and location
         if (NULL == goal) {
             reward = 0;
@@ -2064,228 +3533,862 @@ public:
             x = goal->get_ox();
             y = goal->get_oy();
         }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() <<": reward = " << reward 
-            << " at (" << x << "," << y << ") " << endl;
-        }
-        
-        // 4. What was our expected reward?
-        expectation = (RewardAtExpectation *) expectations->at(x, y);
+        TRACE(verbose && (reward != 0), TRACE_REWARD, get_count(),
+              reward, x, y);
+
+        // 4. Else get reward from goal?
+        expectation = expectations->at(x, y);
         if (expectation == NULL) {
-            expectedReward = EXPECTED_REWARD_UNKNOWN;
-            expectedNumber = 0;
+            c.expectedReward = EXPECTED_REWARD_UNKNOWN;
         } else {
             if ((x == get_last_x()) && (y == get_last_y())) {
-                expectedReward = 0;
-                expectedNumber = 0;
+                c.expectedReward = 0;
             } else {
-                expectedReward = expectation->get_reward();
-                expectedNumber = expectation->get_number();
-            } 
-        }
-        if (verbose && (reward != 0)) {
-            cout << "step " << get_count() << ": ";
-            if (expectation == NULL) cout << "No expectation" << endl;
-            else cout << "Expectation of " << expectedReward << endl;
+                c.expectedReward = expectation->get_reward();
+            }
+            record_expected(c.expectedReward);
         }
-        
-        // 5. Just store the reward if this is the first time
-        if ((NULL == expectation) && (reward != 0)) {
-            char sensor_name[15];
-            expectation = new RewardAtExpectation(reward, x, y);
-            expectations->add((Expectation*)expectation);
-            sprintf(sensor_name, "expect%d", expectation->get_number());
-            expectedNumber = expectation->get_number();
-            if (verbose) {
-                cout << "step " << get_count() << ": " 
-                << "Added expectation of reward " << reward 
-                << " at (" << x << "," << y << ")" 
-                << " named " << sensor_name  
-                << " number " << expectedNumber << endl;
+        if (reward != 0) {
+            if (expectation == NULL) {
+                TRACE(verbose, TRACE_NO_EXPECTATION, get_count());
+            } else {
+                TRACE(verbose, TRACE_EXPECTATION, get_count(),
+                      c.expectedReward);
             }
-            expected[expectation->get_number()] = reward;
-            mclMA::declareExpectation(mcl_key, EGK, 
-                                       sensor_name, 
-                                       EC_MAINTAINVALUE, 
-                                       (float) reward);
         }
-        
-        // 6. Set values in update object
-        sensors[0] = get_count();
-        sensors[1] = reward;
-        sensors[2] = expected[1];
-        sensors[3] = expected[2];
-        sensors[4] = expected[3];
-        sensors[5] = expected[4];
-        if (expectedNumber > 0) {
-            sensors[1+expectedNumber] = reward;
+
+        // 5. Just store the reward if this is the first time
+        if ((NULL == expectation) && (reward != 0))
+        {
+            expectations->add(reward, x, y);
+            TRACE(verbose, TRACE_EXPECT_ADD, get_count(), reward, x, y);
+            return goal;
         }
-        _update.set_update("step",    sensors[0]);
-        _update.set_update("reward",  sensors[1]);
-        _update.set_update("expect1", sensors[2]);
-        _update.set_update("expect2", sensors[3]);
-        _update.set_update("expect3", sensors[4]);
-        _update.set_update("expect4", sensors[5]);
 
-        // 7. Tell MCL what we know
-        responseVector rv = mclMA::monitor(mcl_key, _update);
-        
-        // 8. Evaluate the suggestions from MCL
-        processSuggestions(rv);
-        
-        // 9. Return the goal
+        // 6. Invoke MCL
+        c.expectedState = x*100+y;
+        Compare(x*100+y, reward, get_count());
+
+        // 7. Return this reward, and hope for better days
         return goal;
     }
-    
-    void processSuggestions(responseVector& m) {
-        if (m.size() > 0) {
-            for (responseVector::iterator rvi = m.begin();
-                 rvi!=m.end();
-                 rvi++) {
-                mclMonitorResponse *r = (mclMonitorResponse *)(*rvi);
-                if (verbose) {
-                    cout << "step " << get_count()
-                         << ": " << r->rclass();
-                    if (r->requiresAction()) cout << " Action";
-                    if (r->recommendAbort()) cout << " Abort";
-                    cout << " " << r->responseText() << endl;
-                    cout << "step " << get_count() << ": ";
-                }
-                processSuggestion(r);
-            } // end for
-        } else {
-            decrease_epsilon(0.0003);
-        }// end if
-    } // end processSuggestions
 
-    void processSuggestion(mclMonitorResponse *r) {
-        if (r->rclass() == "internalError") 
-            processSuggestionInternalError((mclInternalErrorResponse*)r);
-        else if (r->rclass() == "noAnomalies")
-            processSuggestionOK((mclMonitorOKResponse*)r);
-        else if (r->rclass() == "noOperation")
-            processSuggestionNOOP((mclMonitorNOOPResponse*)r);
-        else if (r->rclass() == "suggestion")
-            processSuggestionCorrective((mclMonitorCorrectiveResponse*)r);
-        else {
-            if (verbose) 
-                cout << "Unknown MCL monitor response ("
-                     << r->rclass() << ")" << endl;
+    void Reset(void)
+    {
+        TRACE(verbose, P::reset_trace, get_count());
+        expectations->clear();
+        reset();
+        resets += 1;
+        c.clear();
+        assessor.clear();
+    }
+
+    void Compare(int inState, int inReward, int64_t inTurn)
+    {
+        // 1. Increase MCL action number and look for perturbations
+        //    (the turn is only traced)
+        (void) inTurn;
+        ++c.actionNumber;
+        int pType = detector.detect(*this, inState, inReward);
+
+        // 2. If there has been a perturbation, assess it
+        if (pType != PERTURB_NONE)
+        {
+            TRACE(verbose, TRACE_COMPARE, get_count(),
+                  inState, inReward, inTurn, pType);
+            assessor.assess(*this, pType, inReward);
         }
-    } // end processSuggestion
 
-    void processSuggestionInternalError(mclInternalErrorResponse* r)
+        // 3. Guide
+        guidance.guide(*this);
+
+        // 4. Let the assessor learn from the reward
+        assessor.learn(*this, inReward);
+    }
+};
+
+// ====================================================================
+//                                                       QLMCLSensitive
+// A grid walker that learns with a modest amount of meta-congnition
+// ====================================================================
+struct MCLSensitivePolicies
+{
+    typedef MCLRewardDetector    Detector;
+    typedef MCLViolationAssessor Assessor;
+    typedef MCLDecayGuide        Guide;
+    static const char* name(void)     { return "MCLSensitive"; }
+    static const char* initials(void) { return "SE"; }
+    static const char* tag(void)      { return "QLMCLSensitive"; }
+    enum { reset_trace = TRACE_RESET_SENSITIVE };
+};
+typedef QLMCLPipeline<MCLSensitivePolicies> QLMCLSensitive;
+
+// ====================================================================
+//                                                   QLMCLSophisticated
+// A grid walker that learns with a modest amount of meta-congnition
+// Based on Visual Basic version: mcl_module3.cls
+// ====================================================================
+struct MCLSophisticatedPolicies
+{
+    typedef MCLDampedDetector    Detector;
+    typedef MCLDegreeAssessor    Assessor;
+    typedef MCLDecayGuide        Guide;
+    static const char* name(void)     { return "MCLSophisticated"; }
+    static const char* initials(void) { return "SO"; }
+    static const char* tag(void)      { return "QLMCLSophisticated"; }
+    enum { reset_trace = TRACE_RESET_SOPHISTICATED };
+};
+typedef QLMCLPipeline<MCLSophisticatedPolicies> QLMCLSophisticated;
+
+// ====================================================================
+//                                                            Local MCL
+// In-process stand-in for the part of the MCL multiagent API that the
+// Bayes walkers use, for builds where mcl_multiagent_api.h is not
+// available (compile with CHIPPY_LOCAL_MCL as well as USEMCL2).  The
+// table of agents grows with the walkers alive at once.  Each agent
+// has fixed tables of properties, observables and expectation groups, and the responses that monitor() returns live in the agent,
+// so a monitor call allocates nothing.  A violated expectation gets a
+// single corrective response.  The correction is picked from a ladder
+// (ACTIVATE_LEARNING, REBUILD_MODELS, REVISE_EXPECTATIONS) limited to
+// the corrections the agent allows.  A failed correction moves up the
+// ladder straight away.  An implemented one has MCL_SETTLE steps to
+// take effect, and the agent only answers noOperation during that
+// time.  After MCL_SETTLE quiet steps the agent starts again at the
+// bottom of the ladder.  Steps are the walker's step count when it
+// gives one, else are read from the agent's first SC_TEMPORAL
+// observable (or are its monitor calls if it has none), so a walker
+// that monitors less often than every step gets the same settling
+// time.  No HTML is written.
+// ====================================================================
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+#define MCL_AGENT_ROOM       64   // agents the table starts with
+#define MCL_MAX_OBSERVABLES  16
+#define MCL_MAX_GROUPS       4
+#define MCL_MAX_EXPECTATIONS 16
+#define MCL_MAX_RESPONSES    4
+#define MCL_NAME_SIZE        16
+#define MCL_SETTLE           100
+
+// Properties: the PCI_ codes describe the host, the CRC_ codes say
+// which corrections the host is willing to make
+enum {
+    PCI_INTENTIONAL, PCI_EFFECTORS_CAN_FAIL, PCI_SENSORS_CAN_FAIL,
+    PCI_PARAMETERIZED, PCI_DECLARATIVE, PCI_RETRAINABLE,
+    PCI_HLC_CONTROLLING, PCI_HTN_IN_PLAY, PCI_PLAN_IN_PLAY,
+    PCI_ACTION_IN_PLAY,
+    CRC_IGNORE, CRC_NOOP, CRC_TRY_AGAIN, CRC_SOLICIT_HELP,
+    CRC_RELINQUISH_CONTROL, CRC_SENSOR_DIAG, CRC_EFFECTOR_DIAG,
+    CRC_ACTIVATE_LEARNING, CRC_ADJ_PARAMS, CRC_REBUILD_MODELS,
+    CRC_REVISIT_ASSUMPTIONS, CRC_AMEND_CONTROLLER,
+    CRC_REVISE_EXPECTATIONS, CRC_ALG_SWAP, CRC_CHANGE_HLC,
+    MCL_PROPERTIES
+};
+enum { PC_NO, PC_YES };
+enum { PROP_DT, PROP_SCLASS };
+enum { DT_INTEGER, DT_RATIONAL };
+enum { SC_TEMPORAL, SC_REWARD };
+enum { EC_MAINTAINVALUE, EC_STAYOVER, EC_STAYUNDER };
+
+static const int mcl_ladder[] = {
+    CRC_ACTIVATE_LEARNING, CRC_REBUILD_MODELS, CRC_REVISE_EXPECTATIONS
+};
+#define MCL_LADDER (int)(sizeof(mcl_ladder) / sizeof(mcl_ladder[0]))
+
+static const string mcl_class_error("internalError");
+static const string mcl_class_ok("noAnomalies");
+static const string mcl_class_noop("noOperation");
+static const string mcl_class_suggestion("suggestion");
+
+static const char* mcl_correction_text(int code)
+{
+    switch (code) {
+        case CRC_IGNORE:              return "ignore the anomaly";
+        case CRC_NOOP:                return "do nothing";
+        case CRC_TRY_AGAIN:           return "try again";
+        case CRC_ACTIVATE_LEARNING:   return "activate learning";
+        case CRC_REVISE_EXPECTATIONS: return "revise expectations";
+        case CRC_REBUILD_MODELS:      return "rebuild models";
+        default:                      return "unknown correction";
+    }
+}
+
+class mclMonitorResponse
+{
+protected:
+    const string *cls;
+    const char   *text;
+    int           code;
+    int           ref;
+    bool          action;
+
+public:
+    mclMonitorResponse(const string &c, const char *t)
+    : cls(&c), text(t), code(CRC_NOOP), ref(0), action(false) {}
+
+    const string& rclass(void)       const { return *cls; }
+    const char*   responseText(void) const { return text; }
+    int           responseCode(void) const { return code; }
+    int           referenceCode(void) const { return ref; }
+    bool          requiresAction(void) const { return action; }
+    bool          recommendAbort(void) const { return false; }
+};
+
+class mclInternalErrorResponse : public mclMonitorResponse
+{
+public:
+    mclInternalErrorResponse()
+    : mclMonitorResponse(mcl_class_error, "no such MCL agent") {}
+};
+
+class mclMonitorOKResponse : public mclMonitorResponse
+{
+public:
+    mclMonitorOKResponse()
+    : mclMonitorResponse(mcl_class_ok, "no anomalies") {}
+};
+
+class mclMonitorNOOPResponse : public mclMonitorResponse
+{
+public:
+    mclMonitorNOOPResponse()
+    : mclMonitorResponse(mcl_class_noop, "waiting for the last correction") {}
+};
+
+class mclMonitorCorrectiveResponse : public mclMonitorResponse
+{
+public:
+    mclMonitorCorrectiveResponse()
+    : mclMonitorResponse(mcl_class_suggestion, "") {}
+
+    void suggest(int c, int r)
     {
-        if (verbose)
-            cout << "mclInternalErrorResponse" << endl;
-    } // end processSuggestionInternalError 
+        code   = c;
+        ref    = r;
+        text   = mcl_correction_text(c);
+        action = (c != CRC_IGNORE) && (c != CRC_NOOP);
+    }
+};
 
-    void processSuggestionOK(mclMonitorOKResponse* r)
+// A fixed size list of response pointers, returned by value
+class responseVector
+{
+    mclMonitorResponse *items[MCL_MAX_RESPONSES];
+    size_t              n;
+
+public:
+    typedef mclMonitorResponse** iterator;
+
+    responseVector() : n(0) {}
+
+    void push_back(mclMonitorResponse *r)
     {
-        if (verbose)
-            cout << "mclMonitorOKResponse" << endl;
-    } // end processSuggestionOK 
+        if (n < MCL_MAX_RESPONSES) items[n++] = r;
+    }
+    size_t   size(void) const { return n; }
+    iterator begin(void)      { return items; }
+    iterator end(void)        { return items + n; }
+};
 
-    void processSuggestionNOOP(mclMonitorNOOPResponse* r)
+struct mclObservable {
+    char   name[MCL_NAME_SIZE];
+    double value;
+    int    dt;
+    int    sclass;
+};
+
+struct mclExpectation {
+    int   obs;
+    int   code;
+    float value;
+};
+
+struct mclGroup {
+    bool           used;
+    int            key;
+    int            n;
+    mclExpectation exp[MCL_MAX_EXPECTATIONS];
+};
+
+struct mclAgent {
+    bool          used;
+    string        key;
+    int           props[MCL_PROPERTIES];
+    int           nobs;
+    mclObservable obs[MCL_MAX_OBSERVABLES];
+    mclGroup      groups[MCL_MAX_GROUPS];
+    int           rung;      // how far up the ladder the next correction is
+    int           clock;     // the observable that counts steps (or -1)
+    int64_t       tick;      // its value at the last monitor
+    int64_t       now;       // steps seen
+    int64_t       settle_until;   // no corrections before this step
+    int64_t       last_violation; // step of the last violation
+    int           pending;   // reference code of the outstanding correction
+    int           next_ref;
+    mclMonitorCorrectiveResponse corrective;
+    mclMonitorNOOPResponse       noop;
+};
+
+static mclAgent               **mcl_agents = NULL;
+static int                      mcl_agent_room = 0;
+static std::mutex               mcl_agents_lock;
+static mclInternalErrorResponse mcl_internal_error;
+
+// Agents live in one table for the whole program, so each walker
+// gets its own key and walkers can run side by side
+static string mcl_local_key(const string &base)
+{
+    static std::atomic<int> next(0);
+    ostringstream key;
+    key << base << "." << next++;
+    return key.str();
+}
+
+static mclAgent* mcl_agent(const string &key)
+{
+    std::lock_guard<std::mutex> hold(mcl_agents_lock);
+    for (int i = 0; i < mcl_agent_room; ++i) {
+        if (mcl_agents[i]->used && (mcl_agents[i]->key == key))
+            return mcl_agents[i];
+    }
+    return NULL;
+}
+
+// Twice the room in the table (called with the lock held).  The agents
+// themselves never move, as the walkers keep pointers to them.
+static void mcl_grow_agents(void)
+{
+    int room = (0 == mcl_agent_room) ? MCL_AGENT_ROOM : 2*mcl_agent_room;
+    mclAgent **bigger = (mclAgent **)realloc(mcl_agents, 
+                                             room * sizeof(mclAgent *));
+    if (NULL == bigger) throw std::bad_alloc();
+    mcl_agents = bigger;
+    for (int i = mcl_agent_room; i < room; ++i) {
+        mcl_agents[i] = new mclAgent();
+        mcl_agents[i]->used = false;
+    }
+    mcl_agent_room = room;
+}
+
+static int mcl_observable(mclAgent *a, const char *name)
+{
+    for (int i = 0; i < a->nobs; ++i) {
+        if (0 == strcmp(a->obs[i].name, name)) return i;
+    }
+    return -1;
+}
+
+static mclGroup* mcl_group(mclAgent *a, int egk)
+{
+    for (int i = 0; i < MCL_MAX_GROUPS; ++i) {
+        if (a->groups[i].used && (a->groups[i].key == egk))
+            return &a->groups[i];
+    }
+    return NULL;
+}
+
+static bool mcl_violated(const mclAgent *a, const mclExpectation &e)
+{
+    double value = a->obs[e.obs].value;
+    if (DT_INTEGER == a->obs[e.obs].dt) value = floor(value + 0.5);
+    switch (e.code) {
+        case EC_MAINTAINVALUE: return (float) value != e.value;
+        case EC_STAYOVER:      return (float) value <= e.value;
+        case EC_STAYUNDER:     return (float) value >= e.value;
+    }
+    return false;
+}
+
+// The correction on the current rung of the ladder, skipping the ones
+// the agent does not allow, else the mildest response it does allow
+static int mcl_correction(const mclAgent *a)
+{
+    int code = -1;
+    int rung = a->rung;
+    for (int i = 0; i < MCL_LADDER; ++i) {
+        if (PC_YES != a->props[mcl_ladder[i]]) continue;
+        code = mcl_ladder[i];
+        if (0 == rung--) break;
+    }
+    if (-1 != code) return code;
+    if (PC_YES == a->props[CRC_TRY_AGAIN]) return CRC_TRY_AGAIN;
+    if (PC_YES == a->props[CRC_NOOP]) return CRC_NOOP;
+    return CRC_IGNORE;
+}
+
+// Check the expectations against the latest values and add the
+// agent's response (if any) to rv.  The step is the walker's step
+// count, or -1 to go by the clock observable.
+static void mcl_respond(mclAgent *a, responseVector &rv, int64_t step=-1)
+{
+    // 1. Move the clock on by the steps since the last monitor
+    int64_t steps = 1;
+    if ((-1 == step) && (-1 != a->clock)) 
+        step = (int64_t) a->obs[a->clock].value;
+    if (-1 != step) {
+        if (step > a->tick) steps = step - a->tick;
+        a->tick = step;
+    }
+    a->now += steps;
+
+    // 2. Check the expectations
+    bool violated = false;
+    for (int g = 0; (g < MCL_MAX_GROUPS) && !violated; ++g) {
+        if (!a->groups[g].used) continue;
+        for (int e = 0; (e < a->groups[g].n) && !violated; ++e) {
+            violated = mcl_violated(a, a->groups[g].exp[e]);
+        }
+    }
+
+    // 3. Nothing to report, and after a while start the ladder over
+    if (!violated) {
+        if (a->now - a->last_violation >= MCL_SETTLE) a->rung = 0;
+        return;
+    }
+    a->last_violation = a->now;
+
+    // 4. Give the last correction time to work
+    if (a->now < a->settle_until) {
+        rv.push_back(&a->noop);
+        return;
+    }
+
+    // 5. Suggest a correction
+    a->pending = ++a->next_ref;
+    a->corrective.suggest(mcl_correction(a), a->pending);
+    rv.push_back(&a->corrective);
+}
+
+// The agent's state goes into the snapshots of the walkers, so a walker
+// loaded from one carries on with the same expectations and ladder
+static void mcl_save_agent(const string &key, Snapshot &s)
+{
+    mclAgent *a = mcl_agent(key);
+    s.put_tag("mclAgent");
+    s.put_int(NULL != a);
+    if (NULL == a) return;
+    s.put(a->props, sizeof(a->props));
+    s.put_int(a->nobs);
+    s.put(a->obs, sizeof(a->obs));
+    s.put(a->groups, sizeof(a->groups));
+    s.put_int(a->rung);
+    s.put_int(a->clock);
+    s.put_int64(a->tick);
+    s.put_int64(a->now);
+    s.put_int64(a->settle_until);
+    s.put_int64(a->last_violation);
+    s.put_int(a->pending);
+    s.put_int(a->next_ref);
+}
+
+static int mcl_load_agent(const string &key, Snapshot &s)
+{
+    mclAgent *a = mcl_agent(key);
+    if (!s.get_tag("mclAgent")) return 0;
+    if (!s.get_int()) return s.ok();
+    if (NULL == a) return 0;
+    s.get(a->props, sizeof(a->props));
+    a->nobs = s.get_int();
+    s.get(a->obs, sizeof(a->obs));
+    s.get(a->groups, sizeof(a->groups));
+    a->rung     = s.get_int();
+    a->clock    = s.get_int();
+    a->tick     = s.get_int64();
+    a->now      = s.get_int64();
+    a->settle_until   = s.get_int64();
+    a->last_violation = s.get_int64();
+    a->pending  = s.get_int();
+    a->next_ref = s.get_int();
+    return s.ok();
+}
+
+namespace mclMA {
+    namespace observables {
+
+        // The latest values, by name.  The walkers pass the same literal
+        // names each step so the names are kept as pointers.
+        class update
+        {
+            const char *names[MCL_MAX_OBSERVABLES];
+            double      values[MCL_MAX_OBSERVABLES];
+            int         n;
+
+        public:
+            update() : n(0) {}
+
+            void set_update(const char *name, double value)
+            {
+                for (int i = 0; i < n; ++i) {
+                    if ((names[i] == name) || (0 == strcmp(names[i], name))) {
+                        values[i] = value;
+                        return;
+                    }
+                }
+                if (n < MCL_MAX_OBSERVABLES) {
+                    names[n]  = name;
+                    values[n] = value;
+                    ++n;
+                }
+            }
+            int         size(void)       const { return n; }
+            const char* name(int i)      const { return names[i]; }
+            double      value(int i)     const { return values[i]; }
+        };
+
+        // Returns the observable's place in the declaration order
+        inline int declare_observable_self(const string &key,
+                                           const char *name, double value)
+        {
+            mclAgent *a = mcl_agent(key);
+            if (NULL == a) return -1;
+            int i = mcl_observable(a, name);
+            if ((-1 == i) && (a->nobs < MCL_MAX_OBSERVABLES)) {
+                i = a->nobs++;
+                strncpy(a->obs[i].name, name, MCL_NAME_SIZE - 1);
+                a->obs[i].name[MCL_NAME_SIZE - 1] = 0;
+                a->obs[i].dt     = DT_RATIONAL;
+                a->obs[i].sclass = SC_REWARD;
+            }
+            if (-1 != i) a->obs[i].value = value;
+            return i;
+        }
+
+        inline void set_obs_prop_self(const string &key, const char *name,
+                                      int prop, int value)
+        {
+            mclAgent *a = mcl_agent(key);
+            if (NULL == a) return;
+            int i = mcl_observable(a, name);
+            if (-1 == i) return;
+            if (PROP_DT == prop)     a->obs[i].dt     = value;
+            if (PROP_SCLASS == prop) a->obs[i].sclass = value;
+
+            // The first temporal observable is the agent's clock
+            if ((PROP_SCLASS == prop) && (SC_TEMPORAL == value) &&
+                ((-1 == a->clock) || (i < a->clock))) a->clock = i;
+            if ((PROP_SCLASS == prop) && (SC_TEMPORAL != value) &&
+                (i == a->clock)) a->clock = -1;
+        }
+    } // end namespace observables
+
+    // The library writes an HTML log here; the stand-in has none
+    inline void setOutput(const string &) {}
+
+    inline void initializeMCL(const string &key, int)
     {
-        if (verbose)
-            cout << "mclMonitorNOOPResponse" << endl;
-    } // end processSuggestionNOOP 
+        std::lock_guard<std::mutex> hold(mcl_agents_lock);
+        mclAgent *a = NULL;
+        for (int i = 0; i < mcl_agent_room; ++i) {
+            if (mcl_agents[i]->used && (mcl_agents[i]->key == key)) {
+                a = mcl_agents[i];
+                break;
+            }
+            if ((NULL == a) && !mcl_agents[i]->used) a = mcl_agents[i];
+        }
+        if (NULL == a) {
+            int first_new = mcl_agent_room;
+            mcl_grow_agents();
+            a = mcl_agents[first_new];
+        }
+        a->used = true;
+        a->key  = key;
+        for (int p = 0; p < MCL_PROPERTIES; ++p) a->props[p] = PC_YES;
+        a->nobs = 0;
+        for (int g = 0; g < MCL_MAX_GROUPS; ++g) a->groups[g].used = false;
+        a->rung     = 0;
+        a->clock    = -1;
+        a->tick     = 0;
+        a->now      = 0;
+        a->settle_until   = 0;
+        a->last_violation = 0;
+        a->pending  = 0;
+        a->next_ref = 0;
+    }
 
+    inline void releaseMCL(const string &key)
+    {
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) return;
+        std::lock_guard<std::mutex> hold(mcl_agents_lock);
+        a->used = false;
+    }
 
-    void processSuggestionCorrective(mclMonitorCorrectiveResponse* r)
+    inline void setPropertyDefault(const string &key, int prop, int value)
     {
-        if (verbose)
-            cout << "mclMonitorCorrectiveResponse" << endl;
+        mclAgent *a = mcl_agent(key);
+        if ((NULL != a) && (prop >= 0) && (prop < MCL_PROPERTIES))
+            a->props[prop] = value;
+    }
 
-        switch (r->responseCode()) {
-            case CRC_IGNORE:
-                if (verbose) cout << "Suggestion: Ignore" << endl;
-                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                break;
-            case CRC_NOOP:
-                if (verbose) cout << "Suggestion: No Op" << endl;
-                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                break;
-            case CRC_TRY_AGAIN:
-                if (verbose) cout << "Suggestion: Try Again" << endl;
-                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                break;
-            case CRC_REBUILD_MODELS:
-                if (verbose) cout << "Suggestion: Rebuild Models" << endl;
-                reset();
-                increment_policy();
-                mclMA::declareExpectationGroup(mcl_key, EGK);
-                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                break;
-            default:
-                cout << "Unexpected Suggestion: ["
-                     << r->responseCode() << "] "
-                     << r->responseText() << endl;
-                if (r->requiresAction()) {
-                    mclMA::suggestionIgnored(mcl_key, r->referenceCode());
-                } // end if requiresAction
-        } // end switch
-    } // end processConcreteSuggestion
-    
-    virtual int reinit(void) {
-        reset();
-        mclMA::declareExpectationGroup(mcl_key, EGK);
-        return QLMCLSimple::reinit();
+    inline void reSetDefaultPV(const string &key)
+    {
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) return;
+        for (int p = 0; p < MCL_PROPERTIES; ++p) a->props[p] = PC_YES;
     }
-    
-    void resetExpectationGroup(void) {
-        mclMA::expectationGroupAborted(mcl_key, EGK);
-        for (int i=0; i < 5; ++i) {
-            expected[i] = 0;
+
+    inline void declareExpectationGroup(const string &key, int egk)
+    {
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) return;
+        mclGroup *g = mcl_group(a, egk);
+        for (int i = 0; (NULL == g) && (i < MCL_MAX_GROUPS); ++i) {
+            if (!a->groups[i].used) g = &a->groups[i];
         }
+        if (NULL == g) return;
+        g->used = true;
+        g->key  = egk;
+        g->n    = 0;
     }
 
-    void reset(void) {    
-        if (verbose) {
-            cout << "step " << get_count() << ": MCLBayes1::reset()" << endl;
+    inline void declareExpectation(const string &key, int egk,
+                                   const char *name, int code, float value)
+    {
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) return;
+        mclGroup *g = mcl_group(a, egk);
+        int obs = mcl_observable(a, name);
+        if ((NULL == g) || (-1 == obs) || (g->n >= MCL_MAX_EXPECTATIONS))
+            return;
+        g->exp[g->n].obs   = obs;
+        g->exp[g->n].code  = code;
+        g->exp[g->n].value = value;
+        ++g->n;
+    }
+
+    // Aborting a group also drops the correction that was settling
+    inline void expectationGroupAborted(const string &key, int egk)
+    {
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) return;
+        mclGroup *g = mcl_group(a, egk);
+        if (NULL != g) g->used = false;
+        a->settle_until = 0;
+        a->pending = 0;
+    }
+
+    inline void suggestionImplemented(const string &key, int ref)
+    {
+        mclAgent *a = mcl_agent(key);
+        if ((NULL == a) || (ref != a->pending)) return;
+        a->pending = 0;
+        a->settle_until = a->now + MCL_SETTLE;
+        if (a->rung < MCL_LADDER - 1) ++a->rung;
+    }
+
+    inline void suggestionFailed(const string &key, int ref)
+    {
+        mclAgent *a = mcl_agent(key);
+        if ((NULL == a) || (ref != a->pending)) return;
+        a->pending = 0;
+        if (a->rung < MCL_LADDER - 1) ++a->rung;
+    }
+
+    inline void suggestionIgnored(const string &key, int ref)
+    {
+        mclAgent *a = mcl_agent(key);
+        if ((NULL == a) || (ref != a->pending)) return;
+        a->pending = 0;
+        a->settle_until = a->now + MCL_SETTLE;
+    }
+
+    inline responseVector monitor(const string &key,
+                                  const observables::update &u)
+    {
+        responseVector rv;
+
+        // 1. Only known agents can be monitored
+        mclAgent *a = mcl_agent(key);
+        if (NULL == a) {
+            rv.push_back(&mcl_internal_error);
+            return rv;
         }
-        resetExpectationGroup();
-        QLMCLSimple::reset();
+
+        // 2. Take the new values of the observables
+        for (int i = 0; i < u.size(); ++i) {
+            int obs = mcl_observable(a, u.name(i));
+            if (-1 != obs) a->obs[obs].value = u.value(i);
+        }
+
+        // 3. See what the agent makes of them
+        mcl_respond(a, rv);
+        return rv;
     }
-    
-#endif    
-};
 
+    // The agent of a key, so a walker can look it up once and then
+    // monitor without the lock (until the agent is released)
+    inline mclAgent* agent(const string &key) { return mcl_agent(key); }
+
+    // values[i] is the value of the i-th observable declared, and step
+    // the walker's step count (a float cannot count a long soak)
+    inline responseVector monitor(mclAgent *a, const float *values, int n,
+                                  int64_t step=-1)
+    {
+        responseVector rv;
+        if ((NULL == a) || !a->used) {
+            rv.push_back(&mcl_internal_error);
+            return rv;
+        }
+        if (n > a->nobs) n = a->nobs;
+        for (int i = 0; i < n; ++i) a->obs[i].value = values[i];
+        mcl_respond(a, rv, step);
+        return rv;
+    }
+
+    inline responseVector monitor(const string &key,
+                                  const float *values, int n)
+    {
+        return monitor(mcl_agent(key), values, n);
+    }
+} // end namespace mclMA
+#endif
 
-    
 // ====================================================================
-//                                                          QLMCLBayes2
-// A grid walker that learns with a modest amount of meta-congnition
+//                                                       MCLObservables
+// The observables of an MCL agent.  Each one is declared once, when
+// the walker is built, and gets an integer handle.  Each step the
+// walker sets values by handle in a flat array and monitor() passes
+// the whole array to MCL.  The stand-in reads the array directly.
+// The library is still given each value by name, but the names are
+// built only once.  due() says whether the walker should monitor at
+// a step, given the cadence (see monitoring cadence).
 // ====================================================================
-class QLMCLBayes2 : public QLMCLSimple
-{
-    float sensors[10];
-    int   total_rewards;
-    int   count_rewards;
-    int   reward_steps;
-    int   last_reward_step;
-    bool   expectations_set;
 #ifdef USEMCL2
+#define MCL_OBSERVABLES 16
+
+class MCLObservables
+{
+    string key;
+    int    n;
+    string names[MCL_OBSERVABLES];
+    float  values[MCL_OBSERVABLES];
+    int    cadence;
+    int64_t last;
+#ifdef CHIPPY_LOCAL_MCL
+    mclAgent *agent;
+#else
     mclMA::observables::update _update;
-    string mcl_key;
 #endif
-    
+
 public:
-    QLMCLBayes2(Grid *gr = NULL, int th = 3,
-                int sx = LOC_CTR, int sy = LOC_CTR, 
-                double a = 0.5, double g = 0.9, double e = 0.05) 
-    : QLMCLSimple(gr, th, sx, sy, a, g, e)
+    MCLObservables() : n(0), cadence(MONITOR_EVERY), last(0) 
     {
-#ifdef USEMCL2
-        // 1. Introduce ourselves to MCL
-        mcl_key = "QLMCLBayes2";
-        mclMA::setOutput("QLMCLBayes2.html");
-        mclMA::initializeMCL(mcl_key, 0); 
-        
-        // 2. Define properties
-        mclMA::setPropertyDefault(mcl_key, PCI_INTENTIONAL,         PC_NO);
-        mclMA::setPropertyDefault(mcl_key, PCI_EFFECTORS_CAN_FAIL,  PC_NO);
+#ifdef CHIPPY_LOCAL_MCL
+        agent = NULL;
+#endif
+    }
+
+    // The key of an initialized agent (the stand-in's agent is looked
+    // up here, once, rather than at every monitor)
+    void set_key(const string &k) 
+    { 
+        key = k; 
+#ifdef CHIPPY_LOCAL_MCL
+        agent = mclMA::agent(k);
+#endif
+    }
+    void set_cadence(int c)       { cadence = (c < 0) ? MONITOR_EVERY : c; }
+    int  get_cadence(void) const  { return cadence; }
+
+    // Declare an observable (with its data type and sensor class) and
+    // return its handle
+    int declare(const char *name, int dt, int sclass)
+    {
+        assert(n < MCL_OBSERVABLES);
+#ifdef CHIPPY_LOCAL_MCL
+        // The stand-in takes the values in declaration order
+        int slot = mclMA::observables::declare_observable_self(key, name, 0.0);
+        assert((-1 == slot) || (n == slot));
+#else
+        mclMA::observables::declare_observable_self(key, name, 0.0);
+#endif
+        mclMA::observables::set_obs_prop_self(key, name, PROP_DT, dt);
+        mclMA::observables::set_obs_prop_self(key, name, PROP_SCLASS, sclass);
+        names[n]  = name;
+        values[n] = 0.0;
+        return n++;
+    }
+
+    int         size(void)         const { return n; }
+    const char* name(int h)        const { return names[h].c_str(); }
+    float       get(int h)         const { return values[h]; }
+    void        set(int h, float v)      { values[h] = v; }
+
+    // Should the walker monitor at this step?  With events, an event
+    // or the heartbeat (or a step count that went back) says yes.
+    bool due(int64_t step, bool event)
+    {
+        bool yes;
+        if (MONITOR_EVENTS == cadence) {
+            yes = event || (step < last) || 
+                  (step - last >= MONITOR_HEARTBEAT);
+        } else {
+            yes = (cadence <= MONITOR_EVERY) || (0 == step % cadence);
+        }
+        if (yes) last = step;
+        return yes;
+    }
+
+    void save(Snapshot &s)
+    {
+        s.put_int(cadence);
+        s.put_int64(last);
+    }
+    void load(Snapshot &s)
+    {
+        cadence = s.get_int();
+        last    = s.get_int64();
+    }
+
+    // Tell MCL the values (at the walker's step, if it is given) and
+    // return its responses
+    responseVector monitor(int64_t step=-1)
+    {
+#ifdef CHIPPY_LOCAL_MCL
+        return mclMA::monitor(agent, values, n, step);
+#else
+        (void) step;     // the library only has the observables
+        for (int i = 0; i < n; ++i) _update.set_update(names[i], values[i]);
+        return mclMA::monitor(key, _update);
+#endif
+    }
+};
+#endif
+
+// ====================================================================
+//                                                          QLMCLBayes1
+// A grid walker that learns with a modest amount of meta-congnition
+// ====================================================================
+class QLMCLBayes1 : public QLMCLSimple
+{
+    double sensors[10];
+    int    expected[5];
+#ifdef USEMCL2
+    MCLObservables observables;
+    int    obs_step;
+    int    obs_reward;
+    int    obs_expect[5];
+    int    corrections;
+    string mcl_key;
+#endif
+public:
+    QLMCLBayes1(Grid *gr = NULL, int th = 3,
+                   int sx = LOC_CTR, int sy = LOC_CTR, 
+                   double a = 0.5, double g = 0.9, double e = 0.05) 
+    : QLMCLSimple(gr, th, sx, sy, a, g, e)
+    {
+
+#ifdef USEMCL2
+        // 1. Introduce ourselves to MCL
+        mcl_key = "QLMCLBayes1";
+#ifdef CHIPPY_LOCAL_MCL
+        mcl_key = mcl_local_key(mcl_key);
+#endif
+        mclMA::setOutput("QLMCLBayes1.html");
+        mclMA::initializeMCL(mcl_key, 0); 
+        
+        // 2. Define properties
+        mclMA::setPropertyDefault(mcl_key, PCI_INTENTIONAL,         PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_EFFECTORS_CAN_FAIL,  PC_NO);
         mclMA::setPropertyDefault(mcl_key, PCI_SENSORS_CAN_FAIL,    PC_NO);
         mclMA::setPropertyDefault(mcl_key, PCI_PARAMETERIZED,       PC_YES);
         mclMA::setPropertyDefault(mcl_key, PCI_DECLARATIVE,         PC_NO);
@@ -2302,145 +4405,180 @@ public:
         mclMA::setPropertyDefault(mcl_key, CRC_RELINQUISH_CONTROL,  PC_NO);
         mclMA::setPropertyDefault(mcl_key, CRC_SENSOR_DIAG,         PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_EFFECTOR_DIAG,       PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_ACTIVATE_LEARNING,   PC_YES); 
+        mclMA::setPropertyDefault(mcl_key, CRC_ACTIVATE_LEARNING,   PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_ADJ_PARAMS,          PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_REBUILD_MODELS,      PC_YES);
         mclMA::setPropertyDefault(mcl_key, CRC_REVISIT_ASSUMPTIONS, PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_AMEND_CONTROLLER,    PC_NO);
-        mclMA::setPropertyDefault(mcl_key, CRC_REVISE_EXPECTATIONS, PC_YES); 
+        mclMA::setPropertyDefault(mcl_key, CRC_REVISE_EXPECTATIONS, PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_ALG_SWAP,            PC_NO); 
         mclMA::setPropertyDefault(mcl_key, CRC_CHANGE_HLC,          PC_NO);
-
-        // 3. Define the sensors and property values
-        mclMA::observables::declare_observable_self(mcl_key, "step",    0.0);  // [0]
-        mclMA::observables::declare_observable_self(mcl_key, "reward",  0.0);  // [1]
-        mclMA::observables::declare_observable_self(mcl_key, "valperf", 0.0);  // [2]
-        mclMA::observables::declare_observable_self(mcl_key, "kntperf", 0.0);  // [3]
-        mclMA::observables::declare_observable_self(mcl_key, "lastrwd", 0.0);  // [4]
-        
-        // 4. Define the property values for the sensors
-        mclMA::observables::set_obs_prop_self(mcl_key, "step",     PROP_DT, DT_INTEGER);  // [0]
-        mclMA::observables::set_obs_prop_self(mcl_key, "reward",   PROP_DT, DT_INTEGER);  // [1]
-        mclMA::observables::set_obs_prop_self(mcl_key, "valperf",  PROP_DT, DT_RATIONAL); // [2]
-        mclMA::observables::set_obs_prop_self(mcl_key, "kntperf",  PROP_DT, DT_RATIONAL); // [3]
-        mclMA::observables::set_obs_prop_self(mcl_key, "lastrwd",  PROP_DT, DT_INTEGER);  // [4]
-        
-        mclMA::observables::set_obs_prop_self(mcl_key, "step",     PROP_SCLASS, SC_TEMPORAL); // [0]
-        mclMA::observables::set_obs_prop_self(mcl_key, "reward",   PROP_SCLASS, SC_REWARD);   // [1]
-        mclMA::observables::set_obs_prop_self(mcl_key, "valperf",  PROP_SCLASS, SC_REWARD);   // [2]
-        mclMA::observables::set_obs_prop_self(mcl_key, "kntperf",  PROP_SCLASS, SC_REWARD);   // [3]
-        mclMA::observables::set_obs_prop_self(mcl_key, "lastrwd",  PROP_SCLASS, SC_TEMPORAL); // [4]
-        
-        // 5. Define the expectation group.  
+        
+        // 3. Define the sensors and their properties
+        observables.set_key(mcl_key);
+        obs_step   = observables.declare("step",    DT_INTEGER, SC_TEMPORAL);
+        obs_reward = observables.declare("reward",  DT_INTEGER, SC_REWARD);
+        obs_expect[0] = -1;
+        obs_expect[1] = observables.declare("expect1", DT_INTEGER, SC_REWARD);
+        obs_expect[2] = observables.declare("expect2", DT_INTEGER, SC_REWARD);
+        obs_expect[3] = observables.declare("expect3", DT_INTEGER, SC_REWARD);
+        obs_expect[4] = observables.declare("expect4", DT_INTEGER, SC_REWARD);
+        
+        // 4. Define the expectation group.  
         //    We will add the expectations when we get the rewards.
         mclMA::declareExpectationGroup(mcl_key, EGK);
+        corrections = 0;
 #endif
         sensors[0] = 0;
-        total_rewards = 0;
-        count_rewards = 0;
-        reward_steps = 0;
-        last_reward_step = 0;
-        expectations_set  = false;
     }
     
-    virtual const char* name(void)    const { return "MCLBayes2"; }
-    virtual const char* initials(void) const { return "B2"; }
-    
+    virtual const char* name(void)    const { return "MCLBayes1"; }
+    virtual const char* initials(void) const { return "B1"; }
+    // The MCL library's state is not in the snapshot, the stand-in's is
+    virtual int save(Snapshot &s)
+    {
+        QLMCLSimple::save(s);
+        s.put_tag("QLMCLBayes1");
+        s.put(sensors, sizeof(sensors));
+        for (int i = 0; i < 5; ++i) s.put_int(expected[i]);
 #ifdef USEMCL2
-    ~QLMCLBayes2()
+        observables.save(s);
+        s.put_int(corrections);
+#endif
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+        mcl_save_agent(mcl_key, s);
+#endif
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
     {
-        // We should call mclMA::terminateMCL();
-        // but no such function exists 
-        mclMA::reSetDefaultPV(mcl_key);
-        mclMA::expectationGroupAborted(mcl_key, EGK);
+        if (!QLMCLSimple::load(s) || !s.get_tag("QLMCLBayes1")) return 0;
+        s.get(sensors, sizeof(sensors));
+        for (int i = 0; i < 5; ++i) expected[i] = s.get_int();
+#ifdef USEMCL2
+        observables.load(s);
+        corrections = s.get_int();
+#endif
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+        if (!mcl_load_agent(mcl_key, s)) return 0;
+#endif
+        return s.ok();
     }
+#if defined(USEMCL2) && !defined(CHIPPY_LOCAL_MCL)
+    // The MCL library keeps its state in globals keyed by mcl_key
+    virtual int reentrant(void) const { return 0; }
+#endif
 
-    void set_expectations(float val_perf, float knt_perf)
+#ifdef USEMCL2
+    virtual void set_cadence(int c) { observables.set_cadence(c); }
+    int get_corrections(void) const { return corrections; }
+
+    ~QLMCLBayes1()
     {
-        mclMA::declareExpectation(mcl_key, EGK, 
-                                   "valperf", 
-                                   EC_STAYOVER, 
-                                   (float) 0.85*val_perf);
-        mclMA::declareExpectation(mcl_key, EGK, 
-                                   "kntperf", 
-                                   EC_STAYUNDER, 
-                                   (float) 1.5*knt_perf);
-        mclMA::declareExpectation(mcl_key, EGK, 
-                                   "lastrwd", 
-                                   EC_STAYUNDER, 
-                                   (float) 10.0*knt_perf);
-        expectations_set = true;
-        if (verbose) {
-            cout << "Step " << get_count()
-            << " setting expectations " 
-            << " valperf > " << 0.85*val_perf
-            << " kntperf < " << 1.5*knt_perf
-            << " lastrwd < " << 10.0*knt_perf
-            << endl;
-        }
+        mclMA::releaseMCL(mcl_key);
     }
-
+    
     virtual Goal* move(int dir = -1)
+    {
+        return step<0>(dir);
+    }
+
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir = -1)
     {
         int reward;
+        int expectedReward;
+        int expectedNumber;
+        RewardAtExpectation* expectation;
+        int x;
+        int y;
         
         // 1. Move according to what we have learned
-        Goal* goal = QLearner::move(dir);
+        Goal* goal = QLearner::template step<N>(dir);
         
         // 2. If threshold is -1, we don't do MCL
         if (-1 == threshold) return goal;
         
-        // 3. Total and count rewards
-        if (NULL != goal) {
+        // 3. Get reward value and location
+        if (NULL == goal) {
+            reward = 0;
+            x = get_x();
+            y = get_y();
+        } else {
             reward = goal->get_reward();
-            if (verbose && (reward != 0)) {
-                cout << "step " << get_count() 
-                     << ": reward = " << reward 
-                     << " at (" << goal->get_ox() 
-                     << "," << goal->get_oy() << ") " << endl;
-            }
-            if (reward > 0) last_reward_step = get_count();
-            if (reward != 0) {
-                total_rewards += reward;
-                count_rewards += 1;
+            x = goal->get_ox();
+            y = goal->get_oy();
+        }
+        TRACE(verbose && (reward != 0), TRACE_REWARD_LINE, get_count(), 
+              reward, x, y);
+        
+        // 4. What was our expected reward?
+        expectation = expectations->at(x, y);
+        if (expectation == NULL) {
+            expectedReward = EXPECTED_REWARD_UNKNOWN;
+            expectedNumber = 0;
+        } else {
+            if ((x == get_last_x()) && (y == get_last_y())) {
+                expectedReward = 0;
+                expectedNumber = 0;
+            } else {
+                expectedReward = expectation->get_reward();
+                expectedNumber = expectation->get_number();
+            } 
+            record_expected(expectedReward);
+        }
+        if (reward != 0) {
+            if (expectation == NULL) {
+                TRACE(verbose, TRACE_NO_EXPECTATION, get_count());
+            } else {
+                TRACE(verbose, TRACE_EXPECTATION, get_count(), expectedReward);
             }
         }
         
-        // 4. Compute performance numbers
-        ++reward_steps;
-        float val_perf = float(total_rewards) / float(reward_steps);
-        float knt_perf = float(reward_steps) / float(count_rewards>0?count_rewards:1);
-        if (verbose) {
-            cout << "step " << get_count()
-            << ": val_perf = " << val_perf
-            << ", knt_perf = " << knt_perf
-            << ", last_reward = " << get_count() - last_reward_step << endl;
+        // 5. Just store the reward if this is the first time
+        //    (there are only observables for the first four)
+        if ((NULL == expectation) && (reward != 0)) {
+            expectation = expectations->add(reward, x, y);
+            expectedNumber = (NULL == expectation) ? 0 
+                                                   : expectation->get_number();
+            TRACE(verbose, TRACE_EXPECT_NAMED, get_count(), reward, x, y, 
+                  expectedNumber, expectedNumber);
+            if ((expectedNumber > 0) && (expectedNumber < 5)) {
+                expected[expectedNumber] = reward;
+                mclMA::declareExpectation(mcl_key, EGK, 
+                                  observables.name(obs_expect[expectedNumber]),
+                                  EC_MAINTAINVALUE, 
+                                  (float) reward);
+            }
         }
         
-        // 5. Set values in sensor vector
+        // 6. Set the values of the observables
         sensors[0] = get_count();
         sensors[1] = reward;
-        sensors[2] = val_perf;
-        sensors[3] = knt_perf;
-        sensors[4] = get_count() - last_reward_step;
-        
-        // 6. Set expectations if needed
-        if ((!expectations_set) && (reward_steps > MIN_ACTION_NUMBER))
-        {
-            set_expectations(val_perf, knt_perf);
+        sensors[2] = expected[1];
+        sensors[3] = expected[2];
+        sensors[4] = expected[3];
+        sensors[5] = expected[4];
+        if ((expectedNumber > 0) && (expectedNumber < 5)) {
+            sensors[1+expectedNumber] = reward;
+        }
+        observables.set(obs_step,   sensors[0]);
+        observables.set(obs_reward, sensors[1]);
+        for (int i = 1; i < 5; ++i) {
+            observables.set(obs_expect[i], sensors[1+i]);
         }
-        
-        // 7. Tell MCL what we know
-        _update.set_update("step",    sensors[0]);
-        _update.set_update("reward",  sensors[1]);
-        _update.set_update("valperf", sensors[2]);
-        _update.set_update("kntperf", sensors[3]);
-        _update.set_update("lastrwd", sensors[4]);
 
-        responseVector m = mclMA::monitor(mcl_key, _update);
+        // 7. Tell MCL what we know (when it is time to), a step that
+        //    is not monitored counts as a quiet one
+        if (!observables.due(get_count(), 
+                             (reward != 0) || (expectedNumber > 0))) {
+            decrease_epsilon(0.0003);
+            return goal;
+        }
+        responseVector rv = observables.monitor(get_count());
         
         // 8. Evaluate the suggestions from MCL
-        processSuggestions(m);
+        processSuggestions(rv);
         
         // 9. Return the goal
         return goal;
@@ -2452,14 +4590,10 @@ public:
                  rvi!=m.end();
                  rvi++) {
                 mclMonitorResponse *r = (mclMonitorResponse *)(*rvi);
-                if (verbose) {
-                    cout << "step " << get_count()
-                         << ": " << r->rclass();
-                    if (r->requiresAction()) cout << " Action";
-                    if (r->recommendAbort()) cout << " Abort";
-                    cout << " " << r->responseText() << endl;
-                    cout << "step " << get_count() << ": ";
-                }
+                TRACE(verbose, TRACE_MCL_RESPONSE, get_count(), 
+                      trace_mcl_class(r->rclass()),
+                      (r->requiresAction() ? TRACE_ACTION : 0) |
+                      (r->recommendAbort() ? TRACE_ABORT : 0));
                 processSuggestion(r);
             } // end for
         } else {
@@ -2477,71 +4611,51 @@ public:
         else if (r->rclass() == "suggestion")
             processSuggestionCorrective((mclMonitorCorrectiveResponse*)r);
         else {
-            if (verbose) 
-                cout << "Unknown MCL monitor response ("
-                     << r->rclass() << ")" << endl;
+            TRACE(verbose, TRACE_MCL_UNKNOWN, get_count());
         }
     } // end processSuggestion
 
     void processSuggestionInternalError(mclInternalErrorResponse* r)
     {
-        if (verbose)
-            cout << "mclInternalErrorResponse" << endl;
+        TRACE(verbose, TRACE_MCL_ERROR, get_count());
     } // end processSuggestionInternalError 
 
     void processSuggestionOK(mclMonitorOKResponse* r)
     {
-        if (verbose)
-            cout << "mclMonitorOKResponse" << endl;
+        TRACE(verbose, TRACE_MCL_OK, get_count());
     } // end processSuggestionOK 
 
     void processSuggestionNOOP(mclMonitorNOOPResponse* r)
     {
-        if (verbose)
-            cout << "mclMonitorNOOPResponse" << endl;
+        TRACE(verbose, TRACE_MCL_NOOP, get_count());
     } // end processSuggestionNOOP 
 
 
     void processSuggestionCorrective(mclMonitorCorrectiveResponse* r)
     {
-        if (verbose)
-            cout << "mclMonitorCorrectiveResponse" << endl;
+        TRACE(verbose, TRACE_MCL_CORRECTIVE, get_count());
+        ++corrections;
 
         switch (r->responseCode()) {
             case CRC_IGNORE:
-                if (verbose) cout << "Suggestion: Ignore" << endl;
+                TRACE(verbose, TRACE_SUGGEST_IGNORE, get_count());
                 mclMA::suggestionImplemented(mcl_key, r->referenceCode());
                 break;
             case CRC_NOOP:
-                if (verbose) cout << "Suggestion: No Op" << endl;
+                TRACE(verbose, TRACE_SUGGEST_NOOP, get_count());
                 mclMA::suggestionImplemented(mcl_key, r->referenceCode());
                 break;
             case CRC_TRY_AGAIN:
-                if (verbose) cout << "Suggestion: Try Again" << endl;
+                TRACE(verbose, TRACE_SUGGEST_TRY_AGAIN, get_count());
                 mclMA::suggestionImplemented(mcl_key, r->referenceCode());
                 break;
-            case CRC_ACTIVATE_LEARNING:
-                if (verbose) cout << "Suggestion: Activate Learning" << endl;
-                if (get_epsilon() >= 0.5) {
-                    mclMA::suggestionFailed(mcl_key, r->referenceCode());    
-                } else {
-                    increase_epsilon(0.1);
-                    mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                }
-                break;
             case CRC_REBUILD_MODELS:
-                if (verbose) cout << "Suggestion: Rebuild Models" << endl;
+                TRACE(verbose, TRACE_SUGGEST_REBUILD, get_count());
                 reset();
                 increment_policy();
                 mclMA::declareExpectationGroup(mcl_key, EGK);
                 mclMA::suggestionImplemented(mcl_key, r->referenceCode());
                 break;
-            case CRC_REVISE_EXPECTATIONS:
-                if (verbose) cout << "Suggestion: Revise Expectations" << endl;
-                resetExpectationGroup();                           
-                mclMA::declareExpectationGroup(mcl_key, EGK);
-                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
-                break;
             default:
                 cout << "Unexpected Suggestion: ["
                      << r->responseCode() << "] "
@@ -2560,118 +4674,648 @@ public:
     
     void resetExpectationGroup(void) {
         mclMA::expectationGroupAborted(mcl_key, EGK);
-        total_rewards = 0;
-        count_rewards = 0;
-        reward_steps = 0;
-        last_reward_step = get_count();
-        expectations_set = false;
+        for (int i=0; i < 5; ++i) {
+            expected[i] = 0;
+        }
     }
-    
+
     void reset(void) {    
-        if (verbose) {
-            cout << "step " << get_count() << ": MCLBayes2::reset()" << endl;
-        }
+        TRACE(verbose, TRACE_RESET_BAYES1, get_count());
         resetExpectationGroup();
         QLMCLSimple::reset();
     }
+    
 #endif    
 };
 
+
+    
 // ====================================================================
-//                                                       RollingAverage
+//                                                          QLMCLBayes2
+// A grid walker that learns with a modest amount of meta-congnition
 // ====================================================================
-class RollingAverage
+class QLMCLBayes2 : public QLMCLSimple
 {
-    double  *values;
-    int      n;
-    int      index;
-    int      count;
-    double   total;
+    float sensors[10];
+    int64_t total_rewards;
+    int64_t count_rewards;
+    int64_t reward_steps;
+    int64_t last_reward_step;
+    bool   expectations_set;
+#ifdef USEMCL2
+    MCLObservables observables;
+    int    obs_step;
+    int    obs_reward;
+    int    obs_valperf;
+    int    obs_kntperf;
+    int    obs_lastrwd;
+    int    corrections;
+    string mcl_key;
+#endif
     
 public:
-        RollingAverage(int xn=ROLLING_AVERAGE_SIZE)
-    {
-            n      = xn;
-            index  = 0;
-            count  = 0;
-            values = (double *) calloc(sizeof(double), n);
-            values[0] = 0.0;
-            total  = 0.0;
-    }
-    
-    void add(double value)
+    QLMCLBayes2(Grid *gr = NULL, int th = 3,
+                int sx = LOC_CTR, int sy = LOC_CTR, 
+                double a = 0.5, double g = 0.9, double e = 0.05) 
+    : QLMCLSimple(gr, th, sx, sy, a, g, e)
     {
-        if (count == n)
-        {
-            total = total - values[index];
-        }
-        else
-        {
-            ++count;
-        }
+#ifdef USEMCL2
+        // 1. Introduce ourselves to MCL
+        mcl_key = "QLMCLBayes2";
+#ifdef CHIPPY_LOCAL_MCL
+        mcl_key = mcl_local_key(mcl_key);
+#endif
+        mclMA::setOutput("QLMCLBayes2.html");
+        mclMA::initializeMCL(mcl_key, 0); 
         
-        values[index] = value;
-        total = total + value;
-        ++index;
-        if (index == n)
-        {
-            index = 0;
-        }
-    }
-    
-    int    get_n()        const { return n; }
-    int    get_count()    const { return count; }
-    double get_total()    const { return total; }
+        // 2. Define properties
+        mclMA::setPropertyDefault(mcl_key, PCI_INTENTIONAL,         PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_EFFECTORS_CAN_FAIL,  PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_SENSORS_CAN_FAIL,    PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_PARAMETERIZED,       PC_YES);
+        mclMA::setPropertyDefault(mcl_key, PCI_DECLARATIVE,         PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_RETRAINABLE,         PC_YES);
+        mclMA::setPropertyDefault(mcl_key, PCI_HLC_CONTROLLING,     PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_HTN_IN_PLAY,         PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_PLAN_IN_PLAY,        PC_NO);
+        mclMA::setPropertyDefault(mcl_key, PCI_ACTION_IN_PLAY,      PC_NO);
+        
+        mclMA::setPropertyDefault(mcl_key, CRC_IGNORE,              PC_YES);
+        mclMA::setPropertyDefault(mcl_key, CRC_NOOP,                PC_YES);
+        mclMA::setPropertyDefault(mcl_key, CRC_TRY_AGAIN,           PC_YES);
+        mclMA::setPropertyDefault(mcl_key, CRC_SOLICIT_HELP,        PC_NO);
+        mclMA::setPropertyDefault(mcl_key, CRC_RELINQUISH_CONTROL,  PC_NO);
+        mclMA::setPropertyDefault(mcl_key, CRC_SENSOR_DIAG,         PC_NO); 
+        mclMA::setPropertyDefault(mcl_key, CRC_EFFECTOR_DIAG,       PC_NO);
+        mclMA::setPropertyDefault(mcl_key, CRC_ACTIVATE_LEARNING,   PC_YES); 
+        mclMA::setPropertyDefault(mcl_key, CRC_ADJ_PARAMS,          PC_NO); 
+        mclMA::setPropertyDefault(mcl_key, CRC_REBUILD_MODELS,      PC_YES);
+        mclMA::setPropertyDefault(mcl_key, CRC_REVISIT_ASSUMPTIONS, PC_NO); 
+        mclMA::setPropertyDefault(mcl_key, CRC_AMEND_CONTROLLER,    PC_NO);
+        mclMA::setPropertyDefault(mcl_key, CRC_REVISE_EXPECTATIONS, PC_YES); 
+        mclMA::setPropertyDefault(mcl_key, CRC_ALG_SWAP,            PC_NO); 
+        mclMA::setPropertyDefault(mcl_key, CRC_CHANGE_HLC,          PC_NO);
+
+        // 3. Define the sensors and their properties
+        observables.set_key(mcl_key);
+        obs_step    = observables.declare("step",    DT_INTEGER,  SC_TEMPORAL);
+        obs_reward  = observables.declare("reward",  DT_INTEGER,  SC_REWARD);
+        obs_valperf = observables.declare("valperf", DT_RATIONAL, SC_REWARD);
+        obs_kntperf = observables.declare("kntperf", DT_RATIONAL, SC_REWARD);
+        obs_lastrwd = observables.declare("lastrwd", DT_INTEGER,  SC_TEMPORAL);
+        
+        // 4. Define the expectation group.  
+        //    We will add the expectations when we get the rewards.
+        mclMA::declareExpectationGroup(mcl_key, EGK);
+        corrections = 0;
+#endif
+        sensors[0] = 0;
+        total_rewards = 0;
+        count_rewards = 0;
+        reward_steps = 0;
+        last_reward_step = 0;
+        expectations_set  = false;
+    }
     
-    double get_average()
-    {    
-        if (0 == count)
-        {
-            return 0.0;
+    virtual const char* name(void)    const { return "MCLBayes2"; }
+    virtual const char* initials(void) const { return "B2"; }
+    // The MCL library's state is not in the snapshot, the stand-in's is
+    virtual int save(Snapshot &s)
+    {
+        QLMCLSimple::save(s);
+        s.put_tag("QLMCLBayes2");
+        s.put(sensors, sizeof(sensors));
+        s.put_int64(total_rewards);
+        s.put_int64(count_rewards);
+        s.put_int64(reward_steps);
+        s.put_int64(last_reward_step);
+        s.put_int(expectations_set);
+#ifdef USEMCL2
+        observables.save(s);
+        s.put_int(corrections);
+#endif
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+        mcl_save_agent(mcl_key, s);
+#endif
+        return s.ok();
+    }
+    virtual int load(Snapshot &s)
+    {
+        if (!QLMCLSimple::load(s) || !s.get_tag("QLMCLBayes2")) return 0;
+        s.get(sensors, sizeof(sensors));
+        total_rewards    = s.get_int64();
+        count_rewards    = s.get_int64();
+        reward_steps     = s.get_int64();
+        last_reward_step = s.get_int64();
+        expectations_set = (0 != s.get_int());
+#ifdef USEMCL2
+        observables.load(s);
+        corrections = s.get_int();
+#endif
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+        if (!mcl_load_agent(mcl_key, s)) return 0;
+#endif
+        return s.ok();
+    }
+#if defined(USEMCL2) && !defined(CHIPPY_LOCAL_MCL)
+    // The MCL library keeps its state in globals keyed by mcl_key
+    virtual int reentrant(void) const { return 0; }
+#endif
+    
+#ifdef USEMCL2
+    virtual void set_cadence(int c) { observables.set_cadence(c); }
+    int get_corrections(void) const { return corrections; }
+
+    ~QLMCLBayes2()
+    {
+        // We should call mclMA::terminateMCL();
+        // but no such function exists 
+        mclMA::reSetDefaultPV(mcl_key);
+        mclMA::expectationGroupAborted(mcl_key, EGK);
+#ifdef CHIPPY_LOCAL_MCL
+        mclMA::releaseMCL(mcl_key);
+#endif
+    }
+
+    void set_expectations(float val_perf, float knt_perf)
+    {
+        mclMA::declareExpectation(mcl_key, EGK, 
+                                   observables.name(obs_valperf), 
+                                   EC_STAYOVER, 
+                                   (float) 0.85*val_perf);
+        mclMA::declareExpectation(mcl_key, EGK, 
+                                   observables.name(obs_kntperf), 
+                                   EC_STAYUNDER, 
+                                   (float) 1.5*knt_perf);
+        mclMA::declareExpectation(mcl_key, EGK, 
+                                   observables.name(obs_lastrwd), 
+                                   EC_STAYUNDER, 
+                                   (float) 10.0*knt_perf);
+        expectations_set = true;
+        TRACE(verbose, TRACE_BAYES2_EXPECT, get_count(), 
+              0.85*val_perf, 1.5*knt_perf, 10.0*knt_perf);
+    }
+
+    virtual Goal* move(int dir = -1)
+    {
+        return step<0>(dir);
+    }
+
+    // move() for a grid whose size is N (or any size when N is 0)
+    template <int N> Goal* step(int dir = -1)
+    {
+        int reward = 0;
+        
+        // 1. Move according to what we have learned
+        Goal* goal = QLearner::template step<N>(dir);
+        
+        // 2. If threshold is -1, we don't do MCL
+        if (-1 == threshold) return goal;
+        
+        // 3. Total and count rewards
+        if (NULL != goal) {
+            reward = goal->get_reward();
+            TRACE(verbose && (reward != 0), TRACE_REWARD_LINE, get_count(), 
+                  reward, goal->get_ox(), goal->get_oy());
+            if (reward > 0) last_reward_step = get_count();
+            if (reward != 0) {
+                total_rewards += reward;
+                count_rewards += 1;
+            }
         }
-        else
+        
+        // 4. Compute performance numbers
+        ++reward_steps;
+        float val_perf = float(total_rewards) / float(reward_steps);
+        float knt_perf = float(reward_steps) / float(count_rewards>0?count_rewards:1);
+        TRACE(verbose, TRACE_BAYES2_PERF, get_count(), 
+              val_perf, knt_perf, get_count() - last_reward_step);
+        
+        // 5. Set values in sensor vector
+        sensors[0] = get_count();
+        sensors[1] = reward;
+        sensors[2] = val_perf;
+        sensors[3] = knt_perf;
+        sensors[4] = get_count() - last_reward_step;
+        
+        // 6. Set expectations if needed
+        bool event = (reward != 0);
+        if ((!expectations_set) && (reward_steps > MIN_ACTION_NUMBER))
         {
-            return total / double(count);
+            set_expectations(val_perf, knt_perf);
+            event = true;
+        }
+        
+        // 7. Tell MCL what we know (when it is time to), a step that
+        //    is not monitored counts as a quiet one
+        if (!observables.due(get_count(), event)) {
+            decrease_epsilon(0.0003);
+            return goal;
+        }
+        observables.set(obs_step,    sensors[0]);
+        observables.set(obs_reward,  sensors[1]);
+        observables.set(obs_valperf, sensors[2]);
+        observables.set(obs_kntperf, sensors[3]);
+        observables.set(obs_lastrwd, sensors[4]);
+
+        responseVector m = observables.monitor(get_count());
+        
+        // 8. Evaluate the suggestions from MCL
+        processSuggestions(m);
+        
+        // 9. Return the goal
+        return goal;
+    }
+    
+    void processSuggestions(responseVector& m) {
+        if (m.size() > 0) {
+            for (responseVector::iterator rvi = m.begin();
+                 rvi!=m.end();
+                 rvi++) {
+                mclMonitorResponse *r = (mclMonitorResponse *)(*rvi);
+                TRACE(verbose, TRACE_MCL_RESPONSE, get_count(), 
+                      trace_mcl_class(r->rclass()),
+                      (r->requiresAction() ? TRACE_ACTION : 0) |
+                      (r->recommendAbort() ? TRACE_ABORT : 0));
+                processSuggestion(r);
+            } // end for
+        } else {
+            decrease_epsilon(0.0003);
+        }// end if
+    } // end processSuggestions
+
+    void processSuggestion(mclMonitorResponse *r) {
+        if (r->rclass() == "internalError") 
+            processSuggestionInternalError((mclInternalErrorResponse*)r);
+        else if (r->rclass() == "noAnomalies")
+            processSuggestionOK((mclMonitorOKResponse*)r);
+        else if (r->rclass() == "noOperation")
+            processSuggestionNOOP((mclMonitorNOOPResponse*)r);
+        else if (r->rclass() == "suggestion")
+            processSuggestionCorrective((mclMonitorCorrectiveResponse*)r);
+        else {
+            TRACE(verbose, TRACE_MCL_UNKNOWN, get_count());
         }
+    } // end processSuggestion
+
+    void processSuggestionInternalError(mclInternalErrorResponse* r)
+    {
+        TRACE(verbose, TRACE_MCL_ERROR, get_count());
+    } // end processSuggestionInternalError 
+
+    void processSuggestionOK(mclMonitorOKResponse* r)
+    {
+        TRACE(verbose, TRACE_MCL_OK, get_count());
+    } // end processSuggestionOK 
+
+    void processSuggestionNOOP(mclMonitorNOOPResponse* r)
+    {
+        TRACE(verbose, TRACE_MCL_NOOP, get_count());
+    } // end processSuggestionNOOP 
+
+
+    void processSuggestionCorrective(mclMonitorCorrectiveResponse* r)
+    {
+        TRACE(verbose, TRACE_MCL_CORRECTIVE, get_count());
+        ++corrections;
+
+        switch (r->responseCode()) {
+            case CRC_IGNORE:
+                TRACE(verbose, TRACE_SUGGEST_IGNORE, get_count());
+                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                break;
+            case CRC_NOOP:
+                TRACE(verbose, TRACE_SUGGEST_NOOP, get_count());
+                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                break;
+            case CRC_TRY_AGAIN:
+                TRACE(verbose, TRACE_SUGGEST_TRY_AGAIN, get_count());
+                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                break;
+            case CRC_ACTIVATE_LEARNING:
+                TRACE(verbose, TRACE_SUGGEST_LEARNING, get_count());
+                if (get_epsilon() >= 0.5) {
+                    mclMA::suggestionFailed(mcl_key, r->referenceCode());    
+                } else {
+                    increase_epsilon(0.1);
+                    mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                }
+                break;
+            case CRC_REBUILD_MODELS:
+                TRACE(verbose, TRACE_SUGGEST_REBUILD, get_count());
+                reset();
+                increment_policy();
+                mclMA::declareExpectationGroup(mcl_key, EGK);
+                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                break;
+            case CRC_REVISE_EXPECTATIONS:
+                TRACE(verbose, TRACE_SUGGEST_REVISE, get_count());
+                resetExpectationGroup();                           
+                mclMA::declareExpectationGroup(mcl_key, EGK);
+                mclMA::suggestionImplemented(mcl_key, r->referenceCode());
+                break;
+            default:
+                cout << "Unexpected Suggestion: ["
+                     << r->responseCode() << "] "
+                     << r->responseText() << endl;
+                if (r->requiresAction()) {
+                    mclMA::suggestionIgnored(mcl_key, r->referenceCode());
+                } // end if requiresAction
+        } // end switch
+    } // end processConcreteSuggestion
+    
+    virtual int reinit(void) {
+        reset();
+        mclMA::declareExpectationGroup(mcl_key, EGK);
+        return QLMCLSimple::reinit();
+    }
+    
+    void resetExpectationGroup(void) {
+        mclMA::expectationGroupAborted(mcl_key, EGK);
+        total_rewards = 0;
+        count_rewards = 0;
+        reward_steps = 0;
+        last_reward_step = get_count();
+        expectations_set = false;
+    }
+    
+    void reset(void) {    
+        TRACE(verbose, TRACE_RESET_BAYES2, get_count());
+        resetExpectationGroup();
+        QLMCLSimple::reset();
     }
+#endif    
 };
 
 // ====================================================================
-//                                                              Rewards
+//                                                       RollingAverage
 // ====================================================================
-class Rewards
+class RollingAverage
 {
     double  *values;
     int      n;
     int      index;
     int      count;
     double   total;
-    char     initials[10];
-    char     colname[25];
-    char     rowname[25];
     
 public:
-        Rewards(int xn=1024)
+        RollingAverage(int xn=ROLLING_AVERAGE_SIZE)
     {
             n      = xn;
             index  = 0;
             count  = 0;
-            values = (double *) calloc(sizeof(double),n);
+            values = (double *) calloc(sizeof(double), n);
             values[0] = 0.0;
-            total = 0.0;
-            strcpy(initials, "????");
-            strcpy(colname, "????");
-            strcpy(rowname, "????");
+            total  = 0.0;
     }
     
-    void append(double value)
+    ~RollingAverage()
     {
-        if (index == n)
-        {
-            n = 2 * n;
-            values = (double *) realloc(values, sizeof(double)*n);
-        }
-        values[index] = value;
+        free(values);
+    }
+    
+    void add(double value)
+    {
+        if (count == n)
+        {
+            total = total - values[index];
+        }
+        else
+        {
+            ++count;
+        }
+        
+        values[index] = value;
+        total = total + value;
+        ++index;
+        if (index == n)
+        {
+            index = 0;
+        }
+    }
+    
+    int    get_n()        const { return n; }
+    int    get_count()    const { return count; }
+    double get_total()    const { return total; }
+    
+    // Snapshot the window, so a long experiment can carry on from it
+    int save(Snapshot &s)
+    {
+        s.put_tag("RollingAverage");
+        s.put_int(n);
+        s.put_int(index);
+        s.put_int(count);
+        s.put_double(total);
+        s.put(values, sizeof(double)*n);
+        return s.ok();
+    }
+    int load(Snapshot &s)
+    {
+        if (!s.get_tag("RollingAverage")) return 0;
+        if (n != s.get_int()) return 0;
+        index = s.get_int();
+        count = s.get_int();
+        total = s.get_double();
+        s.get(values, sizeof(double)*n);
+        if ((index < 0) || (index >= n) || (count < 0) || (count > n)) 
+            return 0;
+        return s.ok();
+    }
+    
+    double get_average()
+    {    
+        if (0 == count)
+        {
+            return 0.0;
+        }
+        else
+        {
+            return total / double(count);
+        }
+    }
+};
+
+// ====================================================================
+//                                                           P2Quantile
+// An estimate of one quantile of a stream of values, kept in constant
+// space with the P-squared algorithm (Jain and Chlamtac, 1985): five 
+// markers, at the smallest value, the quantile, the largest value and
+// halfway between, whose heights are adjusted as each value arrives.
+// The count of values is kept by the owner, who passes it in, so that
+// many of them (one per step) can share it.
+// ====================================================================
+class P2Quantile
+{
+    double q[5];    // heights of the markers
+    int    m[5];    // positions of the markers (from 0)
+    
+    double parabolic(int i, int d) const
+    {
+        return q[i] + double(d) / (m[i+1] - m[i-1]) *
+               ((m[i] - m[i-1] + d) * (q[i+1] - q[i]) / (m[i+1] - m[i]) +
+                (m[i+1] - m[i] - d) * (q[i] - q[i-1]) / (m[i] - m[i-1]));
+    }
+    
+public:
+    // The count is the number of values including this one
+    void add(double x, int count, double p)
+    {
+        int i, k;
+        
+        // 1. The first five values are just kept, in order
+        if (count <= 5) {
+            for (i = count - 1; (i > 0) && (q[i-1] > x); --i) q[i] = q[i-1];
+            q[i] = x;
+            for (i = 0; i < 5; ++i) m[i] = i;
+            return;
+        }
+        
+        // 2. Find the cell the value falls in, stretching the ends
+        if (x < q[0]) {
+            q[0] = x;
+            k = 0;
+        } else if (x >= q[4]) {
+            q[4] = x;
+            k = 3;
+        } else {
+            for (k = 0; x >= q[k+1]; ++k) ;
+        }
+        for (i = k + 1; i < 5; ++i) ++m[i];
+        
+        // 3. Move the middle markers that are off their desired positions
+        double want[3] = {p/2, p, (1+p)/2};
+        for (i = 1; i < 4; ++i) {
+            double off = want[i-1] * (count - 1) - m[i];
+            if (((off >= 1.0) && (m[i+1] - m[i] > 1)) || 
+                ((off <= -1.0) && (m[i-1] - m[i] < -1))) {
+                int d = (off > 0) ? 1 : -1;
+                double h = parabolic(i, d);
+                if ((q[i-1] < h) && (h < q[i+1])) q[i] = h;
+                else q[i] += d * (q[i+d] - q[i]) / (m[i+d] - m[i]);
+                m[i] += d;
+            }
+        }
+    }
+    
+    double get(int count, double p) const
+    {
+        // 1. Exact (by nearest rank) until there are more than five
+        if (count <= 0) return 0.0;
+        if (count <= 5) return q[(int)(p * (count - 1) + 0.5)];
+        
+        // 2. Then the height of the middle marker
+        return q[2];
+    }
+};
+
+// ====================================================================
+//                                                              Rewards
+// The rewards of one experiment, or the sums of the rewards of several.
+// When used for sums, m2 keeps the sum of squared differences from the
+// mean at each step (and total_m2 for the totals), updated as each
+// experiment is added, so the variance is there without keeping them.
+// With keep_quantiles(), P2Quantile sketches of the 10th, 50th and 90th
+// percentile of the experiments are kept for each step (and the total)
+// as they are added, one at a time.
+// ====================================================================
+#define QUANTILES 3
+static const double QUANTILE_P[QUANTILES] = {0.1, 0.5, 0.9};
+static const char *QUANTILE_NAME[QUANTILES] = {"p10", "p50", "p90"};
+
+#define REWARDS_Z 1.96
+
+#define STATS_NONE      0
+#define STATS_CI        1
+#define STATS_QUANTILES 2
+#define STATS_ALL       3
+
+class Rewards
+{
+    double  *values;
+    double  *m2;
+    P2Quantile *sketch;
+    P2Quantile  total_sketch[QUANTILES];
+    int      n;
+    int      index;
+    int      count;
+    double   total;
+    double   total_m2;
+    char     initials[10];
+    char     colname[25];
+    char     rowname[25];
+    
+    // The values belong to this object, so no copies
+    Rewards(const Rewards&);
+    Rewards& operator=(const Rewards&);
+    
+public:
+        Rewards(int xn=1024)
+    {
+            n      = xn;
+            index  = 0;
+            count  = 0;
+            values = (double *) calloc(sizeof(double),n);
+            values[0] = 0.0;
+            m2     = NULL;
+            sketch = NULL;
+            total = 0.0;
+            total_m2 = 0.0;
+            strcpy(initials, "????");
+            strcpy(colname, "????");
+            strcpy(rowname, "????");
+    }
+    
+    ~Rewards()
+    {
+        free(values);
+        free(m2);
+        free(sketch);
+    }
+    
+    // Start over, keeping the storage for the next experiment
+    void reset()
+    {
+        index = 0;
+        count = 0;
+        total = 0.0;
+        total_m2 = 0.0;
+        if (m2) memset(m2, 0, sizeof(double)*n);
+        if (sketch) memset(sketch, 0, sizeof(P2Quantile)*QUANTILES*n);
+    }
+    
+    // Room for size steps in everything kept for each step
+    void grow(int size)
+    {
+        values = (double *) realloc(values, sizeof(double)*size);
+        if (m2) {
+            m2 = (double *) realloc(m2, sizeof(double)*size);
+            memset(m2 + n, 0, sizeof(double)*(size - n));
+        }
+        if (sketch) {
+            sketch = (P2Quantile *) realloc(sketch, 
+                                            sizeof(P2Quantile)*QUANTILES*size);
+            memset(sketch + QUANTILES*n, 0, 
+                   sizeof(P2Quantile)*QUANTILES*(size - n));
+        }
+        n = size;
+    }
+    
+    // Quantiles have to see every experiment, so start before adding any
+    bool keep_quantiles()
+    {
+        if (count > 0) return false;
+        if (NULL == sketch) 
+            sketch = (P2Quantile *) calloc(sizeof(P2Quantile), QUANTILES*n);
+        return true;
+    }
+    
+    void append(double value)
+    {
+        if (index == n)
+        {
+            grow(2 * n);
+        }
+        values[index] = value;
         ++index;
         total += value;
         count = 1;
@@ -2683,6 +5327,30 @@ public:
     double get_reward(int index)  const { return values[index]; }
     double get_average(int index) const { return values[index] / double(count); }
     double get_total()            const { return total; }
+    double get_mean(int from, int to) const
+    {
+        // The mean of the averages from index from up to (not) index to
+        double sum = 0.0;
+        for (int i = from; i < to; ++i) sum += values[i];
+        return (to > from) ? sum / double(count) / double(to - from) : 0.0;
+    }
+    double get_variance(int index) const 
+    { 
+        return (count > 1 && m2) ? m2[index] / double(count - 1) : 0.0; 
+    }
+    double get_total_variance()   const 
+    { 
+        return (count > 1) ? total_m2 / double(count - 1) : 0.0; 
+    }
+    bool   has_quantiles()        const { return NULL != sketch; }
+    double get_quantile(int index, int which) const
+    {
+        return sketch[QUANTILES*index + which].get(count, QUANTILE_P[which]);
+    }
+    double get_total_quantile(int which) const
+    {
+        return total_sketch[which].get(count, QUANTILE_P[which]);
+    }
     char * get_initials()         { return initials; }
     char * get_colname()          { return colname; }
     char * get_rowname()          { return rowname; }
@@ -2708,6 +5376,63 @@ public:
         strcpy(rowname, name);
     }
     
+    // The sums (not the quantiles), so a shard of the experiments can be
+    // added to the others later
+    int save(Snapshot &s)
+    {
+        s.put_tag("Rewards");
+        s.put(initials, sizeof(initials));
+        s.put(colname, sizeof(colname));
+        s.put(rowname, sizeof(rowname));
+        s.put_int(index);
+        s.put_int(count);
+        s.put_double(total);
+        s.put_double(total_m2);
+        s.put(values, sizeof(double)*index);
+        s.put_int(NULL != m2);
+        if (m2) s.put(m2, sizeof(double)*index);
+        return s.ok();
+    }
+    int load(Snapshot &s)
+    {
+        if (!s.get_tag("Rewards")) return 0;
+        s.get(initials, sizeof(initials));
+        s.get(colname, sizeof(colname));
+        s.get(rowname, sizeof(rowname));
+        initials[sizeof(initials)-1] = '\0';
+        colname[sizeof(colname)-1] = '\0';
+        rowname[sizeof(rowname)-1] = '\0';
+        int size = s.get_int();
+        if (!s.ok() || (size < 0)) return 0;
+        free(sketch);
+        sketch = NULL;
+        if (size > n) grow(size);
+        index = size;
+        count = s.get_int();
+        total = s.get_double();
+        total_m2 = s.get_double();
+        s.get(values, sizeof(double)*index);
+        if (s.get_int()) {
+            if (NULL == m2) m2 = (double *) calloc(sizeof(double), n);
+            s.get(m2, sizeof(double)*index);
+        } else if (m2) {
+            memset(m2, 0, sizeof(double)*n);
+        }
+        return s.ok() && (count >= 0);
+    }
+    
+    // Feed the values of one experiment to the quantiles, as the count'th
+    void sketch_run(const Rewards *other, int count)
+    {
+        for (int i = 0; i < index; ++i) {
+            double x = (i < other->get_index()) ? other->values[i] : 0.0;
+            for (int k = 0; k < QUANTILES; ++k)
+                sketch[QUANTILES*i + k].add(x, count, QUANTILE_P[k]);
+        }
+        for (int k = 0; k < QUANTILES; ++k) 
+            total_sketch[k].add(other->get_total(), count, QUANTILE_P[k]);
+    }
+    
     void add(Rewards *other)
     {
         if (count == 0)
@@ -2716,12 +5441,32 @@ public:
         }
         else
         {
+            // 1. Combine the squared differences of the two groups:
+            //    M2 = M2a + M2b + (mean_b - mean_a)^2 * na*nb/(na+nb)
+            int    nb = other->get_count();
+            if (0 == nb) return;
+            double na = double(count);
+            double weight = na * nb / (na + nb);
+            if (NULL == m2) m2 = (double *) calloc(sizeof(double), n);
             for (int i = 0; i < index; ++i)
             {   
-                values[i] = values[i] + other->get_reward(i);
+                double x = (i < other->get_index()) ? other->values[i] : 0.0;
+                double delta = x/nb - values[i]/na;
+                m2[i] += (other->m2 ? other->m2[i] : 0.0) 
+                       + delta*delta*weight;
+                values[i] = values[i] + x;
             }
-            ++count;
+            double delta = other->get_total()/nb - total/na;
+            total_m2 += other->total_m2 + delta*delta*weight;
+            count += nb;
             total += other->get_total();
+            
+            // 2. Sketches take experiments one at a time, not sums
+            if (sketch && (1 == nb)) sketch_run(other, count);
+            else if (sketch) {
+                free(sketch);
+                sketch = NULL;
+            }
         }
     }
     
@@ -2729,22 +5474,467 @@ public:
     {
         if (other->get_n() > n)
         {
-            n = other->get_n();
-            values = (double *) realloc(values, sizeof(double)*n);
+            grow(other->get_n());
         }
         index = other->get_index();
         for (int i = 0; i < index; ++i)
         {    
             values[i] = other->get_reward(i);
         }
+        if ((NULL == m2) && other->m2) 
+        {
+            m2 = (double *) calloc(sizeof(double), n);
+        }
+        if (m2) 
+        {
+            for (int i = 0; i < index; ++i) 
+                m2[i] = other->m2 ? other->m2[i] : 0.0;
+        }
         total = other->get_total();
+        total_m2 = other->total_m2;
         count = other->get_count();
+        if (sketch && (1 == count)) sketch_run(other, count);
+        else if (sketch && other->sketch) {
+            memcpy(sketch, other->sketch, sizeof(P2Quantile)*QUANTILES*index);
+            memcpy(total_sketch, other->total_sketch, sizeof(total_sketch));
+        } else if (sketch) {
+            free(sketch);
+            sketch = NULL;
+        }
+    }
+};
+
+// ====================================================================
+//                                                      DecimatedSeries
+// A series of average rewards too long to keep.  Every stride values
+// make a bucket (the last value, and the mean, smallest and largest of
+// them), and the buckets go into a buffer of fixed size that is written
+// to the file (if there is one) each time it fills, so the memory used
+// is the same however long the series gets.
+// ====================================================================
+#define SOAK_STRIDE  1000
+#define SOAK_BUCKETS 4096
+
+struct SoakBucket {
+    long long step;       // of the last value in the bucket
+    double    last;
+    double    mean;
+    double    min;
+    double    max;
+};
+
+class DecimatedSeries
+{
+    SoakBucket *buckets;
+    int         size;
+    int         used;
+    int         stride;
+    int         filled;     // values in the bucket being filled
+    double      sum;
+    double      lo;
+    double      hi;
+    double      last;
+    long long   steps;
+    long long   flushed;
+    ofstream    out;
+    
+    DecimatedSeries(const DecimatedSeries&);
+    DecimatedSeries& operator=(const DecimatedSeries&);
+    
+public:
+    DecimatedSeries(int st = SOAK_STRIDE, int sz = SOAK_BUCKETS)
+    {
+        stride  = (st > 0) ? st : 1;
+        size    = (sz > 0) ? sz : 1;
+        buckets = (SoakBucket *) calloc(size, sizeof(SoakBucket));
+        used    = 0;
+        filled  = 0;
+        sum = lo = hi = last = 0.0;
+        steps   = 0;
+        flushed = 0;
+    }
+    
+    ~DecimatedSeries()
+    {
+        close();
+        free(buckets);
+    }
+    
+    bool open(const char *filename)
+    {
+        out.open(filename);
+        out << "step,last,mean,min,max" << endl;
+        return out.good();
+    }
+    
+    void append(double value)
+    {
+        // 1. Add the value to the bucket being filled
+        if (0 == filled) {
+            sum = 0.0;
+            lo = hi = value;
+        }
+        sum += value;
+        if (value < lo) lo = value;
+        if (value > hi) hi = value;
+        last = value;
+        ++steps;
+        
+        // 2. Finish the bucket when it is full
+        if (++filled == stride) finish();
+    }
+    
+    void finish(void)
+    {
+        // 1. Nothing to do if nothing has been added since the last one
+        if (0 == filled) return;
+        
+        // 2. Keep the bucket, writing them all out if there is no room
+        SoakBucket &b = buckets[used++];
+        b.step = steps - 1;
+        b.last = last;
+        b.mean = sum / filled;
+        b.min  = lo;
+        b.max  = hi;
+        filled = 0;
+        if (size == used) flush();
+    }
+    
+    bool flush(void)
+    {
+        // 1. Write the buckets kept so far, and forget them
+        if (out.is_open()) {
+            for (int i = 0; i < used; ++i) {
+                out << buckets[i].step << "," << buckets[i].last << "," 
+                    << buckets[i].mean << "," << buckets[i].min << "," 
+                    << buckets[i].max << '\n';
+            }
+            out.flush();
+        }
+        flushed += used;
+        used = 0;
+        return !out.is_open() || out.good();
+    }
+    
+    bool close(void)
+    {
+        finish();
+        bool ok = flush();
+        if (out.is_open()) out.close();
+        return ok;
+    }
+    
+    int       get_stride()  const { return stride; }
+    int       get_size()    const { return size; }
+    int       get_used()    const { return used; }
+    long long get_steps()   const { return steps; }
+    long long get_buckets() const { return flushed + used; }
+    const SoakBucket *get_bucket(int i) const { return &buckets[i]; }
+};
+
+// ====================================================================
+//                                                          ChippyBatch
+// K QLearner episodes on one kind of Chippy grid, stepped in lockstep.
+// Everything about a lane (position, goals, epsilon, rolling average)
+// is kept in arrays indexed by lane, so moving, goal tests, perturbing
+// and averaging are straight loops over the lanes that the compiler
+// vectorizes.  Picking a direction and updating Q are lookups in each
+// lane's own Q table and use the Square argmax kernel.  A lane draws
+// from its two streams exactly as a QLearner and its grid would, so
+// lane l of a batch repeats a scalar run with the same seeds.
+// ====================================================================
+#define BATCH_NONE    -1
+#define BATCH_CHIPPY  0
+#define BATCH_CLASSIC 1
+#define BATCH_CORNER  2
+#define BATCH_ROTATE  3
+
+class ChippyBatch
+{
+    int     lanes;
+    int     n;
+    int     kind;
+    int     r1;
+    int     r2;
+    double  alpha;
+    double  gamma;
+    double  start_epsilon;
+    int     qsize;
+    double *q;
+    int    *x;
+    int    *y;
+    int    *dir;
+    int    *nx;
+    int    *ny;
+    int    *hit;
+    int    *reward;
+    int    *g1x;
+    int    *g1y;
+    int    *g2x;
+    int    *g2y;
+    int    *g1r;
+    int    *g2r;
+    int    *state;
+    double *epsilon;
+    Random *wrandom;
+    Random *grandom;
+    int     ravg_n;
+    int     ravg_index;
+    int     ravg_count;
+    double *ravg_values;
+    double *ravg_total;
+    double *average;
+    
+    // The batch owns its arrays
+    ChippyBatch(const ChippyBatch&);
+    ChippyBatch& operator=(const ChippyBatch&);
+    
+    int *lane_ints() { return (int *)aligned_calloc(lanes, sizeof(int)); }
+    double *lane_doubles(int rows=1) 
+    {   
+        return (double *)aligned_calloc(rows*lanes, sizeof(double));
+    }
+    
+public:
+    ChippyBatch(const Grid *g, const QLearner *w, int k)
+    {
+        // 1. Copy the grid and walker settings
+        const Chippy *c = dynamic_cast<const Chippy *>(g);
+        lanes = k;
+        n     = g->get_n();
+        kind  = kind_of(g);
+        r1    = c ? c->get_r1() : 0;
+        r2    = c ? c->get_r2() : 0;
+        alpha = w->get_alpha();
+        gamma = w->get_gamma();
+        start_epsilon = w->get_epsilon();
+        ravg_n = ROLLING_AVERAGE_SIZE;
+        
+        // 2. Allocate the lanes
+        qsize   = n*n*DIR_NUM;
+        q       = lane_doubles(qsize);
+        x       = lane_ints();
+        y       = lane_ints();
+        dir     = lane_ints();
+        nx      = lane_ints();
+        ny      = lane_ints();
+        hit     = lane_ints();
+        reward  = lane_ints();
+        g1x     = lane_ints();
+        g1y     = lane_ints();
+        g2x     = lane_ints();
+        g2y     = lane_ints();
+        g1r     = lane_ints();
+        g2r     = lane_ints();
+        state   = lane_ints();
+        epsilon = lane_doubles();
+        wrandom = new Random[lanes];
+        grandom = new Random[lanes];
+        ravg_values = lane_doubles(ravg_n);
+        ravg_total  = lane_doubles();
+        average     = lane_doubles();
+        
+        // 3. Start every lane at the beginning
+        reinit();
+    }
+    
+    ~ChippyBatch()
+    {
+        aligned_free(q);
+        aligned_free(x);
+        aligned_free(y);
+        aligned_free(dir);
+        aligned_free(nx);
+        aligned_free(ny);
+        aligned_free(hit);
+        aligned_free(reward);
+        aligned_free(g1x);
+        aligned_free(g1y);
+        aligned_free(g2x);
+        aligned_free(g2y);
+        aligned_free(g1r);
+        aligned_free(g2r);
+        aligned_free(state);
+        aligned_free(epsilon);
+        delete [] wrandom;
+        delete [] grandom;
+        aligned_free(ravg_values);
+        aligned_free(ravg_total);
+        aligned_free(average);
+    }
+    
+    // Which kind of grid can be batched (BATCH_NONE if it cannot)
+    static int kind_of(const Grid *g)
+    {
+        if (dynamic_cast<const ChippyRotate *>(g))  return BATCH_ROTATE;
+        if (dynamic_cast<const ChippyCorner *>(g))  return BATCH_CORNER;
+        if (dynamic_cast<const ChippyClassic *>(g)) return BATCH_CLASSIC;
+        if (dynamic_cast<const Chippy *>(g))        return BATCH_CHIPPY;
+        return BATCH_NONE;
+    }
+    
+    int     get_lanes()           const { return lanes; }
+    int     get_n()               const { return n; }
+    int     get_kind()            const { return kind; }
+    int     get_x(int l)          const { return x[l]; }
+    int     get_y(int l)          const { return y[l]; }
+    int     get_reward(int l)     const { return reward[l]; }
+    double  get_average(int l)    const { return average[l]; }
+    double  get_epsilon(int l)    const { return epsilon[l]; }
+    void    set_epsilon(int l, double e) { epsilon[l] = e; }
+    int     get_g1r(int l)        const { return g1r[l]; }
+    int     get_state(int l)      const { return state[l]; }
+    double *q_of(int l)           const { return q + (size_t)l*qsize; }
+    Random *get_walker_random(int l)    { return &wrandom[l]; }
+    Random *get_grid_random(int l)      { return &grandom[l]; }
+    
+    void place_goals(int l)
+    {
+        // Rotate state 0 is the Chippy layout: BL and TR
+        int other = (state[l] + 2) % 4;
+        g1x[l] = orient_value(CLOCKWISE[state[l]][0], n);
+        g1y[l] = orient_value(CLOCKWISE[state[l]][1], n);
+        g2x[l] = orient_value(CLOCKWISE[other][0], n);
+        g2y[l] = orient_value(CLOCKWISE[other][1], n);
+    }
+    
+    void reinit(void)
+    {
+        // 1. Forget everything that was learned
+        memset(q, 0, sizeof(double)*qsize*lanes);
+        memset(ravg_values, 0, sizeof(double)*ravg_n*lanes);
+        ravg_index = 0;
+        ravg_count = 0;
+        
+        // 2. Put the walkers in the middle and the goals back
+        for (int l = 0; l < lanes; ++l)
+        {
+            x[l] = orient_value(LOC_CTR, n);
+            y[l] = orient_value(LOC_CTR, n);
+            g1r[l] = r1;
+            g2r[l] = r2;
+            state[l] = 0;
+            epsilon[l] = start_epsilon;
+            ravg_total[l] = 0.0;
+            average[l] = 0.0;
+            place_goals(l);
+        }
+    }
+    
+    void perturb(const unsigned char *mask=NULL)
+    {
+        // "Perturb the lanes in the mask (or all of them)"
+        int l;
+        switch (kind)
+        {
+            case BATCH_CLASSIC:
+            case BATCH_CORNER:
+                // 1. Swap the rewards
+                for (l = 0; l < lanes; ++l)
+                {
+                    int m = mask ? mask[l] : 1;
+                    int a = g1r[l];
+                    int b = g2r[l];
+                    g1r[l] = m ? b : a;
+                    g2r[l] = m ? a : b;
+                }
+                break;
+            case BATCH_ROTATE:
+                // 2. Move the goals clockwise
+                for (l = 0; l < lanes; ++l)
+                {
+                    if (mask && !mask[l]) continue;
+                    state[l] = (state[l] + 1) % 4;
+                    place_goals(l);
+                }
+                break;
+        }
+    }
+    
+    void step(void)
+    {
+        int l;
+        
+        // 1. Pick the best direction or explore, as QLearner::move does
+        for (l = 0; l < lanes; ++l)
+        {
+            Random *r = &wrandom[l];
+            int d = Square::best_of(q_of(l) + (x[l]*n + y[l])*DIR_NUM, r);
+            if ((epsilon[l]*10000) > r->below(10000)) d = r->below(DIR_NUM);
+            dir[l] = d;
+        }
+        
+        // 2. Move, staying on the grid, and see if a goal was reached
+        for (l = 0; l < lanes; ++l)
+        {
+            int d = dir[l];
+            int mx = x[l] + (d == DIR_E) - (d == DIR_W);
+            int my = y[l] + (d == DIR_N) - (d == DIR_S);
+            mx = mx < 0 ? 0 : (mx >= n ? n-1 : mx);
+            my = my < 0 ? 0 : (my >= n ? n-1 : my);
+            int moved = (mx != x[l]) | (my != y[l]);
+            int h1 = moved & (mx == g1x[l]) & (my == g1y[l]);
+            int h2 = moved & (mx == g2x[l]) & (my == g2y[l]);
+            nx[l] = mx;
+            ny[l] = my;
+            hit[l] = h1 | (h2 << 1);
+            reward[l] = h1 ? g1r[l] : (h2 ? g2r[l] : 0);
+        }
+        
+        // 3. Goals jump the walker somewhere else
+        for (l = 0; l < lanes; ++l)
+        {
+            if (0 == hit[l]) continue;
+            if (BATCH_CORNER == kind) {
+                nx[l] = ny[l] = (1 == hit[l]) ? n-1 : 0;
+            } else {
+                nx[l] = grandom[l].randint(1, n-2);
+                ny[l] = grandom[l].randint(1, n-2);
+            }
+        }
+        
+        // 4. Update the expected reward of the move just made
+        for (l = 0; l < lanes; ++l)
+        {
+            double *ql = q_of(l);
+            double *qsa = ql + (x[l]*n + y[l])*DIR_NUM + dir[l];
+            double maxQspap = Square::max_of(ql + (nx[l]*n + ny[l])*DIR_NUM);
+            *qsa = *qsa + alpha*(reward[l] + (gamma*maxQspap) - *qsa);
+            x[l] = nx[l];
+            y[l] = ny[l];
+        }
+        
+        // 5. Update the rolling averages, as RollingAverage::add does
+        double *slot = ravg_values + ravg_index*lanes;
+        if (ravg_count == ravg_n) {
+            for (l = 0; l < lanes; ++l) ravg_total[l] = ravg_total[l] - slot[l];
+        } else {
+            ++ravg_count;
+        }
+        double count = double(ravg_count);
+        for (l = 0; l < lanes; ++l)
+        {
+            slot[l] = reward[l];
+            ravg_total[l] = ravg_total[l] + reward[l];
+            average[l] = ravg_total[l] / count;
+        }
+        if (++ravg_index == ravg_n) ravg_index = 0;
+    }
+    
+    // Copy what one lane has learned into a grid (to draw its policy)
+    void copy_q_to(int l, Grid *g) const
+    {
+        for (int xx = 0; xx < n; ++xx)
+            for (int yy = 0; yy < n; ++yy)
+                for (int d = 0; d < DIR_NUM; ++d)
+                    g->set_q(xx, yy, d, q_of(l)[(xx*n + yy)*DIR_NUM + d]);
     }
 };
 
 // ====================================================================
 //                                                         grid_factory
-// Return an initialized grid object based on grid number
+// Return an initialized grid object based on grid number (and, if they
+// are given, with its own size and rewards)
 // ====================================================================
 Grid* grid_factory(int igrid) {
     switch(igrid) {
@@ -2761,10 +5951,36 @@ Grid* grid_factory(int igrid) {
     return NULL;
 }
 
-// ====================================================================
-//                                                       walker_factory
-// Return an initialized walker object based on walker number
-// ====================================================================
+Grid* grid_factory(int igrid, int n, int r1, int r2) {
+    switch(igrid) {
+        case GRID_CHIPPY: 
+        case GRID_PCHIPPY: return new Chippy(n, r1, r2);
+        case GRID_CLASSIC: 
+        case GRID_PCLASSIC: return new ChippyClassic(n, r1, r2);
+        case GRID_CORNER: 
+        case GRID_PCORNER: return new ChippyCorner(n, r1, r2);
+        case GRID_ROTATE: 
+        case GRID_PROTATE: return new ChippyRotate(n, r1, r2);
+    }
+    return NULL;
+}
+
+// ====================================================================
+//                                                       walker_factory
+// Return an initialized walker object based on walker number (and, if
+// they are given, with its own learning parameters)
+// ====================================================================
+struct WalkerParams {
+    double alpha;
+    double gamma;
+    double epsilon;
+    int    threshold;
+    
+    WalkerParams(double a = 0.5, double g = 0.9, double e = 0.05, 
+                 int th = 3)
+        : alpha(a), gamma(g), epsilon(e), threshold(th) {}
+};
+
 Walker* walker_factory(int iwalk) {
     switch(iwalk) {
         case WALK_NONE: return NULL;
@@ -2779,6 +5995,85 @@ Walker* walker_factory(int iwalk) {
     return NULL;
 }
 
+// Can walkers of this kind run at once on different threads?  (What
+// their reentrant() says, without making one to ask: making an MCL
+// library walker touches the library's globals.)
+int walker_reentrant(int iwalk) {
+    switch(iwalk) {
+#if defined(USEMCL2) && !defined(CHIPPY_LOCAL_MCL)
+        case WALK_BAYES1: return 0;
+        case WALK_BAYES2: return 0;
+#endif
+    }
+    return 1;
+}
+
+Walker* walker_factory(int iwalk, const WalkerParams &p) {
+    double a = p.alpha;
+    double g = p.gamma;
+    double e = p.epsilon;
+    int    th = p.threshold;
+    switch(iwalk) {
+        case WALK_NONE: return NULL;
+        case WALK_WALKER: return new Walker();
+        case WALK_QLEARNER: return new QLearner(NULL, LOC_CTR, LOC_CTR, 
+                                                a, g, e);
+        case WALK_SIMPLE: return new QLMCLSimple(NULL, th, LOC_CTR, LOC_CTR, 
+                                                 a, g, e);
+        case WALK_SENSITIVE: return new QLMCLSensitive(NULL, th, 
+                                                       LOC_CTR, LOC_CTR, 
+                                                       a, g, e);
+        case WALK_SOPHISTICATED: return new QLMCLSophisticated(NULL, th, 
+                                                               LOC_CTR, LOC_CTR,
+                                                               a, g, e);
+        case WALK_BAYES1: return new QLMCLBayes1(NULL, th, LOC_CTR, LOC_CTR, 
+                                                 a, g, e);
+        case WALK_BAYES2: return new QLMCLBayes2(NULL, th, LOC_CTR, LOC_CTR, 
+                                                 a, g, e);
+    }
+    return NULL;
+}
+
+// ====================================================================
+//                                                        save_snapshot
+// Checkpoint a walker and the grid it walks on (and, if given, the
+// rolling average of an experiment in progress).  load_snapshot() puts
+// them back into objects of the same kinds, returning 0 if it cannot.
+// ====================================================================
+int save_snapshot(const char *filename, Walker *w, RollingAverage *ravg=NULL)
+{
+    Snapshot s;
+    
+    // 1. Create the file
+    if (!s.create(filename)) return 0;
+    
+    // 2. Write the grid, then the walker, then the averages
+    w->get_grid()->save(s);
+    w->save(s);
+    s.put_int(NULL != ravg);
+    if (ravg) ravg->save(s);
+    
+    // 3. It is only there if it was all written
+    return s.close();
+}
+
+int load_snapshot(const char *filename, Walker *w, RollingAverage *ravg=NULL)
+{
+    Snapshot s;
+    
+    // 1. Open the file
+    if (!s.open(filename)) return 0;
+    
+    // 2. Read the grid, then the walker, then the averages
+    if (!w->get_grid()->load(s)) return 0;
+    if (!w->load(s)) return 0;
+    int averages = s.get_int();
+    if (ravg && (!averages || !ravg->load(s))) return 0;
+    
+    // 3. Return success if all was read
+    return s.close();
+}
+
 // ====================================================================
 //                                                         write_policy
 // Output the policy that has been learned by the walker
@@ -2795,24 +6090,49 @@ void write_policy(const char *basename, Walker *w, int steps)
     w->picture(tex,false,DRAW_LOGV);
 }
 
+// ====================================================================
+//                                                          walker_step
+// One step of a walker.  For Walker itself (with N of -1) this is the
+// virtual move().  Otherwise it calls W's own step for a grid of size
+// N directly, so the whole step can be inlined.
+// ====================================================================
+template <class W, int N> inline Goal *walker_step(W *w)
+{
+    return w->W::template step<N>(-1);
+}
+
+template <> inline Goal *walker_step<Walker, -1>(Walker *w)
+{
+    return w->move();
+}
+
+// ====================================================================
+//                                                         perturb_step
+// Is the grid perturbed after this step?  At pstep, or with mult at
+// every multiple of pstep (and never when pstep is 0).
+// ====================================================================
+inline int perturb_step(int step, int pstep, int mult)
+{
+    return ((!mult) && step && (pstep == step)) ||
+           (mult && step && pstep && (0 == (step%pstep)));
+}
+
 // ====================================================================
 //                                                           experiment
 // Do a single chippy experiment
 // ====================================================================
-Rewards *experiment(int steps=EXP_STEPS, 
-                    int pstep=0,
-                    int mult=0,
-                    Walker *w=NULL,
-                    const char *basename=NULL,
-                    bool policy=false)
+template <class W, int N>
+Rewards *experiment_in(int steps, int pstep, int mult, W *w,
+                       const char *basename, bool policy,
+                       Rewards *rwds=NULL)
 {
     RollingAverage *ravg;
-    Rewards        *rwds;
     
-    // 1. Create the objects
+    // 1. Create the objects (or reuse the rewards given)
     steps += ROLLING_AVERAGE_SIZE;
     ravg = new RollingAverage();
-    rwds = new Rewards(steps+1);
+    if (NULL == rwds) rwds = new Rewards(steps+1);
+    else rwds->reset();
     rwds->set_colname(w->get_grid()->name());
     rwds->set_rowname(w->name());
     rwds->set_initials(w->initials(), w->get_grid()->initials());
@@ -2823,7 +6143,7 @@ Rewards *experiment(int steps=EXP_STEPS,
     for (int step = 0; step <= steps; ++step)
     {
         // 3. Take a step
-        Goal *goal = w->move();
+        Goal *goal = walker_step<W, N>(w);
         //cout << step << ": (" << w->get_x() << "," << w->get_y() << ") " << reward << endl;
         
         // 4. Record this reward in the averages
@@ -2834,8 +6154,7 @@ Rewards *experiment(int steps=EXP_STEPS,
         rwds->append(ravg->get_average());
         
         // 6. Switch the rewards if it is time
-        if (((!mult) && step && (pstep == step)) ||
-            (mult && step && pstep && (0 == (step%pstep))))
+        if (perturb_step(step, pstep, mult))
         {
             w->get_grid()->perturb();
             if (policy) write_policy(basename, w, step);
@@ -2852,6 +6171,293 @@ Rewards *experiment(int steps=EXP_STEPS,
     return rwds;
 }     
 
+Rewards *experiment(int steps=EXP_STEPS, 
+                    int pstep=0,
+                    int mult=0,
+                    Walker *w=NULL,
+                    const char *basename=NULL,
+                    bool policy=false,
+                    Rewards *into=NULL)
+{
+    return experiment_in<Walker, -1>(steps, pstep, mult, w, basename, policy,
+                                     into);
+}
+
+// ====================================================================
+//                                                  dispatch_experiment
+// experiment() compiled for the walker (by its walker_factory number)
+// and, for ENGINE_N by ENGINE_N grids, for the grid size.  Walkers the
+// engine does not know use the virtual experiment().
+// ====================================================================
+#define ENGINE_N 8
+
+template <class W>
+Rewards *dispatch_size(int steps, int pstep, int mult, W *w,
+                       const char *basename, bool policy, Rewards *into)
+{
+    if (ENGINE_N == w->get_grid()->get_n())
+        return experiment_in<W, ENGINE_N>(steps, pstep, mult, 
+                                          w, basename, policy, into);
+    return experiment_in<W, 0>(steps, pstep, mult, 
+                               w, basename, policy, into);
+}
+
+Rewards *dispatch_experiment(int iwalk,
+                             int steps=EXP_STEPS, 
+                             int pstep=0,
+                             int mult=0,
+                             Walker *w=NULL,
+                             const char *basename=NULL,
+                             bool policy=false,
+                             Rewards *into=NULL)
+{
+    switch (iwalk) {
+        case WALK_WALKER: 
+            return dispatch_size(steps, pstep, mult, w, 
+                                 basename, policy, into);
+        case WALK_QLEARNER: 
+            return dispatch_size(steps, pstep, mult, (QLearner *)w, 
+                                 basename, policy, into);
+        case WALK_SIMPLE: 
+            return dispatch_size(steps, pstep, mult, (QLMCLSimple *)w, 
+                                 basename, policy, into);
+        case WALK_SENSITIVE: 
+            return dispatch_size(steps, pstep, mult, (QLMCLSensitive *)w, 
+                                 basename, policy, into);
+        case WALK_SOPHISTICATED: 
+            return dispatch_size(steps, pstep, mult, 
+                                 (QLMCLSophisticated *)w, 
+                                 basename, policy, into);
+        case WALK_BAYES1: 
+            return dispatch_size(steps, pstep, mult, (QLMCLBayes1 *)w, 
+                                 basename, policy, into);
+        case WALK_BAYES2: 
+            return dispatch_size(steps, pstep, mult, (QLMCLBayes2 *)w, 
+                                 basename, policy, into);
+    }
+    return experiment(steps, pstep, mult, w, basename, policy, into);
+}
+
+// ====================================================================
+//                                                                 soak
+// One walker for a very long time (more steps than an int can count),
+// with the grid perturbed after every pstep steps, recording the rolling
+// average reward into a DecimatedSeries.  Returns the perturbations.
+// ====================================================================
+template <class W, int N>
+long long soak_in(long long steps, int pstep, W *w, DecimatedSeries *series)
+{
+    RollingAverage ravg;
+    long long perturbs = 0;
+    int since = 0;
+    
+    // 1. Walk, keeping count of the steps since a multiple of pstep
+    w->start_at();
+    for (long long step = 0; step < steps; ++step)
+    {
+        // 2. Take a step and record the rolling average
+        Goal *goal = walker_step<W, N>(w);
+        ravg.add((NULL==goal)?0:goal->get_reward());
+        series->append(ravg.get_average());
+        
+        // 3. Switch the rewards at every multiple of pstep
+        if (pstep && step && (0 == since)) {
+            w->get_grid()->perturb();
+            ++perturbs;
+        }
+        if (++since == pstep) since = 0;
+    }
+    
+    // 4. Finish off the last bucket
+    series->finish();
+    return perturbs;
+}
+
+long long dispatch_soak(int iwalk, long long steps, int pstep, Walker *w,
+                        DecimatedSeries *series)
+{
+    int n = w->get_grid()->get_n();
+    QLearner *q = (QLearner *)w;
+    
+    switch (iwalk) {
+        case WALK_WALKER: 
+            if (ENGINE_N == n) 
+                return soak_in<Walker, ENGINE_N>(steps, pstep, w, series);
+            return soak_in<Walker, 0>(steps, pstep, w, series);
+        case WALK_QLEARNER: 
+            if (ENGINE_N == n) 
+                return soak_in<QLearner, ENGINE_N>(steps, pstep, q, series);
+            return soak_in<QLearner, 0>(steps, pstep, q, series);
+    }
+    return soak_in<Walker, -1>(steps, pstep, w, series);
+}
+
+// ====================================================================
+//                                                      fork_experiment
+// Variants of one experiment that are the same until they first perturb
+// the grid: different perturbation steps, or grids with the same goals
+// (such as Chippy, ChippyClassic and ChippyRotate).  The steps before
+// the earliest perturbation are walked once by w, then each variant
+// carries on from its own copy of the walker, the grid and the rolling
+// average.  A variant whose grid has other goals, or whose walker keeps
+// state in the MCL library, starts from the copy made at step 0.  The
+// results of each are what experiment() would give on a fresh copy of
+// the walker and grid as they were at the start.
+// ====================================================================
+struct ExperimentFork {
+    Grid *grid;
+    int   pstep;
+    int   mult;
+};
+
+int fork_experiment(int iwalk, int steps, Walker *w, 
+                    int nforks, const ExperimentFork *forks, Rewards **rwds)
+{
+    Snapshot start;
+    Snapshot shared;
+    Grid *grid = w->get_grid();
+    int f, step;
+    int sharing = 0;
+    
+    // 1. The shared steps end with the first perturbation of any variant
+    steps += ROLLING_AVERAGE_SIZE;
+    int last = steps;
+    for (f = 0; f < nforks; ++f) {
+        if ((forks[f].pstep > 0) && (forks[f].pstep < last)) 
+            last = forks[f].pstep;
+    }
+    
+    // 2. Keep the walker, grid and averages as they are at the start
+    RollingAverage *ravg = new RollingAverage();
+    w->start_at();
+    start.create();
+    w->save(start);
+    ravg->save(start);
+    Grid *start_grid = grid->clone();
+    start_grid->copy_state(grid);
+    
+    // 3. Walk the shared steps once, and keep where they got to
+    Rewards *prefix = new Rewards(last+2);
+    prefix->append(0.0);
+    for (step = 0; step <= last; ++step)
+    {
+        Goal *goal = w->move();
+        ravg->add((NULL==goal)?0:goal->get_reward());
+        prefix->append(ravg->get_average());
+    }
+    shared.create();
+    w->save(shared);
+    ravg->save(shared);
+    
+    // 4. Loop for each variant
+    for (f = 0; f < nforks; ++f)
+    {
+        // 5. Copy the walker and grid from the shared steps if we can
+        Grid *g = (forks[f].grid ? forks[f].grid : grid)->clone();
+        Walker *fw = walker_factory(iwalk);
+        RollingAverage *fa = new RollingAverage();
+        fw->set_grid(g);
+        bool shares = w->reentrant() && g->same_goals(grid);
+        Snapshot *from = shares ? &shared : &start;
+        from->reread();
+        fw->load(*from);
+        fa->load(*from);
+        g->copy_state(shares ? grid : start_grid);
+        
+        // 6. Start the results with the shared steps (if any)
+        if (NULL == rwds[f]) rwds[f] = new Rewards(steps+1);
+        else rwds[f]->reset();
+        rwds[f]->set_colname(g->name());
+        rwds[f]->set_rowname(fw->name());
+        rwds[f]->set_initials(fw->initials(), g->initials());
+        if (shares) {
+            for (int i = 0; i < prefix->get_index(); ++i) 
+                rwds[f]->append(prefix->get_reward(i));
+            if (perturb_step(last, forks[f].pstep, forks[f].mult))
+                g->perturb();
+            ++sharing;
+        } else {
+            rwds[f]->append(0.0);
+        }
+        
+        // 7. And walk the rest of the way
+        for (step = shares ? last+1 : 0; step <= steps; ++step)
+        {
+            Goal *goal = fw->move();
+            fa->add((NULL==goal)?0:goal->get_reward());
+            rwds[f]->append(fa->get_average());
+            if (perturb_step(step, forks[f].pstep, forks[f].mult))
+                g->perturb();
+        }
+        delete fa;
+        delete fw;
+        delete g;
+    }
+    
+    // 8. Return how many variants shared the steps
+    delete prefix;
+    delete start_grid;
+    delete ravg;
+    return sharing;
+}
+
+// ====================================================================
+//                                                     batch_experiment
+// Do one chippy experiment in every lane of a batch.  The walker (on
+// its own grid) names the results and draws the policy of lane 0.
+// ====================================================================
+Rewards **batch_experiment(int steps, int pstep, int mult, 
+                           ChippyBatch *b, Walker *w,
+                           const char *basename=NULL,
+                           bool policy=false,
+                           Rewards **rwds=NULL)
+{
+    int lanes = b->get_lanes();
+    
+    // 1. Create the objects (or reuse the rewards given)
+    steps += ROLLING_AVERAGE_SIZE;
+    if (NULL == rwds) rwds = (Rewards **)calloc(lanes, sizeof(Rewards *));
+    for (int l = 0; l < lanes; ++l)
+    {
+        if (NULL == rwds[l]) rwds[l] = new Rewards(steps+1);
+        else rwds[l]->reset();
+        rwds[l]->set_colname(w->get_grid()->name());
+        rwds[l]->set_rowname(w->name());
+        rwds[l]->set_initials(w->initials(), w->get_grid()->initials());
+        rwds[l]->append(0.0);
+    }
+    
+    // 2. Walk a mile in every chippy's shoes
+    b->reinit();
+    for (int step = 0; step <= steps; ++step)
+    {
+        // 3. Take a step in all the lanes
+        b->step();
+        
+        // 4. Record the averages in the results
+        for (int l = 0; l < lanes; ++l) rwds[l]->append(b->get_average(l));
+        
+        // 5. Switch the rewards if it is time
+        if (perturb_step(step, pstep, mult))
+        {
+            b->perturb();
+            if (policy) {
+                b->copy_q_to(0, w->get_grid());
+                write_policy(basename, w, step);
+            }
+        }    
+    }    
+    
+    // 6. Output final policy
+    if (policy) {
+        b->copy_q_to(0, w->get_grid());
+        write_policy(basename, w, steps);
+    }
+    
+    // 7. Return the average rewards at each step of each lane
+    return rwds;
+}
+
 void write_line(char *basename, Rewards* rwd, int steps, int skip=1) 
 {
     // 1. Create Output files
@@ -2876,8 +6482,60 @@ void write_line(char *basename, Rewards* rwd, int steps, int skip=1)
     out << endl;
 }
 
+// The spread of a series, after its mean, when the writers are asked
+// for it: the standard deviation and the 95% interval of the mean, and
+// the quantiles.  The step is -1 for the totals.  Series that do not
+// keep the spread (such as those of a binary results file) leave the
+// columns empty.
+void write_stats_header(ostream &out, const char *name, int stats)
+{
+    if (stats & STATS_CI) 
+        out << "," << name << " sd," << name << " lo," << name << " hi";
+    if (stats & STATS_QUANTILES) {
+        for (int k = 0; k < QUANTILES; ++k) 
+            out << "," << name << " " << QUANTILE_NAME[k];
+    }
+}
+
+template <class S>
+void write_stats(ostream &out, const S *, int, int stats)
+{
+    if (stats & STATS_CI) out << ",,,";
+    if (stats & STATS_QUANTILES) {
+        for (int k = 0; k < QUANTILES; ++k) out << ",";
+    }
+}
+
+void write_stats(ostream &out, const Rewards *r, int step, int stats)
+{
+    int k;
+    
+    // 1. The deviation of one experiment, and the interval of the mean
+    if (stats & STATS_CI) {
+        double mean = (step < 0) ? r->get_total() / r->get_count() 
+                                 : r->get_average(step);
+        double sd = sqrt((step < 0) ? r->get_total_variance() 
+                                    : r->get_variance(step));
+        double half = REWARDS_Z * sd / sqrt(double(r->get_count()));
+        out << "," << sd << "," << mean - half << "," << mean + half;
+    }
+    
+    // 2. The quantiles of the experiments, if they were kept
+    if (stats & STATS_QUANTILES) {
+        for (k = 0; k < QUANTILES; ++k) {
+            out << ",";
+            if (!r->has_quantiles()) continue;
+            out << ((step < 0) ? r->get_total_quantile(k) 
+                               : r->get_quantile(step, k));
+        }
+    }
+}
+
+// The writers take Rewards or anything else with the same get_ methods
+// (such as the ResultsSeries of a binary results file)
+template <class S>
 void write_lines(const char *basename, int kntw, int kntg, 
-                 Rewards** rewards, int steps, int skip=1)
+                 S** rewards, int steps, int skip=1, int stats=STATS_NONE)
 {
     // 1. Create Output files
     char filename[40];
@@ -2887,9 +6545,11 @@ void write_lines(const char *basename, int kntw, int kntg,
     
     // 2. Output column headers
     out << "step";
-    for (int i=0; i < kntw*kntg; ++i)
+    for (int i=0; i < kntw*kntg; ++i) {
         out << "," << rewards[i]->get_initials(); 
-    out << endl;
+        write_stats_header(out, rewards[i]->get_initials(), stats);
+    }
+    out << '\n';
     
     // 3. Loop for all of the steps and output step number
     for (int step = 0; step <= steps; step += skip)
@@ -2897,19 +6557,21 @@ void write_lines(const char *basename, int kntw, int kntg,
         out << step;
         
         // 4. Loop for all of the experiments
-        for (Rewards **ri = rewards; *ri !=NULL; ++ri) {
+        for (S **ri = rewards; *ri !=NULL; ++ri) {
             
             // 5. Output step average for one experiment
             out << "," << (*ri)->get_average(step);
+            if (stats) write_stats(out, *ri, step, stats);
         }
         
         // 6. End off the row for this step
-        out << endl;
+        out << '\n';
     }
 }
 
+template <class S>
 void write_totals(const char *basename, int kntw, int kntg, 
-                  Rewards** rewards, int steps)
+                  S** rewards, int steps, int stats=STATS_NONE)
 {
     // 1. Create Output files
     char filename[256];
@@ -2919,12 +6581,14 @@ void write_totals(const char *basename, int kntw, int kntg,
     
     // 2. Output column headers
     out << "totals";
-    for (int i=0; i < kntg; ++i)
+    for (int i=0; i < kntg; ++i) {
         out << "," << rewards[i]->get_colname(); 
+        write_stats_header(out, rewards[i]->get_colname(), stats);
+    }
     out << endl;
     
     // 3. Loop for all of the Walkers
-    Rewards** ri = rewards;
+    S** ri = rewards;
     for (int w = 0; w < kntw; ++w)
     {
         // 4. Output name of the Walker
@@ -2935,6 +6599,7 @@ void write_totals(const char *basename, int kntw, int kntg,
             
             // 6. Output step average for one experiment
             out << "," << (*ri)->get_total()/(*ri)->get_count();
+            if (stats) write_stats(out, *ri, -1, stats);
         }
         
         // 7. End off the row for this walker
@@ -2942,12 +6607,38 @@ void write_totals(const char *basename, int kntw, int kntg,
     }
 }
 
+template <class S>
+void write_repeats(const char *basename, int kntw, int kntg, S** rewards)
+{
+    // 1. Create Output file
+    char filename[256];
+    strcpy(filename, basename);
+    strcat(filename, "r.csv");
+    ofstream out(filename);
+    
+    // 2. Output column headers
+    out << "repeats";
+    for (int i=0; i < kntg; ++i)
+        out << "," << rewards[i]->get_colname(); 
+    out << endl;
+    
+    // 3. Output the number of runs of each walker on each grid
+    S** ri = rewards;
+    for (int w = 0; w < kntw; ++w)
+    {
+        out << (*ri)->get_rowname();
+        for (int g = 0; g < kntg; ++g, ++ri) out << "," << (*ri)->get_count();
+        out << endl;
+    }
+}
+
 char *stripChippy(char *name) {
     return name+6;
 }
 
+template <class S>
 void write_table_totals(const char *basename, int kntw, int kntg, 
-                        Rewards** rewards, int steps)
+                        S** rewards, int steps)
 {
     int g;
     int w;
@@ -2973,7 +6664,7 @@ void write_table_totals(const char *basename, int kntw, int kntg,
     out << "\\hline" << endl;
     
     // 3. Loop for all of the Walkers
-    Rewards** ri = rewards;
+    S** ri = rewards;
     for (w = 0; w < kntw; ++w)
     {
         // 4. Output name of the Walker
@@ -2999,111 +6690,1292 @@ void write_table_totals(const char *basename, int kntw, int kntg,
 
 
 // ====================================================================
-//                                                          experiments
-// Repeat the chippy experiment multiple times
+//                                                         results file
+// Binary, column oriented results.  A 64 byte header, a 128 byte entry
+// per Rewards series (names, count, total) and then, starting on a 64
+// byte boundary, one column per series of the average reward at each
+// step as float64 or float32.  Integers are little endian.
 // ====================================================================
-void experiments(const char *basename,
-                 int repeat=EXP_REPEAT, 
-                 int steps=EXP_STEPS, 
-                 int pstep=EXP_PERTURB, 
-                 int mult=0,
-                 int *walkers = NULL, Grid **grids = NULL)
+#define RESULTS_MAGIC   "CHIPPYR1"
+#define RESULTS_VERSION 1
+#define RESULTS_ALIGN   64
+
+#define FORMAT_TEXT   1
+#define FORMAT_BINARY 2
+#define FORMAT_BOTH   3
+#define FORMAT_FLOAT32 4
+#define FORMAT_TRAJECTORY 8
+
+struct ResultsHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    uint32_t walkers;
+    uint32_t grids;
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t steps;
+    uint32_t unused;
+    uint64_t data_offset;
+    uint8_t  reserved[16];
+};
+
+struct ResultsColumnInfo
 {
-    int *wi;
-    Grid   **gi;
-    Walker *w;
-    Grid   *g;
-    int     kntw = 0;
-    int     kntg = 0;
-    int     kntr = 0;
-    Rewards** ri; 
-    Rewards** rewards;
-    int     i;
+    char     initials[16];
+    char     colname[32];
+    char     rowname[32];
+    int32_t  count;
+    int32_t  unused;
+    double   total;
+    double   total_variance;
+    uint64_t offset;
+    uint8_t  reserved[16];
+};
+
+// --------------------------------------------------------------------
+//                                                         write_binary
+// --------------------------------------------------------------------
+int write_binary(const char *basename, int kntw, int kntg, 
+                 Rewards** rewards, int steps, int value_size=8)
+{
+    ResultsHeader header;
+    int columns = kntw * kntg;
+    int c;
     
-    // 1. Count the number of walkers and grids
-    if (NULL != walkers) {
-        for (wi = walkers; WALK_NONE != *wi; ++wi)
-            ++kntw;
-    }
-    if (NULL != grids) {
-        for (gi = grids; NULL != *gi; ++gi)
-            ++kntg;
-    }
-    kntr = kntw *kntg;
-    printf("%d walkers, %d grids, %d rewards\n", kntw, kntg, kntr);
-    if (0 == kntr) return;
+    // 1. Create the output file
+    char filename[256];
+    strcpy(filename, basename);
+    strcat(filename, "b.bin");
+    FILE *out = fopen(filename, "wb");
+    if (NULL == out) return 0;
     
-    // 2. Allocate and initialize rewards
-    rewards = (Rewards**)calloc(1+kntr, sizeof(Rewards*));
-    for (i = 0; i < kntr; ++i) {
-        rewards[i] = new Rewards(steps);
+    // 2. Every column has all the steps that every series has
+    int rows = rewards[0]->get_index();
+    for (c = 1; c < columns; ++c) 
+        if (rewards[c]->get_index() < rows) rows = rewards[c]->get_index();
+    
+    // 3. Write the header
+    size_t table = sizeof(header) + columns*sizeof(ResultsColumnInfo);
+    size_t column_bytes = (((size_t)rows * value_size + RESULTS_ALIGN - 1) 
+                           / RESULTS_ALIGN) * RESULTS_ALIGN;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESULTS_MAGIC, 8);
+    header.version     = RESULTS_VERSION;
+    header.value_size  = value_size;
+    header.walkers     = kntw;
+    header.grids       = kntg;
+    header.columns     = columns;
+    header.rows        = rows;
+    header.steps       = steps;
+    header.data_offset = ((table + RESULTS_ALIGN - 1) / RESULTS_ALIGN) 
+                         * RESULTS_ALIGN;
+    int ok = (1 == fwrite(&header, sizeof(header), 1, out));
+    
+    // 4. Write the description of each column
+    for (c = 0; c < columns; ++c)
+    {
+        ResultsColumnInfo info;
+        memset(&info, 0, sizeof(info));
+        strncpy(info.initials, rewards[c]->get_initials(), 15);
+        strncpy(info.colname, rewards[c]->get_colname(), 31);
+        strncpy(info.rowname, rewards[c]->get_rowname(), 31);
+        info.count = rewards[c]->get_count();
+        info.total = rewards[c]->get_total();
+        info.total_variance = rewards[c]->get_total_variance();
+        info.offset = header.data_offset + c*column_bytes;
+        if (1 != fwrite(&info, sizeof(info), 1, out)) ok = 0;
     }
-    rewards[kntr] = NULL;
-
-    // 3. Loop for all the Walkers
-    for (ri = rewards, wi = walkers; WALK_NONE != *wi; ++wi)
+    
+    // 5. Write the columns (if there are any steps), each padded out to
+    //    the alignment
+    char *buffer = (char *)calloc(column_bytes, 1);
+    if ((NULL == buffer) && (0 < column_bytes)) ok = 0;
+    for (c = 0; ok && (0 < column_bytes) && (c < columns); ++c)
     {
-        w = walker_factory(*wi);
-        printf("walker %s\n", w->name());
-        (*ri)->set_rowname(w->name());
-               
-        // 4. Loop for all the grids
-        for (gi = grids; NULL !=*gi; ++gi, ++ri)
-        {
-            printf("  grid %s\n", (*gi)->name());
-            (*ri)->set_colname((*gi)->name());
-            (*ri)->set_initials(w->initials(), (*gi)->initials());
-            
-            // 5. Loop for several time to smooth the curves
-            printf("    ");
-            bool policy = true;
-            for (int num = 0; num < repeat; ++num)
-            {
-                Rewards *result;
-                
-                cout << num << " ";
-                cout.flush();
-                
-                // 6. Reinitialize a grid and walker for the repeated experiment
-                g = *gi;
-                g->reset();
-                g->restore();
-                w->set_grid(g);
-
-                // 7. Run the experiment, saving the result
-                result = experiment(steps, pstep, mult, w, basename, policy);
-                (*ri)->add(result);
-                delete result;
-                policy = false;
-            }
-            cout << "OK" << endl;    
+        if (0 != fseeko(out, (off_t)(header.data_offset + c*column_bytes), 
+                        SEEK_SET)) {
+            ok = 0;
+            break;
         }
-        delete w;
+        for (int step = 0; step < rows; ++step) {
+            double average = rewards[c]->get_average(step);
+            if (sizeof(float) == value_size) 
+                ((float *)buffer)[step] = float(average);
+            else
+                ((double *)buffer)[step] = average;
+        }
+        if (1 != fwrite(buffer, column_bytes, 1, out)) ok = 0;
     }
-
-    // 8. Write the results files
-    write_lines(basename, kntw, kntg, rewards, steps, 100);
-    write_totals(basename, kntw, kntg, rewards, steps);
-    write_table_totals(basename, kntw, kntg, rewards, steps);
+    free(buffer);
     
-    // 9. Release allocated storage
-    for (i = 0; i < kntr; ++i) {
-        delete rewards[i];
-    }
-    free(rewards);
+    // 6. Close the file and report success
+    if (0 != ferror(out)) ok = 0;
+    if (0 != fclose(out)) ok = 0;
+    return ok;
 }
 
-
-
-// ====================================================================
+// --------------------------------------------------------------------
+//                                                        write_results
+// The results files of the experiments, in the formats asked for.
+// Returns 0 (after saying so) if the binary file could not be written.
+// --------------------------------------------------------------------
+int write_results(const char *basename, int kntw, int kntg, 
+                  Rewards** rewards, int steps, 
+                  int format=FORMAT_BOTH, int stats=STATS_NONE)
+{
+    if (format & FORMAT_TEXT) {
+        write_lines(basename, kntw, kntg, rewards, steps, 100, stats);
+        write_totals(basename, kntw, kntg, rewards, steps, stats);
+        write_table_totals(basename, kntw, kntg, rewards, steps);
+    }
+    if (format & FORMAT_BINARY) {
+        if (!write_binary(basename, kntw, kntg, rewards, steps, 
+                          (format & FORMAT_FLOAT32) ? 4 : 8)) {
+            cerr << "Unable to write " << basename << "b.bin" << endl;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ====================================================================
+//                                                          ResultsFile
+// Read only view of a results file, mapped into memory (or read in
+// whole where mmap is not available).
+// ====================================================================
+class ResultsSeries;
+
+class ResultsFile
+{
+    char   *base;
+    size_t  size;
+    bool    mapped;
+    const ResultsHeader *header;
+    ResultsColumnInfo   *infos;
+    
+    ResultsFile(const ResultsFile&);
+    ResultsFile& operator=(const ResultsFile&);
+    
+public:
+    ResultsFile() 
+    { 
+        base = NULL; 
+        size = 0; 
+        mapped = false; 
+        header = NULL; 
+        infos = NULL;
+    }
+    
+    ~ResultsFile() { close(); }
+    
+    bool open(const char *filename)
+    {
+        close();
+        
+        // 1. Map (or read) the file
+#ifndef _WIN32
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (0 == fstat(fd, &st) && st.st_size > 0) {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED != p) {
+                base = (char *)p;
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        ::close(fd);
+#else
+        FILE *in = fopen(filename, "rb");
+        if (NULL == in) return false;
+        off_t end = -1;
+        if (0 == fseeko(in, 0, SEEK_END)) end = ftello(in);
+        if ((end > 0) && (0 == fseeko(in, 0, SEEK_SET))) {
+            size = (size_t)end;
+            base = (char *)malloc(size);
+        }
+        if (base && 1 != fread(base, size, 1, in)) {
+            free(base);
+            base = NULL;
+        }
+        fclose(in);
+#endif
+        if (NULL == base) return false;
+        
+        // 2. Check that this is a results file that is all there
+        header = (const ResultsHeader *)base;
+        if ((size < sizeof(ResultsHeader)) ||
+            (0 != memcmp(header->magic, RESULTS_MAGIC, 8)) ||
+            (RESULTS_VERSION != header->version) ||
+            ((4 != header->value_size) && (8 != header->value_size)) ||
+            (size < sizeof(ResultsHeader) + 
+                    header->columns*sizeof(ResultsColumnInfo))) {
+            close();
+            return false;
+        }
+        infos = (ResultsColumnInfo *)(base + sizeof(ResultsHeader));
+        for (int c = 0; c < get_columns(); ++c) {
+            if (infos[c].offset + (uint64_t)header->rows*header->value_size 
+                > size) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    void close(void)
+    {
+#ifndef _WIN32
+        if (mapped) munmap(base, size);
+#else
+        free(base);
+#endif
+        base = NULL;
+        size = 0;
+        mapped = false;
+        header = NULL;
+        infos = NULL;
+    }
+    
+    bool   is_open()       const { return NULL != base; }
+    int    get_columns()   const { return header->columns; }
+    int    get_rows()      const { return header->rows; }
+    int    get_steps()     const { return header->steps; }
+    int    get_walkers()   const { return header->walkers; }
+    int    get_grids()     const { return header->grids; }
+    int    get_value_size() const { return header->value_size; }
+    ResultsColumnInfo *get_info(int c) const { return &infos[c]; }
+    
+    // The column of averages of a series, as float64 or float32
+    const double *doubles(int c) const 
+    { 
+        return (8 == header->value_size) ? 
+               (const double *)(base + infos[c].offset) : NULL; 
+    }
+    const float *floats(int c) const 
+    { 
+        return (4 == header->value_size) ? 
+               (const float *)(base + infos[c].offset) : NULL; 
+    }
+    double get_value(int c, int step) const
+    {
+        if (8 == header->value_size) return doubles(c)[step];
+        return floats(c)[step];
+    }
+};
+
+// --------------------------------------------------------------------
+//                                                        ResultsSeries
+// One column of a results file, looking like the Rewards it came from
+// --------------------------------------------------------------------
+class ResultsSeries
+{
+    const ResultsFile *file;
+    int column;
+    
+public:
+    ResultsSeries(const ResultsFile *f=NULL, int c=0) { file = f; column = c; }
+    
+    double get_average(int step) const { return file->get_value(column, step); }
+    double get_total()     const { return file->get_info(column)->total; }
+    int    get_count()     const { return file->get_info(column)->count; }
+    int    get_index()     const { return file->get_rows(); }
+    char * get_initials()  const { return file->get_info(column)->initials; }
+    char * get_colname()   const { return file->get_info(column)->colname; }
+    char * get_rowname()   const { return file->get_info(column)->rowname; }
+};
+
+// --------------------------------------------------------------------
+//                                                      convert_results
+// Write the l.csv, t.csv and t.tex files from a binary results file
+// --------------------------------------------------------------------
+int convert_results(const char *filename, const char *basename, int skip=100)
+{
+    ResultsFile file;
+    
+    // 1. Open the results
+    if (!file.open(filename)) return 0;
+    
+    // 2. Make the series look like Rewards
+    int columns = file.get_columns();
+    ResultsSeries *series = new ResultsSeries[columns];
+    ResultsSeries **ps = (ResultsSeries **)calloc(columns+1, 
+                                                 sizeof(ResultsSeries *));
+    for (int c = 0; c < columns; ++c) {
+        series[c] = ResultsSeries(&file, c);
+        ps[c] = &series[c];
+    }
+    
+    // 3. And write them out as text
+    int kntw = file.get_walkers();
+    int kntg = file.get_grids();
+    write_lines(basename, kntw, kntg, ps, file.get_steps(), skip);
+    write_totals(basename, kntw, kntg, ps, file.get_steps());
+    write_table_totals(basename, kntw, kntg, ps, file.get_steps());
+    
+    // 4. Release the series
+    free(ps);
+    delete [] series;
+    return 1;
+}
+
+// ====================================================================
+//                                                     ExperimentRunner
+// Run every walker x grid x repeat experiment on a pool of threads.
+// Each job gets its own grid, walker and random number stream.  The
+// results of a cell are merged in repeat order, so the totals do not
+// depend on the number of threads or the order the jobs finish.
+// With lanes set, the repeats of QLearner cells are run as batches of
+// that many lanes.  A lane uses the streams its job would have, so the
+// results are the same either way.
+// With a StopRule the experiments of a cell are run in rounds: the
+// first round has the fewest repeats allowed, and after each round the
+// cells whose results are not yet close enough get as many more as they
+// look like needing.  Only results that have been merged in order are
+// looked at, so the rounds too are the same whatever the thread count.
+// A shard runs only its own block of the jobs, in job order (whole
+// cells when there are at least as many cells as shards), and ignores
+// any StopRule, which needs all the repeats of a cell.
+// Experiments write into Rewards buffers from a pool, and a buffer goes
+// back to the pool as soon as it is added to its cell, so the memory
+// used depends on the threads and not on the number of repeats.
+// ====================================================================
+// --------------------------------------------------------------------
+// When to stop repeating the experiment of one cell: once the 95%
+// confidence interval of the mean total reward (or of the mean rolling
+// reward after the perturbation) is narrower than width times that mean.
+// A cell always gets at least min repeats and never more than asked for.
+// --------------------------------------------------------------------
+#define STOP_NONE  0
+#define STOP_TOTAL 1
+#define STOP_AFTER 2
+#define STOP_MIN_REPEATS 5
+
+struct StopRule {
+    int    metric;
+    double width;
+    int    min;
+    
+    StopRule(int m = STOP_NONE, double w = 0.0, int mn = STOP_MIN_REPEATS)
+        : metric(m), width(w), min(mn) {}
+    
+    // What the rule looks at in the results of one run
+    double measure(const Rewards *r, int pstep) const
+    {
+        if (STOP_AFTER == metric) 
+            return r->get_mean(pstep + 2, r->get_index());
+        return r->get_total();
+    }
+    
+    // How many runs are wanted after n, whose measures have the mean and
+    // sum of squared differences given
+    int wanted(int n, double mean, double m2, int most) const
+    {
+        // 1. Enough already if the interval is narrow enough
+        if (n >= most) return n;
+        if (n < 2) return (min > n) ? min : n + 1;
+        double half = REWARDS_Z * sqrt(m2 / (n - 1));
+        double target = width * fabs(mean);
+        if (2.0 * half <= target * sqrt(double(n))) return n;
+        
+        // 2. Otherwise as many as would make it so at this deviation
+        double runs = (target > 0.0) ? 2.0 * half / target : most;
+        int want = (runs*runs < most) ? (int)ceil(runs*runs) : most;
+        return (want > n) ? want : n + 1;
+    }
+};
+
+static std::mutex mcl_lock;
+
+class ExperimentRunner
+{
+    const char *basename;
+    int        *walkers;
+    Grid      **grids;
+    Rewards   **rewards;
+    int         kntw;
+    int         kntg;
+    int         repeat;
+    int         steps;
+    int         pstep;
+    int         mult;
+    unsigned long long seed;
+    int         jobs;
+    bool        policy;
+    int         lanes;
+    bool        record;
+    int         cadence;
+    const WalkerParams *params;
+    StopRule    stop;
+    int        *target;
+    int        *planned;
+    int         scheduled;
+    int         shard_lo;
+    int         shard_hi;
+    double     *stat_mean;
+    double     *stat_m2;
+    int         tasks;
+    int        *task_cell;
+    int        *task_first;
+    int        *task_count;
+    Rewards  ***pending;
+    int        *merged;
+    std::mutex *locks;
+    Rewards   **pool;
+    int         pooled;
+    int         buffers;
+    std::mutex  pool_lock;
+    std::atomic<int> next_task;
+    std::atomic<int> next_worker;
+    std::atomic<int> done_jobs;
+    
+public:
+    ExperimentRunner(const char *bn, int *w, Grid **g, Rewards **r,
+                     int nw, int ng, int rp, int st, int ps, int mu,
+                     unsigned long long sd)
+    {
+        basename = bn;
+        walkers  = w;
+        grids    = g;
+        rewards  = r;
+        kntw     = nw;
+        kntg     = ng;
+        repeat   = rp;
+        steps    = st;
+        pstep    = ps;
+        mult     = mu;
+        seed     = sd;
+        jobs     = kntw * kntg * repeat;
+        shard_lo = 0;
+        shard_hi = jobs;
+        policy   = true;
+        lanes    = 0;
+        record   = false;
+        cadence  = MONITOR_EVERY;
+        params   = NULL;
+        tasks    = 0;
+        task_cell  = (int *)calloc(jobs + 1, sizeof(int));
+        task_first = (int *)calloc(jobs + 1, sizeof(int));
+        task_count = (int *)calloc(jobs + 1, sizeof(int));
+        next_task = 0;
+        next_worker = 0;
+        done_jobs = 0;
+        
+        // 1. Each cell holds the results that are waiting to be merged
+        pending = (Rewards ***)calloc(kntw * kntg, sizeof(Rewards **));
+        merged  = (int *)calloc(kntw * kntg, sizeof(int));
+        target  = (int *)calloc(kntw * kntg, sizeof(int));
+        planned = (int *)calloc(kntw * kntg, sizeof(int));
+        stat_mean = (double *)calloc(kntw * kntg, sizeof(double));
+        stat_m2   = (double *)calloc(kntw * kntg, sizeof(double));
+        scheduled = 0;
+        for (int c = 0; c < kntw * kntg; ++c) {
+            pending[c] = (Rewards **)calloc(repeat, sizeof(Rewards *));
+        }
+        locks = new std::mutex[kntw * kntg];
+        
+        // 2. The pool of rewards buffers starts out empty
+        pool    = (Rewards **)calloc(jobs + 1, sizeof(Rewards *));
+        pooled  = 0;
+        buffers = 0;
+    }
+    
+    ~ExperimentRunner()
+    {
+        for (int b = 0; b < pooled; ++b) delete pool[b];
+        free(pool);
+        for (int c = 0; c < kntw * kntg; ++c) free(pending[c]);
+        free(pending);
+        free(merged);
+        free(target);
+        free(planned);
+        free(stat_mean);
+        free(stat_m2);
+        free(task_cell);
+        free(task_first);
+        free(task_count);
+        delete [] locks;
+    }
+    
+    int get_jobs()  const { return jobs; }
+    int get_done()  const { return done_jobs; }
+    int get_tasks() const { return tasks; }
+    int get_buffers() const { return buffers; }
+    
+    Rewards *take_buffer(void)
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        if (pooled > 0) return pool[--pooled];
+        ++buffers;
+        return new Rewards(steps + ROLLING_AVERAGE_SIZE + 2);
+    }
+    
+    void give_buffer(Rewards *r)
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        pool[pooled++] = r;
+    }
+    void set_policy(bool p) { policy = p; }
+    void set_lanes(int k)   { lanes = k; }
+    void set_record(bool r) { record = r; }
+    void set_cadence(int c) { cadence = c; }
+    void set_params(const WalkerParams *p) { params = p; }
+    void set_stop(const StopRule &s) { stop = s; }
+    
+    // The jobs of the i'th of n shards (from 0)
+    void set_shard(int i, int n)
+    {
+        long long cells = kntw * kntg;
+        if (cells >= n) {
+            shard_lo = (int)(cells * i / n) * repeat;
+            shard_hi = (int)(cells * (i + 1) / n) * repeat;
+        } else {
+            shard_lo = (int)((long long)jobs * i / n);
+            shard_hi = (int)((long long)jobs * (i + 1) / n);
+        }
+    }
+    int get_shard_lo() const { return shard_lo; }
+    int get_shard_hi() const { return shard_hi; }
+    
+    // A walker of the iw'th kind, with the iw'th parameters if there are any
+    Walker *make_walker(int iw) const
+    {
+        if (NULL == params) return walker_factory(walkers[iw]);
+        return walker_factory(walkers[iw], params[iw]);
+    }
+    
+    int batchable(int cell) const
+    {
+        return (lanes > 1) && !record && 
+               (WALK_QLEARNER == walkers[cell / kntg]) &&
+               (BATCH_NONE != ChippyBatch::kind_of(grids[cell % kntg]));
+    }
+    
+    void plan(void)
+    {
+        // 1. One task per job, or per batch of jobs, in job order, for
+        //    the jobs up to the target of each cell not yet planned
+        tasks = 0;
+        for (int cell = 0; cell < kntw * kntg; ++cell) {
+            int size = batchable(cell) ? lanes : 1;
+            int last = target[cell];
+            for (int first = planned[cell]; first < last; first += size) {
+                task_cell[tasks]  = cell;
+                task_first[tasks] = first;
+                task_count[tasks] = (last - first < size) ? 
+                                    (last - first) : size;
+                ++tasks;
+            }
+            scheduled += last - planned[cell];
+            planned[cell] = last;
+        }
+    }
+    
+    void note(int cell, const Rewards *result)
+    {
+        // 1. Keep the mean and squared differences of what stop measures
+        int    n = merged[cell] + 1;
+        double x = stop.measure(result, pstep);
+        double delta = x - stat_mean[cell];
+        stat_mean[cell] += delta / n;
+        stat_m2[cell]   += delta * (x - stat_mean[cell]);
+    }
+    
+    void merge(int cell, int num, Rewards *result)
+    {
+        // 1. Merge all the results of this cell that are now in order
+        std::lock_guard<std::mutex> guard(locks[cell]);
+        pending[cell][num] = result;
+        while ((merged[cell] < repeat) && 
+               (NULL != pending[cell][merged[cell]])) {
+            if (STOP_NONE != stop.metric) 
+                note(cell, pending[cell][merged[cell]]);
+            rewards[cell]->add(pending[cell][merged[cell]]);
+            give_buffer(pending[cell][merged[cell]]);
+            pending[cell][merged[cell]] = NULL;
+            ++merged[cell];
+        }
+    }
+    
+    void run_job(int job, TrajectoryRecorder *recorder=NULL)
+    {
+        // 1. Determine the cell and repeat number of the job
+        int cell = job / repeat;
+        int num  = job % repeat;
+        int iw   = cell / kntg;
+        int ig   = cell % kntg;
+        
+        // 2. Walkers that are not reentrant have to take turns, from
+        //    before they are made until after they are gone
+        std::unique_lock<std::mutex> serial(mcl_lock, std::defer_lock);
+        if (!walker_reentrant(walkers[iw])) serial.lock();
+        
+        // 3. Create a grid and walker just for this job, each with its
+        //    own random number stream derived from the cell and repeat
+        unsigned long long stream = ((unsigned long long)cell << 32) | num;
+        Walker *w = make_walker(iw);
+        Grid *g = grids[ig]->clone();
+        w->set_seed(seed, 2*stream);
+        g->set_seed(seed, 2*stream+1);
+        w->set_grid(g);
+        w->set_cadence(cadence);
+        if (NULL != recorder) {
+            recorder->set_run(walkers[iw], ig, num);
+            w->set_recorder(recorder);
+        }
+        
+        // 4. Run the experiment, writing the policy for the first one
+        Rewards *result = dispatch_experiment(walkers[iw], steps, pstep, mult,
+                                              w, basename, 
+                                              policy && (0 == num),
+                                              take_buffer());
+        delete w;
+        delete g;
+        if (serial.owns_lock()) serial.unlock();
+        
+        // 5. Merge the result with the others of the cell
+        merge(cell, num, result);
+    }
+    
+    void run_batch(int cell, int first, int count)
+    {
+        // 1. Determine which grid and walker
+        int iw = cell / kntg;
+        int ig = cell % kntg;
+        
+        // 2. A walker on its own grid for the names and the policy
+        Walker *w = make_walker(iw);
+        Grid *g = grids[ig]->clone();
+        w->set_grid(g);
+        
+        // 3. One lane per job, each with the streams of that job
+        ChippyBatch batch(g, (QLearner *)w, count);
+        for (int l = 0; l < count; ++l) {
+            unsigned long long stream = 
+                ((unsigned long long)cell << 32) | (first + l);
+            batch.get_walker_random(l)->set_seed(seed, 2*stream);
+            batch.get_grid_random(l)->set_seed(seed, 2*stream+1);
+        }
+        
+        // 4. Run them, writing the policy when the first job is in it
+        Rewards **results = (Rewards **)calloc(count, sizeof(Rewards *));
+        for (int l = 0; l < count; ++l) results[l] = take_buffer();
+        batch_experiment(steps, pstep, mult, &batch, w, basename, 
+                         policy && (0 == first), results);
+        delete w;
+        delete g;
+        
+        // 5. Merge the results with the others of the cell
+        for (int l = 0; l < count; ++l) merge(cell, first + l, results[l]);
+        free(results);
+    }
+    
+    void work()
+    {
+        TrajectoryRecorder recorder;
+        char filename[256];
+        
+        // 1. When recording, each worker has a trajectory file of its own
+        if (record) {
+            snprintf(filename, sizeof(filename), "%sj%d.traj", 
+                     basename, (int)next_worker++);
+            if (!recorder.open(filename)) {
+                cerr << "Unable to write trajectory file " << filename << endl;
+            }
+        }
+        
+        // 2. Take tasks in order until there are none left
+        for (int t = next_task++; t < tasks; t = next_task++) {
+            if (batchable(task_cell[t])) {
+                run_batch(task_cell[t], task_first[t], task_count[t]);
+            } else {
+                run_job(task_cell[t] * repeat + task_first[t], 
+                        record ? &recorder : NULL);
+            }
+            done_jobs += task_count[t];
+        }
+    }
+    
+    void run_tasks(int threads)
+    {
+        int reported = -1;
+        
+        // 1. Start the workers on the tasks planned
+        next_task = 0;
+        std::thread *workers = new std::thread[threads];
+        for (int t = 0; t < threads; ++t) {
+            workers[t] = std::thread(&ExperimentRunner::work, this);
+        }
+        
+        // 2. Report progress from here so the workers never wait on cout
+        while (reported < scheduled) {
+            int done = done_jobs;
+            if (done != reported) {
+                cout << "\r    " << done << "/" << scheduled << " experiments";
+                cout.flush();
+                reported = done;
+            }
+            if (done < scheduled) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            }
+        }
+        
+        // 3. Wait for the workers to finish
+        for (int t = 0; t < threads; ++t) workers[t].join();
+        delete [] workers;
+    }
+    
+    void run(int threads)
+    {
+        int cell;
+        
+        // 1. Every repeat in the shard, or the fewest a stopping rule allows
+        bool stopping = (STOP_NONE != stop.metric) && 
+                        (0 == shard_lo) && (jobs == shard_hi);
+        for (cell = 0; cell < kntw * kntg; ++cell) {
+            int lo = shard_lo - cell * repeat;
+            int hi = shard_hi - cell * repeat;
+            lo = (lo < 0) ? 0 : ((lo > repeat) ? repeat : lo);
+            hi = (hi < lo) ? lo : ((hi > repeat) ? repeat : hi);
+            merged[cell]  = lo;
+            planned[cell] = lo;
+            target[cell]  = hi;
+            if (stopping && (stop.min < repeat)) 
+                target[cell] = (stop.min > 1) ? stop.min : 1;
+        }
+        
+        // 2. Run rounds until no cell wants any more
+        for (plan(); tasks > 0; plan()) {
+            run_tasks(threads);
+            if (!stopping) break;
+            for (cell = 0; cell < kntw * kntg; ++cell) {
+                target[cell] = stop.wanted(merged[cell], stat_mean[cell],
+                                           stat_m2[cell], repeat);
+            }
+        }
+        cout << " OK" << endl;
+    }
+};
+
+// ====================================================================
+//                                                               shards
+// The experiments of -e can be spread over machines that share only a
+// file system: each runs one shard (--shard i/N) and writes the sums of
+// its results to <basename>p<i>of<N>.bin, then merge_shards() (-m) adds
+// the shards together in order and writes the results files just as a
+// run without shards would have.  When each shard has whole cells the
+// sums are the same to the last bit; a cell split between shards is 
+// summed in a different order, so it can differ in the last digits.
+// ====================================================================
+struct ShardHeader {
+    char basename[200];
+    int  shard;
+    int  shards;
+    unsigned long long seed;
+    int  repeat;
+    int  steps;
+    int  kntw;
+    int  kntg;
+    
+    void save(Snapshot &s) const
+    {
+        int length = strlen(basename);
+        s.put_tag("Shard");
+        s.put_int(length);
+        s.put(basename, length);
+        s.put_int(shard);
+        s.put_int(shards);
+        s.put(&seed, sizeof(seed));
+        s.put_int(repeat);
+        s.put_int(steps);
+        s.put_int(kntw);
+        s.put_int(kntg);
+    }
+    int load(Snapshot &s)
+    {
+        if (!s.get_tag("Shard")) return 0;
+        int length = s.get_int();
+        if (!s.ok() || (length < 0) || (length >= (int)sizeof(basename))) 
+            return 0;
+        s.get(basename, length);
+        basename[length] = '\0';
+        shard  = s.get_int();
+        shards = s.get_int();
+        s.get(&seed, sizeof(seed));
+        repeat = s.get_int();
+        steps  = s.get_int();
+        kntw   = s.get_int();
+        kntg   = s.get_int();
+        return s.ok() && (shard >= 0) && (shard < shards) && 
+               (kntw > 0) && (kntg > 0);
+    }
+    
+    // Shards of the same experiments
+    bool same(const ShardHeader &other) const
+    {
+        return (0 == strcmp(basename, other.basename)) &&
+               (shards == other.shards) && (seed == other.seed) &&
+               (repeat == other.repeat) && (steps == other.steps) &&
+               (kntw == other.kntw) && (kntg == other.kntg);
+    }
+};
+
+int write_shard(const char *basename, int shard, int shards,
+                unsigned long long seed, int repeat, int steps,
+                int kntw, int kntg, Rewards **rewards)
+{
+    ShardHeader header;
+    Snapshot s;
+    char filename[256];
+    
+    // 1. Create the file
+    snprintf(filename, sizeof(filename), "%sp%dof%d.bin", 
+             basename, shard, shards);
+    if (!s.create(filename)) return 0;
+    
+    // 2. Write what the shards have to agree on, then the sums of each cell
+    snprintf(header.basename, sizeof(header.basename), "%s", basename);
+    header.shard  = shard;
+    header.shards = shards;
+    header.seed   = seed;
+    header.repeat = repeat;
+    header.steps  = steps;
+    header.kntw   = kntw;
+    header.kntg   = kntg;
+    header.save(s);
+    for (int c = 0; c < kntw * kntg; ++c) rewards[c]->save(s);
+    
+    // 3. It is only there if it was all written
+    return s.close();
+}
+
+int merge_shards(int nfiles, char **files, 
+                 int format=FORMAT_BOTH, int stats=STATS_NONE)
+{
+    ShardHeader first, header;
+    Snapshot s;
+    int f, c, k;
+    int merged = 0;
+    
+    // 1. The shards must all be of the same experiments, and different
+    if ((nfiles < 1) || !s.open(files[0]) || !first.load(s)) {
+        cerr << "Not a shard file: " << ((nfiles > 0) ? files[0] : "") 
+             << endl;
+        return 0;
+    }
+    int *file_of = (int *)malloc(first.shards * sizeof(int));
+    for (k = 0; k < first.shards; ++k) file_of[k] = -1;
+    for (f = 0; f < nfiles; ++f) {
+        if (!s.open(files[f]) || !header.load(s) || !header.same(first)) {
+            cerr << "Not a shard of the same experiments: " << files[f] 
+                 << endl;
+            free(file_of);
+            return 0;
+        }
+        if (-1 != file_of[header.shard]) {
+            cerr << "Shard " << header.shard << " is there twice" << endl;
+            free(file_of);
+            return 0;
+        }
+        file_of[header.shard] = f;
+    }
+    s.close();
+    
+    // 2. Add up the cells, shard by shard in order
+    int cells = first.kntw * first.kntg;
+    Rewards **rewards = (Rewards **)calloc(cells + 1, sizeof(Rewards *));
+    Rewards *part = new Rewards(first.steps);
+    for (c = 0; c < cells; ++c) rewards[c] = new Rewards(first.steps);
+    for (k = 0; k < first.shards; ++k) {
+        if (-1 == file_of[k]) {
+            cerr << "Shard " << k << " of " << first.shards 
+                 << " is missing" << endl;
+            continue;
+        }
+        bool ok = s.open(files[file_of[k]]) && header.load(s);
+        for (c = 0; ok && (c < cells); ++c) {
+            if (0 == merged) ok = rewards[c]->load(s);
+            else if ((ok = part->load(s)) && (part->get_count() > 0)) 
+                rewards[c]->add(part);
+        }
+        s.close();
+        if (!ok) {
+            cerr << "Unable to read shard file " << files[file_of[k]] << endl;
+            merged = 0;
+            break;
+        }
+        ++merged;
+    }
+    
+    // 3. Write the results files
+    if (merged > 0) {
+        printf("%d of %d shards of %s\n", merged, first.shards, 
+               first.basename);
+        if (!write_results(first.basename, first.kntw, first.kntg, rewards, 
+                           first.steps, format, stats)) merged = 0;
+    }
+    
+    // 4. Release allocated storage
+    for (c = 0; c < cells; ++c) delete rewards[c];
+    free(rewards);
+    free(file_of);
+    delete part;
+    return merged;
+}
+
+// ====================================================================
+//                                                          experiments
+// Repeat the chippy experiment multiple times
+// ====================================================================
+void experiments(const char *basename,
+                 int repeat=EXP_REPEAT, 
+                 int steps=EXP_STEPS, 
+                 int pstep=EXP_PERTURB, 
+                 int mult=0,
+                 int *walkers = NULL, Grid **grids = NULL,
+                 int threads = 1, unsigned long long seed = 1,
+                 int lanes = 0, int format = FORMAT_BOTH,
+                 int cadence = MONITOR_EVERY,
+                 const StopRule &stop = StopRule(),
+                 int stats = STATS_NONE,
+                 int shard = 0, int shards = 1)
+{
+    int *wi;
+    Grid   **gi;
+    Walker *w;
+    int     kntw = 0;
+    int     kntg = 0;
+    int     kntr = 0;
+    Rewards** ri; 
+    Rewards** rewards;
+    int     i;
+    
+    // 1. Count the number of walkers and grids
+    if (NULL != walkers) {
+        for (wi = walkers; WALK_NONE != *wi; ++wi)
+            ++kntw;
+    }
+    if (NULL != grids) {
+        for (gi = grids; NULL != *gi; ++gi)
+            ++kntg;
+    }
+    kntr = kntw *kntg;
+    if (threads < 1) threads = std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    printf("%d walkers, %d grids, %d rewards, %d threads, seed %llu\n", 
+           kntw, kntg, kntr, threads, seed);
+    if (lanes > 1) printf("QLearner batches of %d lanes\n", lanes);
+    if (shards > 1) printf("shard %d of %d\n", shard, shards);
+    if (0 == kntr) return;
+    
+    // 2. Allocate and initialize rewards
+    rewards = (Rewards**)calloc(1+kntr, sizeof(Rewards*));
+    for (i = 0; i < kntr; ++i) {
+        rewards[i] = new Rewards(steps);
+        if (stats & STATS_QUANTILES) rewards[i]->keep_quantiles();
+    }
+    rewards[kntr] = NULL;
+
+    // 3. Name the results for all the walkers and grids
+    for (ri = rewards, wi = walkers; WALK_NONE != *wi; ++wi)
+    {
+        w = walker_factory(*wi);
+        printf("walker %s\n", w->name());
+        for (gi = grids; NULL !=*gi; ++gi, ++ri)
+        {
+            (*ri)->set_rowname(w->name());
+            (*ri)->set_colname((*gi)->name());
+            (*ri)->set_initials(w->initials(), (*gi)->initials());
+        }
+        delete w;
+    }
+    
+    // 4. Run all of the experiments
+    ExperimentRunner runner(basename, walkers, grids, rewards,
+                            kntw, kntg, repeat, steps, pstep, mult, seed);
+    runner.set_lanes(lanes);
+    runner.set_record(0 != (format & FORMAT_TRAJECTORY));
+    runner.set_cadence(cadence);
+    runner.set_stop(stop);
+    if (shards > 1) runner.set_shard(shard, shards);
+    runner.run(threads);
+    if ((STOP_NONE != stop.metric) && (shards <= 1)) {
+        int runs = 0;
+        for (i = 0; i < kntr; ++i) runs += rewards[i]->get_count();
+        printf("%d of %d repeats\n", runs, kntr * repeat);
+    }
+
+    // 5. Write the results files (or the sums of this shard)
+    if (shards > 1) {
+        if (!write_shard(basename, shard, shards, seed, repeat, steps, 
+                         kntw, kntg, rewards)) {
+            cerr << "Unable to write shard " << shard << " of " << shards 
+                 << endl;
+        }
+    } else {
+        if ((format & FORMAT_TEXT) && (STOP_NONE != stop.metric)) 
+            write_repeats(basename, kntw, kntg, rewards);
+        write_results(basename, kntw, kntg, rewards, steps, format, stats);
+    }
+    
+    // 6. Release allocated storage
+    for (i = 0; i < kntr; ++i) {
+        delete rewards[i];
+    }
+    free(rewards);
+}
+
+// ====================================================================
+//                                                                sweep
+// Run one walker on one kind of grid for every combination of learning
+// parameters (alpha, gamma, epsilon and the MCL threshold), grid sizes
+// and reward pairs, and write one row per combination to <basename>s.csv
+// so the table can be pivoted into a heatmap.  Each axis is a list 
+// (a,b,c) or an inclusive range (from:to:step).  All the combinations go
+// to one ExperimentRunner, so they share the threads and the same seed 
+// gives the same table whatever the number of threads.
+// ====================================================================
+#define SWEEP_MAX 32
+#define SWEEP_MAX_CELLS 1024
+#define SWEEP_MIN_SIZE 3    // corner goals and a square between to jump to
+
+struct SweepAxis {
+    int    n;
+    double v[SWEEP_MAX];
+    
+    SweepAxis(double d = 0.0) { set(d); }
+    void set(double d) { n = 1; v[0] = d; }
+    
+    // Returns false, and leaves the axis as it was, if the text is bad
+    // (or, for whole numbers, any value is not one or is below least)
+    bool parse(const char *text, bool whole=false, int least=INT_MIN)
+    {
+        SweepAxis axis;
+        double from, to, step;
+        char *end;
+        
+        // 1. An inclusive range from:to:step
+        axis.n = 0;
+        if (NULL != strchr(text, ':')) {
+            if (3 != sscanf(text, "%lf:%lf:%lf", &from, &to, &step)) 
+                return false;
+            if ((step <= 0.0) || (to < from)) return false;
+            for (int i = 0; from + i*step <= to + step*1e-9; ++i) {
+                if (SWEEP_MAX == axis.n) return false;
+                axis.v[axis.n++] = from + i*step;
+            }
+            
+        // 2. Or a list of values a,b,c
+        } else {
+            for (const char *p = text; *p; p = end) {
+                double d = strtod(p, &end);
+                if ((end == p) || (SWEEP_MAX == axis.n)) return false;
+                axis.v[axis.n++] = d;
+                if (',' == *end) ++end;
+                else if ('\0' != *end) return false;
+            }
+            if (0 == axis.n) return false;
+        }
+        
+        // 3. Whole numbers must be just that
+        for (int i = 0; whole && (i < axis.n); ++i) {
+            if ((axis.v[i] != floor(axis.v[i])) || (axis.v[i] < least)) 
+                return false;
+        }
+        *this = axis;
+        return true;
+    }
+};
+
+struct SweepSpec {
+    bool      on;
+    SweepAxis alpha;
+    SweepAxis gamma;
+    SweepAxis epsilon;
+    SweepAxis threshold;
+    SweepAxis size;
+    int       rewards;          // 0 = the rewards of the grid
+    int       r1[SWEEP_MAX];
+    int       r2[SWEEP_MAX];
+    
+    SweepSpec() : on(false), size(8), rewards(0)
+    {
+        WalkerParams p;
+        alpha.set(p.alpha);
+        gamma.set(p.gamma);
+        epsilon.set(p.epsilon);
+        threshold.set(p.threshold);
+    }
+    
+    int walkers() const { return alpha.n * gamma.n * epsilon.n * threshold.n; }
+    int grids()   const { return size.n * ((rewards > 0) ? rewards : 1); }
+    
+    // Reward pairs r1/r2,r1/r2,...  (false if the text is bad)
+    bool parse_rewards(const char *text)
+    {
+        int k = 0;
+        int a, b, used;
+        for (const char *p = text; *p; p += used) {
+            if ((SWEEP_MAX == k) || 
+                (2 != sscanf(p, "%d/%d%n", &a, &b, &used))) return false;
+            r1[k] = a;
+            r2[k++] = b;
+            if (',' == p[used]) ++used;
+            else if ('\0' != p[used]) return false;
+        }
+        if (0 == k) return false;
+        rewards = k;
+        return true;
+    }
+};
+
+template <class S>
+void write_sweep(const char *basename, int kntw, int kntg, 
+                 const WalkerParams *params, Grid **grids, 
+                 S** rewards, int pstep)
+{
+    // 1. Create Output file
+    char filename[256];
+    strcpy(filename, basename);
+    strcat(filename, "s.csv");
+    ofstream out(filename);
+    
+    // 2. Output column headers
+    out << "walker,grid,alpha,gamma,epsilon,threshold,n,r1,r2,"
+        << "runs,total,sd,before,after" << endl;
+    
+    // 3. Loop for all of the combinations
+    S** ri = rewards;
+    for (int w = 0; w < kntw; ++w) {
+        for (int g = 0; g < kntg; ++g, ++ri) {
+            Chippy *grid = (Chippy *)grids[g];
+            
+            // 4. The average rolling reward before and after perturbing
+            int    last   = (*ri)->get_index();
+            int    split  = (pstep + 2 < last) ? pstep + 2 : last;
+            double before = (*ri)->get_mean(1, split);
+            double after  = (*ri)->get_mean(split, last);
+            
+            // 5. Output the parameters and the results of one combination
+            out << (*ri)->get_rowname() << "," << (*ri)->get_colname()
+                << "," << params[w].alpha << "," << params[w].gamma 
+                << "," << params[w].epsilon << "," << params[w].threshold
+                << "," << grid->get_n() << "," << grid->get_r1() 
+                << "," << grid->get_r2() 
+                << "," << (*ri)->get_count() 
+                << "," << (*ri)->get_total()/(*ri)->get_count()
+                << "," << sqrt((*ri)->get_total_variance())
+                << "," << before << "," << after << endl;
+        }
+    }
+}
+
+int sweep(const char *basename, int iwalk, int igrid, 
+          const SweepSpec &spec,
+          int repeat=EXP_REPEAT, int threads=1, 
+          unsigned long long seed=1, int lanes=0,
+          int steps=EXP_STEPS, int pstep=EXP_PERTURB,
+          const StopRule &stop = StopRule())
+{
+    int kntw = spec.walkers();
+    int kntg = spec.grids();
+    int kntr = kntw * kntg;
+    int a, b, c, d, i;
+    
+    // 1. There is a limit to how much we will run (and keep) at once
+    if (threads < 1) threads = std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    printf("%d parameter sets, %d grids, %d threads, seed %llu\n", 
+           kntw, kntg, threads, seed);
+    if (kntr > SWEEP_MAX_CELLS) {
+        cerr << "Too many combinations (" << kntr << " > " 
+             << SWEEP_MAX_CELLS << ")" << endl;
+        return 0;
+    }
+    
+    // 2. The walker (once per set of learning parameters)
+    WalkerParams *params = new WalkerParams[kntw];
+    int *walkers = (int *)calloc(kntw + 1, sizeof(int));
+    i = 0;
+    for (a = 0; a < spec.alpha.n; ++a)
+        for (b = 0; b < spec.gamma.n; ++b)
+            for (c = 0; c < spec.epsilon.n; ++c)
+                for (d = 0; d < spec.threshold.n; ++d, ++i) {
+                    params[i] = WalkerParams(spec.alpha.v[a], 
+                                             spec.gamma.v[b],
+                                             spec.epsilon.v[c],
+                                             (int)spec.threshold.v[d]);
+                    walkers[i] = iwalk;
+                }
+    walkers[kntw] = WALK_NONE;
+    
+    // 3. The grid (once per size and reward pair)
+    Chippy *proto = (Chippy *)grid_factory(igrid);
+    Grid **grids = (Grid **)calloc(kntg + 1, sizeof(Grid *));
+    i = 0;
+    for (a = 0; a < spec.size.n; ++a) {
+        if (0 == spec.rewards) {
+            grids[i++] = grid_factory(igrid, (int)spec.size.v[a],
+                                      proto->get_r1(), proto->get_r2());
+        }
+        for (b = 0; b < spec.rewards; ++b) {
+            grids[i++] = grid_factory(igrid, (int)spec.size.v[a],
+                                      spec.r1[b], spec.r2[b]);
+        }
+    }
+    grids[kntg] = NULL;
+    delete proto;
+    
+    // 4. Allocate and name the results of every combination
+    Rewards **rewards = (Rewards **)calloc(kntr + 1, sizeof(Rewards *));
+    Walker *w = walker_factory(iwalk);
+    for (i = 0; i < kntr; ++i) {
+        rewards[i] = new Rewards(steps);
+        rewards[i]->set_rowname(w->name());
+        rewards[i]->set_colname(grids[i % kntg]->name());
+        rewards[i]->set_initials(w->initials(), grids[i % kntg]->initials());
+    }
+    delete w;
+    
+    // 5. Run all of the experiments
+    ExperimentRunner runner(basename, walkers, grids, rewards,
+                            kntw, kntg, repeat, steps, pstep, 0, seed);
+    runner.set_params(params);
+    runner.set_stop(stop);
+    runner.set_policy(false);
+    runner.set_lanes(lanes);
+    runner.run(threads);
+    
+    // 6. Write the table
+    write_sweep(basename, kntw, kntg, params, grids, rewards, pstep);
+    
+    // 7. Release allocated storage
+    for (i = 0; i < kntr; ++i) delete rewards[i];
+    for (i = 0; i < kntg; ++i) delete grids[i];
+    free(rewards);
+    free(grids);
+    free(walkers);
+    delete [] params;
+    return kntr;
+}
+
+
+
+// ====================================================================
 //                                                           unit tests
 // ====================================================================
+void TestRandom();
 void Testrandint();
 void Testorient_value();
 void TestSquare();
 void TestSquare_testEmptyConstructor();
 void TestSquare_testConstructor();
 void TestSquare_testSuggestions();
+void TestSquare_testArgmax();
 void TestGoal();
 void TestGoal_testEmptyConstructor();
 void TestGoal_testConstructor();
@@ -3112,6 +7984,9 @@ void TestGrid_testEmptyConstructor();
 void TestGrid_testConstructor();
 void TestGrid_testMoves();
 void TestGrid_testSquares();
+void TestGrid_testStores();
+void TestGrid_testGoalIndex();
+void TestGrid_testCompact();
 void TestChippy();
 void TestChippy_testEmptyConstructor();
 void TestChippy_testConstructor();
@@ -3145,6 +8020,10 @@ void TestQLearner_testEmptyConstructor();
 void TestQLearner_testConstructor();
 void TestQLearner_testLearning();
 void TestQLearner_test10k();
+void TestQLearner_testEngine();
+void TestQLearner_testSnapshot();
+void TestQLearner_testFork();
+void TestQLearner_testRecord();
 void TestQLMCLSimple();
 void TestQLMCLSimple_testEmptyConstructor();
 void TestQLMCLSimple_testConstructor();
@@ -3153,6 +8032,8 @@ void TestQLMCLSimple_testCH20k();
 void TestQLMCLSimple_testCL10k();
 void TestQLMCLSimple_testCO10k();
 void TestQLMCLSimple_testCR10k();
+void TestQLMCLSimple_testExpectations();
+void TestQLMCLSimple_testEngine();
 void TestQLMCLSensitive();
 void TestQLMCLSensitive_testEmptyConstructor();
 void TestQLMCLSensitive_testConstructor();
@@ -3161,6 +8042,7 @@ void TestQLMCLSensitive_testCH20k();
 void TestQLMCLSensitive_testCL10k();
 void TestQLMCLSensitive_testCO10k();
 void TestQLMCLSensitive_testCR10k();
+void TestQLMCLSensitive_testPipeline();
 void TestQLMCLSophisticated();
 void TestQLMCLSophisticated_testEmptyConstructor();
 void TestQLMCLSophisticated_testConstructor();
@@ -3169,6 +8051,8 @@ void TestQLMCLSophisticated_testCH20k();
 void TestQLMCLSophisticated_testCL10k();
 void TestQLMCLSophisticated_testCO10k();
 void TestQLMCLSophisticated_testCR10k();
+void TestQLMCLSophisticated_testSnapshot();
+void TestQLMCLSophisticated_testTrace();
 void TestQLMCLBayes1();
 void TestQLMCLBayes1_testEmptyConstructor();
 void TestQLMCLBayes1_testConstructor();
@@ -3186,7 +8070,17 @@ void TestQLMCLBayes2_testCL10k();
 void TestQLMCLBayes2_testCO10k();
 void TestQLMCLBayes2_testCR10k();
 void TestQLMCLBayes2_testCL10p5();
+void TestLocalMCL();
+void TestLocalMCL_testExpectations();
+void TestLocalMCL_testLadder();
+void TestLocalMCL_testAgents();
+void TestLocalMCL_testHandles();
+void TestLocalMCL_testSnapshot();
+void TestLocalMCL_testCadence();
 void TestRollingAverage();
+void TestDecimatedSeries();
+void TestDecimatedSeries_testBuckets();
+void TestDecimatedSeries_testSoak();
 void TestRollingAverage_testEmptyConstructor();
 void TestRollingAverage_testConstructor();
 void TestRollingAverage_testAverages();
@@ -3195,13 +8089,27 @@ void TestRewards_testEmptyConstructor();
 void TestRewards_testConstructor();
 void TestRewards_testAppend();
 void TestRewards_testAdd();
-
+void TestRewards_testVariance();
+void TestRewards_testQuantiles();
+void TestRewards_testBinary();
+void TestChippyBatch();
+void TestChippyBatch_testLanes();
+void TestChippyBatch_testPerturb();
+void TestChippyBatch_testStatistics();
+void TestExperimentRunner();
+void TestExperimentRunner_testThreads();
+void TestExperimentRunner_testSweep();
+void TestExperimentRunner_testStop();
+void TestExperimentRunner_testShards();
+
+void TestRandom();
 void Testrandint();
 void Testorient_value();
 void TestSquare();
 void TestSquare_testEmptyConstructor();
 void TestSquare_testConstructor();
 void TestSquare_testSuggestions();
+void TestSquare_testArgmax();
 void TestGoal();
 void TestGoal_testEmptyConstructor();
 void TestGoal_testConstructor();
@@ -3210,6 +8118,9 @@ void TestGrid_testEmptyConstructor();
 void TestGrid_testConstructor();
 void TestGrid_testMoves();
 void TestGrid_testSquares();
+void TestGrid_testStores();
+void TestGrid_testGoalIndex();
+void TestGrid_testCompact();
 void TestChippy();
 void TestChippy_testEmptyConstructor();
 void TestChippy_testConstructor();
@@ -3243,6 +8154,10 @@ void TestQLearner_testEmptyConstructor();
 void TestQLearner_testConstructor();
 void TestQLearner_testLearning();
 void TestQLearner_test10k();
+void TestQLearner_testEngine();
+void TestQLearner_testSnapshot();
+void TestQLearner_testFork();
+void TestQLearner_testRecord();
 void TestQLMCLSimple();
 void TestQLMCLSimple_testEmptyConstructor();
 void TestQLMCLSimple_testConstructor();
@@ -3251,6 +8166,8 @@ void TestQLMCLSimple_testCH20k();
 void TestQLMCLSimple_testCL10k();
 void TestQLMCLSimple_testCO10k();
 void TestQLMCLSimple_testCR10k();
+void TestQLMCLSimple_testExpectations();
+void TestQLMCLSimple_testEngine();
 void TestQLMCLSensitive();
 void TestQLMCLSensitive_testEmptyConstructor();
 void TestQLMCLSensitive_testConstructor();
@@ -3259,6 +8176,7 @@ void TestQLMCLSensitive_testCH20k();
 void TestQLMCLSensitive_testCL10k();
 void TestQLMCLSensitive_testCO10k();
 void TestQLMCLSensitive_testCR10k();
+void TestQLMCLSensitive_testPipeline();
 void TestQLMCLSophisticated();
 void TestQLMCLSophisticated_testEmptyConstructor();
 void TestQLMCLSophisticated_testConstructor();
@@ -3267,6 +8185,8 @@ void TestQLMCLSophisticated_testCH20k();
 void TestQLMCLSophisticated_testCL10k();
 void TestQLMCLSophisticated_testCO10k();
 void TestQLMCLSophisticated_testCR10k();
+void TestQLMCLSophisticated_testSnapshot();
+void TestQLMCLSophisticated_testTrace();
 void TestQLMCLBayes1();
 void TestQLMCLBayes1_testEmptyConstructor();
 void TestQLMCLBayes1_testConstructor();
@@ -3284,7 +8204,17 @@ void TestQLMCLBayes2_testCL10k();
 void TestQLMCLBayes2_testCO10k();
 void TestQLMCLBayes2_testCR10k();
 void TestQLMCLBayes2_testCL10p5();
+void TestLocalMCL();
+void TestLocalMCL_testExpectations();
+void TestLocalMCL_testLadder();
+void TestLocalMCL_testAgents();
+void TestLocalMCL_testHandles();
+void TestLocalMCL_testSnapshot();
+void TestLocalMCL_testCadence();
 void TestRollingAverage();
+void TestDecimatedSeries();
+void TestDecimatedSeries_testBuckets();
+void TestDecimatedSeries_testSoak();
 void TestRollingAverage_testEmptyConstructor();
 void TestRollingAverage_testConstructor();
 void TestRollingAverage_testAverages();
@@ -3293,10 +8223,23 @@ void TestRewards_testEmptyConstructor();
 void TestRewards_testConstructor();
 void TestRewards_testAppend();
 void TestRewards_testAdd();
+void TestRewards_testVariance();
+void TestRewards_testQuantiles();
+void TestRewards_testBinary();
+void TestChippyBatch();
+void TestChippyBatch_testLanes();
+void TestChippyBatch_testPerturb();
+void TestChippyBatch_testStatistics();
+void TestExperimentRunner();
+void TestExperimentRunner_testThreads();
+void TestExperimentRunner_testSweep();
+void TestExperimentRunner_testStop();
+void TestExperimentRunner_testShards();
 
 void unittests()
 {
     cout << "Running unittests ... " << endl;
+    TestRandom();
     Testrandint();
     Testorient_value();
     TestSquare();
@@ -3312,8 +8255,42 @@ void unittests()
     TestQLMCLSophisticated();
     TestQLMCLBayes1();
     TestQLMCLBayes2();
+    TestLocalMCL();
     TestRollingAverage();
+    TestDecimatedSeries();
     TestRewards();
+    TestChippyBatch();
+    TestExperimentRunner();
+    cout << "OK" << endl;
+}
+
+void TestRandom()
+{
+    Random r1(42, 7);
+    Random r2(42, 7);
+    Random r3(42, 8);
+    int value[10] = {0,0,0,0,0,0,0,0,0,0};
+    int same = 0;
+    cout << "  Random ... ";
+    for (int i=0; i<1000; ++i) {
+        unsigned long long v1 = r1.next();
+        assert(v1 == r2.next());
+        if (v1 == r3.next()) ++same;
+        int v = r1.below(10);
+        assert(v >= 0);
+        assert(v < 10);
+        value[v]++;
+        r2.below(10);
+    }
+    assert(same == 0);
+    for (int j=0; j<10; ++j) {
+        assert(value[j] > 50);
+    }
+    r3.set_state(r1.get_key(), r1.get_counter());
+    assert(r1.next() == r3.next());
+    r1.set_seed(42, 7);
+    r2.set_seed(42, 7);
+    assert(r1.randint(1, 6) == r2.randint(1, 6));
     cout << "OK" << endl;
 }
 
@@ -3363,6 +8340,7 @@ void TestSquare()
     TestSquare_testEmptyConstructor();
     TestSquare_testConstructor();
     TestSquare_testSuggestions();
+    TestSquare_testArgmax();
     cout << "OK" << endl;
 }
 
@@ -3401,6 +8379,40 @@ void TestSquare_testSuggestions()
     delete s;
 }
 
+void TestSquare_testArgmax()
+{
+    Random r;
+    double q[DIR_NUM], vbest, sbest;
+    int counts[DIR_NUM] = {0};
+    
+    // 1. The vector kernel agrees with the scalar one, ties and all
+    r.set_seed(7);
+    for (int i = 0; i < 10000; ++i)
+    {
+        for (int dir = 0; dir < DIR_NUM; ++dir) q[dir] = r.below(4) - 2.0;
+        if (0 == i%3) q[r.below(DIR_NUM)] = 1.0/3.0;
+        unsigned vmask = argmax_mask(q, &vbest);
+        unsigned smask = argmax_mask_scalar(q, &sbest);
+        assert(vmask == smask);
+        assert(vbest == sbest);
+        assert(Square::max_of(q) == sbest);
+        assert((vmask >> Square::best_of(q, &r)) & 1);
+    }
+    
+    // 2. A single best direction does not use the generator
+    q[0] = 1.0; q[1] = 2.0; q[2] = 0.5; q[3] = -1.0;
+    unsigned long long counter = r.get_counter();
+    assert(Square::best_of(q, &r) == 1);
+    assert(r.get_counter() == counter);
+    
+    // 3. Ties are broken uniformly
+    q[0] = 1.0; q[1] = 2.0; q[2] = 2.0; q[3] = 2.0;
+    for (int i = 0; i < 30000; ++i) ++counts[Square::best_of(q, &r)];
+    assert(counts[0] == 0);
+    for (int dir = 1; dir < DIR_NUM; ++dir)
+        assert(counts[dir] > 9500 && counts[dir] < 10500);
+}
+
 void TestGoal()
 {
     cout << "  Goal ... ";
@@ -3460,6 +8472,9 @@ void TestGrid()
     TestGrid_testConstructor();
     TestGrid_testMoves();
     TestGrid_testSquares();
+    TestGrid_testStores();
+    TestGrid_testGoalIndex();
+    TestGrid_testCompact();
     cout << "OK" << endl;
 }
 
@@ -3622,6 +8637,152 @@ void TestGrid_testSquares()
     delete g;
 }
 
+void TestGrid_testStores()
+{
+    // 1. Both stores start out empty
+    Grid *c = new Grid(5, NULL, STORE_CONTIGUOUS);
+    Grid *s = new Grid(5, NULL, STORE_SQUARES);
+    assert(c->get_store() == STORE_CONTIGUOUS);
+    assert(s->get_store() == STORE_SQUARES);
+    assert(c->get_q(2, 3, DIR_E) == 0.0);
+    assert(s->get_q(2, 3, DIR_E) == 0.0);
+    
+    // 2. The grid and the square views see the same values
+    c->set_q(2, 3, DIR_E, 1.5);
+    s->set_q(2, 3, DIR_E, 1.5);
+    assert(c->square(2, 3)->get_q(DIR_E) == 1.5);
+    assert(s->square(2, 3)->get_q(DIR_E) == 1.5);
+    c->square(4, 1)->set_q(DIR_S, -2.0);
+    assert(c->get_q(4, 1, DIR_S) == -2.0);
+    assert(c->q_at(4, 1) == c->square(4, 1)->get_qs());
+    assert(c->max(4, 1) == 0.0);
+    assert(c->max(2, 3) == 1.5);
+    assert(c->suggest(2, 3) == DIR_E);
+    assert(s->suggest(2, 3) == DIR_E);
+    
+    // 3. Other square values are kept separately
+    c->square(1, 1)->set_visits(7);
+    c->square(1, 2)->set_letter('x');
+    assert(c->square(1, 1)->get_visits() == 7);
+    assert(c->square(1, 2)->get_visits() == 0);
+    assert(c->square(1, 2)->get_letter() == 'x');
+    
+    // 4. Reset clears the q values
+    c->reset();
+    s->reset();
+    assert(c->get_q(2, 3, DIR_E) == 0.0);
+    assert(s->get_q(2, 3, DIR_E) == 0.0);
+    
+    // 5. Clones keep the store
+    Grid *cc = c->clone();
+    assert(cc->get_store() == STORE_CONTIGUOUS);
+    delete cc;
+    delete c;
+    delete s;
+}
+
+void TestGrid_testCompact()
+{
+    // 1. Float and fixed point grids hold values closely
+    Chippy *f = new Chippy(8, 10, -10, STORE_FLOAT);
+    Chippy *i = new Chippy(8, 10, -10, STORE_INT16);
+    assert(STORE_FLOAT == f->get_store());
+    assert(STORE_INT16 == i->get_store());
+    assert(fabs(i->get_q_scale() - Q16_HEADROOM*10/Q16_MAX) < 1e-12);
+    f->set_q(2, 3, DIR_E, 1.1);
+    i->set_q(2, 3, DIR_E, 1.1);
+    assert(float(1.1) == f->get_q(2, 3, DIR_E));
+    assert(fabs(i->get_q(2, 3, DIR_E) - 1.1) <= i->get_q_scale()/2);
+    assert(0.0 == i->get_q(3, 2, DIR_E));
+    
+    // 2. Fixed point values stop at the range
+    i->set_q(1, 1, DIR_N, 1000.0);
+    i->set_q(1, 1, DIR_S, -1000.0);
+    assert(fabs(i->get_q(1, 1, DIR_N) - Q16_HEADROOM*10) < 1e-9);
+    assert(fabs(i->get_q(1, 1, DIR_S) + Q16_HEADROOM*10) < 1e-9);
+    
+    // 3. Two squares can be looked at at once
+    double *a = i->q_at(2, 3);
+    double *b = i->q_at(1, 1);
+    assert(a[DIR_E] > 1.0);
+    assert(b[DIR_N] > 100.0);
+    assert(DIR_N == i->suggest(1, 1));
+    
+    // 4. Squares are copies for drawing
+    assert(float(1.1) == f->square(2, 3)->get_q(DIR_E));
+    f->set_q(2, 3, DIR_E, 2.5);
+    assert(2.5 == f->square(2, 3)->get_q(DIR_E));
+    
+    // 5. Reset clears them, and clones keep the store
+    i->reset();
+    assert(0.0 == i->get_q(1, 1, DIR_N));
+    Grid *c = f->clone();
+    assert(STORE_FLOAT == c->get_store());
+    
+    // 6. A learner does about as well with either
+    Chippy *d = new Chippy();
+    QLearner *qd = new QLearner(d);
+    QLearner *qf = new QLearner(f);
+    f->reset();
+    d->set_seed(1);
+    f->set_seed(1);
+    qd->set_seed(2);
+    qf->set_seed(2);
+    for (int step = 0; step < 5000; ++step) {
+        qd->move();
+        qf->move();
+    }
+    assert(qf->get_score() > 0.8 * qd->get_score());
+    
+    delete qd;
+    delete qf;
+    delete c;
+    delete d;
+    delete f;
+    delete i;
+}
+
+void TestGrid_testGoalIndex()
+{
+    // 1. Many goals, two of them on the same square
+    Goal *goals[41];
+    for (int i = 0; i < 40; ++i) 
+        goals[i] = new Goal(i, (i*7)%10, (i*3)%10, LOC_RAN, LOC_RAN);
+    goals[40] = NULL;
+    goals[39]->set_x(goals[0]->get_x());
+    goals[39]->set_y(goals[0]->get_y());
+    Grid *g = new Grid(10, goals);
+    
+    // 2. The index agrees with searching the list
+    for (int x = -1; x <= 10; ++x)
+        for (int y = -1; y <= 10; ++y)
+            assert(g->goal_at(x, y) == g->goal_scan(x, y));
+    assert(g->goal_at(0, 0) == goals[0]);
+    
+    // 3. Moving a goal needs set_goals to update the index
+    goals[5]->set_x(9);
+    goals[5]->set_y(9);
+    g->set_goals(goals);
+    assert(g->goal_at(9, 9) == goals[5]);
+    for (int x = 0; x < 10; ++x)
+        for (int y = 0; y < 10; ++y)
+            assert(g->goal_at(x, y) == g->goal_scan(x, y));
+    g->set_goals(NULL);
+    assert(g->goal_at(9, 9) == NULL);
+    delete g;
+    for (int i = 0; i < 40; ++i) delete goals[i];
+    
+    // 4. Rotating the goals keeps the index up to date
+    ChippyRotate *r = new ChippyRotate(6);
+    for (int p = 0; p < 5; ++p) {
+        for (int x = 0; x < 6; ++x)
+            for (int y = 0; y < 6; ++y)
+                assert(r->goal_at(x, y) == r->goal_scan(x, y));
+        r->perturb();
+    }
+    delete r;
+}
+
 void TestChippy()
 {
     cout << "  Chippy ... ";
@@ -4710,195 +9871,876 @@ void TestRotate_testMoves()
     assert(7 == new_x);
     assert(7 == new_y);
 
-    assert(g->goal_at(0,7) == g->move(0, 6, DIR_N, &new_x, &new_y));
-    assert(g->goal_at(0,7)->get_reward() == 10);
-    assert(0 != new_x);
-    assert(0 != new_y);
-    assert(7 != new_x);
-    assert(7 != new_y);
-    assert(g->goal_at(7,0) == g->move(7, 1, DIR_S, &new_x, &new_y));
-    assert(g->goal_at(7,0)->get_reward() == -10);
-    assert(0 != new_x);
-    assert(0 != new_y);
-    assert(7 != new_x);
-    assert(7 != new_y);
+    assert(g->goal_at(0,7) == g->move(0, 6, DIR_N, &new_x, &new_y));
+    assert(g->goal_at(0,7)->get_reward() == 10);
+    assert(0 != new_x);
+    assert(0 != new_y);
+    assert(7 != new_x);
+    assert(7 != new_y);
+    assert(g->goal_at(7,0) == g->move(7, 1, DIR_S, &new_x, &new_y));
+    assert(g->goal_at(7,0)->get_reward() == -10);
+    assert(0 != new_x);
+    assert(0 != new_y);
+    assert(7 != new_x);
+    assert(7 != new_y);
+    delete g;
+}
+
+void TestRotate_testSquares()
+{
+    ChippyRotate *g = new ChippyRotate();
+    assert(g->get_n()  == 8);
+    assert(g->goal_at(0,0)->get_reward() == 10);
+    assert(g->goal_at(7,7)->get_reward() == -10);
+    assert(g->square(3, 4)->get_x() == 3);
+    assert(g->square(3, 4)->get_y() == 4);
+    delete g;
+}
+
+void TestWalker()
+{
+    cout << "  Walker ... ";
+    TestWalker_testEmptyConstructor();
+    TestWalker_testConstructor();
+    TestWalker_testMoves();
+    cout << "OK" << endl;
+}
+
+void TestWalker_testEmptyConstructor()
+{
+    Walker *w = new Walker();
+    assert(0   == w->get_score());
+    assert(0   == w->get_count());
+    assert(0   == w->get_x());
+    assert(0   == w->get_y());
+    delete w;
+}
+void TestWalker_testConstructor()
+{
+    Grid   *g = new Grid();
+    Walker *w = new Walker(g);
+    assert(0   == w->get_score());
+    assert(0   == w->get_count());
+    assert(4   == w->get_x());
+    assert(4   == w->get_y());
+    delete g;
+    delete w;
+}
+
+void TestWalker_testMoves()
+{
+    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
+    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
+    Goal *goals[3] = {g1, g2, NULL};
+    
+    Grid   *g = new Grid(8,goals);
+    Walker *w = new Walker(g, 0, 0);
+    assert(0   == w->get_score());
+    assert(0   == w->get_count());
+    assert(0   == w->get_x());
+    assert(0   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(0   == w->get_x());
+    assert(1   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(0   == w->get_x());
+    assert(2   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(0   == w->get_x());
+    assert(3   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(0   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(1   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(2   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(3   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(4   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(5   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(6   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(7   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(7   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_E));
+    assert(7   == w->get_x());
+    assert(4   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(7   == w->get_x());
+    assert(5   == w->get_y());
+    assert(NULL== w->move(DIR_N));
+    assert(7   == w->get_x());
+    assert(6   == w->get_y());
+    assert(g->goal_at(7,7) == w->move(DIR_N));
+    assert(g->goal_at(7,7)->get_reward() == -10);
+    assert(0   == w->get_x());
+    assert(0   == w->get_y());
+    assert(NULL== w->move(DIR_S));
+    assert(0   == w->get_x());
+    assert(0   == w->get_y());
+    assert(-10 == w->get_score());
+    assert(17  == w->get_count());
+    
+    delete g1;
+    delete g2;
+    delete g;
+    delete w;
+}
+
+void TestQLearner()
+{
+    cout << "  QLearner ... ";
+    TestQLearner_testEmptyConstructor();
+    TestQLearner_testConstructor();
+    TestQLearner_testLearning();
+    TestQLearner_test10k();
+    TestQLearner_testEngine();
+    TestQLearner_testSnapshot();
+    TestQLearner_testFork();
+    TestQLearner_testRecord();
+    cout << "OK" << endl;
+}
+
+void TestQLearner_testEmptyConstructor()
+{
+    QLearner *q = new QLearner();
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(0    == q->get_x());
+    assert(0    == q->get_y());
+    assert(0.05 == q->get_epsilon());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    delete q;
+}
+
+void TestQLearner_testConstructor()
+{
+    Grid   *g = new Grid();
+    QLearner *q = new QLearner(g, 1, 2, 0.8, 0.7, 0.1);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(1    == q->get_x());
+    assert(2    == q->get_y());
+    assert(0.1  == q->get_epsilon());
+    assert(0.8  == q->get_alpha());
+    assert(0.7  == q->get_gamma());
+    delete g;
+    delete q;
+}
+
+void TestQLearner_testLearning()
+{
+    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
+    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
+    Goal *goals[3] = {g1, g2, NULL};
+    Grid   *g = new Grid(8,goals);
+    QLearner *q = new QLearner(g, 0, 0, 0.5, 0.9, 0.05);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(0    == q->get_x());
+    assert(0    == q->get_y());
+    assert(0.05 == q->get_epsilon());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    q->move(DIR_N);
+    q->move(DIR_E);
+    q->move(DIR_S);
+    q->move(DIR_W);
+    assert(10    == q->get_score());
+    assert(4    == q->get_count());
+    assert(7    == q->get_x());
+    assert(7    == q->get_y());
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_W);
+    assert(7    == q->get_x());
+    assert(7    == q->get_y());
+    assert(0.0  == g->square(1,0)->get_q(0));
+    assert(0.0  == g->square(1,0)->get_q(1));
+    assert(0.0  == g->square(1,0)->get_q(2));
+    assert(7.5  == g->square(1,0)->get_q(3)); 
+    assert(0.0  == g->square(1,1)->get_q(0));
+    assert(2.25 == g->square(1,1)->get_q(1));
+    assert(0.0  == g->square(1,1)->get_q(2));
+    assert(0.0  == g->square(1,1)->get_q(3));
+    
+    delete g1;
+    delete g2;
+    delete g;
+    delete q;
+}
+
+void TestQLearner_test10k()
+{
+    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
+    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
+    Goal *goals[3] = {g1, g2, NULL};
+    Grid   *g = new Grid(8,goals);
+    QLearner *q = new QLearner(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.05 == q->get_epsilon());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    for (int i = 0; i < 10000; ++i)
+        q->move();
+    assert(10000 == q->get_count());
+    delete g1;
+    delete g2;
     delete g;
+    delete q;
 }
 
-void TestRotate_testSquares()
+void TestQLearner_testEngine()
 {
-    ChippyRotate *g = new ChippyRotate();
-    assert(g->get_n()  == 8);
-    assert(g->goal_at(0,0)->get_reward() == 10);
-    assert(g->goal_at(7,7)->get_reward() == -10);
-    assert(g->square(3, 4)->get_x() == 3);
-    assert(g->square(3, 4)->get_y() == 4);
+    // The compiled engine gives the same results as the virtual one
+    int kinds[] = {WALK_WALKER, WALK_QLEARNER, WALK_SIMPLE, WALK_SENSITIVE,
+                   WALK_SOPHISTICATED, WALK_NONE};
+    int sizes[] = {ENGINE_N, 6, 0};
+    for (int *k = kinds; *k != WALK_NONE; ++k)
+    {
+        for (int *n = sizes; *n; ++n)
+        {
+            Grid *g1 = new ChippyClassic(*n);
+            Grid *g2 = new ChippyClassic(*n);
+            Walker *w1 = walker_factory(*k);
+            Walker *w2 = walker_factory(*k);
+            w1->set_grid(g1);
+            w2->set_grid(g2);
+            w1->set_seed(3, 0);
+            w2->set_seed(3, 0);
+            g1->set_seed(3, 1);
+            g2->set_seed(3, 1);
+            Rewards *r1 = experiment(3000, 1500, 0, w1);
+            Rewards *r2 = dispatch_experiment(*k, 3000, 1500, 0, w2);
+            assert(r1->get_index() == r2->get_index());
+            assert(r1->get_total() == r2->get_total());
+            for (int i = 0; i < r1->get_index(); ++i)
+                assert(r1->get_reward(i) == r2->get_reward(i));
+            assert(w1->get_x() == w2->get_x());
+            assert(w1->get_count() == w2->get_count());
+            delete r1;
+            delete r2;
+            delete w1;
+            delete w2;
+            delete g1;
+            delete g2;
+        }
+    }
+}
+// FGJMjpsw
+
+// Walk w1 part way, checkpoint it, and check that w2 (of the same kind
+// but seeded differently) carries on from the checkpoint exactly as w1
+// carries on from where it was
+int snapshot_resumes(Walker *w1, Walker *w2, int steps, int pstep)
+{
+    // 1. Walk the first half, perturbing part way, and checkpoint
+    w1->get_grid()->set_seed(1);
+    w1->set_seed(2);
+    w2->get_grid()->set_seed(3);
+    w2->set_seed(4);
+    RollingAverage avg1, avg2;
+    for (int step = 0; step < steps; ++step) {
+        if (step == pstep) w1->get_grid()->perturb();
+        Goal *g = w1->move();
+        avg1.add(g ? g->get_reward() : 0);
+    }
+    if (!save_snapshot("testsnapshot.bin", w1, &avg1)) return 0;
+    if (!load_snapshot("testsnapshot.bin", w2, &avg2)) return 0;
+    remove("testsnapshot.bin");
+    
+    // 2. Both carry on the same way, perturbing again
+    for (int step = 0; step < steps; ++step) {
+        if (step == pstep) {
+            w1->get_grid()->perturb();
+            w2->get_grid()->perturb();
+        }
+        Goal *g1 = w1->move();
+        Goal *g2 = w2->move();
+        avg1.add(g1 ? g1->get_reward() : 0);
+        avg2.add(g2 ? g2->get_reward() : 0);
+        if (w1->get_x() != w2->get_x() || w1->get_y() != w2->get_y()) return 0;
+        if (avg1.get_average() != avg2.get_average()) return 0;
+    }
+    
+    // 3. And have learned the same things
+    Grid *g1 = w1->get_grid();
+    Grid *g2 = w2->get_grid();
+    for (int x = 0; x < g1->get_n(); ++x)
+        for (int y = 0; y < g1->get_n(); ++y)
+            for (int dir = 0; dir < DIR_NUM; ++dir)
+                if (g1->get_q(x, y, dir) != g2->get_q(x, y, dir)) return 0;
+    return w1->get_score() == w2->get_score();
+}
+
+void TestQLearner_testSnapshot()
+{
+    // 1. A rotating grid carries on from where it was
+    ChippyRotate *g1 = new ChippyRotate();
+    ChippyRotate *g2 = new ChippyRotate();
+    QLearner *q1 = new QLearner(g1);
+    QLearner *q2 = new QLearner(g2);
+    assert(snapshot_resumes(q1, q2, 3000, 1000));
+    assert(q1->get_count() == q2->get_count());
+    assert(q1->get_policy_number() == q2->get_policy_number());
+    
+    // 2. A snapshot only loads into the same kinds of objects
+    ChippyClassic *g3 = new ChippyClassic();
+    QLearner *q3 = new QLearner(g3);
+    QLMCLSimple *q4 = new QLMCLSimple(g2);
+    RollingAverage avg;
+    assert(1 == save_snapshot("testsnapshot.bin", q1));
+    assert(0 == load_snapshot("testsnapshot.bin", q3));
+    assert(0 == load_snapshot("testsnapshot.bin", q4));
+    assert(0 == load_snapshot("testsnapshot.bin", q2, &avg));
+    assert(1 == load_snapshot("testsnapshot.bin", q2));
+    assert(0 == load_snapshot("nosuchsnapshot.bin", q2));
+    remove("testsnapshot.bin");
+    
+    delete q1;
+    delete q2;
+    delete q3;
+    delete q4;
+    delete g1;
+    delete g2;
+    delete g3;
+}
+
+void TestQLearner_testFork()
+{
+    // 1. Variants: perturbation steps, every so often, never, and
+    //    grids with the same goals and with other goals
+    const int steps = 2000;
+    ChippyClassic *classic = new ChippyClassic();
+    ChippyRotate *rotate = new ChippyRotate();
+    ChippyCorner *corner = new ChippyCorner();
+    ExperimentFork forks[] = {{NULL, 1000, 0}, {NULL, 1500, 0}, 
+                              {NULL, 700, 1}, {NULL, 0, 0},
+                              {rotate, 1000, 0}, {corner, 1000, 0}};
+    const int nforks = sizeof(forks) / sizeof(forks[0]);
+    Rewards *rwds[nforks] = {NULL};
+    
+    // 2. Run them all from one walker
+    Grid *g = classic->clone();
+    QLearner *q = new QLearner(g);
+    g->set_seed(1);
+    q->set_seed(2);
+    assert(5 == fork_experiment(WALK_QLEARNER, steps, q, nforks, forks, rwds));
+    
+    // 3. Each is what the experiment by itself gives
+    for (int f = 0; f < nforks; ++f) {
+        Grid *fg = (forks[f].grid ? forks[f].grid : classic)->clone();
+        QLearner *fq = new QLearner(fg);
+        fg->set_seed(1);
+        fq->set_seed(2);
+        Rewards *r = experiment(steps, forks[f].pstep, forks[f].mult, fq);
+        assert(r->get_index() == rwds[f]->get_index());
+        for (int i = 0; i < r->get_index(); ++i) 
+            assert(r->get_reward(i) == rwds[f]->get_reward(i));
+        assert(0 == strcmp(r->get_colname(), rwds[f]->get_colname()));
+        delete r;
+        delete fq;
+        delete fg;
+        delete rwds[f];
+    }
+    delete q;
     delete g;
+    delete classic;
+    delete rotate;
+    delete corner;
 }
 
-void TestWalker()
+void TestQLearner_testRecord()
+{
+    // 1. The same experiment without and with a recorder
+    const int steps = 3 * TRAJECTORY_ROWS;
+    TrajectoryRecorder recorder;
+    Rewards *r[2];
+    for (int recording = 0; recording < 2; ++recording) {
+        Grid *g = new ChippyClassic();
+        QLearner *q = new QLearner(g);
+        g->set_seed(1);
+        q->set_seed(2);
+        if (recording) {
+            assert(recorder.open("testrecord.traj"));
+            recorder.set_run(WALK_QLEARNER, 3, 7);
+            q->set_recorder(&recorder);
+        }
+        r[recording] = dispatch_experiment(WALK_QLEARNER, steps, steps/2, 0, q);
+        delete q;
+        delete g;
+    }
+    
+    // 2. Recording does not change the walk, and costs 40 bytes a step
+    assert(r[0]->get_total() == r[1]->get_total());
+    assert(40 == sizeof(TrajectoryRow));
+    long rows = recorder.close();
+    assert(steps + ROLLING_AVERAGE_SIZE + 1 == rows);
+    
+    // 3. The CSV has a row for every step, each starting where the
+    //    last one finished
+    assert(rows == convert_trajectory("testrecord.traj", "testrecord.csv"));
+    ifstream csv("testrecord.csv");
+    string line;
+    getline(csv, line);
+    assert(line == TRAJECTORY_HEADER);
+    int knt = 0;
+    int last_x = LOC_CTR;
+    int last_y = LOC_CTR;
+    while (getline(csv, line)) {
+        int runner, exp, num, step, sx, sy, dir, rx, ry, expected, actual;
+        int fx, fy, suggestion;
+        char why;
+        double qn, qs, qe, qw;
+        assert(19 == sscanf(line.c_str(), 
+                            "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%c,"
+                            "%lf,%lf,%lf,%lf,%d",
+                            &runner, &exp, &num, &step, &sx, &sy, &dir, 
+                            &rx, &ry, &expected, &actual, &fx, &fy, &why,
+                            &qn, &qs, &qe, &qw, &suggestion));
+        assert((WALK_QLEARNER == runner) && (3 == exp) && (7 == num));
+        assert(knt == step);
+        assert((0 == knt) || ((sx == last_x) && (sy == last_y)));
+        assert(('P' == why) || ('R' == why));
+        assert(expected == actual);
+        assert(SUGGEST_NONE == suggestion);
+        last_x = fx;
+        last_y = fy;
+        ++knt;
+    }
+    assert(rows == knt);
+    
+    // 4. Not a trajectory file
+    assert(!is_trajectory("testrecord.csv"));
+    assert(-1 == convert_trajectory("testrecord.csv", "testrecord.csv"));
+    csv.close();
+    remove("testrecord.traj");
+    remove("testrecord.csv");
+    delete r[0];
+    delete r[1];
+}
+
+void TestQLMCLSimple()
 {
-    cout << "  Walker ... ";
-    TestWalker_testEmptyConstructor();
-    TestWalker_testConstructor();
-    TestWalker_testMoves();
+    cout << "  QLearner MCL Simple ... ";
+    TestQLMCLSimple_testEmptyConstructor();
+    TestQLMCLSimple_testConstructor();
+    TestQLMCLSimple_testLearning();
+    TestQLMCLSimple_testCH20k();
+    TestQLMCLSimple_testCL10k();
+    TestQLMCLSimple_testCO10k();
+    TestQLMCLSimple_testCR10k();
+    TestQLMCLSimple_testExpectations();
+    TestQLMCLSimple_testEngine();
     cout << "OK" << endl;
 }
 
-void TestWalker_testEmptyConstructor()
+void TestQLMCLSimple_testEmptyConstructor()
+{
+    QLMCLSimple *q = new QLMCLSimple();
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(0    == q->get_x());
+    assert(0    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_resets());
+    delete q;
+}
+
+void TestQLMCLSimple_testConstructor()
+{
+    Grid   *g = new Grid();
+    QLMCLSimple *q = new QLMCLSimple(g,2,4,4,0.8,0.7,0.1);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.8  == q->get_alpha());
+    assert(0.7  == q->get_gamma());
+    assert(0.1  == q->get_epsilon());
+    assert(2    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_resets());
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSimple_testLearning()
+{
+    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
+    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
+    Goal *goals[3] = {g1, g2, NULL};
+    Grid   *g = new Grid(8,goals);
+    QLMCLSimple *q = new QLMCLSimple(g, 2, 0, 0, 0.5, 0.9, 0.05);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(0    == q->get_x());
+    assert(0    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    assert(2    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_resets());
+    q->move(DIR_N); // 0,0->0,1
+    assert(0    == q->get_x());
+    assert(1    == q->get_y());
+    q->move(DIR_E); // 0,1->1,1
+    assert(1    == q->get_x());
+    assert(1    == q->get_y());
+    q->move(DIR_S); // 1,1->1,0
+    assert(1    == q->get_x());
+    assert(0    == q->get_y());
+    q->move(DIR_W); // 1,0->0,0 jumpto 7,7
+    assert(4    == q->get_count());
+    assert(7    == q->get_x());
+    assert(7    == q->get_y());
+    assert(10   == q->get_score());
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_W);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_S);
+    q->move(DIR_W);
+    assert(7    == q->get_x());
+    assert(7    == q->get_y());
+    assert(0.0  == g->square(1,0)->get_q(0));
+    assert(0.0  == g->square(1,0)->get_q(1));
+    assert(0.0  == g->square(1,0)->get_q(2));
+    assert(7.5  == g->square(1,0)->get_q(3)); 
+    assert(0.0  == g->square(1,1)->get_q(0));
+    assert(2.25 == g->square(1,1)->get_q(1));
+    assert(0.0  == g->square(1,1)->get_q(2));
+    assert(0.0  == g->square(1,1)->get_q(3));
+    delete g1;
+    delete g2;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSimple_testCH20k()
+{
+    //cout << "---------- TestQLMCLSimple_testCH20k ----------" << endl;
+    Grid   *g = new ChippyClassic(8);
+    QLMCLSimple *q = new QLMCLSimple(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 20000; ++i)
+        q->move();
+    assert(20000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_resets());
+    assert(0    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSimple_testCL10k()
+{
+    //cout << "---------- TestQLMCLSimple_testCL10k ----------" << endl;
+    Grid   *g = new ChippyClassic(8);
+    QLMCLSimple *q = new QLMCLSimple(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_resets());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSimple_testCO10k()
 {
-    Walker *w = new Walker();
-    assert(0   == w->get_score());
-    assert(0   == w->get_count());
-    assert(0   == w->get_x());
-    assert(0   == w->get_y());
-    delete w;
+    //cout << "---------- TestQLMCLSimple_testCO10k ----------" << endl;
+    Grid   *g = new ChippyCorner(8);
+    QLMCLSimple *q = new QLMCLSimple(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
 }
-void TestWalker_testConstructor()
+
+void TestQLMCLSimple_testCR10k()
 {
-    Grid   *g = new Grid();
-    Walker *w = new Walker(g);
-    assert(0   == w->get_score());
-    assert(0   == w->get_count());
-    assert(4   == w->get_x());
-    assert(4   == w->get_y());
+    //cout << "---------- TestQLMCLSimple_testCR10k ----------" << endl;
+    Grid   *g = new ChippyRotate(8);
+    QLMCLSimple *q = new QLMCLSimple(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
-    delete w;
+    delete q;
 }
 
-void TestWalker_testMoves()
+void TestQLMCLSimple_testExpectations()
 {
-    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
-    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
-    Goal *goals[3] = {g1, g2, NULL};
+    Expectations *e = new Expectations(3);
     
-    Grid   *g = new Grid(8,goals);
-    Walker *w = new Walker(g, 0, 0);
-    assert(0   == w->get_score());
-    assert(0   == w->get_count());
-    assert(0   == w->get_x());
-    assert(0   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(0   == w->get_x());
-    assert(1   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(0   == w->get_x());
-    assert(2   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(0   == w->get_x());
-    assert(3   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(0   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(1   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(2   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(3   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(4   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(5   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(6   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(7   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(7   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_E));
-    assert(7   == w->get_x());
-    assert(4   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(7   == w->get_x());
-    assert(5   == w->get_y());
-    assert(NULL== w->move(DIR_N));
-    assert(7   == w->get_x());
-    assert(6   == w->get_y());
-    assert(g->goal_at(7,7) == w->move(DIR_N));
-    assert(g->goal_at(7,7)->get_reward() == -10);
-    assert(0   == w->get_x());
-    assert(0   == w->get_y());
-    assert(NULL== w->move(DIR_S));
-    assert(0   == w->get_x());
-    assert(0   == w->get_y());
-    assert(-10 == w->get_score());
-    assert(17  == w->get_count());
+    // 1. Nothing is expected anywhere to begin with
+    assert(0 == e->size());
+    assert(NULL == e->at(0, 0));
+    assert(NULL == e->at(100, 100));
+    
+    // 2. Expectations are found at their squares, numbered from one
+    RewardAtExpectation *a = e->add(10, 1, 7);
+    RewardAtExpectation *b = e->add(-10, 7, 1);
+    assert(1 == a->get_number());
+    assert(2 == b->get_number());
+    assert(a == e->at(1, 7));
+    assert(b == e->at(7, 1));
+    assert(NULL == e->at(1, 1));
+    
+    // 3. They stay put (and in order) when a bigger grid needs room
+    RewardAtExpectation *c = e->add(5, 20, 3);
+    assert(3 == c->get_number());
+    assert(10 == e->at(1, 7)->get_reward());
+    assert(-10 == e->get(1)->get_reward());
+    assert(20 == e->get(2)->get_x());
+    
+    // 4. There is a limit, and clearing forgets them all
+    assert(NULL == e->add(1, 2, 2));
+    assert(NULL == e->at(2, 2));
+    e->clear();
+    assert(0 == e->size());
+    assert(NULL == e->at(1, 7));
+    assert(NULL == e->at(20, 3));
+    assert(1 == e->add(-10, 1, 7)->get_number());
+    assert(-10 == e->at(1, 7)->get_reward());
+    delete e;
+}
+
+// Walk the virtual move() and the compiled step<N> side by side
+template <class W, int N> void engine_matches(int iwalk, int n)
+{
+    Grid *g1 = new ChippyClassic(n);
+    Grid *g2 = new ChippyClassic(n);
+    W *w1 = (W *)walker_factory(iwalk);
+    W *w2 = (W *)walker_factory(iwalk);
+    w1->set_grid(g1);
+    w2->set_grid(g2);
+    w1->set_seed(3, 0);
+    w2->set_seed(3, 0);
+    g1->set_seed(3, 1);
+    g2->set_seed(3, 1);
+    for (int step = 0; step < 6000; ++step)
+    {
+        Goal *goal1 = w1->move();
+        Goal *goal2 = w2->W::template step<N>(-1);
+        assert((NULL == goal1) == (NULL == goal2));
+        if (NULL != goal1) assert(goal1->get_reward() == goal2->get_reward());
+        assert(w1->get_x() == w2->get_x());
+        assert(w1->get_y() == w2->get_y());
+        assert(w1->get_epsilon() == w2->get_epsilon());
+        assert(w1->get_policy_number() == w2->get_policy_number());
+        assert(w1->get_violations() == w2->get_violations());
+        if (0 == ((step+1)%2000))
+        {
+            g1->perturb();
+            g2->perturb();
+        }
+    }
     
+    // The MCL noticed the perturbations, so the walkers did more than learn
+    assert(0 < w2->get_policy_number());
+    delete w1;
+    delete w2;
     delete g1;
     delete g2;
-    delete g;
-    delete w;
 }
 
-void TestQLearner()
+void TestQLMCLSimple_testEngine()
 {
-    cout << "  QLearner ... ";
-    TestQLearner_testEmptyConstructor();
-    TestQLearner_testConstructor();
-    TestQLearner_testLearning();
-    TestQLearner_test10k();
+    // The compiled MCL walkers take the same steps as the virtual ones
+    engine_matches<QLMCLSimple, ENGINE_N>(WALK_SIMPLE, ENGINE_N);
+    engine_matches<QLMCLSimple, 0>(WALK_SIMPLE, 6);
+    engine_matches<QLMCLSensitive, ENGINE_N>(WALK_SENSITIVE, ENGINE_N);
+    engine_matches<QLMCLSophisticated, ENGINE_N>(WALK_SOPHISTICATED, 
+                                                 ENGINE_N);
+    engine_matches<QLMCLSophisticated, 0>(WALK_SOPHISTICATED, 6);
+}
+
+void TestQLMCLSensitive()
+{
+    cout << "  QLearner MCL Sensitive ... ";
+    TestQLMCLSensitive_testEmptyConstructor();
+    TestQLMCLSensitive_testConstructor();
+    TestQLMCLSensitive_testLearning();
+    TestQLMCLSensitive_testCH20k();
+    TestQLMCLSensitive_testCL10k();
+    TestQLMCLSensitive_testCO10k();
+    TestQLMCLSensitive_testCR10k();
+    TestQLMCLSensitive_testPipeline();
     cout << "OK" << endl;
 }
 
-void TestQLearner_testEmptyConstructor()
+void TestQLMCLSensitive_testEmptyConstructor()
 {
-    QLearner *q = new QLearner();
+    QLMCLSensitive *q = new QLMCLSensitive();
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
     assert(0    == q->get_y());
-    assert(0.05 == q->get_epsilon());
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
     delete q;
 }
 
-void TestQLearner_testConstructor()
+void TestQLMCLSensitive_testConstructor()
 {
     Grid   *g = new Grid();
-    QLearner *q = new QLearner(g, 1, 2, 0.8, 0.7, 0.1);
+    QLMCLSensitive *q = new QLMCLSensitive(g,2,4,4,0.8,0.7,0.1);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
-    assert(1    == q->get_x());
-    assert(2    == q->get_y());
-    assert(0.1  == q->get_epsilon());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
     assert(0.8  == q->get_alpha());
     assert(0.7  == q->get_gamma());
+    assert(0.1  == q->get_epsilon());
+    assert(2    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
     delete g;
     delete q;
 }
 
-void TestQLearner_testLearning()
+void TestQLMCLSensitive_testLearning()
 {
     Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
     Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
     Goal *goals[3] = {g1, g2, NULL};
     Grid   *g = new Grid(8,goals);
-    QLearner *q = new QLearner(g, 0, 0, 0.5, 0.9, 0.05);
+    QLMCLSensitive *q = new QLMCLSensitive(g, 2, 0, 0, 0.5, 0.9, 0.05);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
     assert(0    == q->get_y());
-    assert(0.05 == q->get_epsilon());
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
-    q->move(DIR_N);
-    q->move(DIR_E);
-    q->move(DIR_S);
-    q->move(DIR_W);
-    assert(10    == q->get_score());
+    assert(0.05 == q->get_epsilon());
+    assert(2    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    q->move(DIR_N); // 0,0->0,1
+    assert(0    == q->get_x());
+    assert(1    == q->get_y());
+    q->move(DIR_E); // 0,1->1,1
+    assert(1    == q->get_x());
+    assert(1    == q->get_y());
+    q->move(DIR_S); // 1,1->1,0
+    assert(1    == q->get_x());
+    assert(0    == q->get_y());
+    q->move(DIR_W); // 1,0->0,0 jumpto 7,7
     assert(4    == q->get_count());
     assert(7    == q->get_x());
     assert(7    == q->get_y());
+    assert(10   == q->get_score());
     q->move(DIR_W);
     q->move(DIR_W);
     q->move(DIR_W);
@@ -4923,53 +10765,193 @@ void TestQLearner_testLearning()
     assert(2.25 == g->square(1,1)->get_q(1));
     assert(0.0  == g->square(1,1)->get_q(2));
     assert(0.0  == g->square(1,1)->get_q(3));
-    
     delete g1;
     delete g2;
     delete g;
     delete q;
 }
 
-void TestQLearner_test10k()
+void TestQLMCLSensitive_testCH20k()
+{
+    //cout << "---------- TestQLMCLSensitive_testCH10k ----------" << endl;
+    Grid   *g = new ChippyClassic(8);
+    QLMCLSensitive *q = new QLMCLSensitive(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    //q->set_verbose(1); // ################# DEBUG ###################
+    for (int i = 0; i < 20000; ++i)
+        q->move();
+    assert(20000 == q->get_count());
+    assert(3    == q->get_threshold());
+    //cout << "CH20K violations = " << q->get_violations() << endl;
+    //cout << "CH20K policy num = " << q->get_policy_number() << endl;
+    assert(2 > q->get_violations());
+    assert(2 > q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSensitive_testCL10k()
+{
+    //cout << "---------- TestQLMCLSensitive_testCL10k ----------" << endl;
+    Grid   *g = new ChippyClassic(8);
+    QLMCLSensitive *q = new QLMCLSensitive(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    //q->set_verbose(1); // ################# DEBUG ###################
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSensitive_testCO10k()
 {
-    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
-    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
-    Goal *goals[3] = {g1, g2, NULL};
-    Grid   *g = new Grid(8,goals);
-    QLearner *q = new QLearner(g);
+    //cout << "---------- TestQLMCLSensitive_testCO10k ----------" << endl;
+    Grid   *g = new ChippyCorner(8);
+    QLMCLSensitive *q = new QLMCLSensitive(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
     assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLSensitive_testCR10k()
+{
+    //cout << "---------- TestQLMCLSensitive_testCR10k ----------" << endl;
+    Grid   *g = new ChippyRotate(8);
+    QLMCLSensitive *q = new QLMCLSensitive(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
-    for (int i = 0; i < 10000; ++i)
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 5000; ++i)
+        q->move();
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
         q->move();
     assert(10000 == q->get_count());
-    delete g1;
-    delete g2;
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
-// FGJMjpsw
 
-void TestQLMCLSimple()
+// A walker composed of existing policies, but with no guidance
+struct TestSteadyGuide
 {
-    cout << "  QLearner MCL Simple ... ";
-    TestQLMCLSimple_testEmptyConstructor();
-    TestQLMCLSimple_testConstructor();
-    TestQLMCLSimple_testLearning();
-    TestQLMCLSimple_testCH20k();
-    TestQLMCLSimple_testCL10k();
-    TestQLMCLSimple_testCO10k();
-    TestQLMCLSimple_testCR10k();
+    template <class W> void guide(W &) {}
+};
+struct TestSteadyPolicies
+{
+    typedef MCLRewardDetector    Detector;
+    typedef MCLViolationAssessor Assessor;
+    typedef TestSteadyGuide      Guide;
+    static const char* name(void)     { return "MCLSteady"; }
+    static const char* initials(void) { return "ST"; }
+    static const char* tag(void)      { return "QLMCLSteady"; }
+    enum { reset_trace = TRACE_RESET_SENSITIVE };
+};
+
+void TestQLMCLSensitive_testPipeline()
+{
+    // 1. The guide is what lowers epsilon
+    Grid *g = new ChippyClassic(8);
+    QLMCLPipeline<TestSteadyPolicies> *q = 
+        new QLMCLPipeline<TestSteadyPolicies>(g, 3, LOC_CTR, LOC_CTR, 
+                                              0.5, 0.9, 0.5);
+    QLMCLSensitive *s = new QLMCLSensitive(g, 3, LOC_CTR, LOC_CTR, 
+                                           0.5, 0.9, 0.5);
+    assert(0 == strcmp("MCLSteady", q->name()));
+    assert(0 == strcmp("ST", q->initials()));
+    for (int i = 0; i < 2000; ++i) {
+        q->move();
+        s->move();
+    }
+    assert(0.5 == q->get_epsilon());
+    assert(0.5 >  s->get_epsilon());
+    
+    // 2. The counters are the pipeline's
+    assert(q->counters().actionNumber > 0);
+    assert(q->counters().actionNumber <= q->get_count());
+    assert(q->counters().numRewards > 0);
+    delete q;
+    delete s;
+    delete g;
+}
+
+void TestQLMCLSophisticated()
+{
+    cout << "  QLearner MCL Sophisticated ... ";
+    TestQLMCLSophisticated_testEmptyConstructor();
+    TestQLMCLSophisticated_testConstructor();
+    TestQLMCLSophisticated_testLearning();
+    TestQLMCLSophisticated_testCH20k();
+    TestQLMCLSophisticated_testCL10k();
+    TestQLMCLSophisticated_testCO10k();
+    TestQLMCLSophisticated_testCR10k();
+    TestQLMCLSophisticated_testSnapshot();
+    TestQLMCLSophisticated_testTrace();
     cout << "OK" << endl;
 }
 
-void TestQLMCLSimple_testEmptyConstructor()
+void TestQLMCLSophisticated_testEmptyConstructor()
 {
-    QLMCLSimple *q = new QLMCLSimple();
+    QLMCLSophisticated *q = new QLMCLSophisticated();
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -4979,14 +10961,14 @@ void TestQLMCLSimple_testEmptyConstructor()
     assert(0.05 == q->get_epsilon());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(0    == q->get_resets());
+    assert(0    == q->get_policy_number());
     delete q;
 }
 
-void TestQLMCLSimple_testConstructor()
+void TestQLMCLSophisticated_testConstructor()
 {
     Grid   *g = new Grid();
-    QLMCLSimple *q = new QLMCLSimple(g,2,4,4,0.8,0.7,0.1);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g,2,4,4,0.8,0.7,0.1);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -4996,18 +10978,18 @@ void TestQLMCLSimple_testConstructor()
     assert(0.1  == q->get_epsilon());
     assert(2    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(0    == q->get_resets());
+    assert(0    == q->get_policy_number());
     delete g;
     delete q;
 }
 
-void TestQLMCLSimple_testLearning()
+void TestQLMCLSophisticated_testLearning()
 {
     Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
     Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
     Goal *goals[3] = {g1, g2, NULL};
     Grid   *g = new Grid(8,goals);
-    QLMCLSimple *q = new QLMCLSimple(g, 2, 0, 0, 0.5, 0.9, 0.05);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g, 2, 0, 0, 0.5, 0.9, 0.05);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -5017,7 +10999,7 @@ void TestQLMCLSimple_testLearning()
     assert(0.05 == q->get_epsilon());
     assert(2    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(0    == q->get_resets());
+    assert(0    == q->get_policy_number());
     q->move(DIR_N); // 0,0->0,1
     assert(0    == q->get_x());
     assert(1    == q->get_y());
@@ -5062,11 +11044,11 @@ void TestQLMCLSimple_testLearning()
     delete q;
 }
 
-void TestQLMCLSimple_testCH20k()
+void TestQLMCLSophisticated_testCL10k()
 {
-    //cout << "---------- TestQLMCLSimple_testCH20k ----------" << endl;
+    //cout << "---------- TestQLMCLSophisticated_testCL10k ----------" << endl;
     Grid   *g = new ChippyClassic(8);
-    QLMCLSimple *q = new QLMCLSimple(g);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5074,23 +11056,30 @@ void TestQLMCLSimple_testCH20k()
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 20000; ++i)
+    for (int i = 0; i < 5000; ++i)
         q->move();
-    assert(20000 == q->get_count());
+    assert(5000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(0    == q->get_resets());
     assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(1    == q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSimple_testCL10k()
+void TestQLMCLSophisticated_testCH20k()
 {
-    //cout << "---------- TestQLMCLSimple_testCL10k ----------" << endl;
+    //cout << "---------- TestQLMCLSophisticated_testCH20k ----------" << endl;
     Grid   *g = new ChippyClassic(8);
-    QLMCLSimple *q = new QLMCLSimple(g);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5098,30 +11087,22 @@ void TestQLMCLSimple_testCL10k()
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_resets());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
+    for (int i = 0; i < 20000; ++i)
         q->move();
-    assert(10000 == q->get_count());
+    assert(20000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(0    == q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSimple_testCO10k()
+void TestQLMCLSophisticated_testCO10k()
 {
-    //cout << "---------- TestQLMCLSimple_testCO10k ----------" << endl;
+    //cout << "---------- TestQLMCLSophisticated_testCO10k ----------" << endl;
     Grid   *g = new ChippyCorner(8);
-    QLMCLSimple *q = new QLMCLSimple(g);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5148,11 +11129,11 @@ void TestQLMCLSimple_testCO10k()
     delete q;
 }
 
-void TestQLMCLSimple_testCR10k()
+void TestQLMCLSophisticated_testCR10k()
 {
-    //cout << "---------- TestQLMCLSimple_testCR10k ----------" << endl;
+    //cout << "---------- TestQLMCLSophisticated_testCR10k ----------" << endl;
     Grid   *g = new ChippyRotate(8);
-    QLMCLSimple *q = new QLMCLSimple(g);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5173,28 +11154,102 @@ void TestQLMCLSimple_testCR10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(2    >  q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSensitive()
+void TestQLMCLSophisticated_testSnapshot()
+{
+    // 1. Swapped rewards, expectations and the MCL counters all carry on
+    ChippyClassic *g1 = new ChippyClassic();
+    ChippyClassic *g2 = new ChippyClassic();
+    QLMCLSophisticated *q1 = new QLMCLSophisticated(g1);
+    QLMCLSophisticated *q2 = new QLMCLSophisticated(g2);
+    assert(snapshot_resumes(q1, q2, 5000, 2500));
+    assert(q1->get_violations() == q2->get_violations());
+    assert(q1->get_resets() == q2->get_resets());
+    assert(q1->get_policy_number() == q2->get_policy_number());
+    assert(g1->get_g1()->get_reward() == g2->get_g1()->get_reward());
+    
+    // 2. As do counters past what an int can count, as in a long soak
+    q1->counters().actionNumber = 5000000000LL;
+    q1->counters().lastRewardTurn = 4999999000LL;
+    assert(1 == save_snapshot("testsnapshot.bin", q1));
+    assert(1 == load_snapshot("testsnapshot.bin", q2));
+    assert(5000000000LL == q2->counters().actionNumber);
+    assert(4999999000LL == q2->counters().lastRewardTurn);
+    remove("testsnapshot.bin");
+    delete q1;
+    delete q2;
+    delete g1;
+    delete g2;
+}
+void TestQLMCLSophisticated_testTrace()
+{
+    // 1. The decoder reproduces the old verbose text
+    TraceEvent e;
+    ostringstream line;
+    memset(&e, 0, sizeof(e));
+    e.step = 1234;
+    e.type = TRACE_VIOLATION;
+    e.field[0] = 10; e.field[1] = 3; e.field[2] = 7; 
+    e.field[3] = -10; e.field[4] = 2;
+    trace_text(e, line);
+    assert(line.str() == "step 1234: Got reward of 10 at (3,7) instead of -10\n"
+                         "Incremented violations to 2\n");
+    
+    // 2. Nothing is recorded unless a trace is open
+    Grid *g = new ChippyClassic(8);
+    QLMCLSophisticated *q = new QLMCLSophisticated(g);
+    q->set_verbose(1);
+    for (int i = 0; i < 100; ++i) q->move();
+    assert(0 == tracer().close());
+    
+    // 3. Trace a perturbed run and decode it
+    assert(tracer().open("testtrace.trace", true));
+    for (int i = 0; i < 5000; ++i) q->move();
+    g->perturb();
+    for (int j = 0; j < 5000; ++j) q->move();
+    long events = tracer().close();
+    ostringstream text;
+    assert(events == trace_decode("testtrace.trace", text));
+#ifdef CHIPPY_NO_TRACE
+    assert(0 == events);
+#else
+    assert(events > 0);
+    assert(string::npos != text.str().find(": reward = "));
+    assert(string::npos == text.str().find("trace events dropped"));
+    if (q->get_policy_number() > 0) {
+        assert(string::npos != text.str().find("increment_policy() to policy 1"));
+        assert(string::npos != text.str().find("MCLSophisticated::Reset()"));
+    }
+#endif
+    
+    // 4. Not a trace file
+    assert(-1 == trace_decode("no such file.trace", text));
+    remove("testtrace.trace");
+    delete q;
+    delete g;
+}
+
+void TestQLMCLBayes1()
 {
-    cout << "  QLearner MCL Sensitive ... ";
-    TestQLMCLSensitive_testEmptyConstructor();
-    TestQLMCLSensitive_testConstructor();
-    TestQLMCLSensitive_testLearning();
-    TestQLMCLSensitive_testCH20k();
-    TestQLMCLSensitive_testCL10k();
-    TestQLMCLSensitive_testCO10k();
-    TestQLMCLSensitive_testCR10k();
+    cout << "  QLearner MCL Bayes 1 ... ";
+    TestQLMCLBayes1_testEmptyConstructor();
+    TestQLMCLBayes1_testConstructor();
+    TestQLMCLBayes1_testLearning();
+    TestQLMCLBayes1_testCH20k();
+    TestQLMCLBayes1_testCL10k();
+    TestQLMCLBayes1_testCO10k();
+    TestQLMCLBayes1_testCR10k();
     cout << "OK" << endl;
 }
 
-void TestQLMCLSensitive_testEmptyConstructor()
+void TestQLMCLBayes1_testEmptyConstructor()
 {
-    QLMCLSensitive *q = new QLMCLSensitive();
+    QLMCLBayes1 *q = new QLMCLBayes1();
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -5208,10 +11263,10 @@ void TestQLMCLSensitive_testEmptyConstructor()
     delete q;
 }
 
-void TestQLMCLSensitive_testConstructor()
+void TestQLMCLBayes1_testConstructor()
 {
     Grid   *g = new Grid();
-    QLMCLSensitive *q = new QLMCLSensitive(g,2,4,4,0.8,0.7,0.1);
+    QLMCLBayes1 *q = new QLMCLBayes1(g,2,4,4,0.8,0.7,0.1);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5226,13 +11281,13 @@ void TestQLMCLSensitive_testConstructor()
     delete q;
 }
 
-void TestQLMCLSensitive_testLearning()
+void TestQLMCLBayes1_testLearning()
 {
     Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
     Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
     Goal *goals[3] = {g1, g2, NULL};
     Grid   *g = new Grid(8,goals);
-    QLMCLSensitive *q = new QLMCLSensitive(g, 2, 0, 0, 0.5, 0.9, 0.05);
+    QLMCLBayes1 *q = new QLMCLBayes1(g, 2, 0, 0, 0.5, 0.9, 0.05);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -5287,11 +11342,11 @@ void TestQLMCLSensitive_testLearning()
     delete q;
 }
 
-void TestQLMCLSensitive_testCH20k()
+void TestQLMCLBayes1_testCH20k()
 {
-    //cout << "---------- TestQLMCLSensitive_testCH10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes1_testCH20k ----------" << endl;
     Grid   *g = new ChippyClassic(8);
-    QLMCLSensitive *q = new QLMCLSensitive(g);
+    QLMCLBayes1 *q = new QLMCLBayes1(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5299,25 +11354,22 @@ void TestQLMCLSensitive_testCH20k()
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
-    //q->set_verbose(1); // ################# DEBUG ###################
-    for (int i = 0; i < 20000; ++i)
+    for (int j = 0; j < 20000; ++j)
         q->move();
     assert(20000 == q->get_count());
     assert(3    == q->get_threshold());
-    //cout << "CH20K violations = " << q->get_violations() << endl;
-    //cout << "CH20K policy num = " << q->get_policy_number() << endl;
-    assert(2 > q->get_violations());
-    assert(2 > q->get_policy_number());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSensitive_testCL10k()
+void TestQLMCLBayes1_testCL10k()
 {
-    //cout << "---------- TestQLMCLSensitive_testCL10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes1_testCL10k ----------" << endl;
     Grid   *g = new ChippyClassic(8);
-    QLMCLSensitive *q = new QLMCLSensitive(g);
+    QLMCLBayes1 *q = new QLMCLBayes1(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5325,13 +11377,13 @@ void TestQLMCLSensitive_testCL10k()
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
-    //q->set_verbose(1); // ################# DEBUG ###################
     for (int i = 0; i < 5000; ++i)
         q->move();
     assert(5000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
     assert(0    == q->get_policy_number());
+    //q->set_verbose(1);
     g->perturb();
     //cout << "----- perturbation ----- " << endl;
     for (int j = 0; j < 5000; ++j)
@@ -5339,17 +11391,18 @@ void TestQLMCLSensitive_testCL10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    assert(0    <  q->get_policy_number());
+    assert(4    >  q->get_policy_number());
+    //cout << "----- MCLBayes1 CL score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSensitive_testCO10k()
+void TestQLMCLBayes1_testCO10k()
 {
-    //cout << "---------- TestQLMCLSensitive_testCO10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes1_testCO10k ----------" << endl;
     Grid   *g = new ChippyCorner(8);
-    QLMCLSensitive *q = new QLMCLSensitive(g);
+    QLMCLBayes1 *q = new QLMCLBayes1(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5370,17 +11423,18 @@ void TestQLMCLSensitive_testCO10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(0    <  q->get_policy_number());
+    assert(4    >  q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSensitive_testCR10k()
+void TestQLMCLBayes1_testCR10k()
 {
-    //cout << "---------- TestQLMCLSensitive_testCR10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes1_testCR10k ----------" << endl;
     Grid   *g = new ChippyRotate(8);
-    QLMCLSensitive *q = new QLMCLSensitive(g);
+    QLMCLBayes1 *q = new QLMCLBayes1(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5401,28 +11455,30 @@ void TestQLMCLSensitive_testCR10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(0    <  q->get_policy_number());
+    assert(4    >  q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSophisticated()
+void TestQLMCLBayes2()
 {
-    cout << "  QLearner MCL Sophisticated ... ";
-    TestQLMCLSophisticated_testEmptyConstructor();
-    TestQLMCLSophisticated_testConstructor();
-    TestQLMCLSophisticated_testLearning();
-    TestQLMCLSophisticated_testCH20k();
-    TestQLMCLSophisticated_testCL10k();
-    TestQLMCLSophisticated_testCO10k();
-    TestQLMCLSophisticated_testCR10k();
+    cout << "  QLearner MCL Bayes 2 ... ";
+    TestQLMCLBayes2_testEmptyConstructor();
+    TestQLMCLBayes2_testConstructor();
+    TestQLMCLBayes2_testLearning();
+    TestQLMCLBayes2_testCH20k();
+    TestQLMCLBayes2_testCL10k();
+    TestQLMCLBayes2_testCO10k();
+    TestQLMCLBayes2_testCR10k();
+    TestQLMCLBayes2_testCL10p5();
     cout << "OK" << endl;
 }
 
-void TestQLMCLSophisticated_testEmptyConstructor()
+void TestQLMCLBayes2_testEmptyConstructor()
 {
-    QLMCLSophisticated *q = new QLMCLSophisticated();
+    QLMCLBayes2 *q = new QLMCLBayes2();
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -5436,10 +11492,10 @@ void TestQLMCLSophisticated_testEmptyConstructor()
     delete q;
 }
 
-void TestQLMCLSophisticated_testConstructor()
+void TestQLMCLBayes2_testConstructor()
 {
     Grid   *g = new Grid();
-    QLMCLSophisticated *q = new QLMCLSophisticated(g,2,4,4,0.8,0.7,0.1);
+    QLMCLBayes2 *q = new QLMCLBayes2(g,2,4,4,0.8,0.7,0.1);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5454,13 +11510,13 @@ void TestQLMCLSophisticated_testConstructor()
     delete q;
 }
 
-void TestQLMCLSophisticated_testLearning()
+void TestQLMCLBayes2_testLearning()
 {
     Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
     Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
     Goal *goals[3] = {g1, g2, NULL};
     Grid   *g = new Grid(8,goals);
-    QLMCLSophisticated *q = new QLMCLSophisticated(g, 2, 0, 0, 0.5, 0.9, 0.05);
+    QLMCLBayes2 *q = new QLMCLBayes2(g, 2, 0, 0, 0.5, 0.9, 0.05);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(0    == q->get_x());
@@ -5515,11 +11571,34 @@ void TestQLMCLSophisticated_testLearning()
     delete q;
 }
 
-void TestQLMCLSophisticated_testCL10k()
+void TestQLMCLBayes2_testCH20k()
 {
-    //cout << "---------- TestQLMCLSophisticated_testCL10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes2_testCH20k ----------" << endl;
     Grid   *g = new ChippyClassic(8);
-    QLMCLSophisticated *q = new QLMCLSophisticated(g);
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
+    assert(0    == q->get_score());
+    assert(0    == q->get_count());
+    assert(4    == q->get_x());
+    assert(4    == q->get_y());
+    assert(0.5  == q->get_alpha());
+    assert(0.9  == q->get_gamma());
+    assert(0.05 == q->get_epsilon());
+    for (int i = 0; i < 20000; ++i)
+        q->move();
+    assert(20000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    delete g;
+    delete q;
+}
+
+void TestQLMCLBayes2_testCL10k()
+{
+    //cout << "---------- TestQLMCLBayes2_testCL10k ----------" << endl;
+    Grid   *g = new ChippyClassic(8);
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5535,22 +11614,23 @@ void TestQLMCLSophisticated_testCL10k()
     assert(0    == q->get_policy_number());
     g->perturb();
     //cout << "----- perturbation ----- " << endl;
+    //q->set_verbose(1);
     for (int j = 0; j < 5000; ++j)
         q->move();
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(0    <  q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSophisticated_testCH20k()
+void TestQLMCLBayes2_testCL10p5()
 {
-    //cout << "---------- TestQLMCLSophisticated_testCH20k ----------" << endl;
-    Grid   *g = new ChippyClassic(8);
-    QLMCLSophisticated *q = new QLMCLSophisticated(g);
+    //cout << "---------- TestQLMCLBayes2_testCL10p5 ----------" << endl;
+    Grid   *g = new ChippyClassic(8, 10, 5);
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5558,9 +11638,18 @@ void TestQLMCLSophisticated_testCH20k()
     assert(0.5  == q->get_alpha());
     assert(0.9  == q->get_gamma());
     assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 20000; ++i)
+    //q->set_verbose(1);
+    for (int i = 0; i < 5000; ++i)
         q->move();
-    assert(20000 == q->get_count());
+    assert(5000 == q->get_count());
+    assert(3    == q->get_threshold());
+    assert(0    == q->get_violations());
+    assert(0    == q->get_policy_number());
+    g->perturb();
+    //cout << "----- perturbation ----- " << endl;
+    for (int j = 0; j < 5000; ++j)
+        q->move();
+    assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
     assert(0    == q->get_policy_number());
@@ -5569,11 +11658,11 @@ void TestQLMCLSophisticated_testCH20k()
     delete q;
 }
 
-void TestQLMCLSophisticated_testCO10k()
+void TestQLMCLBayes2_testCO10k()
 {
-    //cout << "---------- TestQLMCLSophisticated_testCO10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes2_testCO10k ----------" << endl;
     Grid   *g = new ChippyCorner(8);
-    QLMCLSophisticated *q = new QLMCLSophisticated(g);
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5594,17 +11683,17 @@ void TestQLMCLSophisticated_testCO10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(1    == q->get_policy_number());
+    assert(0    <= q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLSophisticated_testCR10k()
+void TestQLMCLBayes2_testCR10k()
 {
-    //cout << "---------- TestQLMCLSophisticated_testCR10k ----------" << endl;
+    //cout << "---------- TestQLMCLBayes2_testCR10k ----------" << endl;
     Grid   *g = new ChippyRotate(8);
-    QLMCLSophisticated *q = new QLMCLSophisticated(g);
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
     assert(0    == q->get_score());
     assert(0    == q->get_count());
     assert(4    == q->get_x());
@@ -5625,800 +11714,2443 @@ void TestQLMCLSophisticated_testCR10k()
     assert(10000 == q->get_count());
     assert(3    == q->get_threshold());
     assert(0    == q->get_violations());
-    assert(2    >  q->get_policy_number());
+    assert(0    <  q->get_policy_number());
     //cout << "----- score = " << q->get_score() << " ----- " << endl;
     delete g;
     delete q;
 }
 
-void TestQLMCLBayes1()
+void TestLocalMCL()
+{
+    cout << "  Local MCL ... ";
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+    TestLocalMCL_testExpectations();
+    TestLocalMCL_testLadder();
+    TestLocalMCL_testAgents();
+    TestLocalMCL_testHandles();
+    TestLocalMCL_testSnapshot();
+    TestLocalMCL_testCadence();
+#endif
+    cout << "OK" << endl;
+}
+
+#if defined(USEMCL2) && defined(CHIPPY_LOCAL_MCL)
+void TestLocalMCL_testExpectations()
+{
+    mclMA::observables::update u;
+    string key = "TestLocalMCL";
+
+    // 1. An agent with one expectation of each kind
+    mclMA::initializeMCL(key, 0);
+    mclMA::observables::declare_observable_self(key, "value", 0.0);
+    mclMA::observables::declare_observable_self(key, "over",  0.0);
+    mclMA::observables::declare_observable_self(key, "under", 0.0);
+    mclMA::observables::set_obs_prop_self(key, "value", PROP_DT, DT_INTEGER);
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, "value", EC_MAINTAINVALUE, 10.0f);
+    mclMA::declareExpectation(key, EGK, "over",  EC_STAYOVER,      0.5f);
+    mclMA::declareExpectation(key, EGK, "under", EC_STAYUNDER,     2.0f);
+
+    // 2. Nothing to say while the expectations hold
+    u.set_update("value", 10.2);
+    u.set_update("over",  0.6);
+    u.set_update("under", 1.9);
+    assert(0 == mclMA::monitor(key, u).size());
+
+    // 3. Each kind of violation gets a suggestion
+    const char *names[3]  = {"value", "over", "under"};
+    double      bad[3]    = {9.0,     0.5,    2.0};
+    double      good[3]   = {10.0,    0.6,    1.9};
+    for (int i = 0; i < 3; ++i) {
+        u.set_update(names[i], bad[i]);
+        responseVector rv = mclMA::monitor(key, u);
+        assert(1 == rv.size());
+        mclMonitorResponse *r = *rv.begin();
+        assert(r->rclass() == "suggestion");
+        assert(r->requiresAction());
+        assert(CRC_ACTIVATE_LEARNING == r->responseCode());
+        u.set_update(names[i], good[i]);
+        assert(0 == mclMA::monitor(key, u).size());
+    }
+
+    // 4. An aborted group expects nothing
+    mclMA::expectationGroupAborted(key, EGK);
+    u.set_update("value", 0.0);
+    assert(0 == mclMA::monitor(key, u).size());
+
+    // 5. Unknown agents get an internal error
+    mclMA::releaseMCL(key);
+    responseVector rv = mclMA::monitor(key, u);
+    assert(1 == rv.size());
+    assert((*rv.begin())->rclass() == "internalError");
+}
+
+void TestLocalMCL_testLadder()
+{
+    mclMA::observables::update u;
+    string key = "TestLocalMCL";
+    mclMonitorResponse *r;
+
+    // 1. An agent that is always disappointed
+    mclMA::initializeMCL(key, 0);
+    mclMA::observables::declare_observable_self(key, "reward", 0.0);
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, "reward", EC_STAYOVER, 1.0f);
+    u.set_update("reward", 0.0);
+
+    // 2. The first suggestion is the mildest one
+    r = *mclMA::monitor(key, u).begin();
+    assert(CRC_ACTIVATE_LEARNING == r->responseCode());
+    mclMA::suggestionImplemented(key, r->referenceCode());
+
+    // 3. The correction is given time to work
+    for (int i = 1; i < MCL_SETTLE; ++i) {
+        responseVector rv = mclMA::monitor(key, u);
+        assert(1 == rv.size());
+        assert((*rv.begin())->rclass() == "noOperation");
+        assert(!(*rv.begin())->requiresAction());
+    }
+
+    // 4. Then it moves up the ladder
+    r = *mclMA::monitor(key, u).begin();
+    assert(r->rclass() == "suggestion");
+    assert(CRC_REBUILD_MODELS == r->responseCode());
+
+    // 5. A failure moves up at once and the response is reused
+    mclMA::suggestionFailed(key, r->referenceCode());
+    mclMonitorResponse *r2 = *mclMA::monitor(key, u).begin();
+    assert(r2 == r);
+    assert(CRC_REVISE_EXPECTATIONS == r2->responseCode());
+    mclMA::suggestionFailed(key, r2->referenceCode());
+    r2 = *mclMA::monitor(key, u).begin();
+    assert(CRC_REVISE_EXPECTATIONS == r2->responseCode());
+
+    // 6. Quiet monitors start the ladder over
+    u.set_update("reward", 2.0);
+    for (int j = 0; j < MCL_SETTLE; ++j) {
+        assert(0 == mclMA::monitor(key, u).size());
+    }
+    u.set_update("reward", 0.0);
+    r = *mclMA::monitor(key, u).begin();
+    assert(CRC_ACTIVATE_LEARNING == r->responseCode());
+
+    // 7. Corrections that are not allowed are skipped
+    mclMA::setPropertyDefault(key, CRC_ACTIVATE_LEARNING, PC_NO);
+    mclMA::suggestionIgnored(key, r->referenceCode());
+    for (int k = 1; k < MCL_SETTLE; ++k) mclMA::monitor(key, u);
+    r = *mclMA::monitor(key, u).begin();
+    assert(CRC_REBUILD_MODELS == r->responseCode());
+
+    // 8. Without any of them, it can only say to try again or ignore it
+    mclMA::setPropertyDefault(key, CRC_REVISE_EXPECTATIONS, PC_NO);
+    mclMA::setPropertyDefault(key, CRC_REBUILD_MODELS,      PC_NO);
+    assert(CRC_TRY_AGAIN == (*mclMA::monitor(key, u).begin())->responseCode());
+    mclMA::setPropertyDefault(key, CRC_TRY_AGAIN, PC_NO);
+    mclMA::setPropertyDefault(key, CRC_NOOP,      PC_NO);
+    r = *mclMA::monitor(key, u).begin();
+    assert(CRC_IGNORE == r->responseCode());
+    assert(!r->requiresAction());
+    mclMA::releaseMCL(key);
+}
+
+void TestLocalMCL_testAgents()
+{
+    const int live = 2*MCL_AGENT_ROOM + 1;
+    QLMCLSimple *walkers[live];
+    int used = 0;
+    int i, j;
+
+    // 1. Walkers release their agents, so the table does not grow
+    for (i = 0; i < 2*MCL_AGENT_ROOM; ++i) {
+        delete new QLMCLBayes1();
+        delete new QLMCLBayes2();
+    }
+    for (j = 0; j < mcl_agent_room; ++j) {
+        if (mcl_agents[j]->used) ++used;
+    }
+    assert(0 == used);
+
+    // 2. More walkers at once than it started with all get an agent
+    for (i = 0; i < live; ++i) {
+        if (i % 2) walkers[i] = new QLMCLBayes1();
+        else walkers[i] = new QLMCLBayes2();
+    }
+    for (j = 0, used = 0; j < mcl_agent_room; ++j) {
+        if (mcl_agents[j]->used) ++used;
+    }
+    assert(live == used);
+    for (i = 0; i < live; ++i) delete walkers[i];
+    for (j = 0, used = 0; j < mcl_agent_room; ++j) {
+        if (mcl_agents[j]->used) ++used;
+    }
+    assert(0 == used);
+
+    // 3. Each walker has its own agent, so they can share the runner
+    QLMCLBayes2 *q1 = new QLMCLBayes2();
+    QLMCLBayes2 *q2 = new QLMCLBayes2();
+    assert(q1->reentrant());
+    assert(q2->reentrant());
+    delete q1;
+    delete q2;
+}
+
+void TestLocalMCL_testHandles()
+{
+    MCLObservables obs;
+    string key = "TestLocalMCL";
+
+    // 1. Handles are given out in declaration order
+    mclMA::initializeMCL(key, 0);
+    obs.set_key(key);
+    int h_step   = obs.declare("step",   DT_INTEGER,  SC_TEMPORAL);
+    int h_reward = obs.declare("reward", DT_RATIONAL, SC_REWARD);
+    assert(0 == h_step);
+    assert(1 == h_reward);
+    assert(2 == obs.size());
+    assert(0 == strcmp("reward", obs.name(h_reward)));
+
+    // 2. Values set by handle are the ones monitored
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, obs.name(h_reward), EC_STAYUNDER, 5.0f);
+    obs.set(h_step,   1);
+    obs.set(h_reward, 4.5);
+    assert(4.5f == obs.get(h_reward));
+    assert(0 == obs.monitor().size());
+    obs.set(h_reward, 5.5);
+    responseVector rv = obs.monitor();
+    assert(1 == rv.size());
+    assert((*rv.begin())->rclass() == "suggestion");
+
+    // 3. The same as setting them by name
+    mclMA::observables::update u;
+    u.set_update("step",   2);
+    u.set_update("reward", 4.5);
+    assert(0 == mclMA::monitor(key, u).size());
+    
+    // 4. The agent looked up once is the agent of the key, until it
+    //    is released
+    mclAgent *a = mclMA::agent(key);
+    float values[2] = {3.0f, 4.5f};
+    assert(NULL != a);
+    assert(0 == mclMA::monitor(a, values, 2).size());
+    mclMA::releaseMCL(key);
+    rv = mclMA::monitor(a, values, 2);
+    assert((*rv.begin())->rclass() == "internalError");
+}
+
+void TestLocalMCL_testSnapshot()
+{
+    string key = "TestLocalMCL";
+    string copy = "TestLocalMCLCopy";
+    const int64_t late = 5000000000LL;
+    float values[2] = {0.0f, 0.0f};
+    Snapshot s;
+    
+    // 1. The agents' expectations carry on, so both notice the perturbation
+    ChippyClassic *g1 = new ChippyClassic();
+    ChippyClassic *g2 = new ChippyClassic();
+    QLMCLBayes1 *b1 = new QLMCLBayes1(g1);
+    QLMCLBayes1 *b2 = new QLMCLBayes1(g2);
+    assert(snapshot_resumes(b1, b2, 5000, 2500));
+    assert(b1->get_policy_number() == b2->get_policy_number());
+    delete b1;
+    delete b2;
+    QLMCLBayes2 *q1 = new QLMCLBayes2(g1);
+    QLMCLBayes2 *q2 = new QLMCLBayes2(g2);
+    assert(snapshot_resumes(q1, q2, 5000, 2500));
+    assert(q1->get_policy_number() == q2->get_policy_number());
+    assert(q1->get_epsilon() == q2->get_epsilon());
+    delete q1;
+    delete q2;
+    delete g1;
+    delete g2;
+    
+    // 2. As do their clocks, to the step, past what an int (or the float
+    //    of an observable) can count
+    mclMA::initializeMCL(key, 0);
+    mclMA::initializeMCL(copy, 0);
+    mclMA::observables::declare_observable_self(key, "step", 0.0);
+    mclMA::observables::declare_observable_self(key, "reward", 0.0);
+    mclMA::observables::set_obs_prop_self(key, "step", PROP_SCLASS, 
+                                          SC_TEMPORAL);
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, "reward", EC_STAYOVER, 1.0f);
+    mclAgent *a = mclMA::agent(key);
+    mclMonitorResponse *r = *mclMA::monitor(a, values, 2, late).begin();
+    assert(r->rclass() == "suggestion");
+    mclMA::suggestionImplemented(key, r->referenceCode());
+    assert(late + MCL_SETTLE == a->settle_until);
+    r = *mclMA::monitor(a, values, 2, late + MCL_SETTLE - 1).begin();
+    assert(r->rclass() == "noOperation");
+    assert(s.create());
+    mcl_save_agent(key, s);
+    assert(s.reread());
+    assert(mcl_load_agent(copy, s));
+    mclAgent *b = mclMA::agent(copy);
+    assert(late + MCL_SETTLE - 1 == b->now);
+    assert(late + MCL_SETTLE - 1 == b->tick);
+    assert(late + MCL_SETTLE == b->settle_until);
+    assert(late + MCL_SETTLE - 1 == b->last_violation);
+    r = *mclMA::monitor(b, values, 2, late + MCL_SETTLE).begin();
+    assert(r->rclass() == "suggestion");
+    mclMA::releaseMCL(key);
+    mclMA::releaseMCL(copy);
+}
+
+void TestLocalMCL_testCadence()
+{
+    MCLObservables obs;
+    string key = "TestLocalMCL";
+    int knt;
+    
+    // 1. Every step, then every fourth
+    assert(MONITOR_EVERY == obs.get_cadence());
+    knt = 0;
+    for (int s = 1; s <= 100; ++s) knt += obs.due(s, false);
+    assert(100 == knt);
+    obs.set_cadence(4);
+    knt = 0;
+    for (int s = 1; s <= 100; ++s) knt += obs.due(s, false);
+    assert(25 == knt);
+    
+    // 2. Events, with a heartbeat when there are none for a while
+    obs.set_cadence(MONITOR_EVENTS);
+    knt = 0;
+    for (int s = 101; s <= 400; ++s) knt += obs.due(s, (120 == s) || (300 == s));
+    assert(7 == knt);
+    assert(obs.due(10, false));
+    
+    // 3. The stand-in gives a correction MCL_SETTLE steps, not monitors
+    mclMA::initializeMCL(key, 0);
+    obs.set_key(key);
+    int h_step   = obs.declare("step",   DT_INTEGER, SC_TEMPORAL);
+    int h_reward = obs.declare("reward", DT_INTEGER, SC_REWARD);
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, "reward", EC_STAYOVER, 1.0f);
+    obs.set(h_step,   10);
+    obs.set(h_reward, 0);
+    mclMonitorResponse *r = *obs.monitor().begin();
+    assert(r->rclass() == "suggestion");
+    mclMA::suggestionImplemented(key, r->referenceCode());
+    obs.set(h_step, 10 + MCL_SETTLE - 1);
+    assert((*obs.monitor().begin())->rclass() == "noOperation");
+    obs.set(h_step, 10 + MCL_SETTLE);
+    assert((*obs.monitor().begin())->rclass() == "suggestion");
+    mclMA::releaseMCL(key);
+    
+    // 4. Monitoring on events still notices the perturbation
+    ChippyClassic *g = new ChippyClassic();
+    QLMCLBayes2 *q = new QLMCLBayes2(g);
+    q->set_cadence(MONITOR_EVENTS);
+    for (int step = 0; step < 5000; ++step) q->move();
+    g->perturb();
+    knt = q->get_corrections();
+    for (int step = 0; step < 2500; ++step) q->move();
+    assert(q->get_corrections() > knt);
+    delete q;
+    delete g;
+}
+#endif
+
+void TestRollingAverage()
+{
+    cout << "  RollingAverage ... ";
+    TestRollingAverage_testEmptyConstructor();
+    TestRollingAverage_testConstructor();
+    TestRollingAverage_testAverages();
+    cout << "OK" << endl;
+}
+
+void TestRollingAverage_testEmptyConstructor()
+{
+    RollingAverage *r = new RollingAverage();
+    assert(0    == r->get_count());
+    assert(ROLLING_AVERAGE_SIZE  == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0.0  == r->get_average());
+    delete r;
+}
+
+void TestRollingAverage_testConstructor()
+{
+    RollingAverage *r = new RollingAverage(10);
+    assert(0    == r->get_count());
+    assert(10   == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0.0  == r->get_average());
+    delete r;
+}
+
+void TestRollingAverage_testAverages()
+{
+    RollingAverage *r = new RollingAverage(10);
+    assert(0    == r->get_count());
+    assert(10   == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0.0  == r->get_average());
+    r->add(1);
+    r->add(2);
+    r->add(0);
+    r->add(3);
+    r->add(4);
+    assert(5    == r->get_count());
+    assert(10   == r->get_n());
+    assert(10.0 == r->get_total());
+    assert(2.0  == r->get_average());
+    r->add(2);
+    r->add(2);
+    r->add(2);
+    r->add(2);
+    r->add(2);
+    assert(10   == r->get_count());
+    assert(10   == r->get_n());
+    assert(20.0 == r->get_total());
+    assert(2.0  == r->get_average());
+    r->add(3);
+    assert(10   == r->get_count());
+    assert(10   == r->get_n());
+    assert(22.0 == r->get_total());
+    assert(fabs(2.2-r->get_average())<0.1);
+    r->add(3);
+    r->add(4);
+    r->add(4);
+    r->add(5);
+    assert(10   == r->get_count());
+    assert(10   == r->get_n());
+    assert(29.0 == r->get_total());
+    assert(fabs(2.9-r->get_average())<0.1);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    r->add(0);
+    assert(10   == r->get_count());
+    assert(10   == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0.0  == r->get_average());
+    delete r;
+}
+
+void TestDecimatedSeries()
+{
+    cout << "  DecimatedSeries ... ";
+    TestDecimatedSeries_testBuckets();
+    TestDecimatedSeries_testSoak();
+    cout << "OK" << endl;
+}
+
+void TestDecimatedSeries_testBuckets()
+{
+    // 1. Buckets of ten values, four at most kept at once
+    DecimatedSeries *d = new DecimatedSeries(10, 4);
+    for (int i = 0; i < 35; ++i) d->append(i % 20);
+    assert(35 == d->get_steps());
+    assert(3 == d->get_used());
+    assert(19 == d->get_bucket(1)->step);
+    assert(19.0 == d->get_bucket(1)->last);
+    assert(14.5 == d->get_bucket(1)->mean);
+    assert(10.0 == d->get_bucket(1)->min);
+    assert(19.0 == d->get_bucket(1)->max);
+    for (int i = 35; i < 95; ++i) d->append(i % 20);
+    assert(1 == d->get_used());
+    assert(9 == d->get_buckets());
+    delete d;
+    
+    // 2. Written out as they fill, with the partial bucket at the end
+    d = new DecimatedSeries(10, 4);
+    assert(d->open("testsoakk.csv"));
+    for (int i = 0; i < 95; ++i) d->append(i % 20);
+    assert(d->close());
+    assert(10 == d->get_buckets());
+    ifstream in("testsoakk.csv");
+    string line, last;
+    int lines = 0;
+    getline(in, line);
+    assert("step,last,mean,min,max" == line);
+    while (getline(in, line)) {
+        last = line;
+        ++lines;
+    }
+    assert(10 == lines);
+    assert("94,14,12,10,14" == last);
+    in.close();
+    remove("testsoakk.csv");
+    delete d;
+}
+
+void TestDecimatedSeries_testSoak()
+{
+    // 1. A soak records what the experiment would, with the same streams
+    Grid *g1 = new Chippy();
+    Grid *g2 = new Chippy();
+    QLearner *q1 = new QLearner(g1);
+    QLearner *q2 = new QLearner(g2);
+    q1->set_seed(5, 0);
+    g1->set_seed(5, 1);
+    q2->set_seed(5, 0);
+    g2->set_seed(5, 1);
+    DecimatedSeries *d = new DecimatedSeries(1000, 8);
+    Rewards *r = dispatch_experiment(WALK_QLEARNER, 20000, 5000, 1, q1);
+    assert(3 == dispatch_soak(WALK_QLEARNER, 20000, 5000, q2, d));
+    assert(20 == d->get_buckets());
+    assert(4 == d->get_used());
+    for (int b = 0; b < d->get_used(); ++b) {
+        const SoakBucket *k = d->get_bucket(b);
+        assert(k->last == r->get_reward(k->step + 1));
+        assert(k->min <= k->mean);
+        assert(k->mean <= k->max);
+    }
+    delete r;
+    delete d;
+    delete q1;
+    delete q2;
+    delete g1;
+    delete g2;
+}
+
+void TestRewards()
 {
-    cout << "  QLearner MCL Bayes 1 ... ";
-    TestQLMCLBayes1_testEmptyConstructor();
-    TestQLMCLBayes1_testConstructor();
-    TestQLMCLBayes1_testLearning();
-    TestQLMCLBayes1_testCH20k();
-    TestQLMCLBayes1_testCL10k();
-    TestQLMCLBayes1_testCO10k();
-    TestQLMCLBayes1_testCR10k();
+    cout << "  Rewards ... ";
+    TestRewards_testEmptyConstructor();
+    TestRewards_testConstructor();
+    TestRewards_testAppend();
+    TestRewards_testAdd();
+    TestRewards_testVariance();
+    TestRewards_testQuantiles();
+    TestRewards_testBinary();
     cout << "OK" << endl;
 }
 
-void TestQLMCLBayes1_testEmptyConstructor()
+void TestRewards_testEmptyConstructor()
 {
-    QLMCLBayes1 *q = new QLMCLBayes1();
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(0    == q->get_x());
-    assert(0    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    delete q;
+    Rewards *r = new Rewards();
+    assert(0    == r->get_count());
+    assert(0    == r->get_index());
+    assert(1024 == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0 == strcmp("????", r->get_initials()));
+    assert(0 == strcmp("????", r->get_initials()));
+    assert(0 == strcmp("????", r->get_initials()));
+    delete r;
 }
 
-void TestQLMCLBayes1_testConstructor()
+void TestRewards_testConstructor()
 {
-    Grid   *g = new Grid();
-    QLMCLBayes1 *q = new QLMCLBayes1(g,2,4,4,0.8,0.7,0.1);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.8  == q->get_alpha());
-    assert(0.7  == q->get_gamma());
-    assert(0.1  == q->get_epsilon());
-    assert(2    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    delete g;
-    delete q;
+    Rewards *r = new Rewards(10);
+    assert(0    == r->get_count());
+    assert(0    == r->get_index());
+    assert(10   == r->get_n());
+    assert(0.0  == r->get_total());
+    assert(0 == strcmp("????", r->get_initials()));
+    assert(0 == strcmp("????", r->get_initials()));
+    assert(0 == strcmp("????", r->get_initials()));
+    delete r;
 }
 
-void TestQLMCLBayes1_testLearning()
+void TestRewards_testAppend()
 {
-    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
-    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
-    Goal *goals[3] = {g1, g2, NULL};
-    Grid   *g = new Grid(8,goals);
-    QLMCLBayes1 *q = new QLMCLBayes1(g, 2, 0, 0, 0.5, 0.9, 0.05);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(0    == q->get_x());
-    assert(0    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    assert(2    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    q->move(DIR_N); // 0,0->0,1
-    assert(0    == q->get_x());
-    assert(1    == q->get_y());
-    q->move(DIR_E); // 0,1->1,1
-    assert(1    == q->get_x());
-    assert(1    == q->get_y());
-    q->move(DIR_S); // 1,1->1,0
-    assert(1    == q->get_x());
-    assert(0    == q->get_y());
-    q->move(DIR_W); // 1,0->0,0 jumpto 7,7
-    assert(4    == q->get_count());
-    assert(7    == q->get_x());
-    assert(7    == q->get_y());
-    assert(10   == q->get_score());
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_W);
-    assert(7    == q->get_x());
-    assert(7    == q->get_y());
-    assert(0.0  == g->square(1,0)->get_q(0));
-    assert(0.0  == g->square(1,0)->get_q(1));
-    assert(0.0  == g->square(1,0)->get_q(2));
-    assert(7.5  == g->square(1,0)->get_q(3)); 
-    assert(0.0  == g->square(1,1)->get_q(0));
-    assert(2.25 == g->square(1,1)->get_q(1));
-    assert(0.0  == g->square(1,1)->get_q(2));
-    assert(0.0  == g->square(1,1)->get_q(3));
-    delete g1;
-    delete g2;
-    delete g;
-    delete q;
+    Rewards *r = new Rewards(10);
+    assert(0    == r->get_count());
+    assert(0    == r->get_index());
+    assert(10   == r->get_n());
+    assert(0.0  == r->get_total());
+    r->append(1);
+    assert(1    == r->get_count());
+    assert(1    == r->get_index());
+    assert(10   == r->get_n());
+    assert(1.0  == r->get_total());
+    assert(1.0  == r->get_reward(0));
+    assert(1.0  == r->get_average(0));
+    r->append(2);
+    assert(1    == r->get_count());
+    assert(2    == r->get_index());
+    assert(10   == r->get_n());
+    assert(3.0  == r->get_total());
+    assert(2.0  == r->get_reward(1));
+    assert(2.0  == r->get_average(1));
+    r->append(3);
+    assert(1    == r->get_count());
+    assert(3    == r->get_index());
+    assert(10   == r->get_n());
+    assert(6.0  == r->get_total());
+    r->append(4);
+    r->append(5);
+    r->append(6);
+    assert(1    == r->get_count());
+    assert(6    == r->get_index());
+    assert(10   == r->get_n());
+    assert(21.0  == r->get_total());
+    r->append(3);
+    r->append(2);
+    r->append(1);
+    assert(1    == r->get_count());
+    assert(9    == r->get_index());
+    assert(10   == r->get_n());
+    assert(27.0  == r->get_total());
+    r->append(4);
+    r->append(3);
+    r->append(1.7);
+    assert(1    == r->get_count());
+    assert(12    == r->get_index());
+    assert(20   == r->get_n());
+    assert(35.7  == r->get_total());
+    assert(1.0  == r->get_reward(0));
+    assert(2.0  == r->get_reward(1));
+    assert(3.0  == r->get_reward(2));
+    assert(4.0  == r->get_reward(3));
+    assert(5.0  == r->get_reward(4));
+    assert(6.0  == r->get_reward(5));
+    assert(3.0  == r->get_reward(6));
+    assert(2.0  == r->get_reward(7));
+    assert(1.0  == r->get_reward(8));
+    assert(4.0  == r->get_reward(9));
+    assert(3.0  == r->get_reward(10));
+    assert(1.7  == r->get_reward(11));
+    assert(1.7  == r->get_average(11));
+    delete r;
+}
+
+void TestRewards_testAdd()
+{
+    Rewards *r1 = new Rewards(10);
+    Rewards *r2 = new Rewards(10);
+    Rewards *r3 = new Rewards(10);
+    r2->append(1);
+    r2->append(2);
+    r2->append(3);
+    r2->append(4);
+    r2->append(3);
+    r2->append(2);
+    r2->append(1);
+    assert(7    == r2->get_index());
+    assert(1.0  == r2->get_reward(0));
+    assert(2.0  == r2->get_reward(1));
+    assert(3.0  == r2->get_reward(2));
+    assert(4.0  == r2->get_reward(3));
+    assert(3.0  == r2->get_reward(4));
+    assert(2.0  == r2->get_reward(5));
+    assert(1.0  == r2->get_reward(6));
+    assert(1.0  == r2->get_average(6));
+    r3->append(1);
+    r3->append(2);
+    r3->append(1);
+    r3->append(2);
+    r3->append(1);
+    r3->append(2);
+    assert(6    == r3->get_index());
+    assert(1.0  == r3->get_reward(0));
+    assert(2.0  == r3->get_reward(1));
+    assert(1.0  == r3->get_reward(2));
+    assert(2.0  == r3->get_reward(3));
+    assert(1.0  == r3->get_reward(4));
+    assert(2.0  == r3->get_reward(5));
+    assert(2.0  == r3->get_average(5));
+    assert(0    == r1->get_count());
+    assert(1    == r2->get_count());
+    assert(1    == r3->get_count());
+    assert(0    == r1->get_total());
+    assert(16   == r2->get_total());
+    assert(9    == r3->get_total());
+    r1->add(r2);
+    //cout << "after r1->add(r2) r1->get_index() = " << r1->get_index() << endl;
+    assert(7    == r1->get_index());
+    assert(1.0  == r1->get_reward(0));
+    assert(2.0  == r1->get_reward(1));
+    assert(3.0  == r1->get_reward(2));
+    assert(4.0  == r1->get_reward(3));
+    assert(3.0  == r1->get_reward(4));
+    assert(2.0  == r1->get_reward(5));
+    assert(2.0  == r1->get_average(5));
+    assert(1.0  == r1->get_reward(6));
+    assert(1.0  == r1->get_average(6));
+    r1->add(r3);
+    assert(2    == r1->get_count());
+    assert(25   == r1->get_total());
+    assert(1.0  == r1->get_average(0));
+    assert(2.0  == r1->get_average(2));
+    assert(2.0  == r1->get_reward(0));  // 1 + 1
+    assert(4.0  == r1->get_reward(1));  // 2 + 2 
+    assert(4.0  == r1->get_reward(2));  // 3 + 1
+    assert(6.0  == r1->get_reward(3));  // 4 + 2
+    assert(4.0  == r1->get_reward(4));  // 3 + 1
+    assert(4.0  == r1->get_reward(5));  // 2 + 2
+    assert(1.0  == r1->get_reward(6));  // 1 + 0
+    assert(2.0  == r1->get_average(5));
+    assert(7    == r1->get_index());
+    //cout << "after r1->add(r3) r1->get_reward(5) = " << r1->get_reward(5) << endl;
+    //cout << "after r1->add(r3) r1->get_average(5) = " << r1->get_average(5) << endl;
+    assert(2.0  == r1->get_average(5));
+    assert(0.5  == r1->get_average(6));
+    delete r1;
+    delete r2;
+    delete r3;
+}    
+
+void TestRewards_testVariance()
+{
+    // 1. Five experiments of three steps, added one at a time
+    double steps[5][3] = {{1, 2, 3}, {2, 2, 5}, {3, 2, 1}, 
+                          {4, 2, 7}, {5, 2, 9}};
+    Rewards *sum = new Rewards(3);
+    Rewards *one = new Rewards(3);
+    for (int e = 0; e < 5; ++e) {
+        one->reset();
+        for (int s = 0; s < 3; ++s) one->append(steps[e][s]);
+        sum->add(one);
+    }
+    assert(5 == sum->get_count());
+    assert(3.0 == sum->get_average(0));
+    assert(fabs(sum->get_variance(0) - 2.5) < 1e-12);
+    assert(0.0 == sum->get_variance(1));
+    assert(fabs(sum->get_variance(2) - 10.0) < 1e-12);
+    assert(fabs(sum->get_total_variance() - 19.5) < 1e-12);
+    
+    // 2. Adding sums gives what adding the experiments would
+    Rewards *half = new Rewards(3);
+    Rewards *rest = new Rewards(3);
+    for (int e = 0; e < 5; ++e) {
+        one->reset();
+        for (int s = 0; s < 3; ++s) one->append(steps[e][s]);
+        if (e < 2) half->add(one); else rest->add(one);
+    }
+    half->add(rest);
+    assert(5 == half->get_count());
+    for (int s = 0; s < 3; ++s) {
+        assert(half->get_reward(s) == sum->get_reward(s));
+        assert(fabs(half->get_variance(s) - sum->get_variance(s)) < 1e-12);
+    }
+    delete sum;
+    delete one;
+    delete half;
+    delete rest;
 }
 
-void TestQLMCLBayes1_testCH20k()
+void TestRewards_testQuantiles()
 {
-    //cout << "---------- TestQLMCLBayes1_testCH20k ----------" << endl;
-    Grid   *g = new ChippyClassic(8);
-    QLMCLBayes1 *q = new QLMCLBayes1(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int j = 0; j < 20000; ++j)
-        q->move();
-    assert(20000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+    P2Quantile p, many;
+    int e, s;
+    
+    // 1. Exact for the first five, then close for a thousand and one
+    p.add(5.0, 1, 0.5);
+    p.add(1.0, 2, 0.5);
+    p.add(3.0, 3, 0.5);
+    assert(3.0 == p.get(3, 0.5));
+    for (e = 0; e < 1001; ++e) many.add((e * 613) % 1001, e + 1, 0.5);
+    assert(fabs(many.get(1001, 0.5) - 500.0) < 10.0);
+    
+    // 2. Experiments added one at a time have quantiles at every step
+    Rewards *sum = new Rewards(3);
+    Rewards *one = new Rewards(3);
+    assert(!sum->has_quantiles());
+    assert(sum->keep_quantiles());
+    for (e = 0; e < 1001; ++e) {
+        one->reset();
+        for (s = 0; s < 3; ++s) one->append(((e * 613) % 1001) * (s + 1));
+        sum->add(one);
+    }
+    assert(!sum->keep_quantiles());
+    assert(sum->has_quantiles());
+    for (s = 0; s < 3; ++s) {
+        assert(fabs(sum->get_quantile(s, 0) - 100.0*(s+1)) < 10.0*(s+1));
+        assert(fabs(sum->get_quantile(s, 1) - 500.0*(s+1)) < 10.0*(s+1));
+        assert(fabs(sum->get_quantile(s, 2) - 900.0*(s+1)) < 10.0*(s+1));
+    }
+    assert(fabs(sum->get_total_quantile(1) - 3000.0) < 60.0);
+    
+    // 3. The writers add the spread after each mean
+    Rewards *rwds[] = {sum, NULL};
+    write_lines("testquantiles", 1, 1, rwds, 2, 1, STATS_ALL);
+    write_totals("testquantiles", 1, 1, rwds, 2, STATS_ALL);
+    ifstream lines("testquantilesl.csv");
+    ifstream totals("testquantilest.csv");
+    string line;
+    getline(lines, line);
+    assert(string("step,????,???? sd,???? lo,???? hi,") +
+           "???? p10,???? p50,???? p90" == line);
+    getline(lines, line);
+    int commas = 0;
+    for (size_t c = 0; c < line.size(); ++c) commas += (',' == line[c]);
+    getline(totals, line);
+    for (size_t c = 0; c < line.size(); ++c) commas += (',' == line[c]);
+    assert(14 == commas);
+    lines.close();
+    totals.close();
+    remove("testquantilesl.csv");
+    remove("testquantilest.csv");
+    
+    // 4. Sums of experiments cannot be sketched, so they drop them
+    Rewards *other = new Rewards(3);
+    other->add(sum);
+    assert(!other->has_quantiles());
+    sum->add(other);
+    assert(!sum->has_quantiles());
+    delete sum;
+    delete one;
+    delete other;
 }
 
-void TestQLMCLBayes1_testCL10k()
+void TestRewards_testBinary()
+{
+    // 1. Two walkers on one grid, three experiments of 100 steps each
+    Rewards *rwds[3];
+    Rewards *one = new Rewards(100);
+    for (int w = 0; w < 2; ++w) {
+        rwds[w] = new Rewards(100);
+        for (int e = 0; e < 3; ++e) {
+            one->reset();
+            for (int s = 0; s < 100; ++s) one->append(0.1*(w+1)*s + e/3.0);
+            rwds[w]->add(one);
+        }
+        rwds[w]->set_colname("Chippy");
+        rwds[w]->set_rowname(w ? "Simple" : "QLearner");
+        rwds[w]->set_initials(w ? "SI" : "QL", "CH");
+    }
+    rwds[2] = NULL;
+    
+    // 2. Write and read back the results in full precision
+    assert(1 == write_binary("testbinary", 2, 1, rwds, 100));
+    ResultsFile file;
+    assert(file.open("testbinaryb.bin"));
+    assert(2 == file.get_columns());
+    assert(100 == file.get_rows());
+    assert(2 == file.get_walkers());
+    assert(1 == file.get_grids());
+    assert(NULL != file.doubles(1));
+    assert(0 == ((uintptr_t)file.doubles(0) % RESULTS_ALIGN));
+    for (int w = 0; w < 2; ++w) {
+        ResultsSeries series(&file, w);
+        assert(3 == series.get_count());
+        assert(rwds[w]->get_total() == series.get_total());
+        assert(0 == strcmp(rwds[w]->get_initials(), series.get_initials()));
+        assert(0 == strcmp(rwds[w]->get_colname(), series.get_colname()));
+        assert(0 == strcmp(rwds[w]->get_rowname(), series.get_rowname()));
+        for (int s = 0; s < 100; ++s) 
+            assert(rwds[w]->get_average(s) == series.get_average(s));
+    }
+    
+    // 3. Single precision values are close to the originals
+    assert(1 == write_binary("testbinary", 2, 1, rwds, 100, 4));
+    assert(file.open("testbinaryb.bin"));
+    assert(NULL == file.doubles(0));
+    assert(NULL != file.floats(0));
+    for (int w = 0; w < 2; ++w)
+        for (int s = 0; s < 100; ++s) 
+            assert(fabs(rwds[w]->get_average(s) - file.get_value(w, s)) 
+                   < 1e-5);
+    file.close();
+    
+    // 4. Anything else is not a results file
+    FILE *junk = fopen("testbinaryb.bin", "wb");
+    fputs("not a results file", junk);
+    fclose(junk);
+    assert(!file.open("testbinaryb.bin"));
+    assert(!file.is_open());
+    remove("testbinaryb.bin");
+    
+    delete one;
+    delete rwds[0];
+    delete rwds[1];
+}
+
+void TestChippyBatch()
 {
-    //cout << "---------- TestQLMCLBayes1_testCL10k ----------" << endl;
-    Grid   *g = new ChippyClassic(8);
-    QLMCLBayes1 *q = new QLMCLBayes1(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    //q->set_verbose(1);
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <  q->get_policy_number());
-    assert(4    >  q->get_policy_number());
-    //cout << "----- MCLBayes1 CL score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+    cout << "  ChippyBatch ... ";
+    TestChippyBatch_testLanes();
+    TestChippyBatch_testPerturb();
+    TestChippyBatch_testStatistics();
+    cout << "OK" << endl;
 }
 
-void TestQLMCLBayes1_testCO10k()
+void TestChippyBatch_testLanes()
 {
-    //cout << "---------- TestQLMCLBayes1_testCO10k ----------" << endl;
-    Grid   *g = new ChippyCorner(8);
-    QLMCLBayes1 *q = new QLMCLBayes1(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <  q->get_policy_number());
-    assert(4    >  q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
+    // Every lane repeats the QLearner run that has the same streams
+    Grid *grids[] = {new Chippy(), new ChippyClassic(), 
+                     new ChippyCorner(), new ChippyRotate(6, 10, 5), NULL};
+    for (Grid **gi = grids; *gi != NULL; ++gi)
+    {
+        QLearner *q = new QLearner();
+        ChippyBatch *b = new ChippyBatch(*gi, q, 3);
+        assert(b->get_lanes() == 3);
+        assert(b->get_kind() == ChippyBatch::kind_of(*gi));
+        for (int l = 0; l < 3; ++l)
+        {
+            Grid *g = (*gi)->clone();
+            QLearner *w = new QLearner(g);
+            RollingAverage ravg;
+            w->set_seed(77, 2*l);
+            g->set_seed(77, 2*l+1);
+            b->reinit();
+            for (int k = 0; k < 3; ++k) {
+                b->get_walker_random(k)->set_seed(77, 2*k);
+                b->get_grid_random(k)->set_seed(77, 2*k+1);
+            }
+            for (int step = 0; step < 3000; ++step)
+            {
+                Goal *goal = w->move();
+                b->step();
+                ravg.add(goal ? goal->get_reward() : 0);
+                assert(b->get_x(l) == w->get_x());
+                assert(b->get_y(l) == w->get_y());
+                assert(b->get_reward(l) == (goal ? goal->get_reward() : 0));
+                assert(b->get_average(l) == ravg.get_average());
+                if (1500 == step) {
+                    g->perturb();
+                    b->perturb();
+                }
+            }
+            for (int x = 0; x < g->get_n(); ++x)
+                for (int y = 0; y < g->get_n(); ++y)
+                    for (int d = 0; d < DIR_NUM; ++d)
+                        assert(g->get_q(x, y, d) == 
+                               b->q_of(l)[(x*g->get_n() + y)*DIR_NUM + d]);
+            delete w;
+            delete g;
+        }
+        delete b;
+        delete q;
+        delete *gi;
+    }
+}
+
+void TestChippyBatch_testPerturb()
+{
+    // Only the lanes in the mask are perturbed
+    ChippyClassic *c = new ChippyClassic();
+    ChippyRotate  *r = new ChippyRotate();
+    QLearner *q = new QLearner();
+    ChippyBatch *bc = new ChippyBatch(c, q, 4);
+    ChippyBatch *br = new ChippyBatch(r, q, 4);
+    unsigned char mask[4] = {1, 0, 1, 0};
+    assert(bc->get_kind() == BATCH_CLASSIC);
+    assert(br->get_kind() == BATCH_ROTATE);
+    Grid plain;
+    assert(ChippyBatch::kind_of(&plain) == BATCH_NONE);
+    bc->perturb(mask);
+    br->perturb(mask);
+    assert(bc->get_g1r(0) == -10);
+    assert(bc->get_g1r(1) == 10);
+    assert(bc->get_g1r(2) == -10);
+    assert(br->get_state(0) == 1);
+    assert(br->get_state(1) == 0);
+    bc->perturb();
+    br->perturb();
+    assert(bc->get_g1r(0) == 10);
+    assert(bc->get_g1r(1) == -10);
+    assert(br->get_state(0) == 2);
+    assert(br->get_state(3) == 1);
+    bc->reinit();
+    assert(bc->get_g1r(1) == 10);
+    delete bc;
+    delete br;
     delete q;
+    delete c;
+    delete r;
 }
 
-void TestQLMCLBayes1_testCR10k()
+void TestChippyBatch_testStatistics()
 {
-    //cout << "---------- TestQLMCLBayes1_testCR10k ----------" << endl;
-    Grid   *g = new ChippyRotate(8);
-    QLMCLBayes1 *q = new QLMCLBayes1(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <  q->get_policy_number());
-    assert(4    >  q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
+    // Batch and scalar runs with different seeds agree on the mean
+    const int runs = 32;
+    const int steps = 4000;
+    ChippyClassic *c = new ChippyClassic();
+    QLearner *q = new QLearner();
+    ChippyBatch *b = new ChippyBatch(c, q, runs);
+    double bsum = 0.0, bsq = 0.0, ssum = 0.0, ssq = 0.0;
+    double *btotal = (double *)calloc(runs, sizeof(double));
+    int l, step;
+    
+    // 1. Total reward of each lane of a batch
+    for (l = 0; l < runs; ++l) {
+        b->get_walker_random(l)->set_seed(5, 2*l);
+        b->get_grid_random(l)->set_seed(5, 2*l+1);
+    }
+    for (step = 0; step < steps; ++step) {
+        b->step();
+        for (l = 0; l < runs; ++l) btotal[l] += b->get_reward(l);
+        if (steps/2 == step) b->perturb();
+    }
+    
+    // 2. And of as many scalar runs
+    for (l = 0; l < runs; ++l) {
+        Grid *g = c->clone();
+        QLearner *w = new QLearner(g);
+        double total = 0.0;
+        w->set_seed(6, 2*l);
+        g->set_seed(6, 2*l+1);
+        for (step = 0; step < steps; ++step) {
+            Goal *goal = w->move();
+            if (goal) total += goal->get_reward();
+            if (steps/2 == step) g->perturb();
+        }
+        ssum += total;
+        ssq  += total*total;
+        bsum += btotal[l];
+        bsq  += btotal[l]*btotal[l];
+        delete w;
+        delete g;
+    }
+    
+    // 3. The means are within four standard errors
+    double bmean = bsum/runs;
+    double smean = ssum/runs;
+    double bvar = (bsq - runs*bmean*bmean)/(runs - 1);
+    double svar = (ssq - runs*smean*smean)/(runs - 1);
+    assert(bmean > 0.0);
+    assert(fabs(bmean - smean) < 4.0*sqrt((bvar + svar)/runs));
+    free(btotal);
+    delete b;
     delete q;
+    delete c;
 }
 
-void TestQLMCLBayes2()
+void TestExperimentRunner()
 {
-    cout << "  QLearner MCL Bayes 2 ... ";
-    TestQLMCLBayes2_testEmptyConstructor();
-    TestQLMCLBayes2_testConstructor();
-    TestQLMCLBayes2_testLearning();
-    TestQLMCLBayes2_testCH20k();
-    TestQLMCLBayes2_testCL10k();
-    TestQLMCLBayes2_testCO10k();
-    TestQLMCLBayes2_testCR10k();
-    TestQLMCLBayes2_testCL10p5();
+    cout << "  ExperimentRunner ... ";
+    TestExperimentRunner_testThreads();
+    TestExperimentRunner_testSweep();
+    TestExperimentRunner_testStop();
+    TestExperimentRunner_testShards();
     cout << "OK" << endl;
 }
 
-void TestQLMCLBayes2_testEmptyConstructor()
+void TestExperimentRunner_testThreads()
 {
-    QLMCLBayes2 *q = new QLMCLBayes2();
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(0    == q->get_x());
-    assert(0    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    delete q;
+    int walkers[] = {WALK_QLEARNER, WALK_SIMPLE, WALK_NONE};
+    Grid *grids[] = {new Chippy(), new ChippyClassic(), NULL};
+    Rewards *one[5];
+    Rewards *many[5];
+    int i;
+    
+    for (i = 0; i < 4; ++i) {
+        one[i]  = new Rewards(2000);
+        many[i] = new Rewards(2000);
+    }
+    one[4]  = NULL;
+    many[4] = NULL;
+    
+    // Every kind of walker is known to be reentrant or not without one
+    for (i = WALK_WALKER; i <= WALK_BAYES2; ++i) {
+        Walker *w = walker_factory(i);
+        assert(w->reentrant() == walker_reentrant(i));
+        delete w;
+    }
+    
+    // The same seed must give the same totals whatever the thread count
+    ExperimentRunner r1(NULL, walkers, grids, one, 
+                        2, 2, 3, 2000, 1000, 0, 1234);
+    ExperimentRunner r3(NULL, walkers, grids, many, 
+                        2, 2, 3, 2000, 1000, 0, 1234);
+    assert(12 == r1.get_jobs());
+    r1.set_policy(false);
+    r3.set_policy(false);
+    r1.run(1);
+    r3.run(3);
+    assert(12 == r1.get_done());
+    assert(12 == r3.get_done());
+    assert(1 == r1.get_buffers());
+    
+    // QLearner batches must not change the totals either
+    Rewards *batched[5];
+    for (i = 0; i < 4; ++i) batched[i] = new Rewards(2000);
+    batched[4] = NULL;
+    ExperimentRunner rb(NULL, walkers, grids, batched,
+                        2, 2, 3, 2000, 1000, 0, 1234);
+    rb.set_policy(false);
+    rb.set_lanes(2);
+    rb.run(2);
+    assert(12 == rb.get_done());
+    assert(10 == rb.get_tasks());
+    assert(rb.get_buffers() <= 2*2);
+    for (i = 0; i < 4; ++i) {
+        assert(one[i]->get_total() == batched[i]->get_total());
+        for (int step = 0; step < one[i]->get_index(); ++step) 
+            assert(one[i]->get_reward(step) == batched[i]->get_reward(step));
+        delete batched[i];
+    }
+    for (i = 0; i < 4; ++i) {
+        assert(3 == one[i]->get_count());
+        assert(one[i]->get_index() == many[i]->get_index());
+        assert(one[i]->get_total() == many[i]->get_total());
+        for (int step = 0; step < one[i]->get_index(); ++step) 
+            assert(one[i]->get_reward(step) == many[i]->get_reward(step));
+        delete one[i];
+        delete many[i];
+    }
+    delete grids[0];
+    delete grids[1];
+}
+
+void TestExperimentRunner_testSweep()
+{
+    SweepAxis axis;
+    SweepSpec spec;
+    
+    // Lists and inclusive ranges, and bad text leaves the axis alone
+    assert(axis.parse("0.1,0.5"));
+    assert(2 == axis.n);
+    assert(0.5 == axis.v[1]);
+    assert(axis.parse("0.1:0.3:0.1"));
+    assert(3 == axis.n);
+    assert(fabs(axis.v[2] - 0.3) < 1e-9);
+    assert(!axis.parse("1,x"));
+    assert(!axis.parse("3:1:1"));
+    assert(3 == axis.n);
+    
+    // Sizes and thresholds are whole numbers, sizes of a usable grid
+    assert(axis.parse("8:12:2", true, SWEEP_MIN_SIZE));
+    assert(axis.parse("3,4,8", true, SWEEP_MIN_SIZE));
+    assert(3 == axis.n);
+    assert(!axis.parse("0", true, SWEEP_MIN_SIZE));
+    assert(!axis.parse("-8", true, SWEEP_MIN_SIZE));
+    assert(!axis.parse("6.5", true, SWEEP_MIN_SIZE));
+    assert(!axis.parse("4:6:0.5", true));
+    assert(3 == axis.n);
+    assert(1 == spec.walkers());
+    assert(1 == spec.grids());
+    assert(spec.parse_rewards("10/-10,10/5"));
+    assert(2 == spec.rewards);
+    assert(5 == spec.r2[1]);
+    assert(!spec.parse_rewards("10"));
+    assert(2 == spec.rewards);
+    
+    // The factories use the parameters they are given
+    Walker *w = walker_factory(WALK_SIMPLE, WalkerParams(0.3, 0.8, 0.2, 5));
+    assert(0.3 == ((QLearner *)w)->get_alpha());
+    assert(0.8 == ((QLearner *)w)->get_gamma());
+    assert(0.2 == ((QLearner *)w)->get_epsilon());
+    assert(5 == ((QLMCLSimple *)w)->get_threshold());
+    delete w;
+    Chippy *g = (Chippy *)grid_factory(GRID_PCORNER, 6, 7, -3);
+    assert(6 == g->get_n());
+    assert(7 == g->get_r1());
+    assert(-3 == g->get_r2());
+    delete g;
+    
+    // One row per combination, the same whatever the thread count
+    assert(spec.alpha.parse("0.2,0.6"));
+    assert(spec.size.parse("6"));
+    assert(4 == spec.walkers() * spec.grids());
+    assert(4 == sweep("testsweep1", WALK_QLEARNER, GRID_CLASSIC, spec,
+                      2, 1, 1234, 0, 2000, 1000));
+    assert(4 == sweep("testsweep3", WALK_QLEARNER, GRID_CLASSIC, spec,
+                      2, 3, 1234, 0, 2000, 1000));
+    ifstream in1("testsweep1s.csv");
+    ifstream in3("testsweep3s.csv");
+    string line1, line3;
+    int rows = 0;
+    getline(in1, line1);
+    assert(0 == line1.find("walker,grid,alpha,gamma,epsilon,threshold,n,"));
+    getline(in3, line3);
+    while (getline(in1, line1)) {
+        assert(getline(in3, line3));
+        assert(line1 == line3);
+        ++rows;
+    }
+    assert(4 == rows);
+    in1.close();
+    in3.close();
+    remove("testsweep1s.csv");
+    remove("testsweep3s.csv");
+}
+
+void TestExperimentRunner_testStop()
+{
+    int walkers[] = {WALK_QLEARNER, WALK_NONE};
+    Grid *grids[] = {new Chippy(), new ChippyRotate(), NULL};
+    Rewards *loose[3], *tight[3], *one[3], *many[3];
+    Rewards *fixed[] = {new Rewards(2000), NULL};
+    int i;
+    
+    for (i = 0; i < 2; ++i) {
+        loose[i] = new Rewards(2000);
+        tight[i] = new Rewards(2000);
+        one[i]   = new Rewards(2000);
+        many[i]  = new Rewards(2000);
+    }
+    
+    // A wide interval stops at the fewest repeats, a zero one at the most
+    ExperimentRunner rl(NULL, walkers, grids, loose, 1, 2, 12, 2000, 1000, 
+                        0, 1234);
+    ExperimentRunner rt(NULL, walkers, grids, tight, 1, 2, 12, 2000, 1000, 
+                        0, 1234);
+    rl.set_policy(false);
+    rt.set_policy(false);
+    rl.set_stop(StopRule(STOP_TOTAL, 10.0, 3));
+    rt.set_stop(StopRule(STOP_AFTER, 0.0, 3));
+    rl.run(2);
+    rt.run(2);
+    assert(6 == rl.get_done());
+    assert(24 == rt.get_done());
+    for (i = 0; i < 2; ++i) {
+        assert(3 == loose[i]->get_count());
+        assert(12 == tight[i]->get_count());
+    }
+    
+    // In between, the rounds are the same whatever the thread count and
+    // a cell has the results of that many fixed repeats
+    ExperimentRunner r1(NULL, walkers, grids, one, 1, 2, 12, 2000, 1000, 
+                        0, 1234);
+    ExperimentRunner r3(NULL, walkers, grids, many, 1, 2, 12, 2000, 1000, 
+                        0, 1234);
+    r1.set_policy(false);
+    r3.set_policy(false);
+    r1.set_stop(StopRule(STOP_TOTAL, 0.05, 3));
+    r3.set_stop(StopRule(STOP_TOTAL, 0.05, 3));
+    r1.run(1);
+    r3.run(3);
+    assert(r1.get_done() == r3.get_done());
+    for (i = 0; i < 2; ++i) {
+        assert(one[i]->get_count() >= 3);
+        assert(one[i]->get_count() <= 12);
+        assert(one[i]->get_count() == many[i]->get_count());
+        assert(one[i]->get_total() == many[i]->get_total());
+    }
+    ExperimentRunner rf(NULL, walkers, grids, fixed, 1, 1, 
+                        one[0]->get_count(), 2000, 1000, 0, 1234);
+    rf.set_policy(false);
+    rf.run(1);
+    assert(one[0]->get_total() == fixed[0]->get_total());
+    delete fixed[0];
+    
+    for (i = 0; i < 2; ++i) {
+        delete loose[i];
+        delete tight[i];
+        delete one[i];
+        delete many[i];
+        delete grids[i];
+    }
+}
+
+void TestExperimentRunner_testShards()
+{
+    int walkers[] = {WALK_QLEARNER, WALK_SIMPLE, WALK_NONE};
+    Grid *grids[] = {new Chippy(), new ChippyClassic(), NULL};
+    Rewards *one[5];
+    Rewards *part[5];
+    char *files[3] = {(char *)"testshardp2of3.bin", (char *)"testshardp0of3.bin",
+                      (char *)"testshardp1of3.bin"};
+    int i, k, done = 0;
+    
+    // 1. The results of all the experiments in one go
+    for (i = 0; i < 4; ++i) one[i] = new Rewards(2000);
+    one[4] = NULL;
+    part[4] = NULL;
+    ExperimentRunner r1(NULL, walkers, grids, one, 2, 2, 3, 2000, 1000, 
+                        0, 1234);
+    r1.set_policy(false);
+    r1.run(2);
+    write_results("testshard1", 2, 2, one, 2000, FORMAT_BOTH, STATS_CI);
+    
+    // 2. And in three shards of whole cells, each with its own file
+    for (k = 0; k < 3; ++k) {
+        for (i = 0; i < 4; ++i) part[i] = new Rewards(2000);
+        ExperimentRunner rk(NULL, walkers, grids, part, 2, 2, 3, 2000, 1000, 
+                            0, 1234);
+        rk.set_policy(false);
+        rk.set_shard(k, 3);
+        assert(0 == rk.get_shard_lo() % 3);
+        rk.run(1);
+        done += rk.get_done();
+        assert(write_shard("testshard", k, 3, 1234, 3, 2000, 2, 2, part));
+        for (i = 0; i < 4; ++i) delete part[i];
+    }
+    assert(12 == done);
+    
+    // 3. Merged in any order they are the same as the run in one go
+    assert(3 == merge_shards(3, files, FORMAT_BOTH, STATS_CI));
+    ifstream in1("testshard1b.bin", ios::binary);
+    ifstream in3("testshardb.bin", ios::binary);
+    string bytes1((std::istreambuf_iterator<char>(in1)), 
+                  std::istreambuf_iterator<char>());
+    string bytes3((std::istreambuf_iterator<char>(in3)), 
+                  std::istreambuf_iterator<char>());
+    assert(bytes1.size() > 0);
+    assert(bytes1 == bytes3);
+    in1.close();
+    in3.close();
+    
+    // 4. With the same spread at every step, whichever shard had the cell
+    const char *texts[] = {"l.csv", "t.csv", NULL};
+    for (k = 0; texts[k] != NULL; ++k) {
+        string name1 = string("testshard1") + texts[k];
+        string name3 = string("testshard") + texts[k];
+        ifstream text1(name1.c_str());
+        ifstream text3(name3.c_str());
+        string lines1((std::istreambuf_iterator<char>(text1)), 
+                      std::istreambuf_iterator<char>());
+        string lines3((std::istreambuf_iterator<char>(text3)), 
+                      std::istreambuf_iterator<char>());
+        assert(lines1.size() > 0);
+        assert(lines1 == lines3);
+        text1.close();
+        text3.close();
+        remove(name1.c_str());
+        remove(name3.c_str());
+    }
+    
+    // 5. A missing shard is left out, one that is there twice is not
+    assert(2 == merge_shards(2, files, FORMAT_BINARY));
+    files[1] = files[0];
+    assert(0 == merge_shards(3, files, FORMAT_BINARY));
+    
+    // 6. More shards than cells split the cells between them
+    ExperimentRunner r5(NULL, walkers, grids, one, 2, 2, 3, 2000, 1000, 
+                        0, 1234);
+    for (k = 0, done = 0; k < 5; ++k) {
+        r5.set_shard(k, 5);
+        assert(r5.get_shard_hi() - r5.get_shard_lo() >= 2);
+        done += r5.get_shard_hi() - r5.get_shard_lo();
+    }
+    assert(12 == done);
+    
+    for (i = 0; i < 4; ++i) delete one[i];
+    delete grids[0];
+    delete grids[1];
+    remove("testshard1b.bin");
+    remove("testshard1t.tex");
+    remove("testshardb.bin");
+    remove("testshardt.tex");
+    remove("testshardp0of3.bin");
+    remove("testshardp1of3.bin");
+    remove("testshardp2of3.bin");
+}
+
+// --------------------------------------------------------------------
+//                                                       do_experiments
+// --------------------------------------------------------------------
+void do_experiments(const char *basename, int repeats=EXP_REPEAT,
+                    int n = 8, int r1=10, int r2=-10, int threads=1,
+                    unsigned long long seed=1, int lanes=0,
+                    int format=FORMAT_BOTH, int cadence=MONITOR_EVERY,
+                    const StopRule &stop=StopRule(), int stats=STATS_NONE,
+                    int shard=0, int shards=1)
+{
+    Grid* grids[] = {
+        new Chippy(n, r1, r2), 
+	    new ChippyClassic(n, r1, r2), 
+        new ChippyCorner(n, r1, r2), 
+	    new ChippyRotate(n, r1, r2),
+	    NULL
+    };
+    Grid **g;
+    int kntg = 0;
+    
+    int walkers[] = {
+        WALK_QLEARNER, 
+	    WALK_SIMPLE,
+        WALK_SENSITIVE,
+        WALK_SOPHISTICATED,
+        WALK_BAYES1,
+        WALK_BAYES2,
+        WALK_NONE
+    };
+    
+    int *w;
+    int kntw= 0;
+    
+    // 1. Count the walkers and 
+    for (w = walkers; *w != WALK_NONE; ++w) ++kntw;
+    for (g = grids; *g != NULL; ++g) ++kntg;
+    //cout << "grids=" << kntg << ", walkers=" << kntw << endl;
+    
+    // 2. Execute the experiments
+    experiments(basename, 
+                repeats, EXP_STEPS, EXP_PERTURB, 0, 
+                walkers, grids, threads, seed, lanes, format, cadence, stop,
+                stats, shard, shards);
+    
+    // 3. Delete allocated objects
+    for (g = grids; *g != NULL; ++g) delete *g;
+    
 }
 
-void TestQLMCLBayes2_testConstructor()
+// ====================================================================
+//                                                           benchmarks
+// ====================================================================
+
+// --------------------------------------------------------------------
+//                                                        bench_seconds
+// --------------------------------------------------------------------
+// Keeps the optimizer from dropping the work being timed
+static volatile double bench_sink = 0.0;
+
+double bench_seconds(void)
 {
-    Grid   *g = new Grid();
-    QLMCLBayes2 *q = new QLMCLBayes2(g,2,4,4,0.8,0.7,0.1);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.8  == q->get_alpha());
-    assert(0.7  == q->get_gamma());
-    assert(0.1  == q->get_epsilon());
-    assert(2    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    delete g;
-    delete q;
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-void TestQLMCLBayes2_testLearning()
+// CPU seconds of the calling thread alone (wall seconds on Windows)
+double bench_thread_seconds(void)
 {
-    Goal *g1 = new Goal(10,LOC_MIN,LOC_MIN,LOC_MAX,LOC_MAX);
-    Goal *g2 = new Goal(-10,LOC_MAX,LOC_MAX,LOC_MIN,LOC_MIN);
-    Goal *goals[3] = {g1, g2, NULL};
-    Grid   *g = new Grid(8,goals);
-    QLMCLBayes2 *q = new QLMCLBayes2(g, 2, 0, 0, 0.5, 0.9, 0.05);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(0    == q->get_x());
-    assert(0    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    assert(2    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    q->move(DIR_N); // 0,0->0,1
-    assert(0    == q->get_x());
-    assert(1    == q->get_y());
-    q->move(DIR_E); // 0,1->1,1
-    assert(1    == q->get_x());
-    assert(1    == q->get_y());
-    q->move(DIR_S); // 1,1->1,0
-    assert(1    == q->get_x());
-    assert(0    == q->get_y());
-    q->move(DIR_W); // 1,0->0,0 jumpto 7,7
-    assert(4    == q->get_count());
-    assert(7    == q->get_x());
-    assert(7    == q->get_y());
-    assert(10   == q->get_score());
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_W);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_S);
-    q->move(DIR_W);
-    assert(7    == q->get_x());
-    assert(7    == q->get_y());
-    assert(0.0  == g->square(1,0)->get_q(0));
-    assert(0.0  == g->square(1,0)->get_q(1));
-    assert(0.0  == g->square(1,0)->get_q(2));
-    assert(7.5  == g->square(1,0)->get_q(3)); 
-    assert(0.0  == g->square(1,1)->get_q(0));
-    assert(2.25 == g->square(1,1)->get_q(1));
-    assert(0.0  == g->square(1,1)->get_q(2));
-    assert(0.0  == g->square(1,1)->get_q(3));
-    delete g1;
-    delete g2;
-    delete g;
-    delete q;
+#ifdef _WIN32
+    return bench_seconds();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
 }
 
-void TestQLMCLBayes2_testCH20k()
+// ====================================================================
+//                                                      microbenchmarks
+// Each case does ops operations per call.  It is run untimed for a
+// warm-up and then timed MICRO_REPEATS times, and reported as the mean
+// and standard deviation of the nanoseconds per operation.  The
+// benchmarks in micro_suites (see BenchMicro) are made of such cases.
+// ====================================================================
+#define MICRO_WARMUP   0.05
+#define MICRO_REPEATS  7
+#define MICRO_MAX      64
+#define MICRO_JSON     "chippy_bench.json"
+
+struct MicroResult {
+    char   name[48];
+    long   ops;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+};
+
+static MicroResult micro_results[MICRO_MAX];
+static int micro_count = 0;
+
+// The heading of a group of cases
+void micro_header(const char *title)
 {
-    //cout << "---------- TestQLMCLBayes2_testCH20k ----------" << endl;
-    Grid   *g = new ChippyClassic(8);
-    QLMCLBayes2 *q = new QLMCLBayes2(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 20000; ++i)
-        q->move();
-    assert(20000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+    cout << "  " << title << endl;
+    cout << "  case                                  mean ns   stddev"
+         << "     min ns        ops/sec" << endl;
 }
 
-void TestQLMCLBayes2_testCL10k()
+// Time work (with clock, wall seconds unless given) and return the mean
+// nanoseconds per operation
+template <class F>
+double micro_run(const char *name, long ops, F work, 
+                 double (*clock)(void) = bench_seconds)
 {
-    //cout << "---------- TestQLMCLBayes2_testCL10k ----------" << endl;
-    Grid   *g = new ChippyClassic(8);
-    QLMCLBayes2 *q = new QLMCLBayes2(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    //q->set_verbose(1);
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <  q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+    char line[160];
+    
+    // 1. Warm up the caches, the branch predictors and the clock
+    double start = bench_seconds();
+    do work(); while (bench_seconds() - start < MICRO_WARMUP);
+    
+    // 2. Time the repetitions, keeping a running mean and variance
+    double mean = 0.0, m2 = 0.0, best = 0.0;
+    for (int r = 0; r < MICRO_REPEATS; ++r) {
+        start = clock();
+        work();
+        double ns = (clock() - start) * 1e9 / ops;
+        double delta = ns - mean;
+        mean += delta / (r + 1);
+        m2 += delta * (ns - mean);
+        if ((0 == r) || (ns < best)) best = ns;
+    }
+    
+    // 3. Keep the result for the json file
+    if (micro_count < MICRO_MAX) {
+        MicroResult *m = &micro_results[micro_count++];
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        m->ops       = ops;
+        m->mean_ns   = mean;
+        m->stddev_ns = sqrt(m2 / (MICRO_REPEATS - 1));
+        m->min_ns    = best;
+    }
+    
+    // 4. Report
+    sprintf(line, "  %-36s %10.1f %8.1f %10.1f %14.0f", name, mean, 
+            sqrt(m2 / (MICRO_REPEATS - 1)), best, 1e9 / mean);
+    cout << line << endl;
+    return mean;
 }
 
-void TestQLMCLBayes2_testCL10p5()
+// --------------------------------------------------------------------
+//                                                       BenchGridStore
+// Steps per second of a QLearner, and square sweeps per second, with
+// the Q values in separate squares and in one contiguous table.
+// --------------------------------------------------------------------
+void BenchGridStore()
 {
-    //cout << "---------- TestQLMCLBayes2_testCL10p5 ----------" << endl;
-    Grid   *g = new ChippyClassic(8, 10, 5);
-    QLMCLBayes2 *q = new QLMCLBayes2(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    //q->set_verbose(1);
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+    const int sizes[] = {8, 32, 128, 512, 1024, 0};
+    const int steps = 1000000;
+    const char *store_names[] = {"squares", "contiguous"};
+    
+    cout << "  GridStore" << endl;
+    cout << "       n       store    steps/sec   squares/sec" << endl;
+    for (const int *n = sizes; *n; ++n)
+    {
+        for (int store = STORE_SQUARES; store <= STORE_CONTIGUOUS; ++store)
+        {
+            // 1. Make a walker on a grid of this size
+            Chippy *g = new Chippy(*n, 10, -10, store);
+            QLearner *q = new QLearner(g);
+            g->set_seed(1);
+            q->set_seed(2);
+            q->start_at();
+            
+            // 2. Time the walking
+            double start = bench_seconds();
+            for (int step = 0; step < steps; ++step) q->move();
+            double walk = bench_seconds() - start;
+            
+            // 3. Time sweeps over every square, as the policy does
+            int sweeps = 1 + (4*1024*1024)/((*n)*(*n));
+            double total = 0.0;
+            start = bench_seconds();
+            for (int s = 0; s < sweeps; ++s)
+                for (int x = 0; x < *n; ++x)
+                    for (int y = 0; y < *n; ++y)
+                        total += g->max(x, y);
+            double sweep = bench_seconds() - start;
+            
+            // 4. Report
+            char line[100];
+            sprintf(line, "    %4d  %10s  %11.0f  %12.0f", 
+                    *n, store_names[store], 
+                    steps/walk, (double(sweeps)*(*n)*(*n))/sweep);
+            bench_sink = total;
+            cout << line << endl;
+            delete q;
+            delete g;
+        }
+    }
 }
 
-void TestQLMCLBayes2_testCO10k()
-{
-    //cout << "---------- TestQLMCLBayes2_testCO10k ----------" << endl;
-    Grid   *g = new ChippyCorner(8);
-    QLMCLBayes2 *q = new QLMCLBayes2(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <= q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
-    delete g;
-    delete q;
+// --------------------------------------------------------------------
+//                                                          BenchArgmax
+// Square::best_of and Square::max_of calls per second on Q values with
+// and without ties.
+// --------------------------------------------------------------------
+void BenchArgmax()
+{
+    const int calls = 20000000;
+    const int kinds = 3;
+    const char *kind_names[kinds] = {"unique", "2 tied", "all tied"};
+    double qs[kinds][DIR_NUM] = {{0.5, 1.5, -2.0, 1.0}, 
+                                 {1.5, 0.5, 1.5, -1.0},
+                                 {0.0, 0.0, 0.0, 0.0}};
+    const int squares = 256;
+    double *table = (double *)aligned_calloc(squares*DIR_NUM, sizeof(double));
+    Random r;
+    r.set_seed(1);
+    
+    cout << "  Argmax" << endl;
+    cout << "          q   suggest/sec       max/sec" << endl;
+    for (int k = 0; k < kinds; ++k)
+    {
+        // 1. Fill a table of squares with rotations of the values
+        for (int s = 0; s < squares; ++s)
+        {
+            int turn = r.below(DIR_NUM);
+            for (int dir = 0; dir < DIR_NUM; ++dir)
+                table[s*DIR_NUM + dir] = qs[k][(dir+turn)%DIR_NUM] + s;
+        }
+        
+        // 2. Time the suggestions
+        int total = 0;
+        double start = bench_seconds();
+        for (int i = 0; i < calls; ++i) 
+            total += Square::best_of(table + (i%squares)*DIR_NUM, &r);
+        double suggest = bench_seconds() - start;
+        
+        // 3. Time the maximums
+        double maxs = 0.0;
+        start = bench_seconds();
+        for (int i = 0; i < calls; ++i) 
+            maxs += Square::max_of(table + (i%squares)*DIR_NUM);
+        double maxt = bench_seconds() - start;
+        
+        // 4. Report
+        char line[100];
+        sprintf(line, "  %9s  %12.0f  %12.0f", 
+                kind_names[k], calls/suggest, calls/maxt);
+        cout << line << endl;
+        bench_sink = total + maxs;
+    }
+    aligned_free(table);
 }
 
-void TestQLMCLBayes2_testCR10k()
+// --------------------------------------------------------------------
+//                                                           BenchBatch
+// Episode steps per second of scalar QLearners and of ChippyBatch with
+// more and more lanes, on the 8 by 8 ChippyClassic grid.
+// --------------------------------------------------------------------
+void BenchBatch()
 {
-    //cout << "---------- TestQLMCLBayes2_testCR10k ----------" << endl;
-    Grid   *g = new ChippyRotate(8);
-    QLMCLBayes2 *q = new QLMCLBayes2(g);
-    assert(0    == q->get_score());
-    assert(0    == q->get_count());
-    assert(4    == q->get_x());
-    assert(4    == q->get_y());
-    assert(0.5  == q->get_alpha());
-    assert(0.9  == q->get_gamma());
-    assert(0.05 == q->get_epsilon());
-    for (int i = 0; i < 5000; ++i)
-        q->move();
-    assert(5000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    == q->get_policy_number());
-    g->perturb();
-    //cout << "----- perturbation ----- " << endl;
-    for (int j = 0; j < 5000; ++j)
-        q->move();
-    assert(10000 == q->get_count());
-    assert(3    == q->get_threshold());
-    assert(0    == q->get_violations());
-    assert(0    <  q->get_policy_number());
-    //cout << "----- score = " << q->get_score() << " ----- " << endl;
+    const int lane_counts[] = {1, 4, 8, 16, 32, 64, 0};
+    const int steps = 2000000;
+    ChippyClassic *c = new ChippyClassic();
+    QLearner *q = new QLearner();
+    char line[100];
+    
+    cout << "  Batch" << endl;
+    cout << "      lanes    steps/sec" << endl;
+    
+    // 1. Time the scalar walker
+    Grid *g = c->clone();
+    QLearner *w = new QLearner(g);
+    RollingAverage ravg;
+    double start = bench_seconds();
+    for (int step = 0; step < steps; ++step) {
+        Goal *goal = w->move();
+        ravg.add(goal ? goal->get_reward() : 0);
+        if (0 == step%10000) g->perturb();
+    }
+    double elapsed = bench_seconds() - start;
+    sprintf(line, "     scalar  %11.0f", steps/elapsed);
+    cout << line << endl;
+    bench_sink = ravg.get_average();
+    delete w;
     delete g;
+    
+    // 2. Time batches with the same total number of steps
+    for (const int *k = lane_counts; *k; ++k)
+    {
+        ChippyBatch *b = new ChippyBatch(c, q, *k);
+        for (int l = 0; l < *k; ++l) {
+            b->get_walker_random(l)->set_seed(1, 2*l);
+            b->get_grid_random(l)->set_seed(1, 2*l+1);
+        }
+        start = bench_seconds();
+        for (int step = 0; step < steps / *k; ++step) {
+            b->step();
+            if (0 == step%10000) b->perturb();
+        }
+        elapsed = bench_seconds() - start;
+        sprintf(line, "       %4d  %11.0f", 
+                *k, (steps / *k) * double(*k) / elapsed);
+        cout << line << endl;
+        bench_sink = b->get_average(0);
+        delete b;
+    }
     delete q;
+    delete c;
 }
 
-void TestRollingAverage()
-{
-    cout << "  RollingAverage ... ";
-    TestRollingAverage_testEmptyConstructor();
-    TestRollingAverage_testConstructor();
-    TestRollingAverage_testAverages();
-    cout << "OK" << endl;
-}
-
-void TestRollingAverage_testEmptyConstructor()
+// --------------------------------------------------------------------
+//                                                           BenchGoals
+// goal_at() through the goal index and by searching the goal list, and
+// random walker moves, on a 32 by 32 grid with 2, 16 and 256 goals.
+// --------------------------------------------------------------------
+void BenchGoals()
 {
-    RollingAverage *r = new RollingAverage();
-    assert(0    == r->get_count());
-    assert(ROLLING_AVERAGE_SIZE  == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0.0  == r->get_average());
-    delete r;
+    const int counts[] = {2, 16, 256, 0};
+    const int n = 32;
+    const int lookups = 20000000;
+    const int moves = 5000000;
+    char line[100];
+    
+    cout << "  Goals" << endl;
+    cout << "      goals   index/sec    scan/sec   moves/sec" << endl;
+    for (const int *k = counts; *k; ++k)
+    {
+        // 1. Spread the goals over the grid
+        Goal **goals = (Goal **)calloc(*k + 1, sizeof(Goal *));
+        for (int i = 0; i < *k; ++i) {
+            int at = (i * 397) % (n*n);
+            goals[i] = new Goal(i%2 ? 10 : -10, at/n, at%n, LOC_RAN, LOC_RAN);
+        }
+        Grid *g = new Grid(n, goals);
+        Walker *w = new Walker(g);
+        g->set_seed(1);
+        w->set_seed(2);
+        
+        // 2. Time the lookups both ways
+        int found = 0;
+        double start = bench_seconds();
+        for (int i = 0; i < lookups; ++i) 
+            found += (NULL != g->goal_at((i*7)%n, (i*13)%n));
+        double index = bench_seconds() - start;
+        start = bench_seconds();
+        for (int i = 0; i < lookups/10; ++i) 
+            found += (NULL != g->goal_scan((i*7)%n, (i*13)%n));
+        double scan = (bench_seconds() - start) * 10;
+        
+        // 3. Time a walker moving at random
+        Random *r = w->get_random();
+        start = bench_seconds();
+        for (int i = 0; i < moves; ++i) 
+            found += (NULL != w->move(r->below(DIR_NUM)));
+        double move = bench_seconds() - start;
+        
+        // 4. Report
+        sprintf(line, "       %4d  %10.0f  %10.0f  %10.0f", 
+                *k, lookups/index, lookups/scan, moves/move);
+        cout << line << endl;
+        bench_sink = found;
+        delete w;
+        delete g;
+        for (int i = 0; i < *k; ++i) delete goals[i];
+        free(goals);
+    }
 }
 
-void TestRollingAverage_testConstructor()
+// --------------------------------------------------------------------
+//                                                          BenchEngine
+// Experiment steps per second through the virtual experiment() and
+// through the engine compiled for the walker and the grid size.
+// --------------------------------------------------------------------
+void BenchEngine()
 {
-    RollingAverage *r = new RollingAverage(10);
-    assert(0    == r->get_count());
-    assert(10   == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0.0  == r->get_average());
-    delete r;
+    const int kinds[] = {WALK_WALKER, WALK_QLEARNER, WALK_SIMPLE, WALK_NONE};
+    const int sizes[] = {ENGINE_N, 16, 0};
+    const int steps = 2000000;
+    char line[100];
+    
+    cout << "  Engine" << endl;
+    cout << "    walker          n   virtual/sec  compiled/sec" << endl;
+    for (const int *k = kinds; *k != WALK_NONE; ++k)
+    {
+        for (const int *n = sizes; *n; ++n)
+        {
+            double rate[2] = {0.0, 0.0};
+            for (int run = 0; run < 6; ++run)
+            {
+                int compiled = run % 2;
+                
+                // 1. A fresh walker and grid with the same seeds
+                Grid *g = new ChippyClassic(*n);
+                Walker *w = walker_factory(*k);
+                w->set_grid(g);
+                w->set_seed(1, 0);
+                g->set_seed(1, 1);
+                
+                // 2. Time the whole experiment
+                double start = bench_seconds();
+                Rewards *r = compiled ? 
+                    dispatch_experiment(*k, steps, steps/2, 0, w) :
+                    experiment(steps, steps/2, 0, w);
+                double r_sec = steps / (bench_seconds() - start);
+                
+                // 3. Keep the best of three runs each
+                if (r_sec > rate[compiled]) rate[compiled] = r_sec;
+                bench_sink = r->get_total();
+                delete r;
+                delete w;
+                delete g;
+            }
+            
+            // 4. Report
+            Walker *w = walker_factory(*k);
+            sprintf(line, "    %-12s %4d  %12.0f  %12.0f", 
+                    w->name(), *n, rate[0], rate[1]);
+            cout << line << endl;
+            delete w;
+        }
+    }
 }
 
-void TestRollingAverage_testAverages()
+// --------------------------------------------------------------------
+//                                                         BenchResults
+// Seconds to write the results of the full experiment set as text and
+// as binary, and to read the binary results back.
+// --------------------------------------------------------------------
+void BenchResults()
 {
-    RollingAverage *r = new RollingAverage(10);
-    assert(0    == r->get_count());
-    assert(10   == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0.0  == r->get_average());
-    r->add(1);
-    r->add(2);
-    r->add(0);
-    r->add(3);
-    r->add(4);
-    assert(5    == r->get_count());
-    assert(10   == r->get_n());
-    assert(10.0 == r->get_total());
-    assert(2.0  == r->get_average());
-    r->add(2);
-    r->add(2);
-    r->add(2);
-    r->add(2);
-    r->add(2);
-    assert(10   == r->get_count());
-    assert(10   == r->get_n());
-    assert(20.0 == r->get_total());
-    assert(2.0  == r->get_average());
-    r->add(3);
-    assert(10   == r->get_count());
-    assert(10   == r->get_n());
-    assert(22.0 == r->get_total());
-    assert(fabs(2.2-r->get_average())<0.1);
-    r->add(3);
-    r->add(4);
-    r->add(4);
-    r->add(5);
-    assert(10   == r->get_count());
-    assert(10   == r->get_n());
-    assert(29.0 == r->get_total());
-    assert(fabs(2.9-r->get_average())<0.1);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    r->add(0);
-    assert(10   == r->get_count());
-    assert(10   == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0.0  == r->get_average());
-    delete r;
+    const int kntw = 6;
+    const int kntg = 4;
+    const int steps = EXP_STEPS;
+    char line[100];
+    
+    // 1. Make up results the size of a full run
+    Rewards *rwds[kntw*kntg + 1];
+    Random r(7);
+    for (int c = 0; c < kntw*kntg; ++c) {
+        rwds[c] = new Rewards(steps + 1);
+        for (int s = 0; s <= steps; ++s) rwds[c]->append(r.randint(-10, 10));
+        rwds[c]->set_colname("Chippy");
+        rwds[c]->set_rowname("QLearner");
+        rwds[c]->set_initials("QL", "CH");
+    }
+    rwds[kntw*kntg] = NULL;
+    
+    // 2. Time writing them as text, as binary and reading them back
+    double start = bench_seconds();
+    write_lines("benchresults", kntw, kntg, rwds, steps, 1);
+    double text = bench_seconds() - start;
+    start = bench_seconds();
+    write_binary("benchresults", kntw, kntg, rwds, steps);
+    double binary = bench_seconds() - start;
+    start = bench_seconds();
+    ResultsFile file;
+    double sum = 0.0;
+    if (file.open("benchresultsb.bin"))
+        for (int c = 0; c < file.get_columns(); ++c)
+            for (int s = 0; s < file.get_rows(); ++s) 
+                sum += file.get_value(c, s);
+    double read = bench_seconds() - start;
+    file.close();
+    bench_sink = sum;
+    
+    // 3. Report
+    cout << "  Results" << endl;
+    cout << "      text write   bin write    bin read" << endl;
+    sprintf(line, "      %10.4f  %10.4f  %10.4f", text, binary, read);
+    cout << line << endl;
+    
+    // 4. Clean up
+    remove("benchresultsl.csv");
+    remove("benchresultsb.bin");
+    for (int c = 0; c < kntw*kntg; ++c) delete rwds[c];
 }
 
-void TestRewards()
-{
-    cout << "  Rewards ... ";
-    TestRewards_testEmptyConstructor();
-    TestRewards_testConstructor();
-    TestRewards_testAppend();
-    TestRewards_testAdd();
-    cout << "OK" << endl;
+// --------------------------------------------------------------------
+//                                                        MicroPipeline
+// Nanoseconds per step of the MCL walkers on ChippyClassic (perturbed
+// half way), and how many more than a QLearner alone that is
+// --------------------------------------------------------------------
+void MicroPipeline()
+{
+    const int kinds[] = {WALK_QLEARNER, WALK_SIMPLE, WALK_SENSITIVE,
+                         WALK_SOPHISTICATED, WALK_NONE};
+    const int steps = 500000;
+    double base = 0.0;
+    char name[48];
+    char line[100];
+    
+    micro_header("Pipeline");
+    for (const int *k = kinds; *k != WALK_NONE; ++k)
+    {
+        // 1. The whole experiment with a fresh walker and grid each time
+        Walker *named = walker_factory(*k);
+        sprintf(name, "%s (per step)", named->name());
+        delete named;
+        double ns = micro_run(name, steps, [&]() {
+            Grid *g = new ChippyClassic();
+            Walker *w = walker_factory(*k);
+            w->set_grid(g);
+            w->set_seed(1, 0);
+            g->set_seed(1, 1);
+            Rewards *r = experiment(steps, steps/2, 0, w);
+            bench_sink = r->get_total();
+            delete r;
+            delete w;
+            delete g;
+        });
+        
+        // 2. What the MCL adds to the QLearner
+        if (WALK_QLEARNER == *k) base = ns;
+        else {
+            sprintf(line, "    MCL ns/step %.2f", ns - base);
+            cout << line << endl;
+        }
+    }
 }
 
-void TestRewards_testEmptyConstructor()
+// --------------------------------------------------------------------
+//                                                            MicroFork
+// Perturbation studies done one experiment at a time and with the steps
+// before the first perturbation shared, per step of each variant
+// --------------------------------------------------------------------
+void MicroFork()
 {
-    Rewards *r = new Rewards();
-    assert(0    == r->get_count());
-    assert(0    == r->get_index());
-    assert(1024 == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0 == strcmp("????", r->get_initials()));
-    assert(0 == strcmp("????", r->get_initials()));
-    assert(0 == strcmp("????", r->get_initials()));
-    delete r;
+    const int kinds[] = {WALK_QLEARNER, WALK_SOPHISTICATED, WALK_NONE};
+    const int repeats = 5;
+    char name[48];
+    
+    micro_header("Fork");
+    for (const int *k = kinds; *k != WALK_NONE; ++k)
+    {
+        // 1. Perturbation at the usual step and at three later ones
+        Grid *proto = grid_factory(GRID_CLASSIC);
+        Grid *rotate = grid_factory(GRID_ROTATE);
+        ExperimentFork forks[] = {{NULL, EXP_PERTURB, 0}, 
+                                  {NULL, EXP_PERTURB + 2000, 0},
+                                  {NULL, EXP_PERTURB/2, 1},
+                                  {rotate, EXP_PERTURB, 0}};
+        const int nforks = sizeof(forks) / sizeof(forks[0]);
+        Rewards *rwds[nforks] = {NULL};
+        double totals[nforks];
+        int differ = 0;
+        Walker *named = walker_factory(*k);
+        
+        // 2. Time them one at a time
+        sprintf(name, "%s separate (per step)", named->name());
+        micro_run(name, repeats * nforks * EXP_STEPS, [&]() {
+            for (int n = 0; n < repeats; ++n)
+            for (int f = 0; f < nforks; ++f) {
+                Grid *g = (forks[f].grid ? forks[f].grid : proto)->clone();
+                Walker *w = walker_factory(*k);
+                g->set_seed(1);
+                w->set_seed(2);
+                w->set_grid(g);
+                Rewards *r = experiment(EXP_STEPS, forks[f].pstep, 
+                                        forks[f].mult, w);
+                totals[f] = r->get_total();
+                delete r;
+                delete w;
+                delete g;
+            }
+        });
+        
+        // 3. And sharing the first steps
+        sprintf(name, "%s forked (per step)", named->name());
+        micro_run(name, repeats * nforks * EXP_STEPS, [&]() {
+            for (int n = 0; n < repeats; ++n) {
+                Grid *g = proto->clone();
+                Walker *w = walker_factory(*k);
+                g->set_seed(1);
+                w->set_seed(2);
+                w->set_grid(g);
+                fork_experiment(*k, EXP_STEPS, w, nforks, forks, rwds);
+                delete w;
+                delete g;
+            }
+        });
+        
+        // 4. The results should be the same
+        for (int f = 0; f < nforks; ++f) {
+            differ += (totals[f] != rwds[f]->get_total());
+            delete rwds[f];
+        }
+        if (differ) cout << "    (" << differ << " variants differ)" << endl;
+        delete named;
+        delete rotate;
+        delete proto;
+    }
 }
 
-void TestRewards_testConstructor()
-{
-    Rewards *r = new Rewards(10);
-    assert(0    == r->get_count());
-    assert(0    == r->get_index());
-    assert(10   == r->get_n());
-    assert(0.0  == r->get_total());
-    assert(0 == strcmp("????", r->get_initials()));
-    assert(0 == strcmp("????", r->get_initials()));
-    assert(0 == strcmp("????", r->get_initials()));
-    delete r;
+// --------------------------------------------------------------------
+//                                                        MicroQuantize
+// Rewards of the standard experiments with the Q values in doubles, in
+// floats and in int16 fixed point (the same walks until the Q values
+// differ), then the memory and speed of a large grid of each kind.
+// --------------------------------------------------------------------
+void MicroQuantize()
+{
+    const int igrids[] = {GRID_CHIPPY, GRID_CLASSIC, GRID_CORNER, 
+                          GRID_ROTATE, GRID_NONE};
+    const int stores[] = {STORE_CONTIGUOUS, STORE_FLOAT, STORE_INT16};
+    const char *store_names[] = {"double", "float", "int16"};
+    const int repeats = 5;
+    char name[48];
+    char line[120];
+    
+    cout << "  Quantize" << endl;
+    cout << "      grid    store      total reward   mean |diff|    max |diff|"
+         << endl;
+    for (const int *ig = igrids; *ig != GRID_NONE; ++ig)
+    {
+        // 1. The experiments in double precision
+        Grid *proto = grid_factory(*ig);
+        Rewards *base[repeats];
+        for (int s = 0; s < 3; ++s)
+        {
+            // 2. Repeat the experiments with the same seeds in each store
+            double total = 0.0, mean_diff = 0.0, max_diff = 0.0;
+            Chippy *c = (Chippy *)proto;
+            for (int r = 0; r < repeats; ++r) {
+                Grid *g = (STORE_CONTIGUOUS == stores[s]) ? proto->clone() :
+                    (GRID_CLASSIC == *ig) ? 
+                        new ChippyClassic(8, c->get_r1(), c->get_r2(), stores[s]) :
+                    (GRID_CORNER == *ig) ? 
+                        new ChippyCorner(8, c->get_r1(), c->get_r2(), stores[s]) :
+                    (GRID_ROTATE == *ig) ? 
+                        new ChippyRotate(8, c->get_r1(), c->get_r2(), stores[s]) :
+                        new Chippy(8, c->get_r1(), c->get_r2(), stores[s]);
+                Walker *w = walker_factory(WALK_QLEARNER);
+                g->set_seed(1, r);
+                w->set_seed(2, r);
+                w->set_grid(g);
+                Rewards *rw = experiment(EXP_STEPS, EXP_PERTURB, 0, w);
+                total += rw->get_total();
+                
+                // 3. Compare the average reward at each step
+                if (0 == s) base[r] = rw;
+                else {
+                    for (int i = 0; i < rw->get_index(); ++i) {
+                        double d = fabs(rw->get_reward(i) - 
+                                        base[r]->get_reward(i));
+                        mean_diff += d / rw->get_index();
+                        if (d > max_diff) max_diff = d;
+                    }
+                    delete rw;
+                }
+                delete w;
+                delete g;
+            }
+            
+            // 4. Report
+            sprintf(line, "      %-6s  %-6s  %14.2f  %12.5f  %12.5f", 
+                    proto->initials(), store_names[s], total/repeats, 
+                    mean_diff/repeats, max_diff);
+            cout << line << endl;
+        }
+        for (int r = 0; r < repeats; ++r) delete base[r];
+        delete proto;
+    }
+    
+    // 5. A large grid of each kind: its bytes per square and speed
+    const int n = 2048;
+    const int steps = 500000;
+    micro_header("Quantize large grid");
+    for (int s = 0; s < 3; ++s)
+    {
+        Grid *g = new Chippy(n, 10, -10, stores[s]);
+        Walker *w = walker_factory(WALK_QLEARNER);
+        g->set_seed(1);
+        w->set_seed(2);
+        w->set_grid(g);
+        w->start_at();
+        sprintf(name, "n=%d %s move", n, store_names[s]);
+        micro_run(name, steps, [&]() {
+            int found = 0;
+            for (int i = 0; i < steps; ++i) found += (NULL != w->move());
+            bench_sink = found;
+        });
+        
+        // 6. Q values plus goal slots (plus picture values for doubles)
+        double bytes = double(n)*n*(DIR_NUM*((0 == s) ? sizeof(double) :
+                                     (1 == s) ? sizeof(float) : 
+                                                sizeof(int16_t)) + sizeof(int));
+        if (0 == s) bytes += double(n)*n*(sizeof(char) + sizeof(double) + 
+                                          sizeof(int) + sizeof(bool) + 
+                                          sizeof(double) + sizeof(Square *));
+        sprintf(line, "    %.0f MB, %.1f bytes/square", bytes/1e6, 
+                bytes/(double(n)*n));
+        cout << line << endl;
+        delete w;
+        delete g;
+    }
 }
 
-void TestRewards_testAppend()
+// --------------------------------------------------------------------
+//                                                          MicroRecord
+// The compiled QLearner experiment without and with the trajectory
+// recorder, per step, and converting the trajectory, per row.  The
+// walker thread cases count only the CPU time of the stepping thread.
+// That leaves out the writer, but not what filling the rows costs the
+// stepping thread's caches and memory bandwidth.  The overall cases
+// include the writer, and waiting for it when it falls behind.
+// --------------------------------------------------------------------
+void MicroRecord()
 {
-    Rewards *r = new Rewards(10);
-    assert(0    == r->get_count());
-    assert(0    == r->get_index());
-    assert(10   == r->get_n());
-    assert(0.0  == r->get_total());
-    r->append(1);
-    assert(1    == r->get_count());
-    assert(1    == r->get_index());
-    assert(10   == r->get_n());
-    assert(1.0  == r->get_total());
-    assert(1.0  == r->get_reward(0));
-    assert(1.0  == r->get_average(0));
-    r->append(2);
-    assert(1    == r->get_count());
-    assert(2    == r->get_index());
-    assert(10   == r->get_n());
-    assert(3.0  == r->get_total());
-    assert(2.0  == r->get_reward(1));
-    assert(2.0  == r->get_average(1));
-    r->append(3);
-    assert(1    == r->get_count());
-    assert(3    == r->get_index());
-    assert(10   == r->get_n());
-    assert(6.0  == r->get_total());
-    r->append(4);
-    r->append(5);
-    r->append(6);
-    assert(1    == r->get_count());
-    assert(6    == r->get_index());
-    assert(10   == r->get_n());
-    assert(21.0  == r->get_total());
-    r->append(3);
-    r->append(2);
-    r->append(1);
-    assert(1    == r->get_count());
-    assert(9    == r->get_index());
-    assert(10   == r->get_n());
-    assert(27.0  == r->get_total());
-    r->append(4);
-    r->append(3);
-    r->append(1.7);
-    assert(1    == r->get_count());
-    assert(12    == r->get_index());
-    assert(20   == r->get_n());
-    assert(35.7  == r->get_total());
-    assert(1.0  == r->get_reward(0));
-    assert(2.0  == r->get_reward(1));
-    assert(3.0  == r->get_reward(2));
-    assert(4.0  == r->get_reward(3));
-    assert(5.0  == r->get_reward(4));
-    assert(6.0  == r->get_reward(5));
-    assert(3.0  == r->get_reward(6));
-    assert(2.0  == r->get_reward(7));
-    assert(1.0  == r->get_reward(8));
-    assert(4.0  == r->get_reward(9));
-    assert(3.0  == r->get_reward(10));
-    assert(1.7  == r->get_reward(11));
-    assert(1.7  == r->get_average(11));
-    delete r;
+    const int steps = 1000000;
+    double ns[2][2];
+    long rows = 0;
+    char name[48];
+    char line[100];
+    
+    micro_header("Record");
+    for (int own = 0; own < 2; ++own)
+    for (int recording = 0; recording < 2; ++recording)
+    {
+        // 1. A fresh walker and grid with the same seeds for each run
+        sprintf(name, "QLearner%s%s (per step)", 
+                recording ? " recording" : "", own ? " walker" : "");
+        ns[own][recording] = micro_run(name, steps, [&]() {
+            TrajectoryRecorder recorder;
+            Grid *g = new ChippyClassic(ENGINE_N);
+            Walker *w = walker_factory(WALK_QLEARNER);
+            w->set_grid(g);
+            w->set_seed(1, 0);
+            g->set_seed(1, 1);
+            if (recording) {
+                recorder.open("benchrecord.traj");
+                recorder.set_run(WALK_QLEARNER, 0, 0);
+                w->set_recorder(&recorder);
+            }
+            
+            // 2. The experiment (and writing the rest of the rows)
+            Rewards *r = dispatch_experiment(WALK_QLEARNER, steps, steps/2, 
+                                             0, w);
+            if (recording) rows = recorder.close();
+            bench_sink = r->get_total();
+            delete r;
+            delete w;
+            delete g;
+        }, own ? bench_thread_seconds : bench_seconds);
+    }
+    
+    // 3. Convert the last trajectory
+    long converted = 0;
+    micro_run("convert_trajectory (per row)", rows, [&]() {
+        converted = convert_trajectory("benchrecord.traj", "benchrecord.csv");
+    });
+    remove("benchrecord.traj");
+    remove("benchrecord.csv");
+    
+    // 4. Report
+    sprintf(line, "    overhead %.1f%% overall, %.1f%% on the walker thread",
+            100.0 * (ns[0][1] - ns[0][0]) / ns[0][0],
+            100.0 * (ns[1][1] - ns[1][0]) / ns[1][0]);
+    cout << line << endl;
+    sprintf(line, "    %ld rows (%ld converted)", rows, converted);
+    cout << line << endl;
 }
 
-void TestRewards_testAdd()
+// --------------------------------------------------------------------
+//                                                     MicroObservables
+// Monitor calls for an agent with the observables of QLMCLBayes1,
+// setting the values by name (as the walkers used to) and by handle
+// with MCLObservables.
+// --------------------------------------------------------------------
+void MicroObservables()
+{
+#ifndef USEMCL2
+    cout << "  Observables" << endl;
+    cout << "    needs USEMCL2" << endl;
+#else
+    const int monitors = 500000;
+    const char *names[6] = {"step", "reward", 
+                            "expect1", "expect2", "expect3", "expect4"};
+    double ns[2];
+    char line[100];
+    
+    // 1. An agent like the one of QLMCLBayes1 with two expectations
+    string key = "BenchObservables";
+    MCLObservables obs;
+    int handles[6];
+    mclMA::initializeMCL(key, 0);
+    obs.set_key(key);
+    for (int i = 0; i < 6; ++i) 
+        handles[i] = obs.declare(names[i], DT_INTEGER, SC_REWARD);
+    mclMA::declareExpectationGroup(key, EGK);
+    mclMA::declareExpectation(key, EGK, names[2], EC_MAINTAINVALUE, 10.0f);
+    mclMA::declareExpectation(key, EGK, names[3], EC_MAINTAINVALUE, -10.0f);
+    
+    // 2. Time the monitor calls with values that meet expectations
+    micro_header("Observables");
+    for (int by_handle = 0; by_handle < 2; ++by_handle)
+    {
+        ns[by_handle] = micro_run(by_handle ? "Bayes1 monitor by handle" :
+                                              "Bayes1 monitor by name", 
+                                  monitors, [&]() {
+            mclMA::observables::update u;
+            long responses = 0;
+            for (int m = 0; m < monitors; ++m) {
+                float values[6] = {(float) m, 0.0f, 10.0f, -10.0f, 
+                                   0.0f, 0.0f};
+                if (by_handle) {
+                    for (int i = 0; i < 6; ++i) obs.set(handles[i], values[i]);
+                    responses += obs.monitor().size();
+                } else {
+                    for (int i = 0; i < 6; ++i) 
+                        u.set_update(names[i], values[i]);
+                    responses += mclMA::monitor(key, u).size();
+                }
+            }
+            bench_sink = responses;
+        });
+    }
+    mclMA::releaseMCL(key);
+    
+    // 3. Report
+    sprintf(line, "    by handle %.2fx", ns[0] / ns[1]);
+    cout << line << endl;
+#endif
+}
+
+// --------------------------------------------------------------------
+//                                                         MicroCadence
+// Steps of the Bayes walkers monitoring every step, every 4 and 16
+// steps and on events, and what that does to their rewards and
+// corrections: the mean total reward, the mean corrections before the
+// perturbation, the runs corrected after it and the mean steps from the
+// perturbation to the first correction of those runs.
+// --------------------------------------------------------------------
+#ifdef USEMCL2
+static int bench_corrections(int kind, Walker *w)
 {
-    Rewards *r1 = new Rewards(10);
-    Rewards *r2 = new Rewards(10);
-    Rewards *r3 = new Rewards(10);
-    r2->append(1);
-    r2->append(2);
-    r2->append(3);
-    r2->append(4);
-    r2->append(3);
-    r2->append(2);
-    r2->append(1);
-    assert(7    == r2->get_index());
-    assert(1.0  == r2->get_reward(0));
-    assert(2.0  == r2->get_reward(1));
-    assert(3.0  == r2->get_reward(2));
-    assert(4.0  == r2->get_reward(3));
-    assert(3.0  == r2->get_reward(4));
-    assert(2.0  == r2->get_reward(5));
-    assert(1.0  == r2->get_reward(6));
-    assert(1.0  == r2->get_average(6));
-    r3->append(1);
-    r3->append(2);
-    r3->append(1);
-    r3->append(2);
-    r3->append(1);
-    r3->append(2);
-    assert(6    == r3->get_index());
-    assert(1.0  == r3->get_reward(0));
-    assert(2.0  == r3->get_reward(1));
-    assert(1.0  == r3->get_reward(2));
-    assert(2.0  == r3->get_reward(3));
-    assert(1.0  == r3->get_reward(4));
-    assert(2.0  == r3->get_reward(5));
-    assert(2.0  == r3->get_average(5));
-    assert(0    == r1->get_count());
-    assert(1    == r2->get_count());
-    assert(1    == r3->get_count());
-    assert(0    == r1->get_total());
-    assert(16   == r2->get_total());
-    assert(9    == r3->get_total());
-    r1->add(r2);
-    //cout << "after r1->add(r2) r1->get_index() = " << r1->get_index() << endl;
-    assert(7    == r1->get_index());
-    assert(1.0  == r1->get_reward(0));
-    assert(2.0  == r1->get_reward(1));
-    assert(3.0  == r1->get_reward(2));
-    assert(4.0  == r1->get_reward(3));
-    assert(3.0  == r1->get_reward(4));
-    assert(2.0  == r1->get_reward(5));
-    assert(2.0  == r1->get_average(5));
-    assert(1.0  == r1->get_reward(6));
-    assert(1.0  == r1->get_average(6));
-    r1->add(r3);
-    assert(2    == r1->get_count());
-    assert(25   == r1->get_total());
-    assert(1.0  == r1->get_average(0));
-    assert(2.0  == r1->get_average(2));
-    assert(2.0  == r1->get_reward(0));  // 1 + 1
-    assert(4.0  == r1->get_reward(1));  // 2 + 2 
-    assert(4.0  == r1->get_reward(2));  // 3 + 1
-    assert(6.0  == r1->get_reward(3));  // 4 + 2
-    assert(4.0  == r1->get_reward(4));  // 3 + 1
-    assert(4.0  == r1->get_reward(5));  // 2 + 2
-    assert(1.0  == r1->get_reward(6));  // 1 + 0
-    assert(2.0  == r1->get_average(5));
-    assert(7    == r1->get_index());
-    //cout << "after r1->add(r3) r1->get_reward(5) = " << r1->get_reward(5) << endl;
-    //cout << "after r1->add(r3) r1->get_average(5) = " << r1->get_average(5) << endl;
-    assert(2.0  == r1->get_average(5));
-    assert(0.5  == r1->get_average(6));
-    delete r1;
-    delete r2;
-    delete r3;
-}    
+    if (WALK_BAYES1 == kind) return ((QLMCLBayes1 *)w)->get_corrections();
+    return ((QLMCLBayes2 *)w)->get_corrections();
+}
+#endif
+
+void MicroCadence()
+{
+#ifndef USEMCL2
+    cout << "  Cadence" << endl;
+    cout << "    needs USEMCL2" << endl;
+#else
+    const int kinds[] = {WALK_BAYES1, WALK_BAYES2, WALK_NONE};
+    const int cadences[] = {MONITOR_EVERY, 4, 16, MONITOR_EVENTS};
+    const char *cadence_names[] = {"every", "4", "16", "events"};
+    const int ncadences = sizeof(cadences) / sizeof(cadences[0]);
+    const int repeats = 10;
+    char name[48];
+    char line[120];
+    
+    micro_header("Cadence");
+    for (const int *k = kinds; *k != WALK_NONE; ++k)
+    {
+        double base = 0.0;
+        for (int c = 0; c < ncadences; ++c)
+        {
+            double reward = 0.0;
+            double early = 0.0;
+            double latency = 0.0;
+            int found = 0;
+            
+            Walker *named = walker_factory(*k);
+            sprintf(name, "%s cadence %s (per step)", named->name(), 
+                    cadence_names[c]);
+            delete named;
+            double ns = micro_run(name, repeats * (EXP_STEPS + 1), [&]() {
+                reward = early = latency = 0.0;
+                found = 0;
+                for (int n = 0; n < repeats; ++n) {
+                    // 1. The same walks for each cadence
+                    Grid *g = grid_factory(GRID_CLASSIC);
+                    Walker *w = walker_factory(*k);
+                    g->set_seed(1, n);
+                    w->set_seed(2, n);
+                    w->set_grid(g);
+                    w->set_cadence(cadences[c]);
+                    w->start_at();
+                    
+                    // 2. Walk, noting the first correction after the
+                    //    perturbation
+                    int before = 0;
+                    int first = -1;
+                    for (int step = 0; step <= EXP_STEPS; ++step) {
+                        Goal *goal = w->move();
+                        if (NULL != goal) reward += goal->get_reward();
+                        if (EXP_PERTURB == step) {
+                            g->perturb();
+                            before = bench_corrections(*k, w);
+                        } else if ((step > EXP_PERTURB) && (first < 0) &&
+                                   (bench_corrections(*k, w) > before)) {
+                            first = step - EXP_PERTURB;
+                        }
+                    }
+                    
+                    // 3. Add up the corrections
+                    early += before;
+                    if (first >= 0) {
+                        ++found;
+                        latency += first;
+                    }
+                    delete w;
+                    delete g;
+                }
+                bench_sink = reward;
+            });
+            
+            // 4. Report
+            if (0 == c) base = ns;
+            sprintf(line, "    %.2fx  reward %.1f  early %.1f  found %d/%d",
+                    base / ns, reward / repeats, early / repeats, found, 
+                    repeats);
+            cout << line;
+            if (found > 0) {
+                sprintf(line, "  latency %.1f", latency / found);
+                cout << line;
+            }
+            cout << endl;
+        }
+    }
+#endif
+}
+
 // --------------------------------------------------------------------
-//                                                       do_experiments
+//                                                         micro_suites
+// The benchmarks made of microbenchmark cases.  BenchMicro runs them
+// all after its own cases, and -b runs one by name.
 // --------------------------------------------------------------------
-void do_experiments(const char *basename, int repeats=EXP_REPEAT,
-                    int n = 8, int r1=10, int r2=-10)
+struct micro_suite {
+    const char *name;
+    void (*run)(void);
+};
+
+micro_suite micro_suites[] = {
+    {"Pipeline", MicroPipeline},
+    {"Fork", MicroFork},
+    {"Quantize", MicroQuantize},
+    {"Record", MicroRecord},
+    {"Observables", MicroObservables},
+    {"Cadence", MicroCadence},
+    {NULL, NULL}
+};
+
+// The suite -b asked for (NULL for all of them)
+static const char *micro_only = NULL;
+
+// --------------------------------------------------------------------
+//                                                     write_micro_json
+// --------------------------------------------------------------------
+int write_micro_json(const char *filename)
 {
-    Grid* grids[] = {
-        new Chippy(n, r1, r2), 
-	    new ChippyClassic(n, r1, r2), 
-        new ChippyCorner(n, r1, r2), 
-	    new ChippyRotate(n, r1, r2),
-	    NULL
-    };
-    Grid **g;
-    int kntg = 0;
+    FILE *out = fopen(filename, "w");
+    if (NULL == out) return 0;
     
-    int walkers[] = {
-        WALK_QLEARNER, 
-	    WALK_SIMPLE,
-        WALK_SENSITIVE,
-        WALK_SOPHISTICATED,
-        WALK_BAYES1,
-        WALK_BAYES2,
-        WALK_NONE
-    };
+    fprintf(out, "{\n");
+    fprintf(out, "  \"program\": \"chippy 2009.7\",\n");
+    fprintf(out, "  \"time\": %lld,\n", (long long)time(0));
+    fprintf(out, "  \"warmup_seconds\": %g,\n", MICRO_WARMUP);
+    fprintf(out, "  \"repeats\": %d,\n", MICRO_REPEATS);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < micro_count; ++i) {
+        MicroResult *m = &micro_results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"ops\": %ld, "
+                "\"mean_ns\": %.3f, \"stddev_ns\": %.3f, "
+                "\"min_ns\": %.3f, \"per_sec\": %.1f}%s\n",
+                m->name, m->ops, m->mean_ns, m->stddev_ns, m->min_ns, 
+                1e9 / m->mean_ns, (i + 1 < micro_count) ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
     
-    int *w;
-    int kntw= 0;
+    int ok = (0 == ferror(out));
+    fclose(out);
+    return ok;
+}
+
+// --------------------------------------------------------------------
+//                                                           BenchMicro
+// The simulator's hot operations one at a time, then whole experiments
+// --------------------------------------------------------------------
+void BenchMicro(const char *filename)
+{
+    const int table = 1024;
+    const long calls = 1000000;
+    const int igrids[] = {GRID_CHIPPY, GRID_CLASSIC, GRID_CORNER, 
+                          GRID_ROTATE, GRID_NONE};
+    const int iwalks[] = {WALK_QLEARNER, WALK_SIMPLE, WALK_SENSITIVE, 
+                          WALK_SOPHISTICATED, WALK_BAYES1, WALK_BAYES2, 
+                          WALK_NONE};
+    char name[48];
+    Random r(1);
     
-    // 1. Count the walkers and 
-    for (w = walkers; *w != WALK_NONE; ++w) ++kntw;
-    for (g = grids; *g != NULL; ++g) ++kntg;
-    //cout << "grids=" << kntg << ", walkers=" << kntw << endl;
+    micro_count = 0;
+    micro_header("Micro");
     
-    // 2. Execute the experiments
-    experiments(basename, 
-                repeats, EXP_STEPS, EXP_PERTURB, 0, 
-                walkers, grids);
+    // 1. Square::suggest and Square::max over squares of random values
+    Square *squares = new Square[table];
+    for (int s = 0; s < table; ++s)
+        for (int dir = 0; dir < DIR_NUM; ++dir)
+            squares[s].set_q(dir, r.randint(-10, 10));
+    micro_run("Square::suggest", calls, [&]() {
+        int total = 0;
+        for (long i = 0; i < calls; ++i) 
+            total += squares[i & (table-1)].suggest(&r);
+        bench_sink = total;
+    });
+    micro_run("Square::max", calls, [&]() {
+        double total = 0.0;
+        for (long i = 0; i < calls; ++i) 
+            total += squares[i & (table-1)].max();
+        bench_sink = total;
+    });
+    delete [] squares;
     
-    // 3. Delete allocated objects
-    for (g = grids; *g != NULL; ++g) delete *g;
+    // 2. Grid::move for each kind of grid from random places
+    for (const int *ig = igrids; *ig != GRID_NONE; ++ig) {
+        Grid *g = grid_factory(*ig);
+        int n = g->get_n();
+        int *xs = new int[table], *ys = new int[table], *ds = new int[table];
+        for (int i = 0; i < table; ++i) {
+            xs[i] = r.below(n);
+            ys[i] = r.below(n);
+            ds[i] = r.below(DIR_NUM);
+        }
+        sprintf(name, "Grid::move %s", g->name());
+        micro_run(name, calls, [&]() {
+            int nx, ny, found = 0;
+            for (long i = 0; i < calls; ++i) {
+                int t = i & (table-1);
+                found += (NULL != g->move(xs[t], ys[t], ds[t], &nx, &ny));
+            }
+            bench_sink = found;
+        });
+        delete [] xs;
+        delete [] ys;
+        delete [] ds;
+        delete g;
+    }
+    
+    // 3. Each learning walker's move on the Chippy grid
+    for (const int *iw = iwalks; *iw != WALK_NONE; ++iw) {
+        Grid *g = grid_factory(GRID_CHIPPY);
+        Walker *w = walker_factory(*iw);
+        g->set_seed(1);
+        w->set_seed(2);
+        w->set_grid(g);
+        w->start_at();
+        long moves = (WALK_QLEARNER == *iw) ? calls : calls / 10;
+        sprintf(name, "%s::move", w->name());
+        micro_run(name, moves, [&]() {
+            int found = 0;
+            for (long i = 0; i < moves; ++i) found += (NULL != w->move());
+            bench_sink = found;
+        });
+        delete w;
+        delete g;
+    }
+    
+    // 4. A whole QLearner experiment on a fresh grid, per step
+    {
+        const int steps = 20000;
+        Rewards *rwds = new Rewards(steps + ROLLING_AVERAGE_SIZE + 2);
+        micro_run("experiment 20k (per step)", 
+                  steps + ROLLING_AVERAGE_SIZE + 1, [&]() {
+            Grid *g = grid_factory(GRID_CHIPPY);
+            Walker *w = walker_factory(WALK_QLEARNER);
+            g->set_seed(1);
+            w->set_seed(2);
+            w->set_grid(g);
+            experiment(steps, steps/2, 0, w, NULL, false, rwds);
+            bench_sink = rwds->get_total();
+            delete w;
+            delete g;
+        });
+        
+        // 5. Adding an experiment's rewards into the totals, per step
+        Rewards *sum = new Rewards(steps + ROLLING_AVERAGE_SIZE + 2);
+        micro_run("Rewards::add (per step)", rwds->get_index(), [&]() {
+            sum->add(rwds);
+            bench_sink = sum->get_total();
+        });
+        delete sum;
+        delete rwds;
+    }
+    
+    // 6. The benchmarks registered as microbenchmark suites
+    for (micro_suite *m = micro_suites; NULL != m->name; ++m) m->run();
     
+    // 7. Write the results for comparing versions
+    if (NULL != filename) {
+        if (write_micro_json(filename)) 
+            cout << "  results written to " << filename << endl;
+        else
+            cerr << "Unable to write " << filename << endl;
+    }
 }
 
+// With -b and a suite's name, just that suite (and no json file)
+void BenchMicro() 
+{ 
+    if (NULL == micro_only) {
+        BenchMicro(MICRO_JSON);
+        return;
+    }
+    micro_count = 0;
+    for (micro_suite *m = micro_suites; NULL != m->name; ++m) 
+        if (0 == strcmp(micro_only, m->name)) m->run();
+}
+
+struct benchmark_reference {
+    char *name;
+    void (*bench)(void);
+};
+
+benchmark_reference benchmarks[] = {
+    {"UNKNOWN", NULL},
+    {"GridStore", BenchGridStore},
+    {"Argmax", BenchArgmax},
+    {"Batch", BenchBatch},
+    {"Goals", BenchGoals},
+    {"Engine", BenchEngine},
+    {"Results", BenchResults},
+    {"Micro", BenchMicro},
+    {"", NULL}
+};
+
 struct unittest_reference {
     char *name;
     void (*test)(void);
@@ -6426,6 +14158,7 @@ struct unittest_reference {
 
 unittest_reference unit_tests[] = {
     {"UNKNOWN", NULL},
+    {"Random", TestRandom},
     {"randint", Testrandint},
     {"orient_value", Testorient_value},
     {"Square", TestSquare},
@@ -6457,8 +14190,12 @@ unittest_reference unit_tests[] = {
     {"B2CO10k", TestQLMCLBayes2_testCO10k},
     {"B2CR10k", TestQLMCLBayes2_testCR10k},
     {"B2CL10p5", TestQLMCLBayes2_testCL10p5},
+    {"LocalMCL", TestLocalMCL},
     {"RollingAverage", TestRollingAverage},
+    {"DecimatedSeries", TestDecimatedSeries},
     {"Rewards", TestRewards},
+    {"ChippyBatch", TestChippyBatch},
+    {"ExperimentRunner", TestExperimentRunner},
     {"", NULL}
 };
 
@@ -6506,13 +14243,16 @@ void do_experiment(int grid_index,
                    int pstep=EXP_STEPS/2,
                    int mult=0,
                    int verbose=false, 
-                   int policy=false) {
+                   int policy=false,
+                   int cadence=MONITOR_EVERY) {
     char basename[20];
+    char tracename[32];
     
     // 1. Get the grid and walkers
     Grid *g = grid_factory(grid_index);
     Walker *w = walker_factory(walk_index);
     w->set_grid(g);
+    w->set_cadence(cadence);
     if (verbose) w->set_verbose(1);
     
     // 2. Set the base name for the output files
@@ -6521,31 +14261,202 @@ void do_experiment(int grid_index,
     strcat(basename, "_");
     strcat(basename, walker_initials[walk_index]);
     
-    // 3. Conduct the experiment
-    Rewards *rwds = experiment(steps, pstep, mult,
-                               w, basename, policy);
+    // 3. Conduct the experiment, tracing it if verbose
+    snprintf(tracename, sizeof(tracename), "%s.trace", basename);
+    if (verbose && !tracer().open(tracename, true)) {
+        cerr << "Unable to write trace file " << tracename << endl;
+    }
+    Rewards *rwds = dispatch_experiment(walk_index, steps, pstep, mult,
+                                        w, basename, policy);
+    if (verbose && (tracer().close() > 0)) trace_decode(tracename, cout);
     
     // 4. Output the rewards received
     write_line(basename, rwds, steps, 50); 
 }
     
+// --------------------------------------------------------------------
+//                                                              do_soak
+// --------------------------------------------------------------------
+void do_soak(int grid_index, 
+             int walk_index,
+             long long steps,
+             int pstep=EXP_PERTURB,
+             int stride=SOAK_STRIDE,
+             int cadence=MONITOR_EVERY) {
+    string basename("chippy2009_");
+    
+    // 1. Get the grid and walker
+    Grid *g = grid_factory(grid_index);
+    Walker *w = walker_factory(walk_index);
+    w->set_grid(g);
+    w->set_cadence(cadence);
+    
+    // 2. Record into <basename>k.csv, a bucket of stride steps at a time
+    basename += grid_initials[grid_index];
+    basename += "_";
+    basename += walker_initials[walk_index];
+    DecimatedSeries series(stride);
+    if (!series.open((basename + "k.csv").c_str())) {
+        cerr << "Unable to write " << basename << "k.csv" << endl;
+    }
+    
+    // 3. Soak the walker
+    std::chrono::steady_clock::time_point start = 
+        std::chrono::steady_clock::now();
+    long long perturbs = dispatch_soak(walk_index, steps, pstep, w, &series);
+    if (!series.close()) cerr << "Unable to write " << basename << "k.csv" << endl;
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%lld steps, %lld perturbations, %lld buckets of %d steps, "
+           "%.1f seconds\n", series.get_steps(), perturbs, 
+           series.get_buckets(), stride, seconds);
+    delete w;
+    delete g;
+}
+
 // --------------------------------------------------------------------
 //                                                 process_command_line
 // --------------------------------------------------------------------
 int process_command_line(int argc, char **argv, 
                          int *itest, int *igrid, int *iwalk,
-                         int *repeats, bool *verbose, bool *policy)
+                         int *repeats, bool *verbose, bool *policy,
+                         int *threads, unsigned long long *seed,
+                         int *ibench, int *lanes, int *format,
+                         int *cadence, SweepSpec *sweep, 
+                         StopRule *stop, int *stats, 
+                         int *shard, int *shards, 
+                         long long *soak, int *stride, int *period,
+                         char **filename, char ***files, int *nfiles)
 {
     int command = CMD_NONE;
     *itest = 0;
+    *ibench = 0;
+    *lanes = 0;
+    *format = FORMAT_BOTH;
+    *cadence = MONITOR_EVERY;
+    *sweep = SweepSpec();
+    *stop = StopRule();
+    *stats = STATS_NONE;
+    *shard = 0;
+    *shards = 1;
+    *files = NULL;
+    *nfiles = 0;
+    *soak = 0;
+    *stride = SOAK_STRIDE;
+    *period = EXP_PERTURB;
+    *filename = NULL;
     *igrid = 0;
     *iwalk = 0;
     *repeats = EXP_REPEAT;
     *verbose = false;
     *policy = false;
+    *threads = 1;
+    *seed = (unsigned long long)time(0);
     
     for (int i=1; i < argc; ++i) {
-        if ('-' == argv[i][0]) {
+        if (0 == strcmp(argv[i], "--seed")) {
+            ++i;
+            if (i < argc) {
+                *seed = strtoull(argv[i], NULL, 10);
+            }
+        } else if (0 == strcmp(argv[i], "--format")) {
+            ++i;
+            if (i < argc) {
+                int record = *format & FORMAT_TRAJECTORY;
+                if (0 == strcmp(argv[i], "text")) *format = FORMAT_TEXT;
+                else if (0 == strcmp(argv[i], "bin")) *format = FORMAT_BINARY;
+                else if (0 == strcmp(argv[i], "bin32")) 
+                    *format = FORMAT_BINARY | FORMAT_FLOAT32;
+                else if (0 == strcmp(argv[i], "both")) *format = FORMAT_BOTH;
+                else cout << "unknown format (" << argv[i] << ")" << endl;
+                *format |= record;
+            }
+        } else if (0 == strcmp(argv[i], "--record")) {
+            *format |= FORMAT_TRAJECTORY;
+        } else if (0 == strcmp(argv[i], "--monitor")) {
+            ++i;
+            if (i < argc) {
+                if (0 == strcmp(argv[i], "every")) *cadence = MONITOR_EVERY;
+                else if (0 == strcmp(argv[i], "events")) 
+                    *cadence = MONITOR_EVENTS;
+                else if (atoi(argv[i]) > 0) *cadence = atoi(argv[i]);
+                else cout << "unknown cadence (" << argv[i] << ")" << endl;
+            }
+        } else if ((0 == strcmp(argv[i], "--ci")) ||
+                   (0 == strcmp(argv[i], "--ci-after"))) {
+            stop->metric = (0 == strcmp(argv[i], "--ci")) ? STOP_TOTAL 
+                                                          : STOP_AFTER;
+            ++i;
+            if (i < argc) {
+                stop->width = atof(argv[i]);
+            }
+        } else if (0 == strcmp(argv[i], "--stats")) {
+            ++i;
+            if (i < argc) {
+                if (0 == strcmp(argv[i], "ci")) *stats = STATS_CI;
+                else if (0 == strcmp(argv[i], "quantiles")) 
+                    *stats = STATS_QUANTILES;
+                else if (0 == strcmp(argv[i], "all")) *stats = STATS_ALL;
+                else cout << "unknown stats (" << argv[i] << ")" << endl;
+            }
+        } else if (0 == strcmp(argv[i], "--shard")) {
+            ++i;
+            if (i < argc) {
+                int k, n;
+                if ((2 == sscanf(argv[i], "%d/%d", &k, &n)) && 
+                    (k >= 0) && (k < n)) {
+                    *shard = k;
+                    *shards = n;
+                }
+                else cout << "unknown shard (" << argv[i] << ")" << endl;
+            }
+        } else if (0 == strcmp(argv[i], "--soak")) {
+            ++i;
+            if (i < argc) {
+                *soak = strtoll(argv[i], NULL, 10);
+            }
+        } else if (0 == strcmp(argv[i], "--stride")) {
+            ++i;
+            if (i < argc) {
+                if (atoi(argv[i]) > 0) *stride = atoi(argv[i]);
+                else cout << "unknown stride (" << argv[i] << ")" << endl;
+            }
+        } else if (0 == strcmp(argv[i], "--perturb")) {
+            ++i;
+            if (i < argc) {
+                if (atoi(argv[i]) > 0) *period = atoi(argv[i]);
+                else cout << "unknown perturb (" << argv[i] << ")" << endl;
+            }
+        } else if (0 == strcmp(argv[i], "--min-repeats")) {
+            ++i;
+            if (i < argc) {
+                stop->min = atoi(argv[i]);
+            }
+        } else if (0 == strcmp(argv[i], "--sweep")) {
+            sweep->on = true;
+        } else if ((0 == strcmp(argv[i], "--alpha")) ||
+                   (0 == strcmp(argv[i], "--gamma")) ||
+                   (0 == strcmp(argv[i], "--epsilon")) ||
+                   (0 == strcmp(argv[i], "--threshold")) ||
+                   (0 == strcmp(argv[i], "--size"))) {
+            SweepAxis *axis = &sweep->size;
+            if ('a' == argv[i][2]) axis = &sweep->alpha;
+            if ('g' == argv[i][2]) axis = &sweep->gamma;
+            if ('e' == argv[i][2]) axis = &sweep->epsilon;
+            if ('t' == argv[i][2]) axis = &sweep->threshold;
+            bool whole = (axis == &sweep->size) || 
+                         (axis == &sweep->threshold);
+            int least = (axis == &sweep->size) ? SWEEP_MIN_SIZE : INT_MIN;
+            ++i;
+            if ((i < argc) && !axis->parse(argv[i], whole, least)) {
+                cout << "unknown values (" << argv[i] << ")" << endl;
+            }
+        } else if (0 == strcmp(argv[i], "--rewards")) {
+            ++i;
+            if ((i < argc) && !sweep->parse_rewards(argv[i])) {
+                cout << "unknown rewards (" << argv[i] << ")" << endl;
+            }
+        } else if ('-' == argv[i][0]) {
             switch (argv[i][1]) {
                 case 'h':
                     command = CMD_HELP;
@@ -6574,6 +14485,49 @@ int process_command_line(int argc, char **argv,
                         }
                     }    
                     break;
+                case 'b':
+                    command = CMD_BENCHMARKS;
+                    ++i;
+                    if (i < argc) {
+                        if (0 == strcmp(argv[i], "all")) *ibench = -1;
+                        for (int b = 1; benchmarks[b].bench != NULL; ++b) {
+                            if (0 == strcmp(argv[i], benchmarks[b].name)) {
+                                *ibench = b;
+                                break;
+                            }
+                            if (0 != strcmp("Micro", benchmarks[b].name)) continue;
+                            for (micro_suite *m = micro_suites; 
+                                 NULL != m->name; ++m) {
+                                if (0 == strcmp(argv[i], m->name)) {
+                                    micro_only = m->name;
+                                    *ibench = b;
+                                }
+                            }
+                        }
+                    }
+                    break;
+                case 'c':
+                    command = CMD_CONVERT;
+                    ++i;
+                    if (i < argc) {
+                        *filename = argv[i];
+                    }
+                    break;
+                case 'm':
+                    command = CMD_MERGE;
+                    *files = argv + i + 1;
+                    while ((i + 1 < argc) && ('-' != argv[i+1][0])) {
+                        ++*nfiles;
+                        ++i;
+                    }
+                    break;
+                case 'd':
+                    command = CMD_DECODE;
+                    ++i;
+                    if (i < argc) {
+                        *filename = argv[i];
+                    }
+                    break;
                 case 'g':
                     command = CMD_1_EXPERIMENT;
                     ++i;
@@ -6601,7 +14555,19 @@ int process_command_line(int argc, char **argv,
                 case 'r':        
                     ++i;
                     if (i < argc) {
-                        *repeats = int(argv[i]);
+                        *repeats = atoi(argv[i]);
+                    }
+                    break;
+                case 'j':        
+                    ++i;
+                    if (i < argc) {
+                        *threads = atoi(argv[i]);
+                    }
+                    break;
+                case 'k':        
+                    ++i;
+                    if (i < argc) {
+                        *lanes = atoi(argv[i]);
                     }
                     break;
                 default:
@@ -6610,6 +14576,14 @@ int process_command_line(int argc, char **argv,
             }
         }
     }
+    if (sweep->on && 
+        ((CMD_NONE == command) || (CMD_1_EXPERIMENT == command))) {
+        command = CMD_SWEEP;
+    }
+    if ((*soak > 0) && 
+        ((CMD_NONE == command) || (CMD_1_EXPERIMENT == command))) {
+        command = CMD_SOAK;
+    }
     return command;
 }
 
@@ -6626,7 +14600,31 @@ void display_help(void)
     cout << "              -t   Execute specified unittest" << endl;
     cout << "              -g   Execute experiment using specified grid" << endl; 
     cout << "              -w   Execute experiment using specified walker" << endl;
+    cout << "              -b   Execute specified benchmark (or all)" << endl;
+    cout << "              -c   Convert binary results or trajectory to text" << endl;
+    cout << "              -d   Print trace file as text" << endl;
+    cout << "              -m   Merge shard files (written by --shard)" << endl;
+    cout << "              --sweep  Sweep parameters for the -g grid and -w walker" << endl;
+    cout << "              --soak  Run the -g grid and -w walker for this many steps" << endl;
     cout << "  <options> = -r   Specify number of times experiment is repeated" << endl;
+    cout << "              -j   Number of threads for -e (0 = all cores)" << endl;
+    cout << "              -k   Lanes per QLearner batch for -e (0 = none)" << endl;
+    cout << "              --format  text, bin, bin32 or both (default)" << endl;
+    cout << "              --record  Write per-step trajectory files for -e" << endl;
+    cout << "              --monitor  MCL monitoring: every (default), K steps or events" << endl;
+    cout << "              --ci  Repeat -e (up to -r) until the 95% interval of" << endl;
+    cout << "                    the total reward is narrower than this times the mean" << endl;
+    cout << "              --ci-after  The same for the mean reward after perturbing" << endl;
+    cout << "              --min-repeats  Fewest repeats with --ci (default 5)" << endl;
+    cout << "              --stats  ci, quantiles or all: spread columns for -e" << endl;
+    cout << "              --shard  i/N: run only shard i (from 0) of N for -e" << endl;
+    cout << "              --stride  Steps per recorded bucket for --soak (1000)" << endl;
+    cout << "              --perturb  Steps between perturbations for --soak (10000)" << endl;
+    cout << "              --seed  Random number seed (default: the time)" << endl;
+    cout << "              --alpha, --gamma, --epsilon, --threshold, --size" << endl;
+    cout << "                   Values for --sweep: a,b,c or from:to:step" << endl;
+    cout << "                   (thresholds and sizes whole, sizes at least 3)" << endl;
+    cout << "              --rewards  Reward pairs for --sweep: r1/r2,..." << endl;
     cout << "              -v   Adds extra trace/debug information" << endl;
     cout << "              -p   Write policy file" << endl;
     cout << endl;
@@ -6635,12 +14633,30 @@ void display_help(void)
 // --------------------------------------------------------------------
 //                                                                 main
 // --------------------------------------------------------------------
+#ifndef CHIPPY_BENCH
 int main(int argc, char **argv)
 {
     int test_index = 0;
     int grid_index = 0;
     int walk_index = 0;
     int repeats = 0;
+    int threads = 1;
+    int bench_index = 0;
+    int lanes = 0;
+    int format = FORMAT_BOTH;
+    int cadence = MONITOR_EVERY;
+    SweepSpec sweep_spec;
+    StopRule stop;
+    int stats = STATS_NONE;
+    int shard = 0;
+    int shards = 1;
+    char *filename = NULL;
+    char **files = NULL;
+    int nfiles = 0;
+    long long soak = 0;
+    int stride = SOAK_STRIDE;
+    int period = EXP_PERTURB;
+    unsigned long long seed = 0;
     bool policy = false;
     bool verbose = false;
     //char *argv1t[] = {"chippyMA","-v","-t","B1CL10k",NULL}; // argc=4 
@@ -6650,15 +14666,21 @@ int main(int argc, char **argv)
     // 1. Announce ourselves
     cout << "chippy 2009.7 - MCL2 w/obserables" << endl;
     
-    // 2. Randomize the random number generator
-    srand(time(0)); 
-
-    // 3. Process command line
+    // 2. Process command line
     //argc = 2;
     //argv = argvu;
     int cmd_type = process_command_line(argc, argv,
                                         &test_index, &grid_index, &walk_index,
-                                        &repeats, &verbose, &policy);
+                                        &repeats, &verbose, &policy,
+                                        &threads, &seed, &bench_index,
+                                        &lanes, &format, &cadence, 
+                                        &sweep_spec, &stop, &stats, 
+                                        &shard, &shards,
+                                        &soak, &stride, &period,
+                                        &filename, &files, &nfiles);
+    
+    // 3. Seed the random number generator
+    default_random().set_seed(seed); 
     
     // 4. Execute command
     switch (cmd_type) {
@@ -6674,6 +14696,11 @@ int main(int argc, char **argv)
         case CMD_UNITTESTS:
             unittests();
             break;
+        case CMD_EXPERIMENTS:
+            do_experiments("chippy2009", repeats, 8, 10, -10, threads, seed,
+                           lanes, format, cadence, stop, stats, 
+                           shard, shards);
+            break;
         case CMD_1_UNITTEST:
             if (0 == test_index) {
                 cerr << "No unit test specified" << endl;
@@ -6691,6 +14718,8 @@ int main(int argc, char **argv)
             }
             break;
         case CMD_1_EXPERIMENT:
+        case CMD_SWEEP:
+        case CMD_SOAK:
             if (0 == grid_index) {
                 cerr << "No grid specified" << endl;
                 cerr << "Valid grid names are:" << endl;
@@ -6711,9 +14740,67 @@ int main(int argc, char **argv)
                     << " " << walkers[walk_index].name
                     << endl;
                 }    
-                do_experiment(grid_index, walk_index, 
-                              EXP_STEPS, EXP_STEPS/2, 0,
-                              verbose, policy);
+                if (CMD_SWEEP == cmd_type) {
+                    string basename("chippy2009_");
+                    basename += grid_initials[grid_index];
+                    basename += "_";
+                    basename += walker_initials[walk_index];
+                    sweep(basename.c_str(), walk_index, grid_index, 
+                          sweep_spec, repeats, threads, seed, lanes,
+                          EXP_STEPS, EXP_PERTURB, stop);
+                } else if (CMD_SOAK == cmd_type) {
+                    do_soak(grid_index, walk_index, soak, period, stride,
+                            cadence);
+                } else {
+                    do_experiment(grid_index, walk_index, 
+                                  EXP_STEPS, EXP_STEPS/2, 0,
+                                  verbose, policy, cadence);
+                }
+            }
+            break;
+        case CMD_BENCHMARKS:
+            if (0 == bench_index) {
+                cerr << "No benchmark specified" << endl;
+                cerr << "Valid benchmarks are (or all):" << endl;
+                for (int b=1; benchmarks[b].bench != NULL; ++b) {
+                    cerr << "  " << benchmarks[b].name << endl;
+                }
+                for (micro_suite *m = micro_suites; NULL != m->name; ++m) {
+                    cerr << "  " << m->name << endl;
+                }
+            } else {
+                for (int b=1; benchmarks[b].bench != NULL; ++b) {
+                    if ((-1 == bench_index) || (b == bench_index)) {
+                        benchmarks[b].bench();
+                    }
+                }
+            }
+            break;
+        case CMD_CONVERT:
+            if (NULL == filename) {
+                cerr << "No results file specified" << endl;
+            } else if (is_trajectory(filename)) {
+                string csvname(filename);
+                csvname = csvname.substr(0, csvname.rfind('.')) + ".csv";
+                if (convert_trajectory(filename, csvname.c_str()) < 0) {
+                    cerr << "Unable to write " << csvname << endl;
+                }
+            } else if (!convert_results(filename, "chippy2009")) {
+                cerr << "Unable to read results file " << filename << endl;
+            }
+            break;
+        case CMD_MERGE:
+            if (0 == nfiles) {
+                cerr << "No shard files specified" << endl;
+            } else if (0 == merge_shards(nfiles, files, format, stats)) {
+                cerr << "Unable to merge shard files" << endl;
+            }
+            break;
+        case CMD_DECODE:
+            if (NULL == filename) {
+                cerr << "No trace file specified" << endl;
+            } else if (trace_decode(filename, cout) < 0) {
+                cerr << "Unable to read trace file " << filename << endl;
             }
             break;
         default:
@@ -6723,6 +14810,20 @@ int main(int argc, char **argv)
     // 4. Return success
     return 0;
 }
+#else
+// chippy_bench [json file]: just the microbenchmarks
+int main(int argc, char **argv)
+{
+    // 1. Announce ourselves
+    cout << "chippy_bench 2009.7" << endl;
+    
+    // 2. Time everything and write the json file
+    BenchMicro((argc > 1) ? argv[1] : MICRO_JSON);
+    
+    // 3. Return success
+    return 0;
+}
+#endif
 
 // ====================================================================
 // end                 c h i p p y 2 0 0 8 . c p p                  end